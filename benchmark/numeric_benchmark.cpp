@@ -0,0 +1,231 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <message_serialization/numeric.h>
+#include <message_serialization/yaml_reader.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+namespace
+{
+/**
+ * @brief Creates a YAML flow sequence of random doubles written with the shortest round-trip representation
+ */
+std::string makeSequence(const std::size_t n)
+{
+  std::mt19937_64 gen(0);
+  std::uniform_real_distribution<double> dist(-10.0, 10.0);
+  char buffer[message_serialization::NUMBER_BUFFER_SIZE];
+
+  std::string yaml = "[";
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    // Mix full precision values with short ones, as typically found in hand-edited files
+    const double value = i % 2 ? dist(gen) : std::round(dist(gen) * 1000.0) / 1000.0;
+    message_serialization::formatNumber(buffer, value);
+    if (i > 0)
+      yaml += ", ";
+    yaml += buffer;
+  }
+  yaml += "]";
+  return yaml;
+}
+
+const std::string& sequence(const std::size_t n)
+{
+  static std::size_t size = 0;
+  static std::string yaml;
+  if (size != n)
+  {
+    yaml = makeSequence(n);
+    size = n;
+  }
+  return yaml;
+}
+
+std::vector<std::string> scalars(const std::size_t n)
+{
+  const YAML::Node node = YAML::Load(sequence(n));
+  std::vector<std::string> out;
+  for (YAML::const_iterator it = node.begin(); it != node.end(); ++it)
+    out.push_back(it->Scalar());
+  return out;
+}
+
+std::size_t totalSize(const std::vector<std::string>& text)
+{
+  std::size_t size = 0;
+  for (const std::string& s : text)
+    size += s.size();
+  return size;
+}
+
+}  // namespace
+
+/**
+ * @brief Random doubles of every magnitude
+ */
+static std::vector<double> randomDoubles(const std::size_t n)
+{
+  std::mt19937_64 gen(0);
+  std::vector<double> values;
+  while (values.size() < n)
+  {
+    const uint64_t bits = gen();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    if (std::isfinite(value))
+      values.push_back(value);
+  }
+  return values;
+}
+
+/**
+ * @brief Shortest round-trip formatting, as used by the YAML and JSON writers
+ */
+static void BM_FormatNumber(benchmark::State& state)
+{
+  const std::vector<double> values = randomDoubles(static_cast<std::size_t>(state.range(0)));
+  char buffer[message_serialization::NUMBER_BUFFER_SIZE];
+  for (auto _ : state)
+  {
+    std::size_t size = 0;
+    for (const double value : values)
+      size += message_serialization::formatNumber(buffer, value);
+    benchmark::DoNotOptimize(size);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * values.size()));
+}
+BENCHMARK(BM_FormatNumber)->Arg(1 << 16);
+
+/**
+ * @brief Formatting with 17 significant digits, which always round-trips but is rarely the shortest
+ */
+static void BM_FormatPrintf(benchmark::State& state)
+{
+  const std::vector<double> values = randomDoubles(static_cast<std::size_t>(state.range(0)));
+  char buffer[message_serialization::NUMBER_BUFFER_SIZE];
+  for (auto _ : state)
+  {
+    int size = 0;
+    for (const double value : values)
+      size += std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    benchmark::DoNotOptimize(size);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * values.size()));
+}
+BENCHMARK(BM_FormatPrintf)->Arg(1 << 16);
+
+/**
+ * @brief Scalar conversion only, with the parser of this package
+ */
+static void BM_ParseNumber(benchmark::State& state)
+{
+  const std::vector<std::string> text = scalars(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state)
+  {
+    double sum = 0.0;
+    for (const std::string& s : text)
+    {
+      double value;
+      message_serialization::parseNumber(s.data(), s.data() + s.size(), value);
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * totalSize(text)));
+}
+BENCHMARK(BM_ParseNumber)->Arg(1 << 16);
+
+/**
+ * @brief Scalar conversion only, with a classic-locale stream as used by YAML::convert<double>
+ */
+static void BM_ParseStream(benchmark::State& state)
+{
+  const std::vector<std::string> text = scalars(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state)
+  {
+    double sum = 0.0;
+    for (const std::string& s : text)
+    {
+      std::stringstream stream(s);
+      stream.unsetf(std::ios::dec);
+      stream.imbue(std::locale::classic());
+      double value;
+      stream >> value;
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * totalSize(text)));
+}
+BENCHMARK(BM_ParseStream)->Arg(1 << 16);
+
+/**
+ * @brief Decoding of a whole document through a YAML::Node tree with YAML::convert
+ */
+static void BM_DecodeNodeConvert(benchmark::State& state)
+{
+  const std::string& yaml = sequence(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state)
+  {
+    const std::vector<double> values = YAML::Load(yaml).as<std::vector<double>>();
+    benchmark::DoNotOptimize(values.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * yaml.size()));
+}
+BENCHMARK(BM_DecodeNodeConvert)->Arg(1 << 16);
+
+/**
+ * @brief Decoding of a whole document through a YAML::Node tree with the parser of this package
+ */
+static void BM_DecodeNodeNumbers(benchmark::State& state)
+{
+  const std::string& yaml = sequence(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state)
+  {
+    const std::vector<double> values = message_serialization::decodeNumbers<double>(YAML::Load(yaml));
+    benchmark::DoNotOptimize(values.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * yaml.size()));
+}
+BENCHMARK(BM_DecodeNodeNumbers)->Arg(1 << 16);
+
+/**
+ * @brief Decoding of a whole document from parser events
+ */
+static void BM_DecodeEvents(benchmark::State& state)
+{
+  const std::string& yaml = sequence(static_cast<std::size_t>(state.range(0)));
+  for (auto _ : state)
+  {
+    std::istringstream stream(yaml);
+    message_serialization::YamlReader reader(stream);
+    std::vector<double> values;
+    parse(reader, values);
+    benchmark::DoNotOptimize(values.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * yaml.size()));
+}
+BENCHMARK(BM_DecodeEvents)->Arg(1 << 16);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,651 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstdlib>
+#include <Eigen/StdVector>
+#include <message_serialization/binary_serialization.h>
+#include <message_serialization/eigen_binary.h>
+#include <message_serialization/eigen_yaml.h>
+#include <message_serialization/json_serialization.h>
+#include <message_serialization/metrics.h>
+#include <message_serialization/sensor_msgs_yaml.h>
+#include <message_serialization/serialize.h>
+#include <message_serialization/shape_msgs_yaml.h>
+#include <message_serialization/shm_ring.h>
+#include <message_serialization/trajectory_msgs_yaml.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * Allocation counting
+ *
+ * The global allocation functions are replaced so that every benchmark can report the number of heap allocations per
+ * operation. The benchmarks run on a single thread, so the count of the calling thread covers all their allocations.
+ */
+MESSAGE_SERIALIZATION_DEFINE_ALLOCATION_COUNTER
+
+namespace
+{
+/**
+ * @brief Current resident set size of the process in bytes, from /proc/self/statm
+ */
+double residentBytes()
+{
+  unsigned long size = 0, resident = 0;
+  FILE* statm = std::fopen("/proc/self/statm", "r");
+  if (statm)
+  {
+    if (std::fscanf(statm, "%lu %lu", &size, &resident) != 2)
+      resident = 0;
+    std::fclose(statm);
+  }
+  return static_cast<double>(resident) * static_cast<double>(::sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * @brief Records the allocations and memory usage of a benchmark
+ */
+class Report
+{
+public:
+  explicit Report(benchmark::State& state)
+    : state_(state), start_(message_serialization::detail::threadAllocations()), start_rss_(residentBytes())
+  {
+  }
+
+  /**
+   * @brief Sets the counters of the benchmark
+   * @param bytes Size of the encoded representation processed by each iteration
+   */
+  void finish(const std::size_t bytes)
+  {
+    const uint64_t count = message_serialization::detail::threadAllocations() - start_;
+    state_.counters["allocs_per_op"] = benchmark::Counter(static_cast<double>(count), benchmark::Counter::kAvgIterations);
+
+    // The process-wide peak (ru_maxrss) would only show the largest benchmark run so far, so the growth of the current
+    // resident size across this benchmark is reported instead
+    state_.counters["rss_growth_MB"] = (residentBytes() - start_rss_) / (1024.0 * 1024.0);
+
+    state_.SetBytesProcessed(static_cast<int64_t>(state_.iterations()) * static_cast<int64_t>(bytes));
+  }
+
+private:
+  benchmark::State& state_;
+  const uint64_t start_;
+  const double start_rss_;
+};
+
+std::mt19937& generator()
+{
+  static std::mt19937 gen(0);
+  return gen;
+}
+
+double randomValue()
+{
+  static std::uniform_real_distribution<double> dist(-10.0, 10.0);
+  return dist(generator());
+}
+
+std::vector<double> randomVector(const std::size_t n)
+{
+  std::vector<double> v(n);
+  for (double& d : v)
+    d = randomValue();
+  return v;
+}
+
+/**
+ * @brief Creates an object of the benchmarked type; n is the size of its variable-length content, if any
+ */
+template <typename T>
+T make(std::size_t n);
+
+template <>
+ros::Time make(std::size_t)
+{
+  return ros::Time(1600000000, 123456789);
+}
+
+template <>
+std_msgs::Header make(std::size_t)
+{
+  std_msgs::Header msg;
+  msg.seq = 42;
+  msg.stamp = make<ros::Time>(0);
+  msg.frame_id = "base_link";
+  return msg;
+}
+
+template <>
+geometry_msgs::Vector3 make(std::size_t)
+{
+  geometry_msgs::Vector3 msg;
+  msg.x = randomValue();
+  msg.y = randomValue();
+  msg.z = randomValue();
+  return msg;
+}
+
+template <>
+geometry_msgs::Point make(std::size_t)
+{
+  geometry_msgs::Point msg;
+  msg.x = randomValue();
+  msg.y = randomValue();
+  msg.z = randomValue();
+  return msg;
+}
+
+template <>
+geometry_msgs::Quaternion make(std::size_t)
+{
+  const Eigen::Quaterniond q = Eigen::Quaterniond::UnitRandom();
+  geometry_msgs::Quaternion msg;
+  msg.x = q.x();
+  msg.y = q.y();
+  msg.z = q.z();
+  msg.w = q.w();
+  return msg;
+}
+
+template <>
+geometry_msgs::Pose make(std::size_t)
+{
+  geometry_msgs::Pose msg;
+  msg.position = make<geometry_msgs::Point>(0);
+  msg.orientation = make<geometry_msgs::Quaternion>(0);
+  return msg;
+}
+
+template <>
+geometry_msgs::PoseStamped make(std::size_t)
+{
+  geometry_msgs::PoseStamped msg;
+  msg.header = make<std_msgs::Header>(0);
+  msg.pose = make<geometry_msgs::Pose>(0);
+  return msg;
+}
+
+template <>
+geometry_msgs::PoseArray make(const std::size_t n)
+{
+  geometry_msgs::PoseArray msg;
+  msg.header = make<std_msgs::Header>(0);
+  msg.poses.reserve(n);
+  for (std::size_t i = 0; i < n; ++i)
+    msg.poses.push_back(make<geometry_msgs::Pose>(0));
+  return msg;
+}
+
+template <>
+geometry_msgs::Transform make(std::size_t)
+{
+  geometry_msgs::Transform msg;
+  msg.translation = make<geometry_msgs::Vector3>(0);
+  msg.rotation = make<geometry_msgs::Quaternion>(0);
+  return msg;
+}
+
+template <>
+geometry_msgs::TransformStamped make(std::size_t)
+{
+  geometry_msgs::TransformStamped msg;
+  msg.header = make<std_msgs::Header>(0);
+  msg.child_frame_id = "tool0";
+  msg.transform = make<geometry_msgs::Transform>(0);
+  return msg;
+}
+
+template <>
+sensor_msgs::RegionOfInterest make(std::size_t)
+{
+  sensor_msgs::RegionOfInterest msg;
+  msg.x_offset = 10;
+  msg.y_offset = 20;
+  msg.height = 480;
+  msg.width = 640;
+  msg.do_rectify = true;
+  return msg;
+}
+
+template <>
+sensor_msgs::CameraInfo make(std::size_t)
+{
+  sensor_msgs::CameraInfo msg;
+  msg.header = make<std_msgs::Header>(0);
+  msg.height = 480;
+  msg.width = 640;
+  msg.distortion_model = "plumb_bob";
+  msg.D = randomVector(5);
+  for (double& d : msg.K)
+    d = randomValue();
+  for (double& d : msg.R)
+    d = randomValue();
+  for (double& d : msg.P)
+    d = randomValue();
+  msg.roi = make<sensor_msgs::RegionOfInterest>(0);
+  return msg;
+}
+
+template <>
+sensor_msgs::JointState make(const std::size_t n)
+{
+  sensor_msgs::JointState msg;
+  msg.header = make<std_msgs::Header>(0);
+  for (std::size_t i = 0; i < n; ++i)
+    msg.name.push_back("joint_" + std::to_string(i));
+  msg.position = randomVector(n);
+  msg.velocity = randomVector(n);
+  msg.effort = randomVector(n);
+  return msg;
+}
+
+template <>
+shape_msgs::MeshTriangle make(std::size_t)
+{
+  shape_msgs::MeshTriangle msg;
+  msg.vertex_indices[0] = 0;
+  msg.vertex_indices[1] = 1;
+  msg.vertex_indices[2] = 2;
+  return msg;
+}
+
+template <>
+shape_msgs::Mesh make(const std::size_t n)
+{
+  // A closed triangulated surface has about half as many vertices as triangles
+  const std::size_t vertices = n / 2 + 3;
+  std::uniform_int_distribution<uint32_t> index(0, static_cast<uint32_t>(vertices - 1));
+
+  shape_msgs::Mesh msg;
+  msg.vertices.reserve(vertices);
+  for (std::size_t i = 0; i < vertices; ++i)
+    msg.vertices.push_back(make<geometry_msgs::Point>(0));
+  msg.triangles.resize(n);
+  for (shape_msgs::MeshTriangle& triangle : msg.triangles)
+  {
+    for (uint32_t& v : triangle.vertex_indices)
+      v = index(generator());
+  }
+  return msg;
+}
+
+template <>
+trajectory_msgs::JointTrajectoryPoint make(std::size_t)
+{
+  const std::size_t joints = 6;
+  trajectory_msgs::JointTrajectoryPoint msg;
+  msg.positions = randomVector(joints);
+  msg.velocities = randomVector(joints);
+  msg.accelerations = randomVector(joints);
+  msg.time_from_start = ros::Duration(1.5);
+  return msg;
+}
+
+template <>
+trajectory_msgs::JointTrajectory make(const std::size_t n)
+{
+  trajectory_msgs::JointTrajectory msg;
+  msg.header = make<std_msgs::Header>(0);
+  for (std::size_t i = 0; i < 6; ++i)
+    msg.joint_names.push_back("joint_" + std::to_string(i));
+  msg.points.reserve(n);
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    msg.points.push_back(make<trajectory_msgs::JointTrajectoryPoint>(0));
+    msg.points.back().time_from_start = ros::Duration(0.01 * static_cast<double>(i));
+  }
+  return msg;
+}
+
+template <>
+Eigen::Vector3d make(std::size_t)
+{
+  return Eigen::Vector3d::Random();
+}
+
+template <>
+Eigen::Isometry3d make(std::size_t)
+{
+  return Eigen::Translation3d(Eigen::Vector3d::Random()) * Eigen::Quaterniond::UnitRandom();
+}
+
+template <>
+Eigen::Affine3d make(std::size_t)
+{
+  return Eigen::Translation3d(Eigen::Vector3d::Random()) * Eigen::Quaterniond::UnitRandom();
+}
+
+typedef std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>> Isometry3dVector;
+
+template <>
+Eigen::MatrixXd make(const std::size_t n)
+{
+  return Eigen::MatrixXd::Random(static_cast<Eigen::Index>(n), 6);
+}
+
+template <>
+Isometry3dVector make(const std::size_t n)
+{
+  Isometry3dVector v;
+  v.reserve(n);
+  for (std::size_t i = 0; i < n; ++i)
+    v.push_back(make<Eigen::Isometry3d>(0));
+  return v;
+}
+
+}  // namespace
+
+template <typename T>
+static std::string encodeYaml(const T& value, const message_serialization::YamlOptions& options)
+{
+  YAML::Emitter out;
+  message_serialization::YamlWriter writer(out, options);
+  message_serialization::emit(writer, value);
+  return out.c_str();
+}
+
+template <typename T>
+static void yamlEncode(benchmark::State& state, const message_serialization::YamlOptions options)
+{
+  const T value = make<T>(static_cast<std::size_t>(state.range(0)));
+  std::size_t bytes = 0;
+
+  Report report(state);
+  for (auto _ : state)
+  {
+    YAML::Emitter out;
+    message_serialization::YamlWriter writer(out, options);
+    message_serialization::emit(writer, value);
+    bytes = out.size();
+    benchmark::DoNotOptimize(out.c_str());
+  }
+  report.finish(bytes);
+}
+
+template <typename T>
+static void yamlDecode(benchmark::State& state, const message_serialization::YamlOptions options)
+{
+  const std::string yaml = encodeYaml(make<T>(static_cast<std::size_t>(state.range(0))), options);
+
+  Report report(state);
+  for (auto _ : state)
+  {
+    std::istringstream stream(yaml);
+    message_serialization::YamlReader reader(stream);
+    T value;
+    message_serialization::parse(reader, value);
+    benchmark::DoNotOptimize(&value);
+  }
+  report.finish(yaml.size());
+}
+
+template <typename T>
+static void jsonEncode(benchmark::State& state)
+{
+  const T value = make<T>(static_cast<std::size_t>(state.range(0)));
+  std::string json;
+
+  Report report(state);
+  for (auto _ : state)
+  {
+    message_serialization::serializeToJsonString(json, value);
+    benchmark::DoNotOptimize(json.data());
+  }
+  report.finish(json.size());
+}
+
+template <typename T>
+static void jsonDecode(benchmark::State& state)
+{
+  const std::string json =
+      message_serialization::serializeToJsonString(make<T>(static_cast<std::size_t>(state.range(0))));
+
+  Report report(state);
+  for (auto _ : state)
+  {
+    // The parser works in place, so each iteration pays for a copy of the text
+    message_serialization::YamlReader reader = message_serialization::YamlReader::fromJson(json);
+    T value;
+    message_serialization::parse(reader, value);
+    benchmark::DoNotOptimize(&value);
+  }
+  report.finish(json.size());
+}
+
+template <typename T>
+static void binaryEncode(benchmark::State& state)
+{
+  const T value = make<T>(static_cast<std::size_t>(state.range(0)));
+  message_serialization::SerializationBuffer buffer;
+  std::size_t bytes = 0;
+
+  Report report(state);
+  for (auto _ : state)
+  {
+    bytes = message_serialization::serializeToBuffer(buffer, value);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  report.finish(bytes);
+}
+
+template <typename T>
+static void binaryDecode(benchmark::State& state)
+{
+  message_serialization::SerializationBuffer buffer;
+  const uint32_t bytes =
+      message_serialization::serializeToBuffer(buffer, make<T>(static_cast<std::size_t>(state.range(0))));
+
+  Report report(state);
+  for (auto _ : state)
+  {
+    T value = message_serialization::deserializeFromBuffer<T>(buffer.data(), bytes);
+    benchmark::DoNotOptimize(&value);
+  }
+  report.finish(bytes);
+}
+
+/**
+ * @brief Writes a binary file with the given durability options, to measure the cost of each mode
+ * @details Deferred syncs are flushed in batches of 16 files, inside the timed loop
+ */
+template <typename T>
+static void binaryWrite(benchmark::State& state, message_serialization::FileWriteOptions options)
+{
+  const T value = make<T>(static_cast<std::size_t>(state.range(0)));
+  const std::string file = "/tmp/message_serialization_bench.msg";
+  message_serialization::SyncBatch batch;
+  options.batch = &batch;
+  std::size_t bytes = 0;
+
+  Report report(state);
+  for (auto _ : state)
+  {
+    message_serialization::serializeToBinary(value, file, message_serialization::BinaryWriteOptions(), options);
+    if (batch.pending() >= 16)
+      batch.sync();
+    bytes = ros::serialization::serializationLength(value);
+  }
+  batch.sync();
+  report.finish(bytes);
+  std::remove(file.c_str());
+}
+
+/**
+ * @brief Publishes a message to a shared-memory ring and decodes it from the slot, i.e. one handoff without the
+ * cache-line transfer between cores
+ */
+template <typename T>
+static void shmRingHandoff(benchmark::State& state)
+{
+  const T value = make<T>(static_cast<std::size_t>(state.range(0)));
+  const uint32_t bytes = ros::serialization::serializationLength(value);
+  message_serialization::ShmRingOptions options;
+  options.slot_capacity = bytes;
+  options.unlink_on_close = true;
+  message_serialization::ShmRingWriter writer("/message_serialization_bench", options);
+  message_serialization::ShmRingReader reader("/message_serialization_bench");
+
+  Report report(state);
+  for (auto _ : state)
+  {
+    writer.publish(value);
+    T received;
+    if (!reader.read(received))
+      state.SkipWithError("Message was not received");
+    benchmark::DoNotOptimize(&received);
+  }
+  report.finish(bytes);
+}
+
+/**
+ * @brief Runs a registered benchmark for each of the input sizes
+ */
+static void sweep(benchmark::internal::Benchmark* bm, const std::vector<int64_t>& sizes)
+{
+  bm->ArgName("n")->Unit(benchmark::kMicrosecond);
+  for (const int64_t n : sizes)
+    bm->Arg(n);
+}
+
+/**
+ * @brief Registers the YAML and JSON benchmarks of a type
+ * @details JSON written by yaml-cpp (YamlEncode/.../json) is compared to the native JSON backend. Types with large
+ * numeric arrays are also benchmarked with flow-style sequences, binary blocks and columnar arrays
+ */
+template <typename T>
+static void registerYaml(const std::string& name, const std::vector<int64_t>& sizes, const bool arrays)
+{
+  std::vector<std::pair<std::string, message_serialization::YamlOptions>> variants;
+  variants.emplace_back("", message_serialization::YamlOptions());
+  message_serialization::YamlOptions json;
+  json.json = true;
+  variants.emplace_back("/json", json);
+  if (arrays)
+  {
+    message_serialization::YamlOptions flow;
+    flow.flow_numeric_sequences = true;
+    variants.emplace_back("/flow", flow);
+
+    message_serialization::YamlOptions binary;
+    binary.binary_array_threshold = 64;
+    variants.emplace_back("/binary_blocks", binary);
+
+    message_serialization::YamlOptions columnar;
+    columnar.columnar_arrays = true;
+    variants.emplace_back("/columnar", columnar);
+  }
+
+  for (const auto& variant : variants)
+  {
+    sweep(benchmark::RegisterBenchmark(("YamlEncode/" + name + variant.first).c_str(), yamlEncode<T>, variant.second),
+          sizes);
+    sweep(benchmark::RegisterBenchmark(("YamlDecode/" + name + variant.first).c_str(), yamlDecode<T>, variant.second),
+          sizes);
+  }
+  sweep(benchmark::RegisterBenchmark(("JsonEncode/" + name).c_str(), jsonEncode<T>), sizes);
+  sweep(benchmark::RegisterBenchmark(("JsonDecode/" + name).c_str(), jsonDecode<T>), sizes);
+}
+
+/**
+ * @brief Registers the YAML and binary benchmarks of a ROS message type
+ */
+template <typename T>
+static void registerMessage(const std::string& name, const std::vector<int64_t>& sizes = { 1 },
+                            const bool arrays = false)
+{
+  registerYaml<T>(name, sizes, arrays);
+  sweep(benchmark::RegisterBenchmark(("BinaryEncode/" + name).c_str(), binaryEncode<T>), sizes);
+  sweep(benchmark::RegisterBenchmark(("BinaryDecode/" + name).c_str(), binaryDecode<T>), sizes);
+}
+
+/**
+ * @brief Sizes from first to last, growing by a factor of 10
+ */
+static std::vector<int64_t> decades(int64_t first, const int64_t last)
+{
+  std::vector<int64_t> sizes;
+  for (; first <= last; first *= 10)
+    sizes.push_back(first);
+  return sizes;
+}
+
+int main(int argc, char** argv)
+{
+  registerYaml<ros::Time>("ros::Time", { 1 }, false);
+  registerMessage<std_msgs::Header>("std_msgs::Header");
+
+  registerMessage<geometry_msgs::Vector3>("geometry_msgs::Vector3");
+  registerMessage<geometry_msgs::Point>("geometry_msgs::Point");
+  registerMessage<geometry_msgs::Quaternion>("geometry_msgs::Quaternion");
+  registerMessage<geometry_msgs::Pose>("geometry_msgs::Pose");
+  registerMessage<geometry_msgs::PoseStamped>("geometry_msgs::PoseStamped");
+  registerMessage<geometry_msgs::PoseArray>("geometry_msgs::PoseArray", decades(10, 1000000), true);
+  registerMessage<geometry_msgs::Transform>("geometry_msgs::Transform");
+  registerMessage<geometry_msgs::TransformStamped>("geometry_msgs::TransformStamped");
+
+  registerMessage<sensor_msgs::RegionOfInterest>("sensor_msgs::RegionOfInterest");
+  registerMessage<sensor_msgs::CameraInfo>("sensor_msgs::CameraInfo");
+  registerMessage<sensor_msgs::JointState>("sensor_msgs::JointState", decades(10, 100000), true);
+
+  registerMessage<shape_msgs::MeshTriangle>("shape_msgs::MeshTriangle");
+  registerMessage<shape_msgs::Mesh>("shape_msgs::Mesh", decades(1000, 10000000), true);
+
+  registerMessage<trajectory_msgs::JointTrajectoryPoint>("trajectory_msgs::JointTrajectoryPoint");
+  registerMessage<trajectory_msgs::JointTrajectory>("trajectory_msgs::JointTrajectory", decades(10, 1000000), true);
+
+  // Durability modes of file writes
+  std::vector<std::pair<std::string, message_serialization::FileWriteOptions>> modes(6);
+  modes[0].first = "/default";
+  modes[1].first = "/single_write";
+  modes[1].second.single_write = true;
+  modes[2].first = "/atomic";
+  modes[2].second.atomic = true;
+  modes[3].first = "/fdatasync";
+  modes[3].second.sync = message_serialization::SyncPolicy::DATA;
+  modes[4].first = "/atomic_fdatasync";
+  modes[4].second.atomic = true;
+  modes[4].second.sync = message_serialization::SyncPolicy::DATA;
+  modes[5].first = "/deferred_sync";
+  modes[5].second.sync = message_serialization::SyncPolicy::DEFERRED;
+  for (const auto& mode : modes)
+    sweep(benchmark::RegisterBenchmark(("BinaryWrite/shape_msgs::Mesh" + mode.first).c_str(),
+                                       binaryWrite<shape_msgs::Mesh>, mode.second),
+          decades(1000, 1000000));
+
+  sweep(benchmark::RegisterBenchmark("ShmRingHandoff/geometry_msgs::PoseStamped",
+                                     shmRingHandoff<geometry_msgs::PoseStamped>),
+        { 1 });
+  sweep(benchmark::RegisterBenchmark("ShmRingHandoff/sensor_msgs::JointState", shmRingHandoff<sensor_msgs::JointState>),
+        decades(10, 1000));
+
+  registerYaml<Eigen::Vector3d>("Eigen::Vector3d", { 1 }, false);
+  registerYaml<Eigen::Isometry3d>("Eigen::Isometry3d", { 1 }, false);
+  registerYaml<Eigen::Affine3d>("Eigen::Affine3d", { 1 }, false);
+  registerMessage<Eigen::MatrixXd>("Eigen::MatrixXd", decades(10, 1000000), true);
+  registerMessage<Isometry3dVector>("std::vector<Eigen::Isometry3d>", decades(10, 1000000), true);
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
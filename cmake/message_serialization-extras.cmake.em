@@ -0,0 +1,20 @@
+# Generated from message_serialization/cmake/message_serialization-extras.cmake.em
+
+@[if DEVELSPACE]@
+set(message_serialization_CMAKE_DIR "@(CMAKE_CURRENT_SOURCE_DIR)/cmake")
+set(message_serialization_GENERATOR "@(CMAKE_CURRENT_SOURCE_DIR)/scripts/generate_yaml_converters.py")
+@[else]@
+set(message_serialization_CMAKE_DIR "${message_serialization_DIR}")
+set(message_serialization_GENERATOR "${message_serialization_DIR}/../scripts/generate_yaml_converters.py")
+@[end if]@
+
+include(${message_serialization_CMAKE_DIR}/message_serialization_generate.cmake)
+
+# Compression codecs are enabled in the headers for each dependent package that can link against them
+include(${message_serialization_CMAKE_DIR}/message_serialization_compression.cmake)
+add_definitions(${message_serialization_COMPRESSION_DEFINITIONS})
+list(APPEND message_serialization_INCLUDE_DIRS ${message_serialization_COMPRESSION_INCLUDE_DIRS})
+list(APPEND message_serialization_LIBRARIES ${message_serialization_COMPRESSION_LIBRARIES})
+
+# shm_open (shm_ring.h) lives in librt before glibc 2.34
+list(APPEND message_serialization_LIBRARIES rt)
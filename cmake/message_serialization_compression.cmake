@@ -0,0 +1,35 @@
+#
+# Finds the optional codecs used to compress binary files (see message_serialization/compression.h)
+#
+# Support for each codec is compiled into the headers when its library is found with the frame API the headers use,
+# i.e. LZ4 1.8.0 and Zstandard 1.4.0 or newer; older releases, such as those of Ubuntu 18.04, are skipped. Sets:
+#
+#   message_serialization_COMPRESSION_DEFINITIONS   MESSAGE_SERIALIZATION_WITH_LZ4 and/or MESSAGE_SERIALIZATION_WITH_ZSTD
+#   message_serialization_COMPRESSION_INCLUDE_DIRS
+#   message_serialization_COMPRESSION_LIBRARIES
+#
+set(message_serialization_COMPRESSION_DEFINITIONS)
+set(message_serialization_COMPRESSION_INCLUDE_DIRS)
+set(message_serialization_COMPRESSION_LIBRARIES)
+
+find_package(PkgConfig QUIET)
+if(PKG_CONFIG_FOUND)
+  pkg_check_modules(message_serialization_LZ4 QUIET liblz4>=1.8.0)
+  pkg_check_modules(message_serialization_ZSTD QUIET libzstd>=1.4.0)
+endif()
+
+if(message_serialization_LZ4_FOUND)
+  list(APPEND message_serialization_COMPRESSION_DEFINITIONS -DMESSAGE_SERIALIZATION_WITH_LZ4)
+  list(APPEND message_serialization_COMPRESSION_INCLUDE_DIRS ${message_serialization_LZ4_INCLUDE_DIRS})
+  find_library(message_serialization_LZ4_LIBRARY NAMES ${message_serialization_LZ4_LIBRARIES}
+    HINTS ${message_serialization_LZ4_LIBRARY_DIRS})
+  list(APPEND message_serialization_COMPRESSION_LIBRARIES ${message_serialization_LZ4_LIBRARY})
+endif()
+
+if(message_serialization_ZSTD_FOUND)
+  list(APPEND message_serialization_COMPRESSION_DEFINITIONS -DMESSAGE_SERIALIZATION_WITH_ZSTD)
+  list(APPEND message_serialization_COMPRESSION_INCLUDE_DIRS ${message_serialization_ZSTD_INCLUDE_DIRS})
+  find_library(message_serialization_ZSTD_LIBRARY NAMES ${message_serialization_ZSTD_LIBRARIES}
+    HINTS ${message_serialization_ZSTD_LIBRARY_DIRS})
+  list(APPEND message_serialization_COMPRESSION_LIBRARIES ${message_serialization_ZSTD_LIBRARY})
+endif()
@@ -0,0 +1,109 @@
+#
+# Generates YAML converters for every message of one or more ROS message packages
+#
+# message_serialization_generate_yaml(PACKAGES pkg1 [pkg2 ...] [TARGET target])
+#
+# A header <package>_yaml.h with YAML::convert specializations and message_serialization emit/parse overloads is
+# generated in ${CATKIN_DEVEL_PREFIX}/include/${PROJECT_NAME}/message_serialization_generated for each package, as well
+# as for the packages whose messages they use, and installed to the same place under the package's include destination.
+# Messages with hand-written converters in message_serialization are not generated again. The headers are regenerated
+# whenever the message definitions they are generated from change, and are built by the given target, by default
+# ${PROJECT_NAME}_generate_yaml_<pkg1>[_<pkg2>...], which targets that include them should depend on:
+#
+#   message_serialization_generate_yaml(PACKAGES visualization_msgs TARGET my_yaml)
+#   add_executable(node src/node.cpp)
+#   add_dependencies(node my_yaml)
+#
+#   #include <my_package/message_serialization_generated/visualization_msgs_yaml.h>
+#
+# The macro may be called several times in a project; headers already declared by an earlier call are not generated
+# again, and the new target depends on the earlier one instead.
+#
+# The message definitions of each listed package are located through the <package>_MSG_INCLUDE_DIRS variable set by
+# find_package(<package>), or through the ROS package path otherwise. The packages whose messages they use are found
+# when CMake runs, and CMake runs again when a message definition changes, so that new dependencies are picked up.
+#
+macro(message_serialization_generate_yaml)
+  cmake_parse_arguments(_MS_GENERATE "" "TARGET" "PACKAGES" ${ARGN})
+  if(NOT _MS_GENERATE_PACKAGES)
+    message(FATAL_ERROR "message_serialization_generate_yaml() called without PACKAGES")
+  endif()
+
+  find_package(PythonInterp REQUIRED)
+
+  set(_ms_target ${_MS_GENERATE_TARGET})
+  if(NOT _ms_target)
+    string(REPLACE ";" "_" _ms_target "${PROJECT_NAME}_generate_yaml_${_MS_GENERATE_PACKAGES}")
+  endif()
+
+  set(_ms_include_prefix "${PROJECT_NAME}/message_serialization_generated")
+  set(_ms_output_dir "${CATKIN_DEVEL_PREFIX}/include/${_ms_include_prefix}")
+  set(_ms_args)
+  foreach(_ms_pkg ${_MS_GENERATE_PACKAGES})
+    set(_ms_dirs ${${_ms_pkg}_MSG_INCLUDE_DIRS})
+    if(NOT _ms_dirs AND ${_ms_pkg}_DIR)
+      set(_ms_dirs "${${_ms_pkg}_DIR}/../msg")
+    endif()
+
+    foreach(_ms_dir ${_ms_dirs})
+      list(APPEND _ms_args -I "${_ms_pkg}:${_ms_dir}")
+    endforeach()
+  endforeach()
+  set(_ms_command ${PYTHON_EXECUTABLE} ${message_serialization_GENERATOR} ${_MS_GENERATE_PACKAGES} ${_ms_args}
+      -o ${_ms_output_dir} --include-prefix ${_ms_include_prefix})
+
+  # Every header is declared, including those of the packages the listed ones depend on, so that each is rebuilt when
+  # any of the message definitions it is generated from changes
+  execute_process(
+    COMMAND ${_ms_command} --list
+    RESULT_VARIABLE _ms_result
+    OUTPUT_VARIABLE _ms_listing
+    ERROR_VARIABLE _ms_error
+  )
+  if(NOT _ms_result EQUAL 0)
+    message(FATAL_ERROR "Cannot generate YAML converters for ${_MS_GENERATE_PACKAGES}: ${_ms_error}")
+  endif()
+
+  # Headers already declared by an earlier call are left to it, as two rules may not write the same file
+  set(_ms_outputs)
+  set(_ms_msg_files)
+  set(_ms_depends)
+  string(REPLACE "\n" ";" _ms_listing "${_ms_listing}")
+  foreach(_ms_line ${_ms_listing})
+    if(_ms_line MATCHES "^output (.*)$")
+      list(FIND _ms_generated_yaml_outputs "${CMAKE_MATCH_1}" _ms_index)
+      if(_ms_index EQUAL -1)
+        list(APPEND _ms_outputs "${CMAKE_MATCH_1}")
+      else()
+        list(GET _ms_generated_yaml_targets ${_ms_index} _ms_other)
+        list(APPEND _ms_depends ${_ms_other})
+      endif()
+    elseif(_ms_line MATCHES "^depends (.*)$")
+      list(APPEND _ms_msg_files "${CMAKE_MATCH_1}")
+    endif()
+  endforeach()
+  set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${_ms_msg_files})
+
+  if(_ms_outputs)
+    add_custom_command(
+      OUTPUT ${_ms_outputs}
+      COMMAND ${_ms_command}
+      DEPENDS ${message_serialization_GENERATOR} ${_ms_msg_files}
+      COMMENT "Generating YAML converters for ${_MS_GENERATE_PACKAGES}"
+    )
+    install(FILES ${_ms_outputs}
+      DESTINATION ${CATKIN_GLOBAL_INCLUDE_DESTINATION}/${_ms_include_prefix}
+    )
+  endif()
+  add_custom_target(${_ms_target} ALL DEPENDS ${_ms_outputs})
+  if(_ms_depends)
+    list(REMOVE_DUPLICATES _ms_depends)
+    add_dependencies(${_ms_target} ${_ms_depends})
+  endif()
+
+  foreach(_ms_output ${_ms_outputs})
+    list(APPEND _ms_generated_yaml_outputs "${_ms_output}")
+    list(APPEND _ms_generated_yaml_targets ${_ms_target})
+  endforeach()
+  include_directories(${CATKIN_DEVEL_PREFIX}/include)
+endmacro()
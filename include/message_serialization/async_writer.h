@@ -0,0 +1,337 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_ASYNC_WRITER_H
+#define MESSAGE_SERIALIZATION_ASYNC_WRITER_H
+
+#include <boost/shared_ptr.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <message_serialization/binary_serialization.h>
+#include <message_serialization/serialize.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace message_serialization
+{
+/**
+ * @brief Behavior of @ref AsyncWriter when its queue is full
+ */
+enum class OverflowPolicy
+{
+  /** @brief Wait for the writer thread to make room in the queue */
+  BLOCK,
+  /** @brief Reject the new request without waiting */
+  DROP
+};
+
+/**
+ * @brief Options for @ref AsyncWriter
+ */
+struct AsyncWriterOptions
+{
+  /**
+   * @brief Maximum number of requests waiting to be written; must be at least one
+   */
+  std::size_t max_queue_size = 64;
+
+  OverflowPolicy overflow_policy = OverflowPolicy::BLOCK;
+};
+
+/**
+ * @brief Serializes objects to files on a dedicated background thread
+ * @details Each request is encoded and written by the writer thread, in the order in which requests were accepted, so
+ * the caller only pays for moving the object (or copying a shared pointer to it) into the queue. The outcome of each
+ * request is reported through the returned future, which holds the exception of a failed request, and through an
+ * optional callback invoked on the writer thread. Requests still queued when the writer is destroyed are written
+ * before the destructor returns.
+ */
+class AsyncWriter
+{
+public:
+  /**
+   * @brief Callback invoked when a request completes
+   * @details The first argument is true on success; the second describes the failure otherwise
+   */
+  typedef std::function<void(bool, const std::string&)> Callback;
+
+  /**
+   * @param options
+   * @throws std::invalid_argument if the maximum queue size is zero, as no request could ever be accepted
+   */
+  explicit AsyncWriter(const AsyncWriterOptions& options = AsyncWriterOptions())
+    : options_(validate(options)), thread_(&AsyncWriter::run, this)
+  {
+  }
+
+  AsyncWriter(const AsyncWriter&) = delete;
+  AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+  ~AsyncWriter()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    not_empty_.notify_one();
+    thread_.join();
+  }
+
+  /**
+   * @brief Queues an object to be serialized to a YAML-formatted file
+   * @param val
+   * @param file
+   * @param options
+   * @param callback
+   * @return future that becomes ready once the file has been written, or holds the exception of the failure. If the
+   * request is dropped because the queue is full, the future holds an exception immediately
+   */
+  template <typename T>
+  std::future<void> serialize(T val, const std::string& file, const YamlOptions& options = YamlOptions(),
+                              Callback callback = Callback())
+  {
+    return serialize(std::make_shared<const T>(std::move(val)), file, options, std::move(callback));
+  }
+
+  /**
+   * @brief Queues an object held by a shared pointer, such as a ROS message's Ptr or ConstPtr, without copying it
+   * @details The object must not be modified until the request completes
+   */
+  template <typename T>
+  std::future<void> serialize(std::shared_ptr<T> val, const std::string& file,
+                              const YamlOptions& options = YamlOptions(), Callback callback = Callback())
+  {
+    return enqueueYaml(std::move(val), file, options, std::move(callback));
+  }
+
+  template <typename T>
+  std::future<void> serialize(boost::shared_ptr<T> val, const std::string& file,
+                              const YamlOptions& options = YamlOptions(), Callback callback = Callback())
+  {
+    return enqueueYaml(std::move(val), file, options, std::move(callback));
+  }
+
+  /**
+   * @brief Queues a ROS message to be serialized to a binary file
+   * @param message
+   * @param file
+   * @param callback
+   * @return future that becomes ready once the file has been written, or holds the exception of the failure. If the
+   * request is dropped because the queue is full, the future holds an exception immediately
+   */
+  template <typename T>
+  std::future<void> serializeToBinary(T message, const std::string& file, Callback callback = Callback())
+  {
+    return serializeToBinary(std::make_shared<const T>(std::move(message)), file, std::move(callback));
+  }
+
+  /**
+   * @brief Queues a ROS message held by a shared pointer, such as its Ptr or ConstPtr, without copying it
+   * @details The message must not be modified until the request completes
+   */
+  template <typename T>
+  std::future<void> serializeToBinary(std::shared_ptr<T> message, const std::string& file,
+                                      Callback callback = Callback())
+  {
+    return enqueueBinary(std::move(message), file, std::move(callback));
+  }
+
+  template <typename T>
+  std::future<void> serializeToBinary(boost::shared_ptr<T> message, const std::string& file,
+                                      Callback callback = Callback())
+  {
+    return enqueueBinary(std::move(message), file, std::move(callback));
+  }
+
+  /**
+   * @brief Blocks until every request accepted before this call has been written
+   */
+  void flush()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t target = accepted_;
+    completed_cv_.wait(lock, [this, target]() { return completed_ >= target; });
+  }
+
+  /**
+   * @brief Number of requests waiting to be written, excluding the one being written
+   */
+  std::size_t pending() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+  /**
+   * @brief Number of requests rejected because the queue was full
+   */
+  uint64_t dropped() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+  }
+
+private:
+  struct Request
+  {
+    std::function<void()> write;
+    std::shared_ptr<std::promise<void>> promise;
+    std::string file;
+    Callback callback;
+  };
+
+  template <typename Pointer>
+  std::future<void> enqueueYaml(Pointer val, const std::string& file, const YamlOptions& options, Callback callback)
+  {
+    return enqueue([val, file, options]() { message_serialization::serialize(*val, file, options); }, file,
+                   std::move(callback));
+  }
+
+  template <typename Pointer>
+  std::future<void> enqueueBinary(Pointer message, const std::string& file, Callback callback)
+  {
+    return enqueue([message, file]() { message_serialization::serializeToBinary(*message, file); }, file,
+                   std::move(callback));
+  }
+
+  static const AsyncWriterOptions& validate(const AsyncWriterOptions& options)
+  {
+    if (options.max_queue_size == 0)
+      throw std::invalid_argument("Asynchronous writer queue size must be at least one");
+    return options;
+  }
+
+  std::future<void> enqueue(std::function<void()> write, const std::string& file, Callback callback)
+  {
+    Request request;
+    request.write = std::move(write);
+    request.promise = std::make_shared<std::promise<void>>();
+    request.file = file;
+    request.callback = std::move(callback);
+    std::future<void> future = request.promise->get_future();
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (queue_.size() >= options_.max_queue_size)
+      {
+        if (options_.overflow_policy == OverflowPolicy::DROP)
+        {
+          ++dropped_;
+          lock.unlock();
+          const std::string error = "Asynchronous write queue is full; dropped request for '" + file + "'";
+          request.promise->set_exception(std::make_exception_ptr(std::runtime_error(error)));
+          if (request.callback)
+            request.callback(false, error);
+          return future;
+        }
+
+        not_full_.wait(lock, [this]() { return queue_.size() < options_.max_queue_size; });
+      }
+
+      queue_.push_back(std::move(request));
+      ++accepted_;
+    }
+    not_empty_.notify_one();
+    return future;
+  }
+
+  void run()
+  {
+    while (true)
+    {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (queue_.empty())
+          return;
+
+        request = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      not_full_.notify_one();
+
+      bool success = false;
+      std::string error;
+      try
+      {
+        request.write();
+        success = true;
+        request.promise->set_value();
+      }
+      catch (const std::exception& ex)
+      {
+        error = ex.what();
+        request.promise->set_exception(std::current_exception());
+      }
+      catch (...)
+      {
+        error = "Unknown error while writing '" + request.file + "'";
+        request.promise->set_exception(std::current_exception());
+      }
+
+      if (!success)
+        ROS_ERROR_STREAM(error);
+
+      if (request.callback)
+      {
+        try
+        {
+          request.callback(success, error);
+        }
+        catch (const std::exception& ex)
+        {
+          ROS_ERROR_STREAM("Asynchronous write callback error: " << ex.what());
+        }
+        catch (...)
+        {
+          ROS_ERROR_STREAM("Unknown asynchronous write callback error for '" << request.file << "'");
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++completed_;
+      }
+      completed_cv_.notify_all();
+    }
+  }
+
+  const AsyncWriterOptions options_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::condition_variable completed_cv_;
+  std::deque<Request> queue_;
+  uint64_t accepted_ = 0;
+  uint64_t completed_ = 0;
+  uint64_t dropped_ = 0;
+  bool stop_ = false;
+
+  // Declared last so that the thread starts after the other members are initialized
+  std::thread thread_;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_ASYNC_WRITER_H
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_BATCH_H
+#define MESSAGE_SERIALIZATION_BATCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <message_serialization/binary_serialization.h>
+#include <message_serialization/serialize.h>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace message_serialization
+{
+/**
+ * @brief Upper bound on the number of worker threads of a batch
+ */
+const std::size_t MAX_BATCH_THREADS = 256;
+
+/**
+ * @brief Options for the batch serialization functions
+ */
+struct BatchOptions
+{
+  /**
+   * @brief Maximum number of worker threads; zero uses the number of hardware threads
+   * @details Values above @ref MAX_BATCH_THREADS are capped to it
+   */
+  std::size_t threads = 0;
+
+  /**
+   * @brief Number of files ahead of the ones being decoded for which the kernel is asked to start reading
+   * @details Read-ahead lets disk I/O overlap with decoding; zero disables it
+   */
+  std::size_t prefetch = 16;
+};
+
+/**
+ * @brief Outcome of the serialization or deserialization of one file of a batch
+ */
+struct BatchStatus
+{
+  bool success = false;
+
+  /**
+   * @brief Description of the failure; empty on success
+   */
+  std::string error;
+};
+
+/**
+ * @brief Outcome of the deserialization of one file of a batch, including the decoded value on success
+ */
+template <typename T>
+struct BatchResult : BatchStatus
+{
+  T value;
+};
+
+namespace detail
+{
+/**
+ * @brief Asks the kernel to start reading a file into the page cache without waiting for it
+ */
+inline void prefetchFile(const std::string& file)
+{
+  const int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  // The advice is only a hint, so failure is not an error
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  ::close(fd);
+}
+
+/**
+ * @brief Runs a function for each index in [0, count) on a bounded number of threads
+ * @details Indices are handed out in increasing order, so that read-ahead issued for later indices stays ahead of the
+ * workers. If the system refuses to start a thread, the work is shared among the threads already running. The
+ * function must not throw
+ */
+template <typename Function>
+inline void parallelFor(const std::size_t count, const BatchOptions& options, Function fn)
+{
+  std::size_t threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+  threads = std::max<std::size_t>(1, std::min(std::min(threads, MAX_BATCH_THREADS), count));
+
+  std::atomic<std::size_t> next(0);
+  const auto work = [&]() {
+    for (std::size_t i = next++; i < count; i = next++)
+      fn(i);
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  for (std::size_t i = 1; i < threads; ++i)
+  {
+    try
+    {
+      workers.emplace_back(work);
+    }
+    catch (const std::system_error&)
+    {
+      break;
+    }
+  }
+
+  // The calling thread does its share of the work
+  work();
+  for (std::thread& worker : workers)
+    worker.join();
+}
+
+template <typename T, typename Load>
+inline std::vector<BatchResult<T>> loadAll(const std::vector<std::string>& files, const BatchOptions& options,
+                                           Load load)
+{
+  std::vector<BatchResult<T>> results(files.size());
+
+  // Start reading the first files before any worker needs them
+  const std::size_t window = std::min(options.prefetch, files.size());
+  for (std::size_t i = 0; i < window; ++i)
+    prefetchFile(files[i]);
+
+  parallelFor(files.size(), options, [&](const std::size_t i) {
+    if (options.prefetch > 0 && i + options.prefetch < files.size())
+      prefetchFile(files[i + options.prefetch]);
+
+    BatchResult<T>& result = results[i];
+    try
+    {
+      result.value = load(files[i]);
+      result.success = true;
+    }
+    catch (const std::exception& ex)
+    {
+      result.error = ex.what();
+    }
+    catch (...)
+    {
+      result.error = "Unknown error while loading '" + files[i] + "'";
+    }
+  });
+
+  return results;
+}
+
+template <typename T, typename Save>
+inline std::vector<BatchStatus> saveAll(const std::vector<std::pair<std::string, T>>& items,
+                                        const BatchOptions& options, Save save)
+{
+  std::vector<BatchStatus> results(items.size());
+
+  parallelFor(items.size(), options, [&](const std::size_t i) {
+    BatchStatus& result = results[i];
+    try
+    {
+      save(items[i].second, items[i].first);
+      result.success = true;
+    }
+    catch (const std::exception& ex)
+    {
+      result.error = ex.what();
+    }
+    catch (...)
+    {
+      result.error = "Unknown error while saving '" + items[i].first + "'";
+    }
+  });
+
+  return results;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Deserializes a set of YAML-formatted files in parallel
+ * @details Failures are reported per file rather than thrown
+ * @param files
+ * @param options
+ * @return One result per input file, in the same order
+ */
+template <typename T>
+inline std::vector<BatchResult<T>> deserializeAll(const std::vector<std::string>& files,
+                                                  const BatchOptions& options = BatchOptions())
+{
+  return detail::loadAll<T>(files, options, [](const std::string& file) { return deserialize<T>(file); });
+}
+
+/**
+ * @brief Serializes a set of objects to YAML-formatted files in parallel
+ * @details Failures are reported per file rather than thrown
+ * @param items Pairs of output file and object
+ * @param options
+ * @param yaml_options
+ * @return One status per input item, in the same order
+ */
+template <typename T>
+inline std::vector<BatchStatus> serializeAll(const std::vector<std::pair<std::string, T>>& items,
+                                             const BatchOptions& options = BatchOptions(),
+                                             const YamlOptions& yaml_options = YamlOptions())
+{
+  return detail::saveAll(items, options,
+                         [&yaml_options](const T& val, const std::string& file) { serialize(val, file, yaml_options); });
+}
+
+/**
+ * @brief Deserializes a set of binary files in parallel
+ * @details Failures are reported per file rather than thrown
+ * @param files
+ * @param options
+ * @return One result per input file, in the same order
+ */
+template <typename T>
+inline std::vector<BatchResult<T>> deserializeAllFromBinary(const std::vector<std::string>& files,
+                                                            const BatchOptions& options = BatchOptions())
+{
+  return detail::loadAll<T>(files, options,
+                            [](const std::string& file) { return deserializeFromBinary<T>(file); });
+}
+
+/**
+ * @brief Serializes a set of objects to binary files in parallel
+ * @details Failures are reported per file rather than thrown
+ * @param items Pairs of output file and object
+ * @param options
+ * @return One status per input item, in the same order
+ */
+template <typename T>
+inline std::vector<BatchStatus> serializeAllToBinary(const std::vector<std::pair<std::string, T>>& items,
+                                                     const BatchOptions& options = BatchOptions())
+{
+  return detail::saveAll(items, options,
+                         [](const T& val, const std::string& file) { serializeToBinary(val, file); });
+}
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_BATCH_H
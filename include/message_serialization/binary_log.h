@@ -0,0 +1,518 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_BINARY_LOG_H
+#define MESSAGE_SERIALIZATION_BINARY_LOG_H
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <message_serialization/binary_serialization.h>
+#include <ros/console.h>
+#include <ros/message_traits.h>
+#include <vector>
+
+/*
+ * Binary log layout
+ *
+ * A log is a file header followed by a sequence of records and, once the writer has been closed, a trailer:
+ *
+ *   file header:    8-byte magic
+ *   record header:  uint32 type | uint32 payload length | uint64 stamp (ns)
+ *   message record: record header (type MESSAGE) + ROS-serialized message
+ *   index record:   record header (type INDEX) + uint64 offset of the previous index record (or 0)
+ *                   + uint32 entry count + entry count * (uint64 stamp (ns), uint64 record offset)
+ *   trailer:        uint64 offset of the last index record | uint64 message count | 8-byte end magic
+ *
+ * Index records are written periodically and chained backwards, so a reader can load the index of a closed log by
+ * reading only the trailer and the index records. Logs that were not closed cleanly are recovered by scanning the
+ * record headers. All integers use the byte order of the host, as does the ROS serialization of the payloads.
+ */
+
+namespace message_serialization
+{
+namespace binary_log
+{
+const char FILE_MAGIC[8] = { 'M', 'S', 'L', 'O', 'G', '\0', '0', '1' };
+const char END_MAGIC[8] = { 'M', 'S', 'L', 'O', 'G', 'E', 'N', 'D' };
+
+const uint32_t MESSAGE_RECORD = 1;
+const uint32_t INDEX_RECORD = 2;
+
+const std::size_t RECORD_HEADER_SIZE = 16;
+const std::size_t INDEX_ENTRY_SIZE = 16;
+const std::size_t TRAILER_SIZE = 24;
+
+/**
+ * @brief Location of a message record within a log
+ */
+struct IndexEntry
+{
+  uint64_t stamp;
+  uint64_t offset;
+};
+
+template <typename T>
+inline void writeValue(char* dst, const T value)
+{
+  std::memcpy(dst, &value, sizeof(T));
+}
+
+template <typename T>
+inline T readValue(const char* src)
+{
+  T value;
+  std::memcpy(&value, src, sizeof(T));
+  return value;
+}
+
+}  // namespace binary_log
+
+/**
+ * @brief Writes a stream of ROS messages into a single indexed, append-only binary log file
+ * @details Each message is stored as a length-prefixed record containing its ROS serialization and a timestamp. The
+ * writer keeps the index entries of the most recent records in memory and flushes them to the file every
+ * @p index_interval messages, so memory use does not grow with the length of the recording.
+ */
+class BinaryLogWriter
+{
+public:
+  /**
+   * @brief Creates a new log, replacing any existing file
+   * @param file
+   * @param index_interval Number of messages between index records
+   * @throws on failure to open or write to the file
+   */
+  explicit BinaryLogWriter(const std::string& file, const std::size_t index_interval = 1024)
+    : file_(file), index_interval_(std::max<std::size_t>(index_interval, 1))
+  {
+    ofs_.open(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs_)
+      throw std::runtime_error("Failed to open binary log at '" + file + "'");
+
+    writeBytes(binary_log::FILE_MAGIC, sizeof(binary_log::FILE_MAGIC));
+    pending_.reserve(index_interval_);
+  }
+
+  BinaryLogWriter(const BinaryLogWriter&) = delete;
+  BinaryLogWriter& operator=(const BinaryLogWriter&) = delete;
+
+  ~BinaryLogWriter()
+  {
+    try
+    {
+      close();
+    }
+    catch (const std::exception& ex)
+    {
+      ROS_ERROR_STREAM("Failed to close binary log: " << ex.what());
+    }
+  }
+
+  /**
+   * @brief Appends a stamped message to the log, indexed by the stamp of its header
+   * @throws on failure to write to the file
+   */
+  template <typename T>
+  void write(const T& message)
+  {
+    static_assert(ros::message_traits::HasHeader<T>::value,
+                  "Messages without a header must be written with an explicit timestamp");
+    write(message, message.header.stamp);
+  }
+
+  /**
+   * @brief Appends a message to the log, indexed by the input timestamp
+   * @throws on failure to write to the file
+   */
+  template <typename T>
+  void write(const T& message, const ros::Time& stamp)
+  {
+    if (!ofs_.is_open())
+      throw std::runtime_error("Binary log at '" + file_ + "' has already been closed");
+
+    const uint32_t size = serializeToBuffer(buffer_, message);
+
+    const binary_log::IndexEntry entry = { stamp.toNSec(), offset_ };
+    writeRecordHeader(binary_log::MESSAGE_RECORD, size, entry.stamp);
+    writeBytes(reinterpret_cast<const char*>(buffer_.data()), size);
+
+    pending_.push_back(entry);
+    ++count_;
+
+    if (pending_.size() >= index_interval_)
+      writeIndex();
+  }
+
+  /**
+   * @brief Flushes buffered data to the operating system
+   * @details The log remains readable through recovery even if the writer is never closed
+   */
+  void flush()
+  {
+    ofs_.flush();
+    if (!ofs_.good())
+      throw std::runtime_error("Failed to flush binary log at '" + file_ + "'");
+  }
+
+  /**
+   * @brief Writes the final index record and the trailer and closes the file
+   * @details Closing an already closed writer has no effect
+   * @throws on failure to write to the file
+   */
+  void close()
+  {
+    if (!ofs_.is_open())
+      return;
+
+    if (!pending_.empty())
+      writeIndex();
+
+    char trailer[binary_log::TRAILER_SIZE];
+    binary_log::writeValue<uint64_t>(trailer, last_index_offset_);
+    binary_log::writeValue<uint64_t>(trailer + 8, count_);
+    std::memcpy(trailer + 16, binary_log::END_MAGIC, sizeof(binary_log::END_MAGIC));
+    writeBytes(trailer, sizeof(trailer));
+
+    ofs_.close();
+    if (ofs_.fail())
+      throw std::runtime_error("Failed to close binary log at '" + file_ + "'");
+  }
+
+  /**
+   * @brief Number of messages written so far
+   */
+  std::size_t size() const
+  {
+    return count_;
+  }
+
+private:
+  void writeBytes(const char* data, const std::size_t size)
+  {
+    ofs_.write(data, size);
+    if (!ofs_.good())
+      throw std::runtime_error("Failed to write to binary log at '" + file_ + "'");
+    offset_ += size;
+  }
+
+  void writeRecordHeader(const uint32_t type, const uint32_t size, const uint64_t stamp)
+  {
+    char header[binary_log::RECORD_HEADER_SIZE];
+    binary_log::writeValue<uint32_t>(header, type);
+    binary_log::writeValue<uint32_t>(header + 4, size);
+    binary_log::writeValue<uint64_t>(header + 8, stamp);
+    writeBytes(header, sizeof(header));
+  }
+
+  void writeIndex()
+  {
+    const uint32_t size = static_cast<uint32_t>(12 + pending_.size() * binary_log::INDEX_ENTRY_SIZE);
+    buffer_.resize(size);
+    char* data = reinterpret_cast<char*>(buffer_.data());
+    binary_log::writeValue<uint64_t>(data, last_index_offset_);
+    binary_log::writeValue<uint32_t>(data + 8, static_cast<uint32_t>(pending_.size()));
+    data += 12;
+    for (const binary_log::IndexEntry& entry : pending_)
+    {
+      binary_log::writeValue<uint64_t>(data, entry.stamp);
+      binary_log::writeValue<uint64_t>(data + 8, entry.offset);
+      data += binary_log::INDEX_ENTRY_SIZE;
+    }
+
+    const uint64_t index_offset = offset_;
+    writeRecordHeader(binary_log::INDEX_RECORD, size, pending_.front().stamp);
+    writeBytes(reinterpret_cast<const char*>(buffer_.data()), size);
+
+    last_index_offset_ = index_offset;
+    pending_.clear();
+  }
+
+  std::string file_;
+  std::ofstream ofs_;
+  std::size_t index_interval_;
+  SerializationBuffer buffer_;
+  std::vector<binary_log::IndexEntry> pending_;
+  uint64_t offset_ = 0;
+  uint64_t last_index_offset_ = 0;
+  uint64_t count_ = 0;
+};
+
+/**
+ * @brief Reads messages from a binary log written by @ref BinaryLogWriter
+ * @details Only the index is loaded into memory on construction; messages are read from the file on demand. Messages
+ * are presented in timestamp order (ties keep the order in which they were written), which for recordings with
+ * non-decreasing stamps is simply the order in which they were written.
+ */
+class BinaryLogReader
+{
+public:
+  /**
+   * @brief Opens a log and loads its index
+   * @details If the log was not closed cleanly, the index is rebuilt by scanning the record headers and any
+   * truncated record at the end of the file is ignored
+   * @param file
+   * @throws on failure to open the file or if it is not a binary log
+   */
+  explicit BinaryLogReader(const std::string& file) : file_(file)
+  {
+    ifs_.open(file, std::ios::in | std::ios::binary);
+    if (!ifs_)
+      throw std::runtime_error("Failed to open binary log at '" + file + "'");
+
+    ifs_.seekg(0, std::ios::end);
+    file_size_ = static_cast<uint64_t>(ifs_.tellg());
+    ifs_.seekg(0, std::ios::beg);
+
+    char magic[sizeof(binary_log::FILE_MAGIC)];
+    if (file_size_ < sizeof(magic) || !readBytes(0, magic, sizeof(magic)) ||
+        std::memcmp(magic, binary_log::FILE_MAGIC, sizeof(magic)) != 0)
+      throw std::runtime_error("File at '" + file + "' is not a binary log");
+
+    if (!loadIndex())
+      recoverIndex();
+
+    // Present the messages in timestamp order; recordings are usually already sorted, so check before sorting
+    const auto by_stamp = [](const binary_log::IndexEntry& lhs, const binary_log::IndexEntry& rhs) {
+      return lhs.stamp < rhs.stamp;
+    };
+    if (!std::is_sorted(entries_.begin(), entries_.end(), by_stamp))
+      std::stable_sort(entries_.begin(), entries_.end(), by_stamp);
+  }
+
+  /**
+   * @brief Number of messages in the log
+   */
+  std::size_t size() const
+  {
+    return entries_.size();
+  }
+
+  /**
+   * @brief Timestamp of the message at the input position
+   */
+  ros::Time stamp(const std::size_t position) const
+  {
+    ros::Time t;
+    t.fromNSec(entries_.at(position).stamp);
+    return t;
+  }
+
+  /**
+   * @brief Returns the position of the first message whose timestamp is not earlier than the input time, or
+   * @ref size if there is no such message
+   * @details Runs in O(log n) on the in-memory index
+   */
+  std::size_t lowerBound(const ros::Time& time) const
+  {
+    const uint64_t t = time.toNSec();
+    const auto it = std::lower_bound(entries_.begin(), entries_.end(), t,
+                                     [](const binary_log::IndexEntry& entry, const uint64_t value) {
+                                       return entry.stamp < value;
+                                     });
+    return static_cast<std::size_t>(it - entries_.begin());
+  }
+
+  /**
+   * @brief Moves the sequential read cursor to the first message whose timestamp is not earlier than the input time
+   * @return the new cursor position
+   */
+  std::size_t seek(const ros::Time& time)
+  {
+    cursor_ = lowerBound(time);
+    return cursor_;
+  }
+
+  /**
+   * @brief Moves the sequential read cursor to the input position
+   */
+  void seek(const std::size_t position)
+  {
+    cursor_ = std::min(position, entries_.size());
+  }
+
+  /**
+   * @brief Position of the message that will be returned by the next call to @ref next
+   */
+  std::size_t tell() const
+  {
+    return cursor_;
+  }
+
+  /**
+   * @brief Reads the message at the input position
+   * @throws if the position is out of range or the record cannot be read or de-serialized into the message type
+   */
+  template <typename T>
+  T read(const std::size_t position)
+  {
+    const binary_log::IndexEntry& entry = entries_.at(position);
+
+    char header[binary_log::RECORD_HEADER_SIZE];
+    if (!readBytes(entry.offset, header, sizeof(header)))
+      throw std::runtime_error("Failed to read record header from binary log at '" + file_ + "'");
+
+    // The header is checked before sizing the buffer, so that a corrupt length cannot cause a huge allocation
+    if (binary_log::readValue<uint32_t>(header) != binary_log::MESSAGE_RECORD)
+      throw std::runtime_error("Record at offset " + std::to_string(entry.offset) + " of binary log at '" + file_ +
+                               "' is not a message record");
+    const uint32_t size = binary_log::readValue<uint32_t>(header + 4);
+    if (size > file_size_ - entry.offset - sizeof(header))
+      throw std::runtime_error("Record at offset " + std::to_string(entry.offset) + " of binary log at '" + file_ +
+                               "' extends past the end of the file");
+    buffer_.resize(size);
+    if (!readBytes(entry.offset + sizeof(header), reinterpret_cast<char*>(buffer_.data()), size))
+      throw std::runtime_error("Failed to read record from binary log at '" + file_ + "'");
+
+    T message;
+    ros::serialization::IStream istream(buffer_.data(), size);
+    ros::serialization::deserialize(istream, message);
+    return message;
+  }
+
+  /**
+   * @brief Reads the message at the cursor and advances the cursor
+   * @param message (output)
+   * @return false if there are no more messages
+   * @throws if the record cannot be read or de-serialized into the message type
+   */
+  template <typename T>
+  bool next(T& message)
+  {
+    if (cursor_ >= entries_.size())
+      return false;
+
+    message = read<T>(cursor_);
+    ++cursor_;
+    return true;
+  }
+
+private:
+  bool readBytes(const uint64_t offset, char* data, const std::size_t size)
+  {
+    ifs_.clear();
+    ifs_.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    ifs_.read(data, size);
+    return static_cast<std::size_t>(ifs_.gcount()) == size;
+  }
+
+  /**
+   * @brief Loads the index of a cleanly closed log from its trailer and chain of index records
+   */
+  bool loadIndex()
+  {
+    if (file_size_ < sizeof(binary_log::FILE_MAGIC) + binary_log::TRAILER_SIZE)
+      return false;
+
+    char trailer[binary_log::TRAILER_SIZE];
+    if (!readBytes(file_size_ - sizeof(trailer), trailer, sizeof(trailer)) ||
+        std::memcmp(trailer + 16, binary_log::END_MAGIC, sizeof(binary_log::END_MAGIC)) != 0)
+      return false;
+
+    uint64_t index_offset = binary_log::readValue<uint64_t>(trailer);
+    const uint64_t count = binary_log::readValue<uint64_t>(trailer + 8);
+
+    // Index records are chained from last to first. Each one must precede the one pointing to it and lie within the
+    // records, so that a corrupt chain cannot loop
+    const uint64_t records_end = file_size_ - binary_log::TRAILER_SIZE;
+    uint64_t limit = records_end;
+    std::vector<std::vector<binary_log::IndexEntry> > chunks;
+    std::size_t total = 0;
+    std::vector<char> data;
+    while (index_offset != 0)
+    {
+      char header[binary_log::RECORD_HEADER_SIZE];
+      if (index_offset < sizeof(binary_log::FILE_MAGIC) || index_offset >= limit ||
+          records_end - index_offset < sizeof(header) || !readBytes(index_offset, header, sizeof(header)) ||
+          binary_log::readValue<uint32_t>(header) != binary_log::INDEX_RECORD)
+        return false;
+
+      const uint32_t size = binary_log::readValue<uint32_t>(header + 4);
+      if (size < 12 || size > records_end - index_offset - sizeof(header))
+        return false;
+      data.resize(size);
+      if (!readBytes(index_offset + sizeof(header), data.data(), data.size()))
+        return false;
+
+      const uint32_t n = binary_log::readValue<uint32_t>(data.data() + 8);
+      if (data.size() != 12 + n * binary_log::INDEX_ENTRY_SIZE)
+        return false;
+
+      std::vector<binary_log::IndexEntry> chunk(n);
+      for (uint32_t i = 0; i < n; ++i)
+      {
+        const char* entry = data.data() + 12 + i * binary_log::INDEX_ENTRY_SIZE;
+        chunk[i].stamp = binary_log::readValue<uint64_t>(entry);
+        chunk[i].offset = binary_log::readValue<uint64_t>(entry + 8);
+      }
+      total += n;
+      if (total > count)
+        return false;
+      chunks.push_back(std::move(chunk));
+
+      limit = index_offset;
+      index_offset = binary_log::readValue<uint64_t>(data.data());
+    }
+
+    if (total != count)
+      return false;
+
+    entries_.reserve(total);
+    for (auto it = chunks.rbegin(); it != chunks.rend(); ++it)
+      entries_.insert(entries_.end(), it->begin(), it->end());
+
+    return true;
+  }
+
+  /**
+   * @brief Rebuilds the index by walking the record headers from the start of the file
+   */
+  void recoverIndex()
+  {
+    entries_.clear();
+
+    uint64_t offset = sizeof(binary_log::FILE_MAGIC);
+    char header[binary_log::RECORD_HEADER_SIZE];
+    while (offset + sizeof(header) <= file_size_ && readBytes(offset, header, sizeof(header)))
+    {
+      const uint32_t type = binary_log::readValue<uint32_t>(header);
+      const uint64_t end = offset + sizeof(header) + binary_log::readValue<uint32_t>(header + 4);
+      if ((type != binary_log::MESSAGE_RECORD && type != binary_log::INDEX_RECORD) || end > file_size_)
+        break;
+
+      if (type == binary_log::MESSAGE_RECORD)
+      {
+        const binary_log::IndexEntry entry = { binary_log::readValue<uint64_t>(header + 8), offset };
+        entries_.push_back(entry);
+      }
+
+      offset = end;
+    }
+
+    ROS_WARN_STREAM("Binary log at '" << file_ << "' was not closed cleanly; recovered " << entries_.size()
+                                      << " messages");
+  }
+
+  std::string file_;
+  std::ifstream ifs_;
+  uint64_t file_size_ = 0;
+  std::vector<binary_log::IndexEntry> entries_;
+  std::size_t cursor_ = 0;
+  SerializationBuffer buffer_;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_BINARY_LOG_H
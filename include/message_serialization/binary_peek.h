@@ -0,0 +1,239 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_BINARY_PEEK_H
+#define MESSAGE_SERIALIZATION_BINARY_PEEK_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <message_serialization/binary_serialization.h>
+#include <message_serialization/compression.h>
+#include <message_serialization/serialization_buffer.h>
+#include <ros/serialization.h>
+#include <ros/console.h>
+#include <std_msgs/Header.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace message_serialization
+{
+/**
+ * @brief Decodes the leading fields of a binary file without reading or decoding the rest of the message
+ * @details ROS messages are serialized field by field in declaration order, so any leading fields of a message can be
+ * decoded from a prefix of its binary file; for example, the `std_msgs::Header` of a stamped message, followed by the
+ * length of its first array. Only a bounded prefix of the file is read (and decompressed, for compressed files). If the
+ * fields do not fit in it, the prefix is doubled and read again, up to the whole file:
+ *
+ *   BinaryPeek peek(file);
+ *   const std_msgs::Header header = peek.read<std_msgs::Header>();
+ *   const uint32_t poses = peek.read<uint32_t>();
+ */
+class BinaryPeek
+{
+public:
+  /**
+   * @brief Reads the first bytes of the serialized message in a binary file
+   * @param file
+   * @param max_bytes Size of the prefix read initially
+   * @param options Only the maximum decompressed size applies; the prefix never grows beyond it
+   * @throws on failure to open, read or decompress the file
+   */
+  explicit BinaryPeek(const std::string& file, const std::size_t max_bytes = 4096,
+                      const BinaryReadOptions& options = BinaryReadOptions())
+    : file_(file), options_(options), buffer_(SerializationBufferPool::threadLocal().acquire())
+  {
+    load(std::max<std::size_t>(max_bytes, 1));
+  }
+
+  /**
+   * @brief Decodes the next field of the message
+   * @throws if the message ends before the field does
+   */
+  template <typename T>
+  T read()
+  {
+    while (true)
+    {
+      try
+      {
+        T value;
+        ros::serialization::IStream istream(buffer_->data() + offset_, static_cast<uint32_t>(size_ - offset_));
+        ros::serialization::deserialize(istream, value);
+        offset_ = static_cast<std::size_t>(istream.getData() - buffer_->data());
+        return value;
+      }
+      catch (const ros::serialization::StreamOverrunException&)
+      {
+        if (complete_)
+          throw std::runtime_error("Binary file at '" + file_ + "' ends before the field being peeked");
+        load(2 * size_);
+      }
+    }
+  }
+
+  /**
+   * @brief Number of bytes of the serialized message that have been decoded so far
+   */
+  std::size_t offset() const
+  {
+    return offset_;
+  }
+
+  /**
+   * @brief Number of bytes of the serialized message currently held in memory
+   */
+  std::size_t prefixSize() const
+  {
+    return size_;
+  }
+
+private:
+  struct Descriptor
+  {
+    explicit Descriptor(const int descriptor) : fd(descriptor)
+    {
+    }
+
+    ~Descriptor()
+    {
+      if (fd >= 0)
+        ::close(fd);
+    }
+
+    const int fd;
+  };
+
+  /**
+   * @brief Reads up to `length` bytes at the input offset, returning the number of bytes read
+   */
+  std::size_t readAt(const int fd, uint8_t* data, const std::size_t length, const uint64_t offset) const
+  {
+    std::size_t total = 0;
+    while (total < length)
+    {
+      const ssize_t n = ::pread(fd, data + total, length - total, static_cast<off_t>(offset + total));
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw std::runtime_error("Failed to read binary file at '" + file_ + "': " + std::strerror(errno));
+      }
+      if (n == 0)
+        break;
+      total += static_cast<std::size_t>(n);
+    }
+    return total;
+  }
+
+  /**
+   * @brief Loads the first `limit` bytes of the serialized message, or all of it if it is shorter
+   */
+  void load(const std::size_t limit)
+  {
+    const Descriptor file(::open(file_.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.fd < 0)
+      throw std::runtime_error("Failed to open binary file at '" + file_ + "': " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(file.fd, &st) != 0)
+      throw std::runtime_error("Failed to stat binary file at '" + file_ + "': " + std::strerror(errno));
+    const uint64_t file_size = static_cast<uint64_t>(st.st_size);
+
+    unsigned char prefix[detail::CompressionHeader::SIZE];
+    const std::size_t prefix_size = readAt(file.fd, prefix, sizeof(prefix), 0);
+
+    detail::CompressionHeader header;
+    if (header.read(prefix, prefix_size))
+    {
+      detail::checkedDecompressedSize(header, options_, file_);
+      size_ = static_cast<std::size_t>(std::min<uint64_t>(limit, header.size));
+      complete_ = size_ == header.size;
+      buffer_->resize(size_);
+
+      // Read compressed data in pieces until enough has been decompressed
+      detail::Decompressor decompressor(header.compression, buffer_->data(), size_, true);
+      const std::size_t chunk_size =
+          std::min<std::size_t>(detail::COMPRESSION_CHUNK_SIZE / 4, std::max<std::size_t>(limit, 512));
+      std::vector<uint8_t> chunk(chunk_size);
+      uint64_t offset = detail::CompressionHeader::SIZE;
+      while (!decompressor.full())
+      {
+        const std::size_t n = readAt(file.fd, chunk.data(), chunk.size(), offset);
+        if (n == 0)
+          throw std::runtime_error("Compressed binary file at '" + file_ + "' is truncated");
+        decompressor.feed(chunk.data(), n);
+        offset += n;
+      }
+    }
+    else
+    {
+      size_ = static_cast<std::size_t>(std::min<uint64_t>(limit, file_size));
+      complete_ = size_ == file_size;
+      buffer_->resize(size_);
+      if (readAt(file.fd, buffer_->data(), size_, 0) != size_)
+        throw std::runtime_error("Failed to read binary file at '" + file_ + "'");
+    }
+
+    if (size_ > std::numeric_limits<uint32_t>::max())
+      throw std::runtime_error("Binary file at '" + file_ + "' is too large to peek into");
+  }
+
+  const std::string file_;
+  const BinaryReadOptions options_;
+  SerializationBufferPool::Lease buffer_;
+  std::size_t size_ = 0;
+  std::size_t offset_ = 0;
+  bool complete_ = false;
+};
+
+/**
+ * @brief Decodes the `std_msgs::Header` of a stamped message from a binary file, without decoding the rest of it
+ * @details Only valid for message types whose first field is a header, as is the case for ROS stamped types
+ * @param file
+ * @return
+ * @throws on failure to read the file or decode the header
+ */
+inline std_msgs::Header peekHeader(const std::string& file)
+{
+  return BinaryPeek(file, 256).read<std_msgs::Header>();
+}
+
+/**
+ * @brief Decodes the `std_msgs::Header` of a stamped message from a binary file, without decoding the rest of it
+ * @param file
+ * @param header (output)
+ * @return
+ */
+inline bool peekHeader(const std::string& file, std_msgs::Header& header) noexcept
+{
+  try
+  {
+    header = peekHeader(file);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM("Deserialization error: '" << ex.what() << "'");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_BINARY_PEEK_H
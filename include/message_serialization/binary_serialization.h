@@ -16,51 +16,89 @@
 #ifndef MESSAGE_SERIALIZATION_BINARY_SERIALIZATION_H
 #define MESSAGE_SERIALIZATION_BINARY_SERIALIZATION_H
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <message_serialization/compression.h>
+#include <message_serialization/mapped_file.h>
+#include <message_serialization/metrics.h>
+#include <message_serialization/output_file.h>
+#include <message_serialization/serialization_buffer.h>
 #include <ros/serialization.h>
 #include <ros/console.h>
 
 namespace message_serialization
 {
+/**
+ * @brief Serializes a ROS message into a reusable buffer
+ * @details The buffer only grows when the message is larger than its current capacity, so serializing messages of
+ * similar size into the same buffer does not allocate once it has reached a steady state
+ * @param buffer (output) Data buffer; its contents are replaced by the serialized message
+ * @param message ROS message to serialize
+ * @return number of bytes in the buffer
+ */
+template <typename T>
+inline uint32_t serializeToBuffer(SerializationBuffer& buffer, const T& message)
+{
+  const uint32_t serial_size = ros::serialization::serializationLength(message);
+  buffer.resize(serial_size);
+  ros::serialization::OStream stream(buffer.data(), serial_size);
+  ros::serialization::serialize(stream, message);
+  return serial_size;
+}
+
 /**
  * @brief Serializes a ROS message to a binary file
+ * @details With compression enabled, the file starts with a small header identifying the codec, which
+ * @ref deserializeFromBinary uses to decompress the file transparently
  * @param file
  * @param message ROS message to serialize
- * @throws on failure to open or write to a file stream
+ * @param options
+ * @param file_options Atomicity, sync policy and write strategy of the file
+ * @throws on failure to open or write to a file stream, or if the requested codec is not supported by this build
  */
 template<typename T>
-inline void serializeToBinary(const T& message, const std::string& file)
+inline void serializeToBinary(const T& message, const std::string& file,
+                              const BinaryWriteOptions& options = BinaryWriteOptions(),
+                              const FileWriteOptions& file_options = FileWriteOptions())
 {
-  uint32_t serial_size = ros::serialization::serializationLength(message);
-  boost::shared_array<uint8_t> buffer(new uint8_t[serial_size]);
-  ros::serialization::OStream stream(buffer.get(), serial_size);
-  ros::serialization::serialize(stream, message);
+  detail::checkCompressionAvailable(options.compression);
 
-  std::ofstream ofs(file, std::ios::out|std::ios::binary);
-  if(ofs)
-  {
-      ofs.write((char*) buffer.get(), serial_size);
-      if(!ofs.good())
-        throw std::runtime_error("Failed to write to binary file stream at '" + file + "'");
-  }
+  MESSAGE_SERIALIZATION_METRICS_CALL(metrics, T, SERIALIZE_BINARY);
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, ENCODE);
+  SerializationBufferPool::Lease buffer = SerializationBufferPool::threadLocal().acquire();
+  const uint32_t serial_size = serializeToBuffer(*buffer, message);
+  MESSAGE_SERIALIZATION_METRICS_BYTES(metrics, serial_size);
+
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
+  OutputFile output(file, file_options);
+  if (options.compression != Compression::NONE)
+    detail::writeCompressed(output.stream(), buffer->data(), serial_size, options);
+  else if (file_options.single_write)
+    output.write(buffer->data(), serial_size);
   else
-  {
-    throw std::runtime_error("Failed to open binary file stream at '" + file + "'");
-  }
+    output.stream().write((char*) buffer->data(), serial_size);
+  output.commit();
+  MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
 }
 
 /**
  * @brief Serializes a ROS message to a binary file
  * @param file
  * @param message ROS message to serialize
+ * @param options
+ * @param file_options
  * @return
  */
 template<typename T>
-inline bool serializeToBinary(const std::string& file, const T& message) noexcept
+inline bool serializeToBinary(const std::string& file, const T& message,
+                              const BinaryWriteOptions& options = BinaryWriteOptions(),
+                              const FileWriteOptions& file_options = FileWriteOptions()) noexcept
 {
   try
   {
-    serializeToBinary<T>(message, file);
+    serializeToBinary<T>(message, file, options, file_options);
   }
   catch (const std::exception& ex)
   {
@@ -71,16 +109,117 @@ inline bool serializeToBinary(const std::string& file, const T& message) noexcep
   return true;
 }
 
+/**
+ * @brief Options controlling how binary files are read
+ */
+struct BinaryReadOptions
+{
+  /**
+   * @brief Files of at least this many bytes are memory-mapped and decoded in place rather than copied into a buffer
+   * @details Set to zero to always map files, or to the maximum value of std::size_t to never map them
+   */
+  std::size_t mmap_threshold = 4 * 1024 * 1024;
+
+  /**
+   * @brief Largest decompressed message size accepted from the header of a compressed file
+   * @details The buffer for the message is allocated at the size stated by the header before any data is decompressed,
+   * so this bounds the memory that a corrupt or malicious file can make the reader allocate
+   */
+  uint64_t max_decompressed_size = uint64_t(1) << 30;
+};
+
+namespace detail
+{
+inline uint32_t checkedMessageSize(const uint64_t size, const std::string& file)
+{
+  if (size > std::numeric_limits<uint32_t>::max())
+    throw std::runtime_error("Binary file at '" + file + "' is too large to de-serialize");
+  return static_cast<uint32_t>(size);
+}
+
+/**
+ * @brief Validates the decompressed size stated by the header of a compressed file
+ * @throws if it exceeds the configured maximum or the maximum size of a ROS message
+ */
+inline uint32_t checkedDecompressedSize(const CompressionHeader& header, const BinaryReadOptions& options,
+                                        const std::string& file)
+{
+  if (header.size > options.max_decompressed_size)
+    throw std::runtime_error("Compressed binary file at '" + file + "' states a decompressed size of " +
+                             std::to_string(header.size) + " bytes, more than the maximum of " +
+                             std::to_string(options.max_decompressed_size));
+  return checkedMessageSize(header.size, file);
+}
+
+}  // namespace detail
+
+/**
+ * @brief De-serializes a binary file into a ROS message by decoding directly from a read-only memory mapping of it
+ * @details This avoids holding a second copy of the file contents in memory, which matters for very large messages.
+ * Compressed files are decompressed from the mapping straight into a reusable buffer
+ * @param file
+ * @param options Only the maximum decompressed size applies
+ * @return
+ * @throws on failure to map or decode the file
+ */
+template <typename T>
+inline T deserializeFromMappedBinary(const std::string& file, const BinaryReadOptions& options = BinaryReadOptions())
+{
+  MESSAGE_SERIALIZATION_METRICS_CALL(metrics, T, DESERIALIZE_BINARY);
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
+  const MappedFile mapping(file);
+  MESSAGE_SERIALIZATION_METRICS_BYTES(metrics, mapping.size());
+
+  detail::CompressionHeader header;
+  if (header.read(mapping.data(), mapping.size()))
+  {
+    const uint32_t size = detail::checkedDecompressedSize(header, options, file);
+    SerializationBufferPool::Lease buffer = SerializationBufferPool::threadLocal().acquire();
+    buffer->resize(size);
+
+    detail::Decompressor decompressor(header.compression, buffer->data(), size);
+    decompressor.feed(mapping.data() + detail::CompressionHeader::SIZE,
+                      mapping.size() - detail::CompressionHeader::SIZE);
+    decompressor.finish();
+
+    MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, DECODE);
+    T message;
+    ros::serialization::IStream istream(buffer->data(), size);
+    ros::serialization::deserialize(istream, message);
+    MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
+    return message;
+  }
+
+  // The input stream only reads from the buffer, so the read-only mapping is never written through
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, DECODE);
+  T message;
+  ros::serialization::IStream istream(const_cast<uint8_t*>(mapping.data()),
+                                      detail::checkedMessageSize(mapping.size(), file));
+  ros::serialization::deserialize(istream, message);
+
+  MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
+  return message;
+}
+
 /**
  * @brief De-serializes a binary file into a ROS message
+ * @details Files larger than the configured threshold are decoded from a memory mapping (see
+ * @ref deserializeFromMappedBinary); smaller files are read into a reusable buffer. Compressed files are detected
+ * from their header and decompressed as they are read, without first reading the whole compressed file into memory
  * @param file
- * @param message (output) ROS message
+ * @param options
  * @return
- * @throws on failure to open or read a file stream
+ * @throws on failure to open or read a file stream, or to decompress it
  */
 template <typename T>
-inline T deserializeFromBinary(const std::string& file)
+inline T deserializeFromBinary(const std::string& file, const BinaryReadOptions& options = BinaryReadOptions())
 {
+  struct stat st;
+  if (::stat(file.c_str(), &st) == 0 && static_cast<std::size_t>(st.st_size) >= options.mmap_threshold)
+    return deserializeFromMappedBinary<T>(file, options);
+
+  MESSAGE_SERIALIZATION_METRICS_CALL(metrics, T, DESERIALIZE_BINARY);
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
   std::ifstream ifs(file, std::ios::in | std::ios::binary);
   if (!ifs)
     throw std::runtime_error("Failed to open binary file stream at '" + file + "'");
@@ -89,17 +228,49 @@ inline T deserializeFromBinary(const std::string& file)
   std::streampos end = ifs.tellg();
   ifs.seekg(0, std::ios::beg);
   std::streampos begin = ifs.tellg();
-  uint32_t file_size = end - begin;
+  const uint64_t file_size = end - begin;
+  MESSAGE_SERIALIZATION_METRICS_BYTES(metrics, file_size);
+
+  SerializationBufferPool::Lease ibuffer = SerializationBufferPool::threadLocal().acquire();
 
-  boost::shared_array<uint8_t> ibuffer(new uint8_t[file_size]);
-  ifs.read((char*)ibuffer.get(), file_size);
+  // Read what could be a compression header first; for raw files it is the start of the message
+  unsigned char prefix[detail::CompressionHeader::SIZE];
+  const std::size_t prefix_size = static_cast<std::size_t>(std::min<uint64_t>(file_size, sizeof(prefix)));
+  ifs.read((char*)prefix, prefix_size);
+
+  detail::CompressionHeader header;
+  uint32_t size;
+  if (header.read(prefix, prefix_size))
+  {
+    size = detail::checkedDecompressedSize(header, options, file);
+    ibuffer->resize(size);
+
+    detail::Decompressor decompressor(header.compression, ibuffer->data(), size);
+    uint8_t chunk[detail::COMPRESSION_CHUNK_SIZE / 4];
+    while (ifs)
+    {
+      ifs.read((char*)chunk, sizeof(chunk));
+      decompressor.feed(chunk, static_cast<std::size_t>(ifs.gcount()));
+    }
+    decompressor.finish();
+  }
+  else
+  {
+    size = detail::checkedMessageSize(file_size, file);
+    ibuffer->resize(size);
+    if (prefix_size > 0)
+      std::memcpy(ibuffer->data(), prefix, prefix_size);
+    ifs.read((char*)ibuffer->data() + prefix_size, size - prefix_size);
+  }
 
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, DECODE);
   T message;
-  ros::serialization::IStream istream(ibuffer.get(), file_size);
+  ros::serialization::IStream istream(ibuffer->data(), size);
   ros::serialization::deserialize(istream, message);
 
   ifs.close();
 
+  MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
   return message;
 }
 
@@ -107,14 +278,16 @@ inline T deserializeFromBinary(const std::string& file)
  * @brief De-serializes a binary file into a ROS message
  * @param file
  * @param message (output) ROS message
+ * @param options
  * @return
  */
 template<typename T>
-inline bool deserializeFromBinary(const std::string& file, T& message) noexcept
+inline bool deserializeFromBinary(const std::string& file, T& message,
+                                  const BinaryReadOptions& options = BinaryReadOptions()) noexcept
 {
   try
   {
-    message = deserializeFromBinary<T>(file);
+    message = deserializeFromBinary<T>(file, options);
   }
   catch (const std::exception &ex)
   {
@@ -170,7 +343,7 @@ inline bool deserializeFromBuffer(uint8_t* const buffer, const uint32_t size, T&
 {
   try
   {
-    message = deserializeFromBinary<T>(buffer, size);
+    message = deserializeFromBuffer<T>(buffer, size);
   }
   catch (const std::exception& ex)
   {
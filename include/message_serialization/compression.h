@@ -0,0 +1,443 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_COMPRESSION_H
+#define MESSAGE_SERIALIZATION_COMPRESSION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The frame APIs used below need LZ4 1.8 and Zstandard 1.4, which the CMake configuration checks for
+#ifdef MESSAGE_SERIALIZATION_WITH_LZ4
+#include <lz4.h>
+#include <lz4frame.h>
+#if LZ4_VERSION_NUMBER < 10800
+#error "MESSAGE_SERIALIZATION_WITH_LZ4 requires LZ4 1.8.0 or newer"
+#endif
+#endif
+#ifdef MESSAGE_SERIALIZATION_WITH_ZSTD
+#include <zstd.h>
+#if ZSTD_VERSION_NUMBER < 10400
+#error "MESSAGE_SERIALIZATION_WITH_ZSTD requires Zstandard 1.4.0 or newer"
+#endif
+#endif
+
+namespace message_serialization
+{
+/**
+ * @brief Compression codec of a binary file
+ * @details Codec support is compiled in when MESSAGE_SERIALIZATION_WITH_LZ4 or MESSAGE_SERIALIZATION_WITH_ZSTD is
+ * defined, which the CMake configuration of this package does when it finds the corresponding library
+ */
+enum class Compression : uint32_t
+{
+  NONE = 0,
+  /** @brief LZ4 frames: fast to compress and very fast to decompress */
+  LZ4 = 1,
+  /** @brief Zstandard frames: better ratio than LZ4 at a higher compression cost */
+  ZSTD = 2
+};
+
+/**
+ * @brief Options controlling how binary files are written
+ */
+struct BinaryWriteOptions
+{
+  Compression compression = Compression::NONE;
+
+  /**
+   * @brief Codec-specific compression level; zero selects the default level of the codec
+   */
+  int level = 0;
+};
+
+/**
+ * @brief Returns true if this build can write and read files compressed with the given codec
+ */
+inline bool isCompressionAvailable(const Compression compression)
+{
+  switch (compression)
+  {
+    case Compression::NONE:
+      return true;
+#ifdef MESSAGE_SERIALIZATION_WITH_LZ4
+    case Compression::LZ4:
+      return true;
+#endif
+#ifdef MESSAGE_SERIALIZATION_WITH_ZSTD
+    case Compression::ZSTD:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+namespace detail
+{
+/**
+ * @brief Header of a compressed binary file
+ * @details The header is followed by a single frame of the codec holding the serialized message. All fields are
+ * little-endian:
+ *   - 8 bytes: magic, chosen so that it cannot be mistaken for text and is unlikely to start a raw message
+ *   - 4 bytes: codec (see @ref Compression)
+ *   - 4 bytes: reserved, zero
+ *   - 8 bytes: size of the serialized message once decompressed
+ */
+struct CompressionHeader
+{
+  static const std::size_t SIZE = 24;
+
+  static const char* magic()
+  {
+    return "\x89MSGZ\r\n\x1a";
+  }
+
+  Compression compression = Compression::NONE;
+  uint64_t size = 0;
+
+  void write(unsigned char* bytes) const
+  {
+    std::memcpy(bytes, magic(), 8);
+    const uint32_t codec = static_cast<uint32_t>(compression);
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+      bytes[8 + i] = static_cast<unsigned char>(codec >> (8 * i));
+      bytes[12 + i] = 0;
+    }
+    for (std::size_t i = 0; i < 8; ++i)
+      bytes[16 + i] = static_cast<unsigned char>(size >> (8 * i));
+  }
+
+  /**
+   * @brief Reads a header from the start of a file
+   * @return false if the data does not start with a compression header, in which case it holds a raw message
+   */
+  bool read(const unsigned char* bytes, const std::size_t length)
+  {
+    if (length < SIZE || std::memcmp(bytes, magic(), 8) != 0)
+      return false;
+
+    uint32_t codec = 0;
+    for (std::size_t i = 0; i < 4; ++i)
+      codec |= static_cast<uint32_t>(bytes[8 + i]) << (8 * i);
+    size = 0;
+    for (std::size_t i = 0; i < 8; ++i)
+      size |= static_cast<uint64_t>(bytes[16 + i]) << (8 * i);
+    compression = static_cast<Compression>(codec);
+    return true;
+  }
+};
+
+inline const char* compressionName(const Compression compression)
+{
+  switch (compression)
+  {
+    case Compression::NONE:
+      return "none";
+    case Compression::LZ4:
+      return "LZ4";
+    case Compression::ZSTD:
+      return "Zstd";
+    default:
+      return "unknown";
+  }
+}
+
+inline void checkCompressionAvailable(const Compression compression)
+{
+  if (!isCompressionAvailable(compression))
+    throw std::runtime_error(std::string("Compression codec '") + compressionName(compression) +
+                             "' is not supported by this build");
+}
+
+/**
+ * @brief Amount of uncompressed data handed to the codec at a time, which bounds the size of the staging buffer
+ */
+static const std::size_t COMPRESSION_CHUNK_SIZE = 64 * 1024;
+
+#ifdef MESSAGE_SERIALIZATION_WITH_LZ4
+inline std::size_t checkLz4(const std::size_t code)
+{
+  if (LZ4F_isError(code))
+    throw std::runtime_error(std::string("LZ4 error: ") + LZ4F_getErrorName(code));
+  return code;
+}
+
+struct Lz4CompressionContextDeleter
+{
+  void operator()(LZ4F_cctx* ctx) const
+  {
+    LZ4F_freeCompressionContext(ctx);
+  }
+};
+
+struct Lz4DecompressionContextDeleter
+{
+  void operator()(LZ4F_dctx* ctx) const
+  {
+    LZ4F_freeDecompressionContext(ctx);
+  }
+};
+#endif
+
+#ifdef MESSAGE_SERIALIZATION_WITH_ZSTD
+inline std::size_t checkZstd(const std::size_t code)
+{
+  if (ZSTD_isError(code))
+    throw std::runtime_error(std::string("Zstd error: ") + ZSTD_getErrorName(code));
+  return code;
+}
+
+struct ZstdCompressionContextDeleter
+{
+  void operator()(ZSTD_CCtx* ctx) const
+  {
+    ZSTD_freeCCtx(ctx);
+  }
+};
+
+struct ZstdDecompressionContextDeleter
+{
+  void operator()(ZSTD_DCtx* ctx) const
+  {
+    ZSTD_freeDCtx(ctx);
+  }
+};
+#endif
+
+/**
+ * @brief Writes a compression header followed by the compressed data to a stream
+ * @details The data is compressed in chunks, so only a chunk-sized staging buffer is held in addition to the input
+ * @throws on codec or stream failure
+ */
+inline void writeCompressed(std::ostream& os, const uint8_t* data, const std::size_t size,
+                            const BinaryWriteOptions& options)
+{
+  (void)data;  // Unused when no codec is compiled in
+  checkCompressionAvailable(options.compression);
+
+  CompressionHeader header;
+  header.compression = options.compression;
+  header.size = size;
+  unsigned char header_bytes[CompressionHeader::SIZE];
+  header.write(header_bytes);
+  os.write(reinterpret_cast<const char*>(header_bytes), CompressionHeader::SIZE);
+
+  std::vector<char> staging;
+  switch (options.compression)
+  {
+#ifdef MESSAGE_SERIALIZATION_WITH_LZ4
+    case Compression::LZ4:
+    {
+      LZ4F_cctx* raw_ctx = nullptr;
+      checkLz4(LZ4F_createCompressionContext(&raw_ctx, LZ4F_VERSION));
+      std::unique_ptr<LZ4F_cctx, Lz4CompressionContextDeleter> ctx(raw_ctx);
+
+      LZ4F_preferences_t preferences;
+      std::memset(&preferences, 0, sizeof(preferences));
+      preferences.compressionLevel = options.level;
+      preferences.frameInfo.contentSize = size;
+
+      staging.resize(std::max<std::size_t>(LZ4F_compressBound(COMPRESSION_CHUNK_SIZE, &preferences),
+                                           LZ4F_HEADER_SIZE_MAX));
+      std::size_t written = checkLz4(LZ4F_compressBegin(ctx.get(), staging.data(), staging.size(), &preferences));
+      os.write(staging.data(), written);
+
+      for (std::size_t offset = 0; offset < size; offset += COMPRESSION_CHUNK_SIZE)
+      {
+        const std::size_t chunk = std::min(COMPRESSION_CHUNK_SIZE, size - offset);
+        written =
+            checkLz4(LZ4F_compressUpdate(ctx.get(), staging.data(), staging.size(), data + offset, chunk, nullptr));
+        os.write(staging.data(), written);
+      }
+
+      written = checkLz4(LZ4F_compressEnd(ctx.get(), staging.data(), staging.size(), nullptr));
+      os.write(staging.data(), written);
+      break;
+    }
+#endif
+#ifdef MESSAGE_SERIALIZATION_WITH_ZSTD
+    case Compression::ZSTD:
+    {
+      std::unique_ptr<ZSTD_CCtx, ZstdCompressionContextDeleter> ctx(ZSTD_createCCtx());
+      if (!ctx)
+        throw std::runtime_error("Failed to create Zstd compression context");
+      checkZstd(ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_compressionLevel, options.level));
+      checkZstd(ZSTD_CCtx_setPledgedSrcSize(ctx.get(), size));
+
+      staging.resize(ZSTD_CStreamOutSize());
+      ZSTD_inBuffer input = { data, size, 0 };
+      std::size_t remaining;
+      do
+      {
+        ZSTD_outBuffer output = { staging.data(), staging.size(), 0 };
+        remaining = checkZstd(ZSTD_compressStream2(ctx.get(), &output, &input, ZSTD_e_end));
+        os.write(staging.data(), output.pos);
+      } while (remaining != 0);
+      break;
+    }
+#endif
+    default:
+      throw std::runtime_error("Unsupported compression codec");
+  }
+}
+
+/**
+ * @brief Decompresses a single frame, fed in arbitrary pieces, into a caller-provided buffer of the expected size
+ * @details A partial decompressor only fills the buffer with the leading part of the data and ignores the rest
+ */
+class Decompressor
+{
+public:
+  /**
+   * @param compression
+   * @param output Destination buffer
+   * @param size Size of the destination buffer, which must match the decompressed size exactly unless partial
+   * @param partial Stop once the buffer is full instead of treating further data as an error
+   * @throws if the codec is not supported by this build
+   */
+  Decompressor(const Compression compression, uint8_t* output, const std::size_t size, const bool partial = false)
+    : compression_(compression), output_(output), size_(size), partial_(partial)
+  {
+    checkCompressionAvailable(compression);
+    switch (compression)
+    {
+#ifdef MESSAGE_SERIALIZATION_WITH_LZ4
+      case Compression::LZ4:
+      {
+        LZ4F_dctx* raw_ctx = nullptr;
+        checkLz4(LZ4F_createDecompressionContext(&raw_ctx, LZ4F_VERSION));
+        lz4_.reset(raw_ctx);
+        break;
+      }
+#endif
+#ifdef MESSAGE_SERIALIZATION_WITH_ZSTD
+      case Compression::ZSTD:
+        zstd_.reset(ZSTD_createDCtx());
+        if (!zstd_)
+          throw std::runtime_error("Failed to create Zstd decompression context");
+        break;
+#endif
+      default:
+        throw std::runtime_error("Unsupported compression codec");
+    }
+  }
+
+  /**
+   * @brief Decompresses the next piece of the frame
+   * @throws if the data is corrupt or, unless partial, decompresses to more than the expected size
+   */
+  void feed(const uint8_t* data, const std::size_t size)
+  {
+    // Unused when no codec is compiled in
+    (void)data;
+    (void)size;
+    switch (compression_)
+    {
+#ifdef MESSAGE_SERIALIZATION_WITH_LZ4
+      case Compression::LZ4:
+      {
+        std::size_t consumed = 0;
+        while (consumed < size)
+        {
+          std::size_t out_size = size_ - position_;
+          std::size_t in_size = size - consumed;
+          const std::size_t hint = checkLz4(
+              LZ4F_decompress(lz4_.get(), output_ + position_, &out_size, data + consumed, &in_size, nullptr));
+          position_ += out_size;
+          consumed += in_size;
+          finished_ = hint == 0;
+          if (in_size == 0 && out_size == 0)
+          {
+            if (partial_)
+              return;
+            throw std::runtime_error("Compressed data is larger than its header states");
+          }
+        }
+        break;
+      }
+#endif
+#ifdef MESSAGE_SERIALIZATION_WITH_ZSTD
+      case Compression::ZSTD:
+      {
+        ZSTD_inBuffer input = { data, size, 0 };
+        while (input.pos < input.size)
+        {
+          ZSTD_outBuffer output = { output_, size_, position_ };
+          const std::size_t before = input.pos;
+          const std::size_t hint = checkZstd(ZSTD_decompressStream(zstd_.get(), &output, &input));
+          const bool progress = input.pos != before || output.pos != position_;
+          position_ = output.pos;
+          finished_ = hint == 0;
+          if (!progress)
+          {
+            if (partial_)
+              return;
+            throw std::runtime_error("Compressed data is larger than its header states");
+          }
+        }
+        break;
+      }
+#endif
+      default:
+        throw std::runtime_error("Unsupported compression codec");
+    }
+  }
+
+  /**
+   * @brief Returns true once the destination buffer has been filled
+   */
+  bool full() const
+  {
+    return position_ == size_;
+  }
+
+  /**
+   * @brief Verifies that a complete frame of exactly the expected size was decompressed
+   * @throws otherwise
+   */
+  void finish() const
+  {
+    if (!finished_ || position_ != size_)
+      throw std::runtime_error("Compressed data is truncated or does not match its header");
+  }
+
+private:
+  const Compression compression_;
+  uint8_t* const output_;
+  const std::size_t size_;
+  const bool partial_;
+  std::size_t position_ = 0;
+  bool finished_ = false;
+
+#ifdef MESSAGE_SERIALIZATION_WITH_LZ4
+  std::unique_ptr<LZ4F_dctx, Lz4DecompressionContextDeleter> lz4_;
+#endif
+#ifdef MESSAGE_SERIALIZATION_WITH_ZSTD
+  std::unique_ptr<ZSTD_DCtx, ZstdDecompressionContextDeleter> zstd_;
+#endif
+};
+
+}  // namespace detail
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_COMPRESSION_H
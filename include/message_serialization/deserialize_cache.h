@@ -0,0 +1,373 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_DESERIALIZE_CACHE_H
+#define MESSAGE_SERIALIZATION_DESERIALIZE_CACHE_H
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <message_serialization/binary_serialization.h>
+#include <message_serialization/serialize.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace message_serialization
+{
+/**
+ * @brief Limits and validation policy of a @ref DeserializeCache
+ */
+struct DeserializeCacheOptions
+{
+  /**
+   * @brief Maximum total size of the cached objects, approximated by the size of the files they were loaded from;
+   * the least recently used objects are evicted beyond it. A file larger than this limit is never cached
+   */
+  std::size_t max_bytes = 64 * 1024 * 1024;
+
+  /**
+   * @brief Maximum number of cached objects
+   */
+  std::size_t max_entries = 1024;
+
+  /**
+   * @brief Also compares a hash of the file contents before returning a cached object
+   * @details By default, a file is considered unchanged if its device, inode, size and modification time are. This
+   * misses rewrites that keep the size within the timestamp granularity of the file system; hashing the contents
+   * detects them, at the cost of reading the file (but still not parsing it)
+   */
+  bool verify_content = false;
+};
+
+/**
+ * @brief Counters of a @ref DeserializeCache
+ */
+struct DeserializeCacheStats
+{
+  /** @brief Loads served from the cache */
+  uint64_t hits = 0;
+  /** @brief Loads that decoded the file, including those of files that changed since they were cached */
+  uint64_t misses = 0;
+  /** @brief Objects dropped to stay within the limits */
+  uint64_t evictions = 0;
+  /** @brief Number of cached objects */
+  std::size_t entries = 0;
+  /** @brief Total size of the files of the cached objects */
+  std::size_t bytes = 0;
+};
+
+/**
+ * @brief Memoizes the objects decoded from files, so that loading an unchanged file again costs a stat() instead of a
+ * parse
+ * @details Objects are shared as `std::shared_ptr<const T>`, so callers must copy them to modify them. Objects are
+ * cached per file, format and type; the same file loaded as different types is decoded once for each. The cache is
+ * thread-safe; files are decoded outside of its lock, so a slow load does not block hits on other files. Use
+ * @ref global for a process-wide instance or construct private instances with their own limits.
+ */
+class DeserializeCache
+{
+public:
+  explicit DeserializeCache(const DeserializeCacheOptions& options = DeserializeCacheOptions()) : options_(options)
+  {
+  }
+
+  /**
+   * @brief Process-wide cache used by @ref deserializeCached and @ref deserializeFromBinaryCached
+   */
+  static DeserializeCache& global()
+  {
+    static DeserializeCache cache;
+    return cache;
+  }
+
+  /**
+   * @brief Loads a YAML file through @ref message_serialization::deserialize, or returns the object cached for it
+   * @throws exception when unable to load the file or convert it to the specified type
+   */
+  template <class T>
+  std::shared_ptr<const T> deserialize(const std::string& file)
+  {
+    return load<T>(file, 'y', [](const std::string& f) { return message_serialization::deserialize<T>(f); });
+  }
+
+  /**
+   * @brief Loads a binary file through @ref message_serialization::deserializeFromBinary, or returns the object cached
+   * for it
+   * @throws exception when unable to load the file or decode the message
+   */
+  template <class T>
+  std::shared_ptr<const T> deserializeFromBinary(const std::string& file)
+  {
+    return load<T>(file, 'b', [](const std::string& f) { return message_serialization::deserializeFromBinary<T>(f); });
+  }
+
+  /**
+   * @brief Drops the objects cached for a file, in any format and as any type
+   */
+  void invalidate(const std::string& file)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = lru_.begin(); it != lru_.end();)
+      it = it->file == file ? erase(it) : std::next(it);
+  }
+
+  /**
+   * @brief Drops all cached objects; the counters are kept
+   */
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+    bytes_ = 0;
+  }
+
+  DeserializeCacheStats stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DeserializeCacheStats stats = stats_;
+    stats.entries = lru_.size();
+    stats.bytes = bytes_;
+    return stats;
+  }
+
+  DeserializeCacheOptions options() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return options_;
+  }
+
+  /**
+   * @brief Changes the limits and validation policy, evicting objects as needed to satisfy the new limits
+   */
+  void setOptions(const DeserializeCacheOptions& options)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+    evict();
+  }
+
+private:
+  /**
+   * @brief Identity of a version of a file
+   */
+  struct Version
+  {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    int64_t mtime_ns;
+    uint64_t hash;
+
+    bool operator==(const Version& rhs) const
+    {
+      return device == rhs.device && inode == rhs.inode && size == rhs.size && mtime_ns == rhs.mtime_ns &&
+             hash == rhs.hash;
+    }
+  };
+
+  struct Entry
+  {
+    std::string key;
+    std::string file;
+    Version version;
+    std::shared_ptr<const void> object;
+  };
+
+  typedef std::list<Entry>::iterator Iterator;
+
+  /**
+   * @brief 64-bit FNV-1a hash of the contents of a file
+   */
+  static uint64_t hashFile(const std::string& file)
+  {
+    std::ifstream ifs(file, std::ios::in | std::ios::binary);
+    if (!ifs)
+      throw std::runtime_error("Failed to open file at '" + file + "'");
+
+    uint64_t hash = 14695981039346656037ull;
+    char chunk[64 * 1024];
+    while (ifs)
+    {
+      ifs.read(chunk, sizeof(chunk));
+      const std::streamsize n = ifs.gcount();
+      for (std::streamsize i = 0; i < n; ++i)
+        hash = (hash ^ static_cast<unsigned char>(chunk[i])) * 1099511628211ull;
+    }
+    return hash;
+  }
+
+  static Version version(const std::string& file, const bool hash)
+  {
+    struct stat st;
+    if (::stat(file.c_str(), &st) != 0)
+      throw std::runtime_error("Failed to stat file at '" + file + "': " + std::strerror(errno));
+
+    Version v;
+    v.device = st.st_dev;
+    v.inode = st.st_ino;
+    v.size = st.st_size;
+    v.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    v.hash = hash ? hashFile(file) : 0;
+    return v;
+  }
+
+  template <class T, typename Loader>
+  std::shared_ptr<const T> load(const std::string& file, const char format, Loader loader)
+  {
+    const std::string key = file + '\0' + format + typeid(T).name();
+    bool hash;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      hash = options_.verify_content;
+    }
+    const Version before = version(file, hash);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = index_.find(key);
+      if (it != index_.end() && it->second->version == before)
+      {
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return std::static_pointer_cast<const T>(it->second->object);
+      }
+      ++stats_.misses;
+    }
+
+    const std::shared_ptr<const T> object = std::make_shared<T>(loader(file));
+
+    // Only cache the object if the file did not change while it was being decoded
+    if (version(file, hash) == before)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = index_.find(key);
+      if (it != index_.end())
+        erase(it->second);
+
+      if (static_cast<std::size_t>(before.size) <= options_.max_bytes && options_.max_entries > 0)
+      {
+        Entry entry = { key, file, before, object };
+        lru_.push_front(entry);
+        index_[key] = lru_.begin();
+        bytes_ += static_cast<std::size_t>(before.size);
+        evict();
+      }
+    }
+    return object;
+  }
+
+  Iterator erase(const Iterator it)
+  {
+    bytes_ -= static_cast<std::size_t>(it->version.size);
+    index_.erase(it->key);
+    return lru_.erase(it);
+  }
+
+  /**
+   * @brief Drops the least recently used objects until the limits are satisfied
+   */
+  void evict()
+  {
+    while (!lru_.empty() && (bytes_ > options_.max_bytes || lru_.size() > options_.max_entries))
+    {
+      erase(std::prev(lru_.end()));
+      ++stats_.evictions;
+    }
+  }
+
+  mutable std::mutex mutex_;
+  DeserializeCacheOptions options_;
+  std::list<Entry> lru_;
+  std::unordered_map<std::string, Iterator> index_;
+  std::size_t bytes_ = 0;
+  DeserializeCacheStats stats_;
+};
+
+/**
+ * @brief Deserializes a YAML-formatted file through the process-wide @ref DeserializeCache
+ * @details Repeated loads of an unchanged file return the same object without parsing the file again
+ * @param file
+ * @return
+ * @throws exception when unable to load the file or convert it to the specified type
+ */
+template <class T>
+inline std::shared_ptr<const T> deserializeCached(const std::string& file)
+{
+  return DeserializeCache::global().deserialize<T>(file);
+}
+
+/**
+ * @brief Deserializes a YAML-formatted file through the process-wide @ref DeserializeCache
+ * @param file
+ * @param val (output)
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool deserializeCached(const std::string& file, std::shared_ptr<const T>& val) noexcept
+{
+  try
+  {
+    val = deserializeCached<T>(file);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM("Deserialization error: " << ex.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief De-serializes a binary file through the process-wide @ref DeserializeCache
+ * @param file
+ * @return
+ * @throws on failure to read or decode the file
+ */
+template <class T>
+inline std::shared_ptr<const T> deserializeFromBinaryCached(const std::string& file)
+{
+  return DeserializeCache::global().deserializeFromBinary<T>(file);
+}
+
+/**
+ * @brief De-serializes a binary file through the process-wide @ref DeserializeCache
+ * @param file
+ * @param val (output)
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool deserializeFromBinaryCached(const std::string& file, std::shared_ptr<const T>& val) noexcept
+{
+  try
+  {
+    val = deserializeFromBinaryCached<T>(file);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM("Deserialization error: '" << ex.what() << "'");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_DESERIALIZE_CACHE_H
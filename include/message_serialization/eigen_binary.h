@@ -0,0 +1,198 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_EIGEN_BINARY_H
+#define MESSAGE_SERIALIZATION_EIGEN_BINARY_H
+
+#include <cstring>
+#include <Eigen/Geometry>
+#include <ros/serialization.h>
+#include <string>
+
+/*
+ * Eigen binary layout
+ *
+ * Matrices are serialized as the number of rows and the number of columns (each a uint32, and only for the dimensions
+ * that are dynamic at compile time), followed by the values in row-major order. Fixed-size matrices thus cost exactly
+ * their values; row-major matrices and vectors are copied in a single block. Isometry3d and Affine3d transforms are
+ * serialized as the top three rows of their 4x4 matrix, i.e. a row-major 3x4 matrix [R | t].
+ *
+ * With these serializers, Eigen types and (aligned) std::vectors of them can be passed to the functions of
+ * binary_serialization.h like ROS messages.
+ */
+
+namespace message_serialization
+{
+namespace detail
+{
+/**
+ * @brief Serializer of the values of a matrix in row-major order
+ */
+template <typename Matrix>
+struct EigenValues
+{
+  typedef typename Matrix::Scalar Scalar;
+
+  /**
+   * @brief True if the storage order of the matrix matches the serialized order
+   */
+  static constexpr bool CONTIGUOUS = Matrix::IsRowMajor || Matrix::RowsAtCompileTime == 1 ||
+                                     Matrix::ColsAtCompileTime == 1;
+
+  static uint32_t size(const Eigen::Index rows, const Eigen::Index cols)
+  {
+    return static_cast<uint32_t>(rows * cols * sizeof(Scalar));
+  }
+
+  template <typename Stream>
+  static void write(Stream& stream, const Matrix& m)
+  {
+    uint8_t* data = stream.advance(size(m.rows(), m.cols()));
+    if (CONTIGUOUS)
+    {
+      if (m.size() > 0)
+        std::memcpy(data, m.data(), m.size() * sizeof(Scalar));
+      return;
+    }
+
+    for (Eigen::Index r = 0; r < m.rows(); ++r)
+      for (Eigen::Index c = 0; c < m.cols(); ++c, data += sizeof(Scalar))
+        std::memcpy(data, &m.coeffRef(r, c), sizeof(Scalar));
+  }
+
+  /**
+   * @brief Reads the values of a matrix that has already been resized
+   */
+  template <typename Stream>
+  static void read(Stream& stream, Matrix& m)
+  {
+    const uint8_t* data = stream.advance(size(m.rows(), m.cols()));
+    if (CONTIGUOUS)
+    {
+      if (m.size() > 0)
+        std::memcpy(m.data(), data, m.size() * sizeof(Scalar));
+      return;
+    }
+
+    for (Eigen::Index r = 0; r < m.rows(); ++r)
+      for (Eigen::Index c = 0; c < m.cols(); ++c, data += sizeof(Scalar))
+        std::memcpy(&m.coeffRef(r, c), data, sizeof(Scalar));
+  }
+};
+
+/**
+ * @brief Reads a dimension of a matrix, which is serialized only if it is dynamic
+ * @throws ros::serialization::StreamOverrunException if the dimension does not fit the matrix type
+ */
+template <int Size, int MaxSize, typename Stream>
+inline Eigen::Index readDimension(Stream& stream)
+{
+  if (Size != Eigen::Dynamic)
+    return Size;
+
+  uint32_t size;
+  ros::serialization::deserialize(stream, size);
+  if (MaxSize != Eigen::Dynamic && size > static_cast<uint32_t>(MaxSize))
+    throw ros::serialization::StreamOverrunException("Matrix dimension " + std::to_string(size) +
+                                                     " exceeds the maximum of the matrix type");
+  return static_cast<Eigen::Index>(size);
+}
+
+/**
+ * @brief Serializer of transforms as the row-major 3x4 matrix [R | t]
+ */
+template <typename Transform>
+struct EigenTransformSerializer
+{
+  typedef Eigen::Matrix<double, 3, 4, Eigen::RowMajor> Matrix;
+
+  template <typename Stream>
+  inline static void write(Stream& stream, const Transform& t)
+  {
+    const Matrix m = t.matrix().template topRows<3>();
+    EigenValues<Matrix>::write(stream, m);
+  }
+
+  template <typename Stream>
+  inline static void read(Stream& stream, Transform& t)
+  {
+    Matrix m;
+    EigenValues<Matrix>::read(stream, m);
+    t.matrix().template topRows<3>() = m;
+    t.makeAffine();
+  }
+
+  inline static uint32_t serializedLength(const Transform&)
+  {
+    return EigenValues<Matrix>::size(3, 4);
+  }
+};
+
+}  // namespace detail
+}  // namespace message_serialization
+
+namespace ros
+{
+namespace serialization
+{
+template <typename Scalar, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
+struct Serializer<Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols> >
+{
+  typedef Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols> Matrix;
+
+  template <typename Stream>
+  inline static void write(Stream& stream, const Matrix& m)
+  {
+    if (Rows == Eigen::Dynamic)
+      serialize(stream, static_cast<uint32_t>(m.rows()));
+    if (Cols == Eigen::Dynamic)
+      serialize(stream, static_cast<uint32_t>(m.cols()));
+    message_serialization::detail::EigenValues<Matrix>::write(stream, m);
+  }
+
+  template <typename Stream>
+  inline static void read(Stream& stream, Matrix& m)
+  {
+    const Eigen::Index rows = message_serialization::detail::readDimension<Rows, MaxRows>(stream);
+    const Eigen::Index cols = message_serialization::detail::readDimension<Cols, MaxCols>(stream);
+
+    // Check the size before allocating, so that corrupted dimensions fail like any other overrun
+    if (static_cast<uint64_t>(rows) * static_cast<uint64_t>(cols) * sizeof(Scalar) > stream.getLength())
+      throwStreamOverrun();
+    m.resize(rows, cols);
+    message_serialization::detail::EigenValues<Matrix>::read(stream, m);
+  }
+
+  inline static uint32_t serializedLength(const Matrix& m)
+  {
+    return (Rows == Eigen::Dynamic ? 4 : 0) + (Cols == Eigen::Dynamic ? 4 : 0) +
+           message_serialization::detail::EigenValues<Matrix>::size(m.rows(), m.cols());
+  }
+};
+
+template <>
+struct Serializer<Eigen::Isometry3d> : message_serialization::detail::EigenTransformSerializer<Eigen::Isometry3d>
+{
+};
+
+template <>
+struct Serializer<Eigen::Affine3d> : message_serialization::detail::EigenTransformSerializer<Eigen::Affine3d>
+{
+};
+
+}  // namespace serialization
+}  // namespace ros
+
+#endif  // MESSAGE_SERIALIZATION_EIGEN_BINARY_H
@@ -17,26 +17,321 @@
 #define MESSAGE_SERIALIZATION_EIGEN_YAML_H
 
 #include <message_serialization/geometry_msgs_yaml.h>
+#include <message_serialization/yaml_binary.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <Eigen/Geometry>
+#include <limits>
+#include <type_traits>
+
+/*
+ * Eigen YAML layout
+ *
+ * Vectors, quaternions and transforms keep the layout of the corresponding geometry_msgs types (Point, Quaternion and
+ * Pose), but are encoded and decoded directly from the Eigen types. Matrices of any size are written as
+ * `{shape: [rows, cols], data: [...]}` with the values in row-major order, or as a binary array
+ * (`{dtype, shape, data: !!binary}`, see yaml_binary.h) when they hold at least `binary_array_threshold` values.
+ * Vectors of points and transforms are written as binary arrays of rows [x, y, z] and [x, y, z, qx, qy, qz, qw] under
+ * the same threshold, or in the columnar layout of such arrays, like geometry_msgs::PoseArray.
+ */
+
+namespace message_serialization
+{
+namespace detail
+{
+/**
+ * @brief Checks the shape read from a file against the compile-time dimensions of a matrix type
+ * @throws YamlParseError if the matrix type cannot hold the shape
+ */
+template <typename Matrix>
+inline void checkMatrixShape(const std::vector<uint64_t>& shape)
+{
+  if (shape.size() != 2)
+    throw YamlParseError("yaml: expected a matrix shape of the form [rows, cols]");
+
+  // Fixed dimensions are positive, so the casts are only evaluated for non-negative values
+  const int rows = Matrix::RowsAtCompileTime, max_rows = Matrix::MaxRowsAtCompileTime;
+  const int cols = Matrix::ColsAtCompileTime, max_cols = Matrix::MaxColsAtCompileTime;
+  const bool rows_ok = (rows == Eigen::Dynamic || shape[0] == static_cast<uint64_t>(rows)) &&
+                       (max_rows == Eigen::Dynamic || shape[0] <= static_cast<uint64_t>(max_rows));
+  const bool cols_ok = (cols == Eigen::Dynamic || shape[1] == static_cast<uint64_t>(cols)) &&
+                       (max_cols == Eigen::Dynamic || shape[1] <= static_cast<uint64_t>(max_cols));
+  if (!rows_ok || !cols_ok)
+    throw YamlParseError("yaml: a matrix of shape [" + std::to_string(shape[0]) + ", " + std::to_string(shape[1]) +
+                         "] does not fit the matrix type");
+}
+
+/**
+ * @brief Fills a matrix from values in row-major order
+ */
+template <typename Matrix>
+inline void assignRowMajor(const std::vector<uint64_t>& shape, const std::vector<typename Matrix::Scalar>& data,
+                           Matrix& rhs)
+{
+  checkMatrixShape<Matrix>(shape);
+
+  // The number of rows is compared before multiplying so that a bogus shape cannot wrap around
+  const uint64_t max_index = static_cast<uint64_t>(std::numeric_limits<Eigen::Index>::max());
+  const bool matches = shape[1] == 0 ? data.empty() && shape[0] <= max_index :
+                                       shape[0] <= data.size() / shape[1] && data.size() == shape[0] * shape[1];
+  if (!matches)
+    throw YamlParseError("yaml: matrix data does not match its shape");
+
+  typedef Eigen::Matrix<typename Matrix::Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajor;
+  rhs = Eigen::Map<const RowMajor>(data.data(), static_cast<Eigen::Index>(shape[0]),
+                                   static_cast<Eigen::Index>(shape[1]));
+}
+
+/**
+ * @brief Fills a matrix from a binary array
+ */
+template <typename Matrix>
+inline void assignBinaryArray(const BinaryArray& array, Matrix& rhs)
+{
+  checkMatrixShape<Matrix>(array.shape);
+  array.check<typename Matrix::Scalar>(static_cast<std::size_t>(array.shape[1]));
+  rhs.resize(static_cast<Eigen::Index>(array.shape[0]), static_cast<Eigen::Index>(array.shape[1]));
+  for (Eigen::Index r = 0; r < rhs.rows(); ++r)
+    for (Eigen::Index c = 0; c < rhs.cols(); ++c)
+      rhs(r, c) = array.at<typename Matrix::Scalar>(static_cast<std::size_t>(r), static_cast<std::size_t>(c));
+}
+
+template <typename Matrix>
+inline bool matrixToBinaryArray(const Matrix& rhs, BinaryArray& array, std::true_type)
+{
+  array.reset<typename Matrix::Scalar>(static_cast<std::size_t>(rhs.rows()), static_cast<std::size_t>(rhs.cols()));
+  for (Eigen::Index r = 0; r < rhs.rows(); ++r)
+    for (Eigen::Index c = 0; c < rhs.cols(); ++c)
+      array.append(rhs(r, c));
+  return true;
+}
+
+/**
+ * @brief Only floating point matrices are written as binary arrays
+ */
+template <typename Matrix>
+inline bool matrixToBinaryArray(const Matrix&, BinaryArray&, std::false_type)
+{
+  return false;
+}
+
+template <typename Matrix>
+inline void matrixFromBinaryArray(const BinaryArray& array, Matrix& rhs, std::true_type)
+{
+  assignBinaryArray(array, rhs);
+}
+
+template <typename Matrix>
+inline void matrixFromBinaryArray(const BinaryArray&, Matrix&, std::false_type)
+{
+  throw YamlParseError("yaml: binary arrays are only supported for floating point matrices");
+}
+
+/**
+ * @brief Orientation of a transform, with the sign chosen so that w >= 0 as in tf::poseEigenToMsg
+ * @details The linear part of an isometry is a rotation, so it is converted directly; rotation() would compute it
+ * through a singular value decomposition
+ */
+inline Eigen::Quaterniond poseOrientation(const Eigen::Isometry3d& rhs)
+{
+  Eigen::Quaterniond q(rhs.linear());
+  if (q.w() < 0)
+    q.coeffs() = -q.coeffs();
+  return q;
+}
+
+/**
+ * @brief Orientation of a transform, with the sign chosen so that w >= 0 as in tf::poseEigenToMsg
+ * @details The linear part of an affine transform may also scale or shear, so only its rotational part is converted
+ */
+inline Eigen::Quaterniond poseOrientation(const Eigen::Affine3d& rhs)
+{
+  Eigen::Quaterniond q(rhs.rotation());
+  if (q.w() < 0)
+    q.coeffs() = -q.coeffs();
+  return q;
+}
+
+/**
+ * @brief Row [x, y, z, qx, qy, qz, qw] of a binary array of transforms
+ */
+template <typename Transform>
+inline void appendPoseRow(const Transform& rhs, BinaryArray& array)
+{
+  const Eigen::Quaterniond q = poseOrientation(rhs);
+  array.append(rhs.translation().x());
+  array.append(rhs.translation().y());
+  array.append(rhs.translation().z());
+  array.append(q.x());
+  array.append(q.y());
+  array.append(q.z());
+  array.append(q.w());
+}
+
+template <typename Transform>
+inline Transform poseRow(const BinaryArray& array, const std::size_t row)
+{
+  Transform rhs;
+  rhs = Eigen::Translation3d(array.at<double>(row, 0), array.at<double>(row, 1), array.at<double>(row, 2)) *
+        Eigen::Quaterniond(array.at<double>(row, 6), array.at<double>(row, 3), array.at<double>(row, 4),
+                           array.at<double>(row, 5));
+  return rhs;
+}
+
+template <typename Alloc>
+inline void toBinaryArray(const std::vector<Eigen::Vector3d, Alloc>& rhs, BinaryArray& array)
+{
+  array.reset<double>(rhs.size(), 3);
+  for (const Eigen::Vector3d& v : rhs)
+  {
+    array.append(v.x());
+    array.append(v.y());
+    array.append(v.z());
+  }
+}
+
+template <typename Transform, typename Alloc>
+inline void toBinaryArray(const std::vector<Transform, Alloc>& rhs, BinaryArray& array)
+{
+  array.reset<double>(rhs.size(), 7);
+  for (const Transform& t : rhs)
+    appendPoseRow(t, array);
+}
+
+template <typename Alloc>
+inline void fromBinaryArray(const BinaryArray& array, std::vector<Eigen::Vector3d, Alloc>& rhs)
+{
+  array.check<double>(3);
+  rhs.resize(array.rows());
+  for (std::size_t i = 0; i < rhs.size(); ++i)
+    rhs[i] = Eigen::Vector3d(array.at<double>(i, 0), array.at<double>(i, 1), array.at<double>(i, 2));
+}
+
+template <typename Transform, typename Alloc>
+inline void fromBinaryArray(const BinaryArray& array, std::vector<Transform, Alloc>& rhs)
+{
+  array.check<double>(7);
+  rhs.resize(array.rows());
+  for (std::size_t i = 0; i < rhs.size(); ++i)
+    rhs[i] = poseRow<Transform>(array, i);
+}
+
+/**
+ * @brief Writes a vector of Eigen points or transforms as a binary array if it is large enough, or in the columnar
+ * layout if the writer's options request it
+ */
+template <typename T, typename Alloc>
+inline void emitEigenArray(YamlWriter& out, const std::vector<T, Alloc>& rhs, const std::size_t columns)
+{
+  const bool binary = out.binaryArray(rhs.size() * columns);
+  if (binary || out.options().columnar_arrays)
+  {
+    BinaryArray array;
+    toBinaryArray(rhs, array);
+    if (binary)
+      emit(out, array);
+    else
+      emitColumns(out, array);
+    return;
+  }
+
+  out.beginSeq();
+  for (const T& element : rhs)
+    emit(out, element);
+  out.endSeq();
+}
+
+template <typename T, typename Alloc>
+inline void parseEigenArray(YamlReader& in, std::vector<T, Alloc>& rhs)
+{
+  if (in.peek() == YamlReader::Event::MAP_START)
+  {
+    BinaryArray array;
+    parse(in, array);
+    fromBinaryArray(array, rhs);
+    return;
+  }
+
+  rhs.clear();
+  rhs.reserve(in.peekCollectionSize());
+  in.beginSeq();
+  while (in.nextElement())
+  {
+    T element;
+    parse(in, element);
+    rhs.push_back(element);
+  }
+}
+
+}  // namespace detail
+}  // namespace message_serialization
 
 namespace YAML
 {
+template<>
+struct convert<Eigen::Vector3d>
+{
+  static Node encode(const Eigen::Vector3d& rhs)
+  {
+    Node node;
+    node["x"] = rhs.x();
+    node["y"] = rhs.y();
+    node["z"] = rhs.z();
+    return node;
+  }
+
+  static bool decode(const Node& node, Eigen::Vector3d& rhs)
+  {
+    if (node.size() != 3) return false;
+
+    rhs.x() = message_serialization::decodeNumber<double>(node["x"]);
+    rhs.y() = message_serialization::decodeNumber<double>(node["y"]);
+    rhs.z() = message_serialization::decodeNumber<double>(node["z"]);
+    return true;
+  }
+};
+
+template<>
+struct convert<Eigen::Quaterniond>
+{
+  static Node encode(const Eigen::Quaterniond& rhs)
+  {
+    Node node;
+    node["x"] = rhs.x();
+    node["y"] = rhs.y();
+    node["z"] = rhs.z();
+    node["w"] = rhs.w();
+    return node;
+  }
+
+  static bool decode(const Node& node, Eigen::Quaterniond& rhs)
+  {
+    if (node.size() != 4) return false;
+
+    rhs.x() = message_serialization::decodeNumber<double>(node["x"]);
+    rhs.y() = message_serialization::decodeNumber<double>(node["y"]);
+    rhs.z() = message_serialization::decodeNumber<double>(node["z"]);
+    rhs.w() = message_serialization::decodeNumber<double>(node["w"]);
+    return true;
+  }
+};
+
 template<>
 struct convert<Eigen::Isometry3d>
 {
   static Node encode(const Eigen::Isometry3d &rhs)
   {
-    geometry_msgs::Pose msg;
-    tf::poseEigenToMsg(rhs, msg);
-    Node node = Node(msg);
+    const Eigen::Vector3d position = rhs.translation();
+    Node node;
+    node["position"] = position;
+    node["orientation"] = message_serialization::detail::poseOrientation(rhs);
     return node;
   }
 
   static bool decode(const Node &node, Eigen::Isometry3d &rhs)
   {
-    geometry_msgs::Pose msg;
-    msg = node.as<geometry_msgs::Pose>();
-    tf::poseMsgToEigen(msg, rhs);
+    if (node.size() != 2) return false;
+
+    rhs = Eigen::Translation3d(node["position"].as<Eigen::Vector3d>()) * node["orientation"].as<Eigen::Quaterniond>();
     return true;
   }
 };
@@ -46,41 +341,300 @@ struct convert<Eigen::Affine3d>
 {
   static Node encode(const Eigen::Affine3d& rhs)
   {
-    geometry_msgs::Pose msg;
-    tf::poseEigenToMsg(rhs, msg);
-    Node node = Node(msg);
+    const Eigen::Vector3d position = rhs.translation();
+    Node node;
+    node["position"] = position;
+    node["orientation"] = message_serialization::detail::poseOrientation(rhs);
     return node;
   }
 
   static bool decode(const Node& node, Eigen::Affine3d& rhs)
   {
-    geometry_msgs::Pose msg;
-    msg = node.as<geometry_msgs::Pose>();
-    tf::poseMsgToEigen(msg, rhs);
+    if (node.size() != 2) return false;
+
+    rhs = Eigen::Translation3d(node["position"].as<Eigen::Vector3d>()) * node["orientation"].as<Eigen::Quaterniond>();
     return true;
   }
 };
 
-template<>
-struct convert<Eigen::Vector3d>
+/**
+ * @brief Vectors of Eigen points and transforms, which also decode the binary array layout
+ */
+template <typename T, typename Alloc>
+struct convertEigenVector
 {
-  static Node encode(const Eigen::Vector3d& rhs)
+  static Node encode(const std::vector<T, Alloc>& rhs)
   {
-    geometry_msgs::Point msg;
-    tf::pointEigenToMsg(rhs, msg);
-    Node node = Node(msg);
+    Node node(NodeType::Sequence);
+    for (const T& element : rhs)
+      node.push_back(element);
     return node;
   }
 
-  static bool decode(const Node& node, Eigen::Vector3d& rhs)
+  static bool decode(const Node& node, std::vector<T, Alloc>& rhs)
+  {
+    if (node.IsMap())
+      message_serialization::detail::fromBinaryArray(node.as<message_serialization::BinaryArray>(), rhs);
+    else
+      message_serialization::decodeSequence(node, rhs);
+    return true;
+  }
+};
+
+template <typename Alloc>
+struct convert<std::vector<Eigen::Vector3d, Alloc> > : convertEigenVector<Eigen::Vector3d, Alloc>
+{
+};
+
+template <typename Alloc>
+struct convert<std::vector<Eigen::Isometry3d, Alloc> > : convertEigenVector<Eigen::Isometry3d, Alloc>
+{
+};
+
+template <typename Alloc>
+struct convert<std::vector<Eigen::Affine3d, Alloc> > : convertEigenVector<Eigen::Affine3d, Alloc>
+{
+};
+
+/**
+ * @brief Matrices of any size and storage order, written as `{shape: [rows, cols], data: [...]}` in row-major order
+ * @details Also decodes the binary array layout written by message_serialization::emit
+ */
+template <typename Scalar, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
+struct convert<Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols> >
+{
+  typedef Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols> Matrix;
+
+  static Node encode(const Matrix& rhs)
   {
-    geometry_msgs::Point msg;
-    msg = node.as<geometry_msgs::Point>();
-    tf::pointMsgToEigen(msg, rhs);
+    Node shape(NodeType::Sequence);
+    shape.push_back(static_cast<uint64_t>(rhs.rows()));
+    shape.push_back(static_cast<uint64_t>(rhs.cols()));
+
+    Node data(NodeType::Sequence);
+    for (Eigen::Index r = 0; r < rhs.rows(); ++r)
+      for (Eigen::Index c = 0; c < rhs.cols(); ++c)
+        data.push_back(rhs(r, c));
+
+    Node node;
+    node["shape"] = shape;
+    node["data"] = data;
+    return node;
+  }
+
+  static bool decode(const Node& node, Matrix& rhs)
+  {
+    if (node.size() == 3)
+    {
+      message_serialization::detail::matrixFromBinaryArray(node.as<message_serialization::BinaryArray>(), rhs,
+                                                           std::is_floating_point<Scalar>());
+      return true;
+    }
+    if (node.size() != 2) return false;
+
+    message_serialization::detail::assignRowMajor(message_serialization::decodeNumbers<uint64_t>(node["shape"]),
+                                                  message_serialization::decodeNumbers<Scalar>(node["data"]), rhs);
     return true;
   }
 };
 
 }
 
+namespace message_serialization
+{
+
+inline void emit(YamlWriter& out, const Eigen::Vector3d& rhs)
+{
+  out.beginMap();
+  out.field("x", rhs.x());
+  out.field("y", rhs.y());
+  out.field("z", rhs.z());
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const Eigen::Quaterniond& rhs)
+{
+  out.beginMap();
+  out.field("x", rhs.x());
+  out.field("y", rhs.y());
+  out.field("z", rhs.z());
+  out.field("w", rhs.w());
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const Eigen::Isometry3d& rhs)
+{
+  const Eigen::Vector3d position = rhs.translation();
+  out.beginMap();
+  out.field("position", position);
+  out.field("orientation", detail::poseOrientation(rhs));
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const Eigen::Affine3d& rhs)
+{
+  const Eigen::Vector3d position = rhs.translation();
+  out.beginMap();
+  out.field("position", position);
+  out.field("orientation", detail::poseOrientation(rhs));
+  out.endMap();
+}
+
+template <typename Scalar, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
+inline void emit(YamlWriter& out, const Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols>& rhs)
+{
+  BinaryArray array;
+  if (out.binaryArray(static_cast<std::size_t>(rhs.size())) &&
+      detail::matrixToBinaryArray(rhs, array, std::is_floating_point<Scalar>()))
+  {
+    emit(out, array);
+    return;
+  }
+
+  out.beginMap();
+  out.key("shape");
+  out.beginNumericSeq();
+  out.scalar(static_cast<uint64_t>(rhs.rows()));
+  out.scalar(static_cast<uint64_t>(rhs.cols()));
+  out.endSeq();
+  out.key("data");
+  out.beginNumericSeq();
+  for (Eigen::Index r = 0; r < rhs.rows(); ++r)
+    for (Eigen::Index c = 0; c < rhs.cols(); ++c)
+      emit(out, rhs(r, c));
+  out.endSeq();
+  out.endMap();
+}
+
+template <typename Alloc>
+inline void emit(YamlWriter& out, const std::vector<Eigen::Vector3d, Alloc>& rhs)
+{
+  detail::emitEigenArray(out, rhs, 3);
+}
+
+template <typename Alloc>
+inline void emit(YamlWriter& out, const std::vector<Eigen::Isometry3d, Alloc>& rhs)
+{
+  detail::emitEigenArray(out, rhs, 7);
+}
+
+template <typename Alloc>
+inline void emit(YamlWriter& out, const std::vector<Eigen::Affine3d, Alloc>& rhs)
+{
+  detail::emitEigenArray(out, rhs, 7);
+}
+
+inline void parse(YamlReader& in, Eigen::Vector3d& rhs)
+{
+  YamlReader::Map map(in, 3);
+  while (map.next())
+  {
+    if (map.key("x"))
+      parse(in, rhs.x());
+    else if (map.key("y"))
+      parse(in, rhs.y());
+    else if (map.key("z"))
+      parse(in, rhs.z());
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, Eigen::Quaterniond& rhs)
+{
+  YamlReader::Map map(in, 4);
+  while (map.next())
+  {
+    if (map.key("x"))
+      parse(in, rhs.x());
+    else if (map.key("y"))
+      parse(in, rhs.y());
+    else if (map.key("z"))
+      parse(in, rhs.z());
+    else if (map.key("w"))
+      parse(in, rhs.w());
+    else
+      map.unknown();
+  }
+}
+
+namespace detail
+{
+template <typename Transform>
+inline void parseTransform(YamlReader& in, Transform& rhs)
+{
+  Eigen::Vector3d position;
+  Eigen::Quaterniond orientation;
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("position"))
+      parse(in, position);
+    else if (map.key("orientation"))
+      parse(in, orientation);
+    else
+      map.unknown();
+  }
+  rhs = Eigen::Translation3d(position) * orientation;
+}
+
+}  // namespace detail
+
+inline void parse(YamlReader& in, Eigen::Isometry3d& rhs)
+{
+  detail::parseTransform(in, rhs);
+}
+
+inline void parse(YamlReader& in, Eigen::Affine3d& rhs)
+{
+  detail::parseTransform(in, rhs);
+}
+
+template <typename Scalar, int Rows, int Cols, int Options, int MaxRows, int MaxCols>
+inline void parse(YamlReader& in, Eigen::Matrix<Scalar, Rows, Cols, Options, MaxRows, MaxCols>& rhs)
+{
+  // The layout is told apart by its number of fields; the binary array layout also has a dtype
+  if (in.peekCollectionSize() == 3)
+  {
+    BinaryArray array;
+    parse(in, array);
+    detail::matrixFromBinaryArray(array, rhs, std::is_floating_point<Scalar>());
+    return;
+  }
+
+  std::vector<uint64_t> shape;
+  std::vector<Scalar> data;
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("shape"))
+      parse(in, shape);
+    else if (map.key("data"))
+      parse(in, data);
+    else
+      map.unknown();
+  }
+  detail::assignRowMajor(shape, data, rhs);
+}
+
+template <typename Alloc>
+inline void parse(YamlReader& in, std::vector<Eigen::Vector3d, Alloc>& rhs)
+{
+  detail::parseEigenArray(in, rhs);
+}
+
+template <typename Alloc>
+inline void parse(YamlReader& in, std::vector<Eigen::Isometry3d, Alloc>& rhs)
+{
+  detail::parseEigenArray(in, rhs);
+}
+
+template <typename Alloc>
+inline void parse(YamlReader& in, std::vector<Eigen::Affine3d, Alloc>& rhs)
+{
+  detail::parseEigenArray(in, rhs);
+}
+
+} // namespace message_serialization
+
 #endif // MESSAGE_SERIALIZATION_EIGEN_YAML_H
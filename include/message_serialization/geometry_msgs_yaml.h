@@ -19,8 +19,49 @@
 #include <geometry_msgs/PoseArray.h>
 #include <geometry_msgs/TransformStamped.h>
 #include <message_serialization/std_msgs_yaml.h>
+#include <message_serialization/yaml_binary.h>
 #include <geometry_msgs/PoseStamped.h>
 
+namespace message_serialization
+{
+
+/**
+ * @brief Packs poses into an array of rows [x, y, z, qx, qy, qz, qw]
+ */
+inline bool toBinaryArray(const std::vector<geometry_msgs::Pose>& rhs, BinaryArray& array)
+{
+  array.reset<double>(rhs.size(), 7);
+  for (const geometry_msgs::Pose& pose : rhs)
+  {
+    array.append(pose.position.x);
+    array.append(pose.position.y);
+    array.append(pose.position.z);
+    array.append(pose.orientation.x);
+    array.append(pose.orientation.y);
+    array.append(pose.orientation.z);
+    array.append(pose.orientation.w);
+  }
+  return true;
+}
+
+inline void fromBinaryArray(const BinaryArray& array, std::vector<geometry_msgs::Pose>& rhs)
+{
+  array.check<double>(7);
+  rhs.resize(array.rows());
+  for (std::size_t i = 0; i < rhs.size(); ++i)
+  {
+    rhs[i].position.x = array.at<double>(i, 0);
+    rhs[i].position.y = array.at<double>(i, 1);
+    rhs[i].position.z = array.at<double>(i, 2);
+    rhs[i].orientation.x = array.at<double>(i, 3);
+    rhs[i].orientation.y = array.at<double>(i, 4);
+    rhs[i].orientation.z = array.at<double>(i, 5);
+    rhs[i].orientation.w = array.at<double>(i, 6);
+  }
+}
+
+} // namespace message_serialization
+
 namespace YAML
 {
 
@@ -41,9 +82,9 @@ struct convert<geometry_msgs::Vector3>
   {
     if (node.size() != 3) return false;
 
-    rhs.x = node["x"].as<double>();
-    rhs.y = node["y"].as<double>();
-    rhs.z = node["z"].as<double>();
+    rhs.x = message_serialization::decodeNumber<double>(node["x"]);
+    rhs.y = message_serialization::decodeNumber<double>(node["y"]);
+    rhs.z = message_serialization::decodeNumber<double>(node["z"]);
     return true;
   }
 };
@@ -64,9 +105,9 @@ struct convert<geometry_msgs::Point>
   {
     if (node.size() != 3) return false;
 
-    rhs.x = node["x"].as<double>();
-    rhs.y = node["y"].as<double>();
-    rhs.z = node["z"].as<double>();
+    rhs.x = message_serialization::decodeNumber<double>(node["x"]);
+    rhs.y = message_serialization::decodeNumber<double>(node["y"]);
+    rhs.z = message_serialization::decodeNumber<double>(node["z"]);
 
     return true;
   }
@@ -91,10 +132,10 @@ struct convert<geometry_msgs::Quaternion>
   {
     if (node.size() != 4) return false;
 
-    rhs.x = node["x"].as<double>();
-    rhs.y = node["y"].as<double>();
-    rhs.z = node["z"].as<double>();
-    rhs.w = node["w"].as<double>();
+    rhs.x = message_serialization::decodeNumber<double>(node["x"]);
+    rhs.y = message_serialization::decodeNumber<double>(node["y"]);
+    rhs.z = message_serialization::decodeNumber<double>(node["z"]);
+    rhs.w = message_serialization::decodeNumber<double>(node["w"]);
 
     return true;
   }
@@ -161,7 +202,7 @@ struct convert<geometry_msgs::PoseArray>
     if (node.size() != 2) return false;
 
     rhs.header = node["header"].as<std_msgs::Header>();
-    rhs.poses = node["poses"].as<std::vector<geometry_msgs::Pose> >();
+    rhs.poses = message_serialization::decodeArray<geometry_msgs::Pose>(node["poses"]);
     return true;
   }
 };
@@ -215,4 +256,201 @@ struct convert<geometry_msgs::TransformStamped>
 
 }
 
+namespace message_serialization
+{
+
+inline void emit(YamlWriter& out, const geometry_msgs::Vector3& rhs)
+{
+  out.beginMap();
+  out.field("x", rhs.x);
+  out.field("y", rhs.y);
+  out.field("z", rhs.z);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const geometry_msgs::Point& rhs)
+{
+  out.beginMap();
+  out.field("x", rhs.x);
+  out.field("y", rhs.y);
+  out.field("z", rhs.z);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const geometry_msgs::Quaternion& rhs)
+{
+  out.beginMap();
+  out.field("x", rhs.x);
+  out.field("y", rhs.y);
+  out.field("z", rhs.z);
+  out.field("w", rhs.w);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const geometry_msgs::Pose& rhs)
+{
+  out.beginMap();
+  out.field("position", rhs.position);
+  out.field("orientation", rhs.orientation);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const geometry_msgs::PoseStamped& rhs)
+{
+  out.beginMap();
+  out.field("header", rhs.header);
+  out.field("pose", rhs.pose);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const geometry_msgs::PoseArray& rhs)
+{
+  out.beginMap();
+  out.field("header", rhs.header);
+  out.key("poses");
+  emitArray(out, rhs.poses, rhs.poses.size() * 7);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const geometry_msgs::Transform& rhs)
+{
+  out.beginMap();
+  out.field("rotation", rhs.rotation);
+  out.field("translation", rhs.translation);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const geometry_msgs::TransformStamped& rhs)
+{
+  out.beginMap();
+  out.field("header", rhs.header);
+  out.field("child_frame_id", rhs.child_frame_id);
+  out.field("transform", rhs.transform);
+  out.endMap();
+}
+
+inline void parse(YamlReader& in, geometry_msgs::Vector3& rhs)
+{
+  YamlReader::Map map(in, 3);
+  while (map.next())
+  {
+    if (map.key("x"))
+      parse(in, rhs.x);
+    else if (map.key("y"))
+      parse(in, rhs.y);
+    else if (map.key("z"))
+      parse(in, rhs.z);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, geometry_msgs::Point& rhs)
+{
+  YamlReader::Map map(in, 3);
+  while (map.next())
+  {
+    if (map.key("x"))
+      parse(in, rhs.x);
+    else if (map.key("y"))
+      parse(in, rhs.y);
+    else if (map.key("z"))
+      parse(in, rhs.z);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, geometry_msgs::Quaternion& rhs)
+{
+  YamlReader::Map map(in, 4);
+  while (map.next())
+  {
+    if (map.key("x"))
+      parse(in, rhs.x);
+    else if (map.key("y"))
+      parse(in, rhs.y);
+    else if (map.key("z"))
+      parse(in, rhs.z);
+    else if (map.key("w"))
+      parse(in, rhs.w);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, geometry_msgs::Pose& rhs)
+{
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("position"))
+      parse(in, rhs.position);
+    else if (map.key("orientation"))
+      parse(in, rhs.orientation);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, geometry_msgs::PoseStamped& rhs)
+{
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("header"))
+      parse(in, rhs.header);
+    else if (map.key("pose"))
+      parse(in, rhs.pose);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, geometry_msgs::PoseArray& rhs)
+{
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("header"))
+      parse(in, rhs.header);
+    else if (map.key("poses"))
+      parseArray(in, rhs.poses);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, geometry_msgs::Transform& rhs)
+{
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("rotation"))
+      parse(in, rhs.rotation);
+    else if (map.key("translation"))
+      parse(in, rhs.translation);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, geometry_msgs::TransformStamped& rhs)
+{
+  YamlReader::Map map(in, 3);
+  while (map.next())
+  {
+    if (map.key("header"))
+      parse(in, rhs.header);
+    else if (map.key("child_frame_id"))
+      parse(in, rhs.child_frame_id);
+    else if (map.key("transform"))
+      parse(in, rhs.transform);
+    else
+      map.unknown();
+  }
+}
+
+} // namespace message_serialization
+
 #endif // MESSAGE_SERIALIZATION_GEOMETRY_MSGS_YAML
@@ -0,0 +1,343 @@
+/*
+ * Adapted from the dtoa_impl of JSON for Modern C++ (https://github.com/nlohmann/json, include/nlohmann/detail/
+ * conversions/to_chars.hpp): the cached-power table, the DiyFp arithmetic, the boundary computation and the digit
+ * generation follow that implementation. Changes: moved to the message_serialization::detail::grisu2 namespace,
+ * renamed to the naming style of this package, and reduced to the digit computation; the formatting of the digits is
+ * done by message_serialization/numeric.h.
+ *
+ * Copyright (c) 2009 Florian Loitsch <https://florian.loitsch.com/>
+ * Copyright (c) 2013-2022 Niels Lohmann <https://nlohmann.me>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of
+ * the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MESSAGE_SERIALIZATION_GRISU2_H
+#define MESSAGE_SERIALIZATION_GRISU2_H
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace message_serialization
+{
+namespace detail
+{
+/**
+ * @brief Shortest decimal digits of binary floating point values with the Grisu2 algorithm
+ * @details Implements the algorithm of F. Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+ * Integers" (PLDI 2010), with the parameters (alpha = -60, gamma = -32) and the digit generation of the "Grisu2"
+ * variant. The digits always parse back to exactly the same value, and are the shortest such digits for all but a
+ * very small fraction of values, for which they are one digit longer. Only 64-bit integer arithmetic is used.
+ */
+namespace grisu2
+{
+/**
+ * @brief Unpacked floating point number f * 2^e
+ */
+struct DiyFp
+{
+  uint64_t f;
+  int e;
+};
+
+inline DiyFp sub(const DiyFp& x, const DiyFp& y)
+{
+  return { x.f - y.f, x.e };
+}
+
+/**
+ * @brief Product of two numbers, with the 128-bit product of the significands rounded to its upper 64 bits
+ */
+inline DiyFp mul(const DiyFp& x, const DiyFp& y)
+{
+  const uint64_t u_lo = x.f & 0xFFFFFFFFu;
+  const uint64_t u_hi = x.f >> 32;
+  const uint64_t v_lo = y.f & 0xFFFFFFFFu;
+  const uint64_t v_hi = y.f >> 32;
+
+  const uint64_t p0 = u_lo * v_lo;
+  const uint64_t p1 = u_lo * v_hi;
+  const uint64_t p2 = u_hi * v_lo;
+  const uint64_t p3 = u_hi * v_hi;
+
+  uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+  q += uint64_t(1) << 31;
+  return { p3 + (p2 >> 32) + (p1 >> 32) + (q >> 32), x.e + y.e + 64 };
+}
+
+inline DiyFp normalize(DiyFp x)
+{
+  while ((x.f >> 63) == 0)
+  {
+    x.f <<= 1;
+    --x.e;
+  }
+  return x;
+}
+
+/**
+ * @brief Value, and the boundaries half-way to its neighbours, sharing the exponent of the upper boundary
+ */
+struct Boundaries
+{
+  DiyFp w;
+  DiyFp minus;
+  DiyFp plus;
+};
+
+template <typename T>
+inline Boundaries computeBoundaries(const T value)
+{
+  static_assert(std::numeric_limits<T>::is_iec559, "IEEE-754 floating point type required");
+  typedef typename std::conditional<sizeof(T) == 8, uint64_t, uint32_t>::type Bits;
+
+  const int precision = std::numeric_limits<T>::digits;  // including the hidden bit
+  const int bias = std::numeric_limits<T>::max_exponent - 1 + (precision - 1);
+  const int min_exponent = 1 - bias;
+  const uint64_t hidden_bit = uint64_t(1) << (precision - 1);
+
+  Bits bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint64_t exponent = static_cast<uint64_t>(bits) >> (precision - 1);
+  const uint64_t fraction = static_cast<uint64_t>(bits) & (hidden_bit - 1);
+
+  const DiyFp v = exponent == 0 ? DiyFp{ fraction, min_exponent } :
+                                  DiyFp{ fraction + hidden_bit, static_cast<int>(exponent) - bias };
+
+  // The lower neighbour is closer for powers of two, except for the smallest normal value
+  const bool lower_closer = fraction == 0 && exponent > 1;
+  const DiyFp plus = normalize({ 2 * v.f + 1, v.e - 1 });
+  DiyFp minus = lower_closer ? DiyFp{ 4 * v.f - 1, v.e - 2 } : DiyFp{ 2 * v.f - 1, v.e - 1 };
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  return { normalize(v), minus, plus };
+}
+
+/**
+ * @brief Normalized power of ten 10^k = f * 2^e
+ */
+struct CachedPower
+{
+  uint64_t f;
+  int e;
+  int k;
+};
+
+/**
+ * @brief Returns a power of ten c such that the binary exponent of c times a number of binary exponent e lies in
+ * [alpha, gamma] = [-60, -32]
+ */
+inline CachedPower cachedPower(const int e)
+{
+  // Powers 10^-300 to 10^324 in steps of 8, rounded to 64 bits
+  static const CachedPower POWERS[] = {
+    { 0xAB70FE17C79AC6CA, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4F, -1034, -292 },
+    { 0xBE5691EF416BD60C, -1007, -284 },
+    { 0x8DD01FAD907FFC3C, -980, -276 },
+    { 0xD3515C2831559A83, -954, -268 },
+    { 0x9D71AC8FADA6C9B5, -927, -260 },
+    { 0xEA9C227723EE8BCB, -901, -252 },
+    { 0xAECC49914078536D, -874, -244 },
+    { 0x823C12795DB6CE57, -847, -236 },
+    { 0xC21094364DFB5637, -821, -228 },
+    { 0x9096EA6F3848984F, -794, -220 },
+    { 0xD77485CB25823AC7, -768, -212 },
+    { 0xA086CFCD97BF97F4, -741, -204 },
+    { 0xEF340A98172AACE5, -715, -196 },
+    { 0xB23867FB2A35B28E, -688, -188 },
+    { 0x84C8D4DFD2C63F3B, -661, -180 },
+    { 0xC5DD44271AD3CDBA, -635, -172 },
+    { 0x936B9FCEBB25C996, -608, -164 },
+    { 0xDBAC6C247D62A584, -582, -156 },
+    { 0xA3AB66580D5FDAF6, -555, -148 },
+    { 0xF3E2F893DEC3F126, -529, -140 },
+    { 0xB5B5ADA8AAFF80B8, -502, -132 },
+    { 0x87625F056C7C4A8B, -475, -124 },
+    { 0xC9BCFF6034C13053, -449, -116 },
+    { 0x964E858C91BA2655, -422, -108 },
+    { 0xDFF9772470297EBD, -396, -100 },
+    { 0xA6DFBD9FB8E5B88F, -369, -92 },
+    { 0xF8A95FCF88747D94, -343, -84 },
+    { 0xB94470938FA89BCF, -316, -76 },
+    { 0x8A08F0F8BF0F156B, -289, -68 },
+    { 0xCDB02555653131B6, -263, -60 },
+    { 0x993FE2C6D07B7FAC, -236, -52 },
+    { 0xE45C10C42A2B3B06, -210, -44 },
+    { 0xAA242499697392D3, -183, -36 },
+    { 0xFD87B5F28300CA0E, -157, -28 },
+    { 0xBCE5086492111AEB, -130, -20 },
+    { 0x8CBCCC096F5088CC, -103, -12 },
+    { 0xD1B71758E219652C, -77, -4 },
+    { 0x9C40000000000000, -50, 4 },
+    { 0xE8D4A51000000000, -24, 12 },
+    { 0xAD78EBC5AC620000, 3, 20 },
+    { 0x813F3978F8940984, 30, 28 },
+    { 0xC097CE7BC90715B3, 56, 36 },
+    { 0x8F7E32CE7BEA5C70, 83, 44 },
+    { 0xD5D238A4ABE98068, 109, 52 },
+    { 0x9F4F2726179A2245, 136, 60 },
+    { 0xED63A231D4C4FB27, 162, 68 },
+    { 0xB0DE65388CC8ADA8, 189, 76 },
+    { 0x83C7088E1AAB65DB, 216, 84 },
+    { 0xC45D1DF942711D9A, 242, 92 },
+    { 0x924D692CA61BE758, 269, 100 },
+    { 0xDA01EE641A708DEA, 295, 108 },
+    { 0xA26DA3999AEF774A, 322, 116 },
+    { 0xF209787BB47D6B85, 348, 124 },
+    { 0xB454E4A179DD1877, 375, 132 },
+    { 0x865B86925B9BC5C2, 402, 140 },
+    { 0xC83553C5C8965D3D, 428, 148 },
+    { 0x952AB45CFA97A0B3, 455, 156 },
+    { 0xDE469FBD99A05FE3, 481, 164 },
+    { 0xA59BC234DB398C25, 508, 172 },
+    { 0xF6C69A72A3989F5C, 534, 180 },
+    { 0xB7DCBF5354E9BECE, 561, 188 },
+    { 0x88FCF317F22241E2, 588, 196 },
+    { 0xCC20CE9BD35C78A5, 614, 204 },
+    { 0x98165AF37B2153DF, 641, 212 },
+    { 0xE2A0B5DC971F303A, 667, 220 },
+    { 0xA8D9D1535CE3B396, 694, 228 },
+    { 0xFB9B7CD9A4A7443C, 720, 236 },
+    { 0xBB764C4CA7A44410, 747, 244 },
+    { 0x8BAB8EEFB6409C1A, 774, 252 },
+    { 0xD01FEF10A657842C, 800, 260 },
+    { 0x9B10A4E5E9913129, 827, 268 },
+    { 0xE7109BFBA19C0C9D, 853, 276 },
+    { 0xAC2820D9623BF429, 880, 284 },
+    { 0x80444B5E7AA7CF85, 907, 292 },
+    { 0xBF21E44003ACDD2D, 933, 300 },
+    { 0x8E679C2F5E44FF8F, 960, 308 },
+    { 0xD433179D9C8CB841, 986, 316 },
+    { 0x9E19DB92B4E31BA9, 1013, 324 },
+  };
+  const int min_decimal_exponent = -300;
+  const int decimal_step = 8;
+
+  // k = ceil((alpha - e - 1) * log10(2)), with log10(2) approximated by 78913 / 2^18
+  const int f = -60 - e - 1;
+  const int k = (f * 78913) / (1 << 18) + (f > 0);
+  const int index = (-min_decimal_exponent + k + (decimal_step - 1)) / decimal_step;
+  return POWERS[index];
+}
+
+/**
+ * @brief Largest power of ten not greater than n, for n < 10^10
+ * @return number of decimal digits of n
+ */
+inline int largestPowerOfTen(const uint32_t n, uint32_t& power)
+{
+  static const uint32_t POWERS[] = { 1,      10,      100,      1000,      10000,
+                                     100000, 1000000, 10000000, 100000000, 1000000000 };
+  int digits = 10;
+  while (digits > 1 && n < POWERS[digits - 1])
+    --digits;
+  power = POWERS[digits - 1];
+  return digits;
+}
+
+/**
+ * @brief Moves the last digit down while the result stays within the boundaries and gets closer to the value
+ */
+inline void round(char* buffer, const int length, const uint64_t distance, const uint64_t delta, uint64_t rest,
+                  const uint64_t ten_k)
+{
+  while (rest < distance && delta - rest >= ten_k &&
+         (rest + ten_k < distance || distance - rest > rest + ten_k - distance))
+  {
+    --buffer[length - 1];
+    rest += ten_k;
+  }
+}
+
+/**
+ * @brief Generates the digits of a number in (minus, plus), as close as possible to w
+ * @param buffer (output) Digits, without terminator
+ * @param length (output) Number of digits
+ * @param exponent (input/output) Decimal exponent of the last digit
+ */
+inline void generateDigits(char* buffer, int& length, int& exponent, const DiyFp& minus, const DiyFp& w,
+                           const DiyFp& plus)
+{
+  uint64_t delta = sub(plus, minus).f;
+  uint64_t distance = sub(plus, w).f;
+
+  // Split the upper boundary into integral and fractional parts; -60 <= e <= -32 so the integral part fits 32 bits
+  const DiyFp one = { uint64_t(1) << -plus.e, plus.e };
+  uint32_t integral = static_cast<uint32_t>(plus.f >> -one.e);
+  uint64_t fractional = plus.f & (one.f - 1);
+
+  uint32_t power;
+  int digits = largestPowerOfTen(integral, power);
+  length = 0;
+  while (digits > 0)
+  {
+    buffer[length++] = static_cast<char>('0' + integral / power);
+    integral %= power;
+    --digits;
+
+    const uint64_t rest = (uint64_t(integral) << -one.e) + fractional;
+    if (rest <= delta)
+    {
+      exponent += digits;
+      round(buffer, length, distance, delta, rest, uint64_t(power) << -one.e);
+      return;
+    }
+    power /= 10;
+  }
+
+  int fraction_digits = 0;
+  for (;;)
+  {
+    fractional *= 10;
+    buffer[length++] = static_cast<char>('0' + (fractional >> -one.e));
+    fractional &= one.f - 1;
+    ++fraction_digits;
+    delta *= 10;
+    distance *= 10;
+    if (fractional <= delta)
+      break;
+  }
+  exponent -= fraction_digits;
+  round(buffer, length, distance, delta, fractional, one.f);
+}
+
+/**
+ * @brief Computes the shortest digits of a finite, positive value
+ * @param buffer (output) Digits, without terminator; must hold 17 characters
+ * @param length (output) Number of digits
+ * @param exponent (output) Decimal exponent, such that value = digits * 10^exponent
+ */
+template <typename T>
+inline void digits(char* buffer, int& length, int& exponent, const T value)
+{
+  const Boundaries b = computeBoundaries(value);
+  const CachedPower cached = cachedPower(b.plus.e);
+  const DiyFp c = { cached.f, cached.e };
+
+  const DiyFp w = mul(b.w, c);
+  const DiyFp minus = mul(b.minus, c);
+  const DiyFp plus = mul(b.plus, c);
+
+  // The products are accurate to one unit of the last place, so the boundaries are narrowed by one unit each
+  exponent = -cached.k;
+  generateDigits(buffer, length, exponent, { minus.f + 1, minus.e }, w, { plus.f - 1, plus.e });
+}
+
+}  // namespace grisu2
+}  // namespace detail
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_GRISU2_H
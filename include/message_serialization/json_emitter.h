@@ -0,0 +1,302 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_JSON_EMITTER_H
+#define MESSAGE_SERIALIZATION_JSON_EMITTER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <message_serialization/numeric.h>
+#include <string>
+#include <yaml-cpp/yaml.h>
+
+namespace message_serialization
+{
+/**
+ * @brief Writes compact JSON text directly to a string
+ * @details The counterpart of YAML::Emitter for JSON output: values are appended as they are written, with only the
+ * separators between them tracked, so no document tree or formatting state stack is kept. The caller is responsible
+ * for writing a well-formed document, i.e. for balancing collections and writing exactly one value per key.
+ */
+class JsonEmitter
+{
+public:
+  /**
+   * @param out (output) String the text is appended to
+   */
+  explicit JsonEmitter(std::string& out) : out_(out)
+  {
+  }
+
+  void beginMap()
+  {
+    separate();
+    out_.push_back('{');
+    first_ = true;
+  }
+
+  void endMap()
+  {
+    out_.push_back('}');
+    first_ = false;
+  }
+
+  void beginSeq()
+  {
+    separate();
+    out_.push_back('[');
+    first_ = true;
+  }
+
+  void endSeq()
+  {
+    out_.push_back(']');
+    first_ = false;
+  }
+
+  /**
+   * @brief Writes the key of the next map entry; the value must be written next
+   */
+  void key(const char* key, const std::size_t size)
+  {
+    separate();
+    quoted(key, size);
+    out_.push_back(':');
+    after_key_ = true;
+  }
+
+  void string(const char* data, const std::size_t size)
+  {
+    separate();
+    quoted(data, size);
+  }
+
+  /**
+   * @brief Writes text that is already valid JSON, such as a number or a literal
+   */
+  void raw(const char* text, const std::size_t size)
+  {
+    separate();
+    out_.append(text, size);
+  }
+
+  void boolean(const bool value)
+  {
+    if (value)
+      raw("true", 4);
+    else
+      raw("false", 5);
+  }
+
+  void null()
+  {
+    raw("null", 4);
+  }
+
+  void integer(const int64_t value)
+  {
+    // The magnitude is computed in unsigned arithmetic so that the minimum value does not overflow
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    char* p = digits(end, value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value));
+    if (value < 0)
+      *--p = '-';
+    raw(p, static_cast<std::size_t>(end - p));
+  }
+
+  void integer(const uint64_t value)
+  {
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    char* p = digits(end, value);
+    raw(p, static_cast<std::size_t>(end - p));
+  }
+
+  /**
+   * @brief Writes a YAML node, for types that are only encoded through YAML::convert
+   * @details YAML scalars are untyped: those that are JSON numbers, booleans or nulls are written as such, and all
+   * others as strings
+   */
+  void node(const YAML::Node& node)
+  {
+    switch (node.Type())
+    {
+      case YAML::NodeType::Map:
+        beginMap();
+        for (YAML::const_iterator it = node.begin(); it != node.end(); ++it)
+        {
+          const std::string& name = it->first.Scalar();
+          key(name.data(), name.size());
+          this->node(it->second);
+        }
+        endMap();
+        break;
+      case YAML::NodeType::Sequence:
+        beginSeq();
+        for (YAML::const_iterator it = node.begin(); it != node.end(); ++it)
+          this->node(*it);
+        endSeq();
+        break;
+      case YAML::NodeType::Scalar:
+        scalar(node.Scalar(), node.Tag() == "!");
+        break;
+      default:
+        null();
+        break;
+    }
+  }
+
+private:
+  /**
+   * @brief Writes the comma that precedes every value of a collection but the first, and any value following a key
+   */
+  void separate()
+  {
+    if (after_key_)
+      after_key_ = false;
+    else if (!first_)
+      out_.push_back(',');
+    first_ = false;
+  }
+
+  /**
+   * @brief Writes the decimal digits of a value backwards, ending at the input pointer
+   * @return pointer to the first digit
+   */
+  static char* digits(char* end, uint64_t value)
+  {
+    do
+    {
+      *--end = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value != 0);
+    return end;
+  }
+
+  /**
+   * @brief Writes a string in double quotes, escaping quotes, backslashes and control characters
+   * @details Runs of characters that need no escaping, which is usually the whole string, are copied at once. Other
+   * bytes, including UTF-8 sequences, are written unchanged
+   */
+  void quoted(const char* data, const std::size_t size)
+  {
+    static const char HEX[] = "0123456789abcdef";
+    out_.push_back('"');
+    const char* run = data;
+    const char* const end = data + size;
+    for (const char* p = data; p != end; ++p)
+    {
+      const unsigned char c = static_cast<unsigned char>(*p);
+      if (c >= 0x20 && c != '"' && c != '\\')
+        continue;
+
+      out_.append(run, p);
+      run = p + 1;
+      out_.push_back('\\');
+      switch (c)
+      {
+        case '"':
+        case '\\':
+          out_.push_back(static_cast<char>(c));
+          break;
+        case '\n':
+          out_.push_back('n');
+          break;
+        case '\r':
+          out_.push_back('r');
+          break;
+        case '\t':
+          out_.push_back('t');
+          break;
+        case '\b':
+          out_.push_back('b');
+          break;
+        case '\f':
+          out_.push_back('f');
+          break;
+        default:
+          out_.append("u00", 3);
+          out_.push_back(HEX[c >> 4]);
+          out_.push_back(HEX[c & 0xF]);
+          break;
+      }
+    }
+    out_.append(run, end);
+    out_.push_back('"');
+  }
+
+  /**
+   * @brief Whether text follows the JSON number grammar
+   * @details YAML accepts forms that JSON does not, such as leading zeros (0123), a missing integer part (-.5), digit
+   * separators (1_000) or a plus sign, so numbers are only copied verbatim when JSON parsers will read them back
+   */
+  static bool isNumber(const char* p, const char* const last)
+  {
+    if (p != last && *p == '-')
+      ++p;
+    if (p == last || !detail::isDigit(*p))
+      return false;
+    if (*p++ != '0')
+      while (p != last && detail::isDigit(*p))
+        ++p;
+
+    if (p != last && *p == '.')
+    {
+      if (++p == last || !detail::isDigit(*p))
+        return false;
+      while (p != last && detail::isDigit(*p))
+        ++p;
+    }
+
+    if (p != last && (*p == 'e' || *p == 'E'))
+    {
+      if (++p != last && (*p == '+' || *p == '-'))
+        ++p;
+      if (p == last || !detail::isDigit(*p))
+        return false;
+      while (p != last && detail::isDigit(*p))
+        ++p;
+    }
+    return p == last;
+  }
+
+  /**
+   * @brief Writes a YAML scalar as a JSON string, number or literal
+   */
+  void scalar(const std::string& text, const bool quoted)
+  {
+    double number;
+    if (quoted)
+      string(text.data(), text.size());
+    else if (text == "true" || text == "false" || text == "null")
+      raw(text.data(), text.size());
+    else if (text == "~")
+      null();
+    else if (isNumber(text.data(), text.data() + text.size()) &&
+             parseNumber(text.data(), text.data() + text.size(), number) && std::isfinite(number))
+      raw(text.data(), text.size());
+    else
+      string(text.data(), text.size());
+  }
+
+  std::string& out_;
+  bool first_ = true;
+  bool after_key_ = false;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_JSON_EMITTER_H
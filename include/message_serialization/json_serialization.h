@@ -0,0 +1,238 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_JSON_SERIALIZATION_H
+#define MESSAGE_SERIALIZATION_JSON_SERIALIZATION_H
+
+#include <fstream>
+#include <message_serialization/json_emitter.h>
+#include <message_serialization/metrics.h>
+#include <message_serialization/output_file.h>
+#include <message_serialization/serialize.h>
+#include <message_serialization/yaml_reader.h>
+#include <message_serialization/yaml_writer.h>
+#include <ros/console.h>
+
+namespace message_serialization
+{
+namespace detail
+{
+/**
+ * @brief Appends the JSON encoding of an object to a string
+ * @return number of nodes written, as counted by @ref YamlWriter::nodes
+ */
+template <class T>
+inline std::size_t emitJson(std::string& json, const T& val)
+{
+  JsonEmitter out(json);
+  YamlWriter writer(out);
+  emit(writer, val);
+  return writer.nodes();
+}
+
+/**
+ * @brief Reads the whole contents of a file
+ * @throws exception on failure to open or read the file
+ */
+inline std::string readTextFile(const std::string& file)
+{
+  std::ifstream ifs(file, std::ios::in | std::ios::binary);
+  if (!ifs)
+    throw std::runtime_error("Failed to open input file stream at '" + file + "'");
+
+  std::string text(fileSize(file), '\0');
+  if (!ifs.read(&text[0], static_cast<std::streamsize>(text.size())))
+    throw std::runtime_error("Failed to read input file '" + file + "'");
+  return text;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Serializes an input object to a JSON-formatted file
+ * @details JSON is written directly through the object's @ref emit overload, without yaml-cpp, with the field layout of
+ * @ref YamlOptions::json. Floating point values are written as the shortest text that parses back to exactly the same
+ * value
+ * @param val
+ * @param file
+ * @param file_options Atomicity, sync policy and write strategy of the file
+ * @throws exception on failure to open or write to the file
+ */
+template <class T>
+inline void serializeToJson(const T& val, const std::string& file,
+                            const FileWriteOptions& file_options = FileWriteOptions())
+{
+  MESSAGE_SERIALIZATION_METRICS_CALL(metrics, T, SERIALIZE_JSON);
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, ENCODE);
+  std::string json;
+  const std::size_t nodes = detail::emitJson(json, val);
+  MESSAGE_SERIALIZATION_METRICS_NODES(metrics, nodes);
+  MESSAGE_SERIALIZATION_METRICS_BYTES(metrics, json.size());
+
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
+  OutputFile output(file, file_options);
+  output.write(json.data(), json.size());
+  output.commit();
+  MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
+}
+
+/**
+ * @brief Serializes an input object to a JSON-formatted file
+ * @param file
+ * @param val
+ * @param file_options
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool serializeToJson(const std::string& file, const T& val,
+                            const FileWriteOptions& file_options = FileWriteOptions()) noexcept
+{
+  try
+  {
+    serializeToJson<T>(val, file, file_options);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM(ex.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Serializes an input object to a JSON-formatted string
+ * @param val
+ * @return
+ * @throws exception on failure to emit the object
+ */
+template <class T>
+inline std::string serializeToJsonString(const T& val)
+{
+  std::string json;
+  detail::emitJson(json, val);
+  return json;
+}
+
+/**
+ * @brief Serializes an input object to a JSON-formatted string
+ * @details The string keeps its capacity, so encoding objects of similar size into the same string repeatedly does not
+ * reallocate it once it has grown to fit them
+ * @param json (output) Its contents are replaced by the JSON text
+ * @param val
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool serializeToJsonString(std::string& json, const T& val) noexcept
+{
+  try
+  {
+    json.clear();
+    detail::emitJson(json, val);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM(ex.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Deserializes a JSON string into a specific object type
+ * @details The string is parsed in place by @ref YamlReader::fromJson and decoded through the object's @ref parse
+ * overload; pass it as an rvalue to avoid copying it. Output of rospy_message_converter, including the NaN and Infinity
+ * literals of Python's json module, is accepted
+ * @param json
+ * @return
+ * @throws exception when unable to parse the string or convert it to the specified type
+ */
+template <class T>
+inline T deserializeFromJsonString(std::string json)
+{
+  YamlReader reader = YamlReader::fromJson(std::move(json));
+  T val;
+  parse(reader, val);
+  return val;
+}
+
+/**
+ * @brief Deserializes a JSON string into a specific object type
+ * @param json
+ * @param val (output)
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool deserializeFromJsonString(std::string json, T& val) noexcept
+{
+  try
+  {
+    val = deserializeFromJsonString<T>(std::move(json));
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM("Deserialization error: " << ex.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Deserializes a JSON-formatted file into a specific object type
+ * @details The file is read into memory at once and parsed in place, see @ref deserializeFromJsonString
+ * @param file
+ * @return
+ * @throws exception when unable to load the file or convert it to the specified type
+ */
+template <class T>
+inline T deserializeFromJson(const std::string& file)
+{
+  MESSAGE_SERIALIZATION_METRICS_CALL(metrics, T, DESERIALIZE_JSON);
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
+  std::string json = detail::readTextFile(file);
+  MESSAGE_SERIALIZATION_METRICS_BYTES(metrics, json.size());
+
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, DECODE);
+  YamlReader reader = YamlReader::fromJson(std::move(json));
+  MESSAGE_SERIALIZATION_METRICS_NODES(metrics, reader.nodes());
+  T val;
+  parse(reader, val);
+  MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
+  return val;
+}
+
+/**
+ * @brief Deserializes a JSON-formatted file into a specific object type
+ * @param file
+ * @param val
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool deserializeFromJson(const std::string& file, T& val) noexcept
+{
+  try
+  {
+    val = deserializeFromJson<T>(file);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM("Deserialization error: " << ex.what());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_JSON_SERIALIZATION_H
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_MAPPED_FILE_H
+#define MESSAGE_SERIALIZATION_MAPPED_FILE_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace message_serialization
+{
+/**
+ * @brief Read-only memory mapping of an entire file
+ * @details The mapping is released when the object is destroyed. Empty files are represented by a null data pointer
+ * and a size of zero
+ */
+class MappedFile
+{
+public:
+  /**
+   * @brief Maps a file into memory
+   * @param file
+   * @param sequential Advises the kernel that the mapping will be read front to back, enabling aggressive read-ahead
+   * @throws on failure to open, stat or map the file
+   */
+  explicit MappedFile(const std::string& file, const bool sequential = true)
+  {
+    const int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::runtime_error("Failed to open file '" + file + "': " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+      const int err = errno;
+      ::close(fd);
+      throw std::runtime_error("Failed to stat file '" + file + "': " + std::strerror(err));
+    }
+
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ > 0)
+    {
+      void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED)
+      {
+        const int err = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to map file '" + file + "': " + std::strerror(err));
+      }
+      data_ = static_cast<uint8_t*>(addr);
+
+      // The advice is only a hint, so failure is not an error
+      if (sequential)
+        ::madvise(addr, size_, MADV_SEQUENTIAL);
+    }
+
+    // The mapping remains valid after the descriptor is closed
+    ::close(fd);
+  }
+
+  MappedFile(MappedFile&& other) noexcept : data_(other.data_), size_(other.size_)
+  {
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+
+  MappedFile& operator=(MappedFile&& other) noexcept
+  {
+    if (this != &other)
+    {
+      unmap();
+      data_ = other.data_;
+      size_ = other.size_;
+      other.data_ = nullptr;
+      other.size_ = 0;
+    }
+    return *this;
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile()
+  {
+    unmap();
+  }
+
+  const uint8_t* data() const
+  {
+    return data_;
+  }
+
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+private:
+  void unmap()
+  {
+    if (data_)
+      ::munmap(data_, size_);
+    data_ = nullptr;
+  }
+
+  uint8_t* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_MAPPED_FILE_H
@@ -0,0 +1,265 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_MESSAGE_REGISTRY_H
+#define MESSAGE_SERIALIZATION_MESSAGE_REGISTRY_H
+
+#include <functional>
+#include <map>
+#include <message_serialization/binary_serialization.h>
+#include <message_serialization/geometry_msgs_yaml.h>
+#include <message_serialization/json_serialization.h>
+#include <message_serialization/sensor_msgs_yaml.h>
+#include <message_serialization/serialize.h>
+#include <message_serialization/shape_msgs_yaml.h>
+#include <message_serialization/std_msgs_yaml.h>
+#include <message_serialization/trajectory_msgs_yaml.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace message_serialization
+{
+/**
+ * @brief File formats of serialized messages
+ */
+enum class MessageFormat : uint8_t
+{
+  BINARY,
+  YAML,
+  JSON
+};
+
+/**
+ * @brief Parses a format name (binary, yaml or json)
+ * @throws std::invalid_argument for any other name
+ */
+inline MessageFormat messageFormat(const std::string& name)
+{
+  if (name == "binary")
+    return MessageFormat::BINARY;
+  if (name == "yaml")
+    return MessageFormat::YAML;
+  if (name == "json")
+    return MessageFormat::JSON;
+  throw std::invalid_argument("Unknown message format '" + name + "' (expected binary, yaml or json)");
+}
+
+/**
+ * @brief Format of a file deduced from its extension: .yaml and .yml files are YAML, .json files are JSON and any
+ * other file is binary
+ */
+inline MessageFormat messageFormatOf(const std::string& file)
+{
+  const std::size_t dot = file.rfind('.');
+  const std::string extension = dot == std::string::npos || file.find('/', dot) != std::string::npos ?
+                                    std::string() :
+                                    file.substr(dot + 1);
+  if (extension == "yaml" || extension == "yml")
+    return MessageFormat::YAML;
+  if (extension == "json")
+    return MessageFormat::JSON;
+  return MessageFormat::BINARY;
+}
+
+/**
+ * @brief Conventional file extension of a format, without the dot
+ */
+inline const char* messageFormatExtension(const MessageFormat format)
+{
+  switch (format)
+  {
+    case MessageFormat::YAML:
+      return "yaml";
+    case MessageFormat::JSON:
+      return "json";
+    default:
+      return "msg";
+  }
+}
+
+/**
+ * @brief Options of the files written by @ref convertMessageFile
+ */
+struct ConversionOptions
+{
+  /**
+   * @brief Layout of YAML output; JSON is written by @ref serializeToJson, which has no options
+   */
+  YamlOptions yaml;
+  BinaryWriteOptions binary;
+  FileWriteOptions file;
+};
+
+/**
+ * @brief Reads a message file in the given format
+ * @throws exception when unable to load or decode the file
+ */
+template <typename T>
+inline T readMessageFile(const std::string& file, const MessageFormat format)
+{
+  if (format == MessageFormat::BINARY)
+    return deserializeFromBinary<T>(file);
+  if (format == MessageFormat::JSON)
+    return deserializeFromJson<T>(file);
+  return deserialize<T>(file);
+}
+
+/**
+ * @brief Writes a message file in the given format
+ * @throws exception when unable to encode or write the file
+ */
+template <typename T>
+inline void writeMessageFile(const T& message, const std::string& file, const MessageFormat format,
+                             const ConversionOptions& options = ConversionOptions())
+{
+  if (format == MessageFormat::BINARY)
+    serializeToBinary(message, file, options.binary, options.file);
+  else if (format == MessageFormat::JSON)
+    serializeToJson(message, file, options.file);
+  else
+    serialize(message, file, options.yaml, options.file);
+}
+
+/**
+ * @brief Converts a message file from one format to another
+ * @throws exception when unable to load, decode, encode or write the files
+ */
+template <typename T>
+inline void convertMessageFile(const std::string& input, const MessageFormat input_format, const std::string& output,
+                               const MessageFormat output_format,
+                               const ConversionOptions& options = ConversionOptions())
+{
+  writeMessageFile(readMessageFile<T>(input, input_format), output, output_format, options);
+}
+
+/**
+ * @brief Maps ROS message type names to the functions converting files of that type, for tools that only know the
+ * type of their input at runtime
+ * @details Types are registered by their ROS name (e.g. `geometry_msgs/PoseStamped`), and can be looked up by that
+ * name or by the Python (`geometry_msgs.msg.PoseStamped`) or C++ (`geometry_msgs::PoseStamped`) spelling of it. The
+ * registry is not synchronized: register types before looking them up from several threads.
+ */
+class MessageRegistry
+{
+public:
+  typedef std::function<void(const std::string&, MessageFormat, const std::string&, MessageFormat,
+                             const ConversionOptions&)>
+      Converter;
+
+  /**
+   * @brief Registry of all message types with converters in this package
+   */
+  static MessageRegistry& builtin()
+  {
+    static MessageRegistry registry = makeBuiltin();
+    return registry;
+  }
+
+  /**
+   * @brief Registers a message type under its ROS name, replacing any type registered under the same name
+   */
+  template <typename T>
+  void add(const std::string& type)
+  {
+    converters_[normalize(type)] = &convertMessageFile<T>;
+  }
+
+  bool contains(const std::string& type) const
+  {
+    return converters_.count(normalize(type)) > 0;
+  }
+
+  /**
+   * @brief Names of the registered types, in alphabetical order
+   */
+  std::vector<std::string> types() const
+  {
+    std::vector<std::string> types;
+    for (const auto& entry : converters_)
+      types.push_back(entry.first);
+    return types;
+  }
+
+  /**
+   * @brief Returns the converter of a type
+   * @throws std::invalid_argument if the type is not registered
+   */
+  const Converter& converter(const std::string& type) const
+  {
+    const auto it = converters_.find(normalize(type));
+    if (it == converters_.end())
+      throw std::invalid_argument("Unsupported message type '" + type + "'");
+    return it->second;
+  }
+
+  /**
+   * @brief Converts a message file of a registered type from one format to another
+   * @throws std::invalid_argument if the type is not registered, or exception on failure to convert the file
+   */
+  void convert(const std::string& type, const std::string& input, const MessageFormat input_format,
+               const std::string& output, const MessageFormat output_format,
+               const ConversionOptions& options = ConversionOptions()) const
+  {
+    converter(type)(input, input_format, output, output_format, options);
+  }
+
+  /**
+   * @brief ROS name of a type given in the ROS, Python or C++ spelling
+   */
+  static std::string normalize(std::string type)
+  {
+    const std::size_t cpp = type.find("::");
+    if (cpp != std::string::npos)
+      return type.replace(cpp, 2, "/");
+    const std::size_t python = type.find(".msg.");
+    if (python != std::string::npos)
+      return type.replace(python, 5, "/");
+    return type;
+  }
+
+private:
+  static MessageRegistry makeBuiltin()
+  {
+    MessageRegistry registry;
+    registry.add<std_msgs::Header>("std_msgs/Header");
+
+    registry.add<geometry_msgs::Vector3>("geometry_msgs/Vector3");
+    registry.add<geometry_msgs::Point>("geometry_msgs/Point");
+    registry.add<geometry_msgs::Quaternion>("geometry_msgs/Quaternion");
+    registry.add<geometry_msgs::Pose>("geometry_msgs/Pose");
+    registry.add<geometry_msgs::PoseStamped>("geometry_msgs/PoseStamped");
+    registry.add<geometry_msgs::PoseArray>("geometry_msgs/PoseArray");
+    registry.add<geometry_msgs::Transform>("geometry_msgs/Transform");
+    registry.add<geometry_msgs::TransformStamped>("geometry_msgs/TransformStamped");
+
+    registry.add<sensor_msgs::RegionOfInterest>("sensor_msgs/RegionOfInterest");
+    registry.add<sensor_msgs::CameraInfo>("sensor_msgs/CameraInfo");
+    registry.add<sensor_msgs::JointState>("sensor_msgs/JointState");
+
+    registry.add<shape_msgs::MeshTriangle>("shape_msgs/MeshTriangle");
+    registry.add<shape_msgs::Mesh>("shape_msgs/Mesh");
+
+    registry.add<trajectory_msgs::JointTrajectoryPoint>("trajectory_msgs/JointTrajectoryPoint");
+    registry.add<trajectory_msgs::JointTrajectory>("trajectory_msgs/JointTrajectory");
+    return registry;
+  }
+
+  std::map<std::string, Converter> converters_;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_MESSAGE_REGISTRY_H
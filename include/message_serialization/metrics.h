@@ -0,0 +1,573 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_METRICS_H
+#define MESSAGE_SERIALIZATION_METRICS_H
+
+/*
+ * Metrics and tracing
+ *
+ * Defining MESSAGE_SERIALIZATION_WITH_METRICS before including any header of this package instruments serialize,
+ * deserialize, serializeToBinary and deserializeFromBinary (including the memory-mapped variant). Every call is
+ * recorded per type and operation in Metrics::instance(): call, error and byte counts, YAML node counts, allocation
+ * counts and latency histograms of the whole call and of its encode, decode and I/O phases. Calls can also be recorded
+ * as Chrome trace events (chrome://tracing, Perfetto) between Metrics::startTrace and Metrics::writeTrace.
+ *
+ * Without the definition, the instrumentation macros expand to nothing and none of this code is compiled into the
+ * instrumented functions.
+ *
+ * Allocation counts require the global allocation functions to be replaced, which a header-only library cannot do on
+ * its own: expand MESSAGE_SERIALIZATION_DEFINE_ALLOCATION_COUNTER at global scope in exactly one translation unit of
+ * the program. Otherwise, allocation counts stay at zero.
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ros/message_traits.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <typeinfo>
+#include <unistd.h>
+#include <vector>
+
+namespace message_serialization
+{
+enum class MetricsOperation : uint8_t
+{
+  SERIALIZE,
+  DESERIALIZE,
+  SERIALIZE_BINARY,
+  DESERIALIZE_BINARY,
+  SERIALIZE_JSON,
+  DESERIALIZE_JSON
+};
+
+/**
+ * @brief Parts of a call that are timed separately
+ * @details Where the encoder writes to or the decoder reads from a file stream as it goes, the buffered I/O is
+ * included in the encode or decode phase; the I/O phase then covers opening, flushing and syncing the file. Reading a
+ * compressed binary file counts as I/O, including its decompression
+ */
+enum class MetricsPhase : uint8_t
+{
+  ENCODE,
+  DECODE,
+  IO
+};
+
+inline const char* operationName(const MetricsOperation operation)
+{
+  switch (operation)
+  {
+    case MetricsOperation::SERIALIZE:
+      return "serialize";
+    case MetricsOperation::DESERIALIZE:
+      return "deserialize";
+    case MetricsOperation::SERIALIZE_BINARY:
+      return "serializeToBinary";
+    case MetricsOperation::DESERIALIZE_BINARY:
+      return "deserializeFromBinary";
+    case MetricsOperation::SERIALIZE_JSON:
+      return "serializeToJson";
+    case MetricsOperation::DESERIALIZE_JSON:
+      return "deserializeFromJson";
+  }
+  return "unknown";
+}
+
+inline const char* phaseName(const MetricsPhase phase)
+{
+  switch (phase)
+  {
+    case MetricsPhase::ENCODE:
+      return "encode";
+    case MetricsPhase::DECODE:
+      return "decode";
+    case MetricsPhase::IO:
+      return "io";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Histogram of latencies with power-of-two buckets: bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds
+ * (bucket 0 also counts latencies under a nanosecond, and the last bucket everything above its lower bound)
+ */
+struct LatencyHistogram
+{
+  static constexpr std::size_t BUCKETS = 40;
+
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+  std::array<uint64_t, BUCKETS> buckets = {};
+
+  void add(const uint64_t ns)
+  {
+    std::size_t bucket = 0;
+    while (bucket + 1 < BUCKETS && (ns >> (bucket + 1)) != 0)
+      ++bucket;
+    ++buckets[bucket];
+    ++count;
+    total_ns += ns;
+    max_ns = std::max(max_ns, ns);
+  }
+
+  double meanNs() const
+  {
+    return count == 0 ? 0.0 : static_cast<double>(total_ns) / static_cast<double>(count);
+  }
+
+  /**
+   * @brief Upper bound of the given quantile (in [0, 1]) of the latencies, in nanoseconds
+   */
+  uint64_t quantileNs(const double q) const
+  {
+    const double rank = q * static_cast<double>(count);
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKETS; ++i)
+    {
+      seen += buckets[i];
+      if (seen > 0 && static_cast<double>(seen) >= rank)
+        return std::min<uint64_t>(max_ns, (uint64_t(2) << i) - 1);
+    }
+    return max_ns;
+  }
+};
+
+/**
+ * @brief Metrics of one operation on one type
+ */
+struct TypeMetrics
+{
+  std::string type;
+  MetricsOperation operation;
+
+  uint64_t calls = 0;
+  /** @brief Calls that ended with an exception */
+  uint64_t errors = 0;
+  /** @brief Size of the encoded data written or read */
+  uint64_t bytes = 0;
+  /** @brief Heap allocations of the calling threads, see MESSAGE_SERIALIZATION_DEFINE_ALLOCATION_COUNTER */
+  uint64_t allocations = 0;
+  /** @brief YAML nodes (keys, scalars and collections) emitted or parsed */
+  uint64_t yaml_nodes = 0;
+  /** @brief Largest number of YAML nodes of a single call */
+  uint64_t peak_yaml_nodes = 0;
+
+  LatencyHistogram total;
+  LatencyHistogram encode;
+  LatencyHistogram decode;
+  LatencyHistogram io;
+
+  const LatencyHistogram& phase(const MetricsPhase p) const
+  {
+    return p == MetricsPhase::ENCODE ? encode : p == MetricsPhase::DECODE ? decode : io;
+  }
+
+  LatencyHistogram& phase(const MetricsPhase p)
+  {
+    return p == MetricsPhase::ENCODE ? encode : p == MetricsPhase::DECODE ? decode : io;
+  }
+};
+
+/**
+ * @brief Copy of all metrics recorded so far
+ */
+struct MetricsSnapshot
+{
+  std::vector<TypeMetrics> entries;
+
+  /**
+   * @brief Returns the metrics of an operation on a type, or nullptr if none was recorded
+   */
+  const TypeMetrics* find(const std::string& type, const MetricsOperation operation) const
+  {
+    for (const TypeMetrics& entry : entries)
+      if (entry.type == type && entry.operation == operation)
+        return &entry;
+    return nullptr;
+  }
+};
+
+namespace detail
+{
+/**
+ * @brief Number of heap allocations made by the calling thread, as counted by
+ * MESSAGE_SERIALIZATION_DEFINE_ALLOCATION_COUNTER
+ */
+inline uint64_t& threadAllocations() noexcept
+{
+  static thread_local uint64_t count = 0;
+  return count;
+}
+
+inline std::string demangle(const char* name)
+{
+  int status = 0;
+  std::unique_ptr<char, void (*)(void*)> demangled(abi::__cxa_demangle(name, nullptr, nullptr, &status), std::free);
+  return status == 0 && demangled ? std::string(demangled.get()) : std::string(name);
+}
+
+template <typename T>
+inline std::string typeName(std::true_type)
+{
+  return ros::message_traits::DataType<T>::value();
+}
+
+template <typename T>
+inline std::string typeName(std::false_type)
+{
+  return demangle(typeid(T).name());
+}
+
+/**
+ * @brief Name under which the metrics of a type are recorded: the ROS data type of messages (e.g.
+ * `geometry_msgs/Pose`) and the C++ type name of anything else
+ */
+template <typename T>
+inline const std::string& typeName()
+{
+  static const std::string name = typeName<T>(std::integral_constant<bool, ros::message_traits::IsMessage<T>::value>());
+  return name;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Process-wide registry of serialization metrics and trace events
+ */
+class Metrics
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  static Metrics& instance()
+  {
+    static Metrics metrics;
+    return metrics;
+  }
+
+  MetricsSnapshot snapshot() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MetricsSnapshot snapshot;
+    for (const auto& entry : metrics_)
+      snapshot.entries.push_back(entry.second);
+    return snapshot;
+  }
+
+  /**
+   * @brief Discards all metrics recorded so far
+   */
+  void reset()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    metrics_.clear();
+  }
+
+  /**
+   * @brief Starts recording trace events, discarding any recorded before
+   * @param max_events Events beyond this number are dropped and counted by @ref droppedTraceEvents
+   */
+  void startTrace(const std::size_t max_events = 1 << 20)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+    dropped_events_ = 0;
+    max_events_ = max_events;
+    trace_start_ = Clock::now();
+    tracing_ = true;
+  }
+
+  void stopTrace()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracing_ = false;
+  }
+
+  bool tracing() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tracing_;
+  }
+
+  std::size_t droppedTraceEvents() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_events_;
+  }
+
+  /**
+   * @brief Writes the recorded trace events to a file in the Chrome trace event format
+   * @details Each call is a complete ("X") event named after its type, with its phases as nested events
+   * @throws std::runtime_error on failure to write the file
+   */
+  void writeTrace(const std::string& file) const
+  {
+    std::ofstream out(file);
+    if (!out)
+      throw std::runtime_error("Failed to open trace file at '" + file + "'");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const long pid = static_cast<long>(::getpid());
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (std::size_t i = 0; i < events_.size(); ++i)
+    {
+      const TraceEvent& event = events_[i];
+      out << (i == 0 ? "\n" : ",\n") << "{\"name\":\"" << escape(event.name) << "\",\"cat\":\""
+          << operationName(event.operation) << "\",\"ph\":\"X\",\"ts\":" << microseconds(event.start_ns)
+          << ",\"dur\":" << microseconds(event.duration_ns) << ",\"pid\":" << pid << ",\"tid\":" << event.thread;
+      if (event.bytes > 0)
+        out << ",\"args\":{\"bytes\":" << event.bytes << "}";
+      out << "}";
+    }
+    out << "\n]}\n";
+    if (!out)
+      throw std::runtime_error("Failed to write trace file at '" + file + "'");
+  }
+
+  /**
+   * @brief Adds the metrics of a finished call
+   */
+  void record(const std::string& type, const MetricsOperation operation, const TypeMetrics& call)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TypeMetrics& entry = metrics_[std::make_tuple(type, operation)];
+    if (entry.calls == 0)
+    {
+      entry.type = type;
+      entry.operation = operation;
+    }
+
+    entry.calls += call.calls;
+    entry.errors += call.errors;
+    entry.bytes += call.bytes;
+    entry.allocations += call.allocations;
+    entry.yaml_nodes += call.yaml_nodes;
+    entry.peak_yaml_nodes = std::max(entry.peak_yaml_nodes, call.yaml_nodes);
+    merge(entry.total, call.total);
+    merge(entry.encode, call.encode);
+    merge(entry.decode, call.decode);
+    merge(entry.io, call.io);
+  }
+
+  /**
+   * @brief Adds a trace event if tracing is enabled
+   */
+  void trace(const std::string& name, const MetricsOperation operation, const Clock::time_point start,
+             const Clock::time_point end, const uint64_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!tracing_ || start < trace_start_)
+      return;
+    if (events_.size() >= max_events_)
+    {
+      ++dropped_events_;
+      return;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.operation = operation;
+    event.start_ns = nanoseconds(start - trace_start_);
+    event.duration_ns = nanoseconds(end - start);
+    event.bytes = bytes;
+    event.thread = std::hash<std::thread::id>()(std::this_thread::get_id()) % 1000000;
+    events_.push_back(event);
+  }
+
+  static uint64_t nanoseconds(const Clock::duration d)
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+  }
+
+private:
+  struct TraceEvent
+  {
+    std::string name;
+    MetricsOperation operation;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t bytes;
+    std::size_t thread;
+  };
+
+  static void merge(LatencyHistogram& lhs, const LatencyHistogram& rhs)
+  {
+    lhs.count += rhs.count;
+    lhs.total_ns += rhs.total_ns;
+    lhs.max_ns = std::max(lhs.max_ns, rhs.max_ns);
+    for (std::size_t i = 0; i < LatencyHistogram::BUCKETS; ++i)
+      lhs.buckets[i] += rhs.buckets[i];
+  }
+
+  static std::string microseconds(const uint64_t ns)
+  {
+    return std::to_string(ns / 1000) + "." + std::to_string(1000 + ns % 1000).substr(1);
+  }
+
+  static std::string escape(const std::string& s)
+  {
+    std::string escaped;
+    for (const char c : s)
+    {
+      if (c == '"' || c == '\\')
+        escaped.push_back('\\');
+      if (static_cast<unsigned char>(c) >= 0x20)
+        escaped.push_back(c);
+    }
+    return escaped;
+  }
+
+  mutable std::mutex mutex_;
+  std::map<std::tuple<std::string, MetricsOperation>, TypeMetrics> metrics_;
+
+  bool tracing_ = false;
+  Clock::time_point trace_start_;
+  std::size_t max_events_ = 0;
+  std::size_t dropped_events_ = 0;
+  std::vector<TraceEvent> events_;
+};
+
+namespace detail
+{
+/**
+ * @brief Measures one call of an instrumented function, moving through its phases with @ref phase
+ * @details The call counts as an error unless @ref done is called before the object is destroyed
+ */
+class MetricsCall
+{
+public:
+  MetricsCall(const std::string& type, const MetricsOperation operation)
+    : type_(type), operation_(operation), allocations_(threadAllocations()), start_(Metrics::Clock::now())
+  {
+    call_.calls = 1;
+  }
+
+  ~MetricsCall()
+  {
+    const Metrics::Clock::time_point end = endPhase();
+    call_.errors = done_ ? 0 : 1;
+    call_.allocations = threadAllocations() - allocations_;
+    call_.total.add(Metrics::nanoseconds(end - start_));
+
+    Metrics& metrics = Metrics::instance();
+    metrics.record(type_, operation_, call_);
+    metrics.trace(type_, operation_, start_, end, call_.bytes);
+  }
+
+  MetricsCall(const MetricsCall&) = delete;
+  MetricsCall& operator=(const MetricsCall&) = delete;
+
+  /**
+   * @brief Ends the current phase, if any, and starts the input one
+   */
+  void phase(const MetricsPhase phase)
+  {
+    phase_start_ = endPhase();
+    phase_ = phase;
+    in_phase_ = true;
+  }
+
+  void addBytes(const uint64_t bytes)
+  {
+    call_.bytes += bytes;
+  }
+
+  void addNodes(const uint64_t nodes)
+  {
+    call_.yaml_nodes += nodes;
+  }
+
+  void done()
+  {
+    done_ = true;
+  }
+
+private:
+  Metrics::Clock::time_point endPhase()
+  {
+    const Metrics::Clock::time_point now = Metrics::Clock::now();
+    if (in_phase_)
+    {
+      call_.phase(phase_).add(Metrics::nanoseconds(now - phase_start_));
+      Metrics::instance().trace(phaseName(phase_), operation_, phase_start_, now, 0);
+      in_phase_ = false;
+    }
+    return now;
+  }
+
+  const std::string& type_;
+  const MetricsOperation operation_;
+  const uint64_t allocations_;
+  const Metrics::Clock::time_point start_;
+  TypeMetrics call_;
+  MetricsPhase phase_ = MetricsPhase::ENCODE;
+  Metrics::Clock::time_point phase_start_;
+  bool in_phase_ = false;
+  bool done_ = false;
+};
+
+}  // namespace detail
+}  // namespace message_serialization
+
+/**
+ * @brief Defines the global allocation functions to count the allocations of each thread for the metrics
+ * @details Expand at global scope in exactly one translation unit of a program built with metrics. operator delete is
+ * kept out of line: once inlined, GCC sees free() called on memory from a new expression and warns about mismatched
+ * allocation functions (-Wmismatched-new-delete)
+ */
+#define MESSAGE_SERIALIZATION_DEFINE_ALLOCATION_COUNTER                                                                \
+  void* operator new(std::size_t size)                                                                                 \
+  {                                                                                                                    \
+    ++::message_serialization::detail::threadAllocations();                                                           \
+    if (void* ptr = std::malloc(size > 0 ? size : 1))                                                                  \
+      return ptr;                                                                                                      \
+    throw std::bad_alloc();                                                                                            \
+  }                                                                                                                    \
+  __attribute__((noinline)) void operator delete(void* ptr) noexcept                                                   \
+  {                                                                                                                    \
+    std::free(ptr);                                                                                                    \
+  }
+
+#ifdef MESSAGE_SERIALIZATION_WITH_METRICS
+#define MESSAGE_SERIALIZATION_METRICS_CALL(call, T, operation)                                                         \
+  ::message_serialization::detail::MetricsCall call(::message_serialization::detail::typeName<T>(),                   \
+                                                    ::message_serialization::MetricsOperation::operation)
+#define MESSAGE_SERIALIZATION_METRICS_PHASE(call, name) call.phase(::message_serialization::MetricsPhase::name)
+#define MESSAGE_SERIALIZATION_METRICS_BYTES(call, bytes) call.addBytes(bytes)
+#define MESSAGE_SERIALIZATION_METRICS_NODES(call, nodes) call.addNodes(nodes)
+#define MESSAGE_SERIALIZATION_METRICS_DONE(call) call.done()
+#else
+#define MESSAGE_SERIALIZATION_METRICS_CALL(call, T, operation)
+#define MESSAGE_SERIALIZATION_METRICS_PHASE(call, name)
+// The arguments are not evaluated, but still count as used
+#define MESSAGE_SERIALIZATION_METRICS_BYTES(call, bytes) static_cast<void>(sizeof(bytes))
+#define MESSAGE_SERIALIZATION_METRICS_NODES(call, nodes) static_cast<void>(sizeof(nodes))
+#define MESSAGE_SERIALIZATION_METRICS_DONE(call)
+#endif
+
+#endif  // MESSAGE_SERIALIZATION_METRICS_H
@@ -0,0 +1,446 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_NUMERIC_H
+#define MESSAGE_SERIALIZATION_NUMERIC_H
+
+#include <algorithm>
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <locale.h>
+#include <locale>
+#include <message_serialization/grisu2.h>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+namespace message_serialization
+{
+/**
+ * @brief Size of a buffer large enough to hold any number formatted by @ref formatNumber
+ */
+const std::size_t NUMBER_BUFFER_SIZE = 32;
+
+namespace detail
+{
+/**
+ * @brief Writes the digits of a number followed by a number of zeros
+ */
+inline char* writeDigits(char* p, const char* digits, const int length, const int zeros)
+{
+  std::memcpy(p, digits, static_cast<std::size_t>(length));
+  std::memset(p + length, '0', static_cast<std::size_t>(zeros));
+  return p + length + zeros;
+}
+
+/**
+ * @brief Formats a finite floating point value with the fewest significant digits that still parse back to exactly
+ * the same value
+ * @details The digits are computed with @ref grisu2::digits, which gives one digit more than the shortest for a small
+ * fraction of values. They are laid out like printf's %g with trailing zeros stripped: positional notation, unless the
+ * decimal exponent is below -4 or at least the precision (the number of digits, but no less than digits10), in which
+ * case scientific notation with a signed exponent of at least two digits is used.
+ */
+template <typename T>
+inline std::size_t formatShortest(char* buffer, T value)
+{
+  char* p = buffer;
+  if (std::signbit(value))
+  {
+    *p++ = '-';
+    value = -value;
+  }
+  if (value == 0)
+  {
+    *p++ = '0';
+    *p = '\0';
+    return static_cast<std::size_t>(p - buffer);
+  }
+
+  char digits[20];
+  int length;
+  int exponent;
+  grisu2::digits(digits, length, exponent, value);
+  while (length > 1 && digits[length - 1] == '0')
+  {
+    --length;
+    ++exponent;
+  }
+
+  const int precision = std::max(length, std::numeric_limits<T>::digits10);
+  const int leading = length + exponent - 1;  // Decimal exponent of the first digit
+  if (leading >= -4 && leading < precision)
+  {
+    if (leading < 0)
+    {
+      *p++ = '0';
+      *p++ = '.';
+      std::memset(p, '0', static_cast<std::size_t>(-leading - 1));
+      p = writeDigits(p - leading - 1, digits, length, 0);
+    }
+    else if (length <= leading + 1)
+    {
+      p = writeDigits(p, digits, length, leading + 1 - length);
+    }
+    else
+    {
+      p = writeDigits(p, digits, leading + 1, 0);
+      *p++ = '.';
+      p = writeDigits(p, digits + leading + 1, length - leading - 1, 0);
+    }
+  }
+  else
+  {
+    *p++ = digits[0];
+    if (length > 1)
+    {
+      *p++ = '.';
+      p = writeDigits(p, digits + 1, length - 1, 0);
+    }
+    *p++ = 'e';
+    *p++ = leading < 0 ? '-' : '+';
+    int magnitude = leading < 0 ? -leading : leading;
+    if (magnitude >= 100)
+    {
+      *p++ = static_cast<char>('0' + magnitude / 100);
+      magnitude %= 100;
+    }
+    *p++ = static_cast<char>('0' + magnitude / 10);
+    *p++ = static_cast<char>('0' + magnitude % 10);
+  }
+
+  *p = '\0';
+  return static_cast<std::size_t>(p - buffer);
+}
+
+/**
+ * @brief Formats a non-finite value in YAML notation
+ */
+inline std::size_t formatNonFinite(char* buffer, const double value)
+{
+  const char* text = std::isnan(value) ? ".nan" : (value > 0.0 ? ".inf" : "-.inf");
+  const std::size_t size = std::strlen(text);
+  std::memcpy(buffer, text, size + 1);
+  return size;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Formats a floating point value as the shortest decimal string that parses back to exactly the same value
+ * @details Non-finite values use the YAML notation (.nan, .inf, -.inf) understood by yaml-cpp. The output is
+ * independent of the current locale.
+ * @param buffer (output) Null-terminated text; must hold at least NUMBER_BUFFER_SIZE characters
+ * @param value
+ * @return number of characters written, excluding the terminator
+ */
+inline std::size_t formatNumber(char* buffer, const double value)
+{
+  if (!std::isfinite(value))
+    return detail::formatNonFinite(buffer, value);
+  return detail::formatShortest(buffer, value);
+}
+
+inline std::size_t formatNumber(char* buffer, const float value)
+{
+  if (!std::isfinite(value))
+    return detail::formatNonFinite(buffer, value);
+  return detail::formatShortest(buffer, value);
+}
+
+namespace detail
+{
+/**
+ * @brief Exact powers of ten representable by a double
+ */
+inline double exactPowerOfTen(const int exponent)
+{
+  static const double powers[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  return powers[exponent];
+}
+
+/**
+ * @brief Largest decimal exponent for which 10^exponent, and therefore the product or quotient of an exactly
+ * representable mantissa with it, is computed exactly (Clinger's fast path)
+ */
+template <typename T>
+struct FastPathLimits;
+
+template <>
+struct FastPathLimits<double>
+{
+  static constexpr int max_exponent = 22;
+  static constexpr uint64_t max_mantissa = uint64_t(1) << 53;
+};
+
+template <>
+struct FastPathLimits<float>
+{
+  static constexpr int max_exponent = 10;
+  static constexpr uint64_t max_mantissa = uint64_t(1) << 24;
+};
+
+/**
+ * @brief Checks whether 8 characters, loaded as a little-endian integer, are all decimal digits
+ */
+inline bool isEightDigits(const uint64_t chunk)
+{
+  return ((((chunk + 0x4646464646464646ULL) | (chunk - 0x3030303030303030ULL)) & 0x8080808080808080ULL) == 0);
+}
+
+/**
+ * @brief Converts 8 decimal digits, loaded as a little-endian integer, to their value with a few multiplications
+ * rather than a loop over the characters
+ */
+inline uint32_t parseEightDigits(uint64_t chunk)
+{
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 0x000F424000000064ULL;  // 100 + (1000000 << 32)
+  const uint64_t mul2 = 0x0000271000000001ULL;  // 1 + (10000 << 32)
+  chunk -= 0x3030303030303030ULL;
+  chunk = (chunk * 10) + (chunk >> 8);
+  chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+  return static_cast<uint32_t>(chunk);
+}
+
+inline bool isDigit(const char c)
+{
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+/**
+ * @brief Accumulates a run of decimal digits into a mantissa, keeping track of digits that did not fit
+ * @return pointer to the first character that is not a digit
+ */
+inline const char* parseDigits(const char* p, const char* last, uint64_t& mantissa, int& digits)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  // Consume 8 digits at a time while the mantissa is guaranteed not to overflow
+  while (last - p >= 8 && digits + 8 <= 19)
+  {
+    uint64_t chunk;
+    std::memcpy(&chunk, p, sizeof(chunk));
+    if (!isEightDigits(chunk))
+      break;
+    mantissa = mantissa * 100000000ULL + parseEightDigits(chunk);
+    digits += 8;
+    p += 8;
+  }
+#endif
+
+  for (; p != last && isDigit(*p); ++p)
+  {
+    if (digits < 19)
+      mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+    // Count digits beyond the 19 that fit so that the caller can fall back to the exact parser
+    ++digits;
+  }
+  return p;
+}
+
+#if defined(__GLIBC__)
+inline locale_t classicLocale()
+{
+  static const locale_t locale = ::newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+  return locale;
+}
+
+inline double parseClassic(const char* first, const char* last, double)
+{
+  const std::string text(first, last);
+  return ::strtod_l(text.c_str(), nullptr, classicLocale());
+}
+
+inline float parseClassic(const char* first, const char* last, float)
+{
+  const std::string text(first, last);
+  return ::strtof_l(text.c_str(), nullptr, classicLocale());
+}
+#else
+template <typename T>
+inline T parseClassic(const char* first, const char* last, T)
+{
+  std::istringstream stream(std::string(first, last));
+  stream.imbue(std::locale::classic());
+  T value = 0;
+  stream >> value;
+  return value;
+}
+#endif
+
+template <typename T>
+inline bool parseFloatingPoint(const char* first, const char* last, T& value)
+{
+  const char* p = first;
+  const bool negative = p != last && *p == '-';
+  if (p != last && (*p == '-' || *p == '+'))
+    ++p;
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  const char* const int_begin = p;
+  p = parseDigits(p, last, mantissa, digits);
+  const int int_digits = static_cast<int>(p - int_begin);
+
+  int exponent = 0;
+  int frac_digits = 0;
+  if (p != last && *p == '.')
+  {
+    ++p;
+    const char* const frac_begin = p;
+    p = parseDigits(p, last, mantissa, digits);
+    frac_digits = static_cast<int>(p - frac_begin);
+    exponent -= frac_digits;
+  }
+
+  if (int_digits + frac_digits == 0)
+    return false;
+
+  if (p != last && (*p == 'e' || *p == 'E'))
+  {
+    ++p;
+    const bool exp_negative = p != last && *p == '-';
+    if (p != last && (*p == '-' || *p == '+'))
+      ++p;
+    if (p == last || !isDigit(*p))
+      return false;
+
+    int exp_value = 0;
+    for (; p != last && isDigit(*p); ++p)
+    {
+      if (exp_value < 100000)
+        exp_value = exp_value * 10 + (*p - '0');
+    }
+    exponent += exp_negative ? -exp_value : exp_value;
+  }
+
+  if (p != last)
+    return false;
+
+  // Clinger's fast path: an exactly representable mantissa scaled by an exactly representable power of ten is
+  // correctly rounded by a single floating point operation
+  if (digits <= 19 && mantissa <= FastPathLimits<T>::max_mantissa &&
+      exponent >= -FastPathLimits<T>::max_exponent && exponent <= FastPathLimits<T>::max_exponent)
+  {
+    T result = static_cast<T>(mantissa);
+    if (exponent < 0)
+      result = result / static_cast<T>(exactPowerOfTen(-exponent));
+    else
+      result = result * static_cast<T>(exactPowerOfTen(exponent));
+    value = negative ? -result : result;
+    return true;
+  }
+
+  // Long mantissas and large exponents need an exact conversion; use the C library independently of the locale
+  value = parseClassic(first, last, T());
+  return true;
+}
+
+template <typename T>
+inline bool parseInteger(const char* first, const char* last, T& value)
+{
+  const char* p = first;
+  const bool negative = p != last && *p == '-';
+  if (p != last && (*p == '-' || *p == '+'))
+    ++p;
+  if (p == last)
+    return false;
+
+  if (negative && !std::numeric_limits<T>::is_signed)
+    return false;
+
+  // Accumulate the magnitude in the widest unsigned type and check the range of the target type at the end
+  const uint64_t limit = negative ? static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1 :
+                                    static_cast<uint64_t>(std::numeric_limits<T>::max());
+  uint64_t magnitude = 0;
+  if (last - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+  {
+    for (p += 2; p != last; ++p)
+    {
+      const char c = *p;
+      uint64_t digit;
+      if (isDigit(c))
+        digit = static_cast<uint64_t>(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        digit = static_cast<uint64_t>(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        digit = static_cast<uint64_t>(c - 'A' + 10);
+      else
+        return false;
+
+      if (magnitude > (limit - digit) / 16)
+        return false;
+      magnitude = magnitude * 16 + digit;
+    }
+  }
+  else
+  {
+    for (; p != last; ++p)
+    {
+      if (!isDigit(*p))
+        return false;
+      const uint64_t digit = static_cast<uint64_t>(*p - '0');
+      if (magnitude > (limit - digit) / 10)
+        return false;
+      magnitude = magnitude * 10 + digit;
+    }
+  }
+
+  value = negative ? static_cast<T>(0 - magnitude) : static_cast<T>(magnitude);
+  return true;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Parses a decimal floating point number, independently of the current locale
+ * @details Numbers with up to 15 significant digits and moderate exponents, which covers most text written by
+ * @ref formatNumber, are converted with a single exact floating point operation after scanning the digits eight at a
+ * time. Other numbers fall back to the C library's correctly rounded conversion. Non-finite values are not accepted
+ * @param first
+ * @param last
+ * @param value (output)
+ * @return false if the text is not a number
+ */
+inline bool parseNumber(const char* first, const char* last, double& value)
+{
+  return detail::parseFloatingPoint(first, last, value);
+}
+
+inline bool parseNumber(const char* first, const char* last, float& value)
+{
+  return detail::parseFloatingPoint(first, last, value);
+}
+
+/**
+ * @brief Parses a decimal or hexadecimal (0x prefix) integer
+ * @return false if the text is not an integer or does not fit in the output type
+ */
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value, bool>::type parseNumber(const char* first,
+                                                                                    const char* last, T& value)
+{
+  return detail::parseInteger(first, last, value);
+}
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_NUMERIC_H
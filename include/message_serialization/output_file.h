@@ -0,0 +1,352 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_OUTPUT_FILE_H
+#define MESSAGE_SERIALIZATION_OUTPUT_FILE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace message_serialization
+{
+/**
+ * @brief When written files are flushed from the page cache to the storage device
+ */
+enum class SyncPolicy
+{
+  /** @brief Leave flushing to the operating system; fastest, but a power loss may lose recently written files */
+  NONE,
+  /** @brief Flush each file with fdatasync before the write call returns */
+  DATA,
+  /**
+   * @brief Record each file in a @ref SyncBatch, which flushes all of them at once when synced
+   * @details Atomic files are still flushed before they are renamed into place, since a rename that reaches the disk
+   * before the data could otherwise replace the previous contents with an empty file on power loss; only the flush of
+   * their directory is deferred
+   */
+  DEFERRED
+};
+
+class SyncBatch;
+
+/**
+ * @brief Options controlling how files are written to disk, independent of their format
+ */
+struct FileWriteOptions
+{
+  /**
+   * @brief Write to a temporary file in the same directory and rename it over the destination once complete
+   * @details Readers then see either the previous contents or the new contents, never a partially written file, even if
+   * the writing process crashes
+   */
+  bool atomic = false;
+
+  SyncPolicy sync = SyncPolicy::NONE;
+
+  /**
+   * @brief Batch recording the files to flush when @ref sync is SyncPolicy::DEFERRED; must outlive the write call
+   */
+  SyncBatch* batch = nullptr;
+
+  /**
+   * @brief Encode the whole file in memory and write it with a single write() on a file descriptor instead of through
+   * a buffered std::ofstream
+   * @details This avoids copying the data through the stream buffer, which pays off for large files, at the cost of
+   * holding the encoded file in memory. Compressed binary files are always written through a stream
+   */
+  bool single_write = false;
+};
+
+namespace detail
+{
+inline std::runtime_error systemError(const std::string& what, const std::string& file)
+{
+  return std::runtime_error(what + " '" + file + "': " + std::strerror(errno));
+}
+
+inline std::string parentDirectory(const std::string& file)
+{
+  const std::string::size_type slash = file.find_last_of('/');
+  if (slash == std::string::npos)
+    return ".";
+  return slash == 0 ? "/" : file.substr(0, slash);
+}
+
+/**
+ * @brief Flushes the data of a file, or the entries of a directory, to the storage device
+ * @throws on failure
+ */
+inline void syncPath(const std::string& path, const bool directory)
+{
+  const int fd = ::open(path.c_str(), (directory ? O_RDONLY | O_DIRECTORY : O_WRONLY) | O_CLOEXEC);
+  if (fd < 0)
+    throw systemError("Failed to open for syncing", path);
+
+  const int result = directory ? ::fsync(fd) : ::fdatasync(fd);
+  const int error = errno;
+  ::close(fd);
+  if (result != 0)
+  {
+    errno = error;
+    throw systemError("Failed to sync", path);
+  }
+}
+
+}  // namespace detail
+
+/**
+ * @brief Set of written files whose flush to the storage device is deferred until @ref sync is called
+ * @details Syncing many files at once lets the device process the flushes together, which is much cheaper than
+ * flushing after every file. Files are only guaranteed to survive a power loss once @ref sync has returned. The batch
+ * may be shared by threads writing concurrently
+ */
+class SyncBatch
+{
+public:
+  SyncBatch() = default;
+  SyncBatch(const SyncBatch&) = delete;
+  SyncBatch& operator=(const SyncBatch&) = delete;
+
+  /**
+   * @brief Syncs the files still pending; failures are ignored
+   */
+  ~SyncBatch()
+  {
+    try
+    {
+      sync();
+    }
+    catch (const std::exception&)
+    {
+    }
+  }
+
+  /**
+   * @brief Records a written file to be synced, along with its directory
+   */
+  void add(const std::string& file)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_.push_back(file);
+  }
+
+  /**
+   * @brief Number of files waiting to be synced
+   */
+  std::size_t pending() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return files_.size();
+  }
+
+  /**
+   * @brief Flushes every recorded file, then the directories holding them
+   * @throws on failure to sync a file; the files not yet synced remain in the batch
+   */
+  void sync()
+  {
+    std::vector<std::string> files;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      files.swap(files_);
+    }
+
+    std::vector<std::string> directories;
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+      try
+      {
+        detail::syncPath(files[i], false);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        files_.insert(files_.end(), files.begin() + static_cast<std::ptrdiff_t>(i), files.end());
+        throw;
+      }
+
+      const std::string directory = detail::parentDirectory(files[i]);
+      if (std::find(directories.begin(), directories.end(), directory) == directories.end())
+        directories.push_back(directory);
+    }
+
+    for (const std::string& directory : directories)
+      detail::syncPath(directory, true);
+  }
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<std::string> files_;
+};
+
+/**
+ * @brief Destination file written according to a @ref FileWriteOptions
+ * @details Data is written either through @ref stream or through @ref write, but not both. Nothing is visible at the
+ * destination path of an atomic file until @ref commit succeeds; if the object is destroyed without committing, the
+ * temporary file is removed
+ */
+class OutputFile
+{
+public:
+  /**
+   * @throws std::invalid_argument if the deferred sync policy is requested without a batch
+   */
+  OutputFile(const std::string& file, const FileWriteOptions& options)
+    : file_(file), path_(options.atomic ? temporaryPath(file) : file), options_(options)
+  {
+    if (options.sync == SyncPolicy::DEFERRED && !options.batch)
+      throw std::invalid_argument("Deferred sync of '" + file + "' requested without a SyncBatch");
+  }
+
+  OutputFile(const OutputFile&) = delete;
+  OutputFile& operator=(const OutputFile&) = delete;
+
+  ~OutputFile()
+  {
+    if (fd_ >= 0)
+      ::close(fd_);
+    if (!committed_ && options_.atomic)
+    {
+      stream_.reset();
+      ::unlink(path_.c_str());
+    }
+  }
+
+  /**
+   * @brief Buffered output stream to the file
+   * @throws on failure to open the file
+   */
+  std::ostream& stream()
+  {
+    if (!stream_)
+    {
+      stream_.reset(new std::ofstream(path_, std::ios::out | std::ios::binary | std::ios::trunc));
+      if (!*stream_)
+        throw std::runtime_error("Failed to open output file stream at '" + file_ + "'");
+    }
+    return *stream_;
+  }
+
+  /**
+   * @brief Writes data directly to the file descriptor, bypassing any user-space buffering
+   * @throws on failure to open or write to the file
+   */
+  void write(const void* data, std::size_t size)
+  {
+    if (fd_ < 0)
+    {
+      fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+      if (fd_ < 0)
+        throw detail::systemError("Failed to open output file", file_);
+    }
+
+    // A single call normally writes everything; the loop only handles interruptions and short writes
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+      const ssize_t written = ::write(fd_, bytes, size);
+      if (written < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw detail::systemError("Failed to write to output file", file_);
+      }
+      bytes += written;
+      size -= static_cast<std::size_t>(written);
+    }
+  }
+
+  /**
+   * @brief Completes the file: flushes it according to the sync policy and moves it into place if atomic
+   * @throws on failure, in which case the destination keeps its previous contents if the file is atomic
+   */
+  void commit()
+  {
+    // The data of an atomic file must reach the disk before the rename does, whether or not the sync is deferred
+    const bool flush = options_.sync == SyncPolicy::DATA || (options_.atomic && options_.sync == SyncPolicy::DEFERRED);
+    if (stream_)
+    {
+      stream_->close();
+      if (stream_->fail())
+        throw std::runtime_error("Failed to write to output file stream at '" + file_ + "'");
+      stream_.reset();
+
+      if (flush)
+        detail::syncPath(path_, false);
+    }
+    else if (fd_ >= 0)
+    {
+      const int result = flush ? ::fdatasync(fd_) : 0;
+      const int error = errno;
+      ::close(fd_);
+      fd_ = -1;
+      if (result != 0)
+      {
+        errno = error;
+        throw detail::systemError("Failed to sync", file_);
+      }
+    }
+    else
+    {
+      // Nothing was written; still create an empty file
+      write(nullptr, 0);
+      commit();
+      return;
+    }
+
+    if (options_.atomic)
+    {
+      if (::rename(path_.c_str(), file_.c_str()) != 0)
+        throw detail::systemError("Failed to move temporary file into place at", file_);
+
+      // The rename itself is only durable once the directory entry has been flushed
+      if (options_.sync == SyncPolicy::DATA)
+        detail::syncPath(detail::parentDirectory(file_), true);
+    }
+    committed_ = true;
+
+    if (options_.sync == SyncPolicy::DEFERRED)
+      options_.batch->add(file_);
+  }
+
+private:
+  static std::string temporaryPath(const std::string& file)
+  {
+    static std::atomic<unsigned long> counter(0);
+    return file + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++);
+  }
+
+  const std::string file_;
+  const std::string path_;
+  const FileWriteOptions options_;
+  std::unique_ptr<std::ofstream> stream_;
+  int fd_ = -1;
+  bool committed_ = false;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_OUTPUT_FILE_H
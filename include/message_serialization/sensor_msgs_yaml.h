@@ -16,6 +16,7 @@
 #ifndef MESSAGE_SERIALIZATION_SENSOR_MSGS_YAML
 #define MESSAGE_SERIALIZATION_SENSOR_MSGS_YAML
 
+#include <cctype>
 #include <message_serialization/std_msgs_yaml.h>
 #include <sensor_msgs/CameraInfo.h>
 #include <sensor_msgs/JointState.h>
@@ -34,7 +35,8 @@ struct convert<sensor_msgs::RegionOfInterest>
     node["y_offset"] = rhs.y_offset;
     node["height"] = rhs.height;
     node["width"] = rhs.width;
-    node["do_rectify"] = rhs.do_rectify;
+    // Encode as a number; yaml-cpp would otherwise write the uint8_t as a character
+    node["do_rectify"] = static_cast<uint32_t>(rhs.do_rectify);
 
     return node;
   }
@@ -43,11 +45,17 @@ struct convert<sensor_msgs::RegionOfInterest>
   {
     if (node.size() != 5) return false;
 
-    rhs.x_offset = node["x_offset"].as<decltype (rhs.x_offset)>();
-    rhs.y_offset = node["y_offset"].as<decltype (rhs.y_offset)>();
-    rhs.height = node["height"].as<decltype (rhs.height)>();
-    rhs.width = node["width"].as<decltype (rhs.width)>();
-    rhs.do_rectify = node["do_rectify"].as<decltype (rhs.do_rectify)>() ;
+    rhs.x_offset = message_serialization::decodeNumber<decltype(rhs.x_offset)>(node["x_offset"]);
+    rhs.y_offset = message_serialization::decodeNumber<decltype(rhs.y_offset)>(node["y_offset"]);
+    rhs.height = message_serialization::decodeNumber<decltype(rhs.height)>(node["height"]);
+    rhs.width = message_serialization::decodeNumber<decltype(rhs.width)>(node["width"]);
+
+    // Older files may contain the flag written as a character rather than a number
+    const Node do_rectify = node["do_rectify"];
+    if (do_rectify.Scalar().size() == 1 && !std::isdigit(static_cast<unsigned char>(do_rectify.Scalar()[0])))
+      rhs.do_rectify = static_cast<uint8_t>(do_rectify.Scalar()[0]);
+    else
+      rhs.do_rectify = static_cast<uint8_t>(message_serialization::decodeNumber<uint32_t>(do_rectify));
 
     return true;
   }
@@ -87,22 +95,22 @@ struct convert<sensor_msgs::CameraInfo>
     if (node.size() != 11) return false;
 
     rhs.header = node["header"].as<decltype(rhs.header)>();
-    rhs.height = node["height"].as<decltype(rhs.height)>();
-    rhs.width = node["width"].as<decltype(rhs.width)>();
+    rhs.height = message_serialization::decodeNumber<decltype(rhs.height)>(node["height"]);
+    rhs.width = message_serialization::decodeNumber<decltype(rhs.width)>(node["width"]);
     rhs.distortion_model = node["distortion_model"].as<decltype(rhs.distortion_model)>();
-    rhs.D = node["D"].as<decltype(rhs.D)>();
+    rhs.D = message_serialization::decodeNumbers<double>(node["D"]);
 
     std::vector<double> K_vec, R_vec, P_vec;
-    K_vec = node["K"].as<decltype(K_vec)>();
-    R_vec = node["R"].as<decltype(R_vec)>();
-    P_vec = node["P"].as<decltype(P_vec)>();
+    K_vec = message_serialization::decodeNumbers<double>(node["K"]);
+    R_vec = message_serialization::decodeNumbers<double>(node["R"]);
+    P_vec = message_serialization::decodeNumbers<double>(node["P"]);
 
     std::copy_n(K_vec.begin(), K_vec.size(), rhs.K.begin());
     std::copy_n(R_vec.begin(), R_vec.size(), rhs.R.begin());
     std::copy_n(P_vec.begin(), P_vec.size(), rhs.P.begin());
 
-    rhs.binning_x = node["binning_x"].as<decltype(rhs.binning_x)>();
-    rhs.binning_y = node["binning_y"].as<decltype(rhs.binning_y)>();
+    rhs.binning_x = message_serialization::decodeNumber<decltype(rhs.binning_x)>(node["binning_x"]);
+    rhs.binning_y = message_serialization::decodeNumber<decltype(rhs.binning_y)>(node["binning_y"]);
     rhs.roi = node["roi"].as<decltype(rhs.roi)>();
 
     return true;
@@ -131,9 +139,9 @@ struct convert<sensor_msgs::JointState>
 
     rhs.header = node["header"].as<decltype (rhs.header)>();
     rhs.name = node["name"].as<decltype (rhs.name)>();
-    rhs.position = node["position"].as<decltype (rhs.position)>();
-    rhs.velocity = node["velocity"].as<decltype (rhs.velocity)>();
-    rhs.effort = node["effort"].as<decltype (rhs.effort)>() ;
+    rhs.position = message_serialization::decodeNumbers<double>(node["position"]);
+    rhs.velocity = message_serialization::decodeNumbers<double>(node["velocity"]);
+    rhs.effort = message_serialization::decodeNumbers<double>(node["effort"]);
 
     return true;
   }
@@ -141,4 +149,132 @@ struct convert<sensor_msgs::JointState>
 
 } // namespace YAML
 
+namespace message_serialization
+{
+
+inline void emit(YamlWriter& out, const sensor_msgs::RegionOfInterest& rhs)
+{
+  out.beginMap();
+  out.field("x_offset", rhs.x_offset);
+  out.field("y_offset", rhs.y_offset);
+  out.field("height", rhs.height);
+  out.field("width", rhs.width);
+  out.field("do_rectify", rhs.do_rectify);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const sensor_msgs::CameraInfo& rhs)
+{
+  out.beginMap();
+  out.field("header", rhs.header);
+  out.field("height", rhs.height);
+  out.field("width", rhs.width);
+  out.field("distortion_model", rhs.distortion_model);
+  out.field("D", rhs.D);
+  out.field("K", rhs.K);
+  out.field("R", rhs.R);
+  out.field("P", rhs.P);
+  out.field("binning_x", rhs.binning_x);
+  out.field("binning_y", rhs.binning_y);
+  out.field("roi", rhs.roi);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const sensor_msgs::JointState& rhs)
+{
+  out.beginMap();
+  out.field("header", rhs.header);
+  out.field("name", rhs.name);
+  out.field("position", rhs.position);
+  out.field("velocity", rhs.velocity);
+  out.field("effort", rhs.effort);
+  out.endMap();
+}
+
+inline void parse(YamlReader& in, sensor_msgs::RegionOfInterest& rhs)
+{
+  YamlReader::Map map(in, 5);
+  while (map.next())
+  {
+    if (map.key("x_offset"))
+      parse(in, rhs.x_offset);
+    else if (map.key("y_offset"))
+      parse(in, rhs.y_offset);
+    else if (map.key("height"))
+      parse(in, rhs.height);
+    else if (map.key("width"))
+      parse(in, rhs.width);
+    else if (map.key("do_rectify"))
+    {
+      // Older files may contain the flag written as a character rather than a number
+      const YamlReader::StringRef value = in.peekScalar();
+      if (value.size == 1 && !std::isdigit(static_cast<unsigned char>(value.data[0])))
+      {
+        rhs.do_rectify = static_cast<uint8_t>(value.data[0]);
+        in.skip();
+      }
+      else
+      {
+        parse(in, rhs.do_rectify);
+      }
+    }
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, sensor_msgs::CameraInfo& rhs)
+{
+  YamlReader::Map map(in, 11);
+  while (map.next())
+  {
+    if (map.key("header"))
+      parse(in, rhs.header);
+    else if (map.key("height"))
+      parse(in, rhs.height);
+    else if (map.key("width"))
+      parse(in, rhs.width);
+    else if (map.key("distortion_model"))
+      parse(in, rhs.distortion_model);
+    else if (map.key("D"))
+      parse(in, rhs.D);
+    else if (map.key("K"))
+      parse(in, rhs.K);
+    else if (map.key("R"))
+      parse(in, rhs.R);
+    else if (map.key("P"))
+      parse(in, rhs.P);
+    else if (map.key("binning_x"))
+      parse(in, rhs.binning_x);
+    else if (map.key("binning_y"))
+      parse(in, rhs.binning_y);
+    else if (map.key("roi"))
+      parse(in, rhs.roi);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, sensor_msgs::JointState& rhs)
+{
+  YamlReader::Map map(in, 5);
+  while (map.next())
+  {
+    if (map.key("header"))
+      parse(in, rhs.header);
+    else if (map.key("name"))
+      parse(in, rhs.name);
+    else if (map.key("position"))
+      parse(in, rhs.position);
+    else if (map.key("velocity"))
+      parse(in, rhs.velocity);
+    else if (map.key("effort"))
+      parse(in, rhs.effort);
+    else
+      map.unknown();
+  }
+}
+
+} // namespace message_serialization
+
 #endif // MESSAGE_SERIALIZATION_SENSOR_MSGS_YAML
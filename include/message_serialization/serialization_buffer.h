@@ -0,0 +1,246 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_SERIALIZATION_BUFFER_H
+#define MESSAGE_SERIALIZATION_SERIALIZATION_BUFFER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace message_serialization
+{
+/**
+ * @brief Growable byte buffer intended to be reused across serialization calls
+ * @details The buffer only allocates when asked to hold more bytes than its current capacity, and then grows
+ * geometrically, so repeatedly serializing messages of similar size reaches a steady state with no heap allocation
+ */
+class SerializationBuffer
+{
+public:
+  SerializationBuffer() = default;
+
+  explicit SerializationBuffer(const std::size_t capacity)
+  {
+    reserve(capacity);
+  }
+
+  SerializationBuffer(SerializationBuffer&&) = default;
+  SerializationBuffer& operator=(SerializationBuffer&&) = default;
+
+  uint8_t* data()
+  {
+    return data_.get();
+  }
+
+  const uint8_t* data() const
+  {
+    return data_.get();
+  }
+
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  std::size_t capacity() const
+  {
+    return capacity_;
+  }
+
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+  /**
+   * @brief Ensures the buffer can hold at least the input number of bytes, preserving its current contents
+   * @param capacity
+   */
+  void reserve(const std::size_t capacity)
+  {
+    if (capacity <= capacity_)
+      return;
+
+    const std::size_t min_capacity = 64;
+    const std::size_t new_capacity = std::max(std::max(capacity, capacity_ * 2), min_capacity);
+    std::unique_ptr<uint8_t[]> new_data(new uint8_t[new_capacity]);
+    if (size_ > 0)
+      std::memcpy(new_data.get(), data_.get(), size_);
+
+    data_.swap(new_data);
+    capacity_ = new_capacity;
+  }
+
+  /**
+   * @brief Sets the number of valid bytes in the buffer, growing the capacity if necessary
+   * @details Newly exposed bytes are left uninitialized
+   * @param size
+   */
+  void resize(const std::size_t size)
+  {
+    reserve(size);
+    size_ = size;
+  }
+
+  /**
+   * @brief Marks the buffer as empty without releasing its memory
+   */
+  void clear()
+  {
+    size_ = 0;
+  }
+
+  /**
+   * @brief Releases the memory held by the buffer
+   */
+  void release()
+  {
+    data_.reset();
+    size_ = 0;
+    capacity_ = 0;
+  }
+
+private:
+  std::unique_ptr<uint8_t[]> data_;
+  std::size_t size_ = 0;
+  std::size_t capacity_ = 0;
+};
+
+/**
+ * @brief Pool of serialization buffers that are handed out and returned through RAII leases
+ * @details The pool itself is not thread-safe; use @ref threadLocal to get a pool that belongs to the calling thread
+ * and make sure leases are released on the thread that acquired them
+ */
+class SerializationBufferPool
+{
+public:
+  /**
+   * @brief RAII handle to a buffer borrowed from a pool; the buffer is returned to the pool on destruction
+   */
+  class Lease
+  {
+  public:
+    Lease(SerializationBufferPool& pool, std::unique_ptr<SerializationBuffer> buffer)
+      : pool_(&pool), buffer_(std::move(buffer))
+    {
+    }
+
+    Lease(Lease&& other) = default;
+    Lease& operator=(Lease&& other) = delete;
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    ~Lease()
+    {
+      if (buffer_)
+        pool_->release(std::move(buffer_));
+    }
+
+    SerializationBuffer& operator*()
+    {
+      return *buffer_;
+    }
+
+    SerializationBuffer* operator->()
+    {
+      return buffer_.get();
+    }
+
+  private:
+    SerializationBufferPool* pool_;
+    std::unique_ptr<SerializationBuffer> buffer_;
+  };
+
+  /**
+   * @brief Default largest capacity of a buffer kept by a pool (64 MiB)
+   */
+  static const std::size_t DEFAULT_MAX_CAPACITY = std::size_t(64) << 20;
+
+  /**
+   * @brief Constructor
+   * @param max_retained Maximum number of idle buffers kept by the pool; buffers returned beyond this are freed
+   * @param max_capacity Largest capacity of a buffer kept by the pool; larger buffers are freed when returned, so that
+   * a single large message does not pin its memory for the lifetime of the pool (e.g. of a thread)
+   */
+  explicit SerializationBufferPool(const std::size_t max_retained = 8,
+                                   const std::size_t max_capacity = DEFAULT_MAX_CAPACITY)
+    : max_retained_(max_retained), max_capacity_(max_capacity)
+  {
+  }
+
+  /**
+   * @brief Borrows a buffer from the pool, creating one only if no idle buffer is available
+   * @details The returned buffer is empty but keeps the capacity it had when it was last returned
+   */
+  Lease acquire()
+  {
+    std::unique_ptr<SerializationBuffer> buffer;
+    if (free_.empty())
+    {
+      buffer.reset(new SerializationBuffer());
+    }
+    else
+    {
+      buffer = std::move(free_.back());
+      free_.pop_back();
+    }
+
+    buffer->clear();
+    return Lease(*this, std::move(buffer));
+  }
+
+  /**
+   * @brief Number of idle buffers currently held by the pool
+   */
+  std::size_t idle() const
+  {
+    return free_.size();
+  }
+
+  /**
+   * @brief Frees all idle buffers
+   */
+  void trim()
+  {
+    free_.clear();
+  }
+
+  /**
+   * @brief Returns the buffer pool owned by the calling thread
+   */
+  static SerializationBufferPool& threadLocal()
+  {
+    static thread_local SerializationBufferPool pool;
+    return pool;
+  }
+
+private:
+  void release(std::unique_ptr<SerializationBuffer> buffer)
+  {
+    if (free_.size() < max_retained_ && buffer->capacity() <= max_capacity_)
+      free_.push_back(std::move(buffer));
+  }
+
+  std::size_t max_retained_;
+  std::size_t max_capacity_;
+  std::vector<std::unique_ptr<SerializationBuffer>> free_;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_SERIALIZATION_BUFFER_H
@@ -17,40 +17,193 @@
 #define MESSAGE_SERIALIZATION_SERIALIZE_H
 
 #include <fstream>
+#include <message_serialization/metrics.h>
+#include <message_serialization/output_file.h>
+#include <message_serialization/yaml_buffer.h>
+#include <message_serialization/yaml_reader.h>
+#include <message_serialization/yaml_writer.h>
 #include <yaml-cpp/yaml.h>
 #include <ros/console.h>
+#include <sys/stat.h>
 
 namespace message_serialization
 {
+namespace detail
+{
+/**
+ * @return number of nodes written, as counted by @ref YamlWriter::nodes
+ */
+template <class T>
+inline std::size_t emitYaml(YAML::Emitter& out, const T& val, const std::string& file, const YamlOptions& options)
+{
+  YamlWriter writer(out, options);
+  emit(writer, val);
+  if (!out.good())
+    throw std::runtime_error("Failed to emit YAML to '" + file + "': " + out.GetLastError());
+  return writer.nodes();
+}
+
+/**
+ * @brief Size of a file, or zero if it cannot be determined
+ */
+inline uint64_t fileSize(const std::string& file)
+{
+  struct stat st;
+  return ::stat(file.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+}  // namespace detail
+
 /**
  * @brief Serializes an input object to a YAML-formatted file
+ * @details The object is streamed directly to the file through its @ref emit overload, so no intermediate YAML::Node
+ * tree is built for types that provide one
  * @param val
  * @param file
+ * @param options
+ * @param file_options Atomicity, sync policy and write strategy of the file
  * @throws exception on failure to open or write to a file stream
  */
 template <class T>
-inline void serialize(const T& val, const std::string& file)
+inline void serialize(const T& val, const std::string& file, const YamlOptions& options = YamlOptions(),
+                      const FileWriteOptions& file_options = FileWriteOptions())
 {
-  std::ofstream ofh(file);
-  if (!ofh)
-    throw std::runtime_error("Failed to open output file stream at '" + file + "'");
-
-  YAML::Node n = YAML::Node(val);
-  ofh << n;
+  MESSAGE_SERIALIZATION_METRICS_CALL(metrics, T, SERIALIZE);
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
+  OutputFile output(file, file_options);
+  if (file_options.single_write)
+  {
+    YAML::Emitter out;
+    MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, ENCODE);
+    const std::size_t nodes = detail::emitYaml(out, val, file, options);
+    MESSAGE_SERIALIZATION_METRICS_NODES(metrics, nodes);
+    MESSAGE_SERIALIZATION_METRICS_BYTES(metrics, out.size());
+    MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
+    output.write(out.c_str(), out.size());
+  }
+  else
+  {
+    YAML::Emitter out(output.stream());
+    MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, ENCODE);
+    const std::size_t nodes = detail::emitYaml(out, val, file, options);
+    MESSAGE_SERIALIZATION_METRICS_NODES(metrics, nodes);
+    MESSAGE_SERIALIZATION_METRICS_BYTES(metrics, out.size());
+    MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
+  }
+  output.commit();
+  MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
 }
 
 /**
  * @brief Serializes an input object to a YAML-formatted file
  * @param file
  * @param val
+ * @param options
+ * @param file_options
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool serialize(const std::string& file, const T& val, const YamlOptions& options = YamlOptions(),
+                      const FileWriteOptions& file_options = FileWriteOptions()) noexcept
+{
+  try
+  {
+    serialize<T>(val, file, options, file_options);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM(ex.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Serializes an input object to a YAML-formatted string
+ * @param val
+ * @param options
+ * @return
+ * @throws exception on failure to emit the object
+ */
+template <class T>
+inline std::string serializeToString(const T& val, const YamlOptions& options = YamlOptions())
+{
+  YAML::Emitter out;
+  detail::emitYaml(out, val, "string", options);
+  return std::string(out.c_str(), out.size());
+}
+
+/**
+ * @brief Serializes an input object to YAML in a reusable buffer
+ * @details The buffer keeps its capacity from one call to the next, so encoding objects of similar size repeatedly does
+ * not reallocate the text once the buffer has grown to fit them
+ * @param val
+ * @param buffer (output) Its contents are replaced by the YAML text
+ * @param options
+ * @return the YAML text, owned by the buffer and valid until its next use
+ * @throws exception on failure to emit the object
+ */
+template <class T>
+inline const std::string& serializeToString(const T& val, YamlBuffer& buffer,
+                                            const YamlOptions& options = YamlOptions())
+{
+  buffer.clear();
+  YAML::Emitter out(buffer.stream());
+  detail::emitYaml(out, val, "string", options);
+  return buffer.str();
+}
+
+/**
+ * @brief Serializes an input object to a YAML-formatted string
+ * @param yaml (output)
+ * @param val
+ * @param options
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool serializeToString(std::string& yaml, const T& val, const YamlOptions& options = YamlOptions()) noexcept
+{
+  try
+  {
+    yaml = serializeToString<T>(val, options);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM(ex.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Serializes an input object as YAML to an output stream
+ * @param val
+ * @param stream
+ * @param options
+ * @throws exception on failure to emit the object or write to the stream
+ */
+template <class T>
+inline void serializeToStream(const T& val, std::ostream& stream, const YamlOptions& options = YamlOptions())
+{
+  YAML::Emitter out(stream);
+  detail::emitYaml(out, val, "stream", options);
+  if (!stream)
+    throw std::runtime_error("Failed to write YAML to the output stream");
+}
+
+/**
+ * @brief Serializes an input object as YAML to an output stream
+ * @param stream
+ * @param val
+ * @param options
  * @return true on success, false otherwise
  */
 template <class T>
-inline bool serialize(const std::string& file, const T& val) noexcept
+inline bool serializeToStream(std::ostream& stream, const T& val, const YamlOptions& options = YamlOptions()) noexcept
 {
   try
   {
-    serialize<T>(val, file);
+    serializeToStream<T>(val, stream, options);
   }
   catch (const std::exception& ex)
   {
@@ -62,6 +215,8 @@ inline bool serialize(const std::string& file, const T& val) noexcept
 
 /**
  * @brief Deserializes a YAML-formatted file into a specific object type
+ * @details The object is decoded from the parser's event stream through its @ref parse overload rather than from a
+ * YAML::Node tree. Documents that use aliases are decoded through YAML::Node instead.
  * @param file
  * @return
  * @throws exception when unable to load the file or convert it to the specified type
@@ -69,9 +224,27 @@ inline bool serialize(const std::string& file, const T& val) noexcept
 template <class T>
 inline T deserialize(const std::string &file)
 {
-  YAML::Node node;
-  node = YAML::LoadFile(file);
-  return node.as<T>();
+  MESSAGE_SERIALIZATION_METRICS_CALL(metrics, T, DESERIALIZE);
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, IO);
+  std::ifstream ifh(file);
+  if (!ifh)
+    throw std::runtime_error("Failed to open input file stream at '" + file + "'");
+  MESSAGE_SERIALIZATION_METRICS_BYTES(metrics, detail::fileSize(file));
+
+  MESSAGE_SERIALIZATION_METRICS_PHASE(metrics, DECODE);
+  YamlReader reader(ifh);
+  MESSAGE_SERIALIZATION_METRICS_NODES(metrics, reader.nodes());
+  if (reader.hasAliases())
+  {
+    T val = YAML::LoadFile(file).as<T>();
+    MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
+    return val;
+  }
+
+  T val;
+  parse(reader, val);
+  MESSAGE_SERIALIZATION_METRICS_DONE(metrics);
+  return val;
 }
 
 /**
@@ -95,6 +268,122 @@ inline bool deserialize(const std::string &file, T& val) noexcept
   return true;
 }
 
+/**
+ * @brief Deserializes YAML text held in memory into a specific object type
+ * @details The text is parsed in place, without being copied, like a file in @ref deserialize
+ * @param data YAML text, which need not be null-terminated
+ * @param size Length of the text
+ * @return
+ * @throws exception when unable to parse the text or convert it to the specified type
+ */
+template <class T>
+inline T deserializeFromBuffer(const char* data, const std::size_t size)
+{
+  detail::MemoryStreamBuf buf(data, size);
+  std::istream stream(&buf);
+  YamlReader reader(stream);
+  if (reader.hasAliases())
+    return YAML::Load(std::string(data, size)).as<T>();
+
+  T val;
+  parse(reader, val);
+  return val;
+}
+
+/**
+ * @brief Deserializes YAML text held in memory into a specific object type
+ * @param data YAML text
+ * @param size Length of the text
+ * @param val (output)
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool deserializeFromBuffer(const char* data, const std::size_t size, T& val) noexcept
+{
+  try
+  {
+    val = deserializeFromBuffer<T>(data, size);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM("Deserialization error: " << ex.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Deserializes a YAML-formatted string into a specific object type
+ * @param yaml
+ * @return
+ * @throws exception when unable to parse the string or convert it to the specified type
+ */
+template <class T>
+inline T deserializeFromString(const std::string& yaml)
+{
+  return deserializeFromBuffer<T>(yaml.data(), yaml.size());
+}
+
+/**
+ * @brief Deserializes a YAML-formatted string into a specific object type
+ * @param yaml
+ * @param val (output)
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool deserializeFromString(const std::string& yaml, T& val) noexcept
+{
+  return deserializeFromBuffer(yaml.data(), yaml.size(), val);
+}
+
+/**
+ * @brief Deserializes a single field of a YAML-formatted file, such as `header.stamp` or `poses[100:200]`
+ * @details Only the part of the document up to the end of the field is parsed; the parser stops there without reading
+ * the rest of the file. A slice path decodes into a sequence type holding the selected elements. See @ref FieldPath for
+ * the path syntax.
+ * @param file
+ * @param path
+ * @return
+ * @throws exception when unable to load the file, find the field or convert it to the specified type
+ */
+template <class T>
+inline T deserializeField(const std::string& file, const FieldPath& path)
+{
+  std::ifstream ifh(file);
+  if (!ifh)
+    throw std::runtime_error("Failed to open input file stream at '" + file + "'");
+
+  YamlReader reader(ifh, path);
+  if (reader.hasAliases())
+    return path.select(YAML::LoadFile(file)).as<T>();
+
+  T val;
+  parse(reader, val);
+  return val;
+}
+
+/**
+ * @brief Deserializes a single field of a YAML-formatted file
+ * @param file
+ * @param path
+ * @param val
+ * @return true on success, false otherwise
+ */
+template <class T>
+inline bool deserializeField(const std::string& file, const FieldPath& path, T& val) noexcept
+{
+  try
+  {
+    val = deserializeField<T>(file, path);
+  }
+  catch (const std::exception& ex)
+  {
+    ROS_ERROR_STREAM("Deserialization error: " << ex.what());
+    return false;
+  }
+  return true;
+}
+
 } // namespace message_serialization
 
 #endif // MESSAGE_SERIALIZATION_SERIALIZE_H
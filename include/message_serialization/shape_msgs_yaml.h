@@ -18,8 +18,68 @@
 
 #include <message_serialization/std_msgs_yaml.h>
 #include <message_serialization/geometry_msgs_yaml.h>
+#include <message_serialization/yaml_binary.h>
 #include <shape_msgs/Mesh.h>
 
+namespace message_serialization
+{
+
+/**
+ * @brief Packs mesh triangles into an array of vertex index rows
+ */
+inline bool toBinaryArray(const std::vector<shape_msgs::MeshTriangle>& rhs, BinaryArray& array)
+{
+  array.reset<uint32_t>(rhs.size(), 3);
+  for (const shape_msgs::MeshTriangle& triangle : rhs)
+  {
+    array.append(triangle.vertex_indices[0]);
+    array.append(triangle.vertex_indices[1]);
+    array.append(triangle.vertex_indices[2]);
+  }
+  return true;
+}
+
+inline void fromBinaryArray(const BinaryArray& array, std::vector<shape_msgs::MeshTriangle>& rhs)
+{
+  array.check<uint32_t>(3);
+  rhs.resize(array.rows());
+  for (std::size_t i = 0; i < rhs.size(); ++i)
+  {
+    rhs[i].vertex_indices[0] = array.at<uint32_t>(i, 0);
+    rhs[i].vertex_indices[1] = array.at<uint32_t>(i, 1);
+    rhs[i].vertex_indices[2] = array.at<uint32_t>(i, 2);
+  }
+}
+
+/**
+ * @brief Packs points into an array of rows [x, y, z]
+ */
+inline bool toBinaryArray(const std::vector<geometry_msgs::Point>& rhs, BinaryArray& array)
+{
+  array.reset<double>(rhs.size(), 3);
+  for (const geometry_msgs::Point& point : rhs)
+  {
+    array.append(point.x);
+    array.append(point.y);
+    array.append(point.z);
+  }
+  return true;
+}
+
+inline void fromBinaryArray(const BinaryArray& array, std::vector<geometry_msgs::Point>& rhs)
+{
+  array.check<double>(3);
+  rhs.resize(array.rows());
+  for (std::size_t i = 0; i < rhs.size(); ++i)
+  {
+    rhs[i].x = array.at<double>(i, 0);
+    rhs[i].y = array.at<double>(i, 1);
+    rhs[i].z = array.at<double>(i, 2);
+  }
+}
+
+} // namespace message_serialization
+
 namespace YAML
 {
 template<>
@@ -39,7 +99,7 @@ struct convert<shape_msgs::MeshTriangle>
   static bool decode(const Node& node, shape_msgs::MeshTriangle& rhs)
   {
     std::vector<unsigned int> tv;
-    tv = node["vertex_indices"].as<decltype (tv)>();
+    tv = message_serialization::decodeNumbers<unsigned int>(node["vertex_indices"]);
     rhs.vertex_indices[0] = tv[0];
     rhs.vertex_indices[1] = tv[1];
     rhs.vertex_indices[2] = tv[2];
@@ -63,8 +123,8 @@ struct convert<shape_msgs::Mesh>
   {
     if (node.size() != 2) return false;
 
-    rhs.triangles = node["triangles"].as<decltype (rhs.triangles) >();
-    rhs.vertices  = node["vertices"].as<decltype(rhs.vertices) >();
+    rhs.triangles = message_serialization::decodeArray<shape_msgs::MeshTriangle>(node["triangles"]);
+    rhs.vertices = message_serialization::decodeArray<geometry_msgs::Point>(node["vertices"]);
 
     return true;
   }
@@ -72,4 +132,52 @@ struct convert<shape_msgs::Mesh>
 
 }
 
+namespace message_serialization
+{
+
+inline void emit(YamlWriter& out, const shape_msgs::MeshTriangle& rhs)
+{
+  out.beginMap();
+  out.field("vertex_indices", rhs.vertex_indices);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const shape_msgs::Mesh& rhs)
+{
+  out.beginMap();
+  out.key("triangles");
+  emitArray(out, rhs.triangles, rhs.triangles.size() * 3);
+  out.key("vertices");
+  emitArray(out, rhs.vertices, rhs.vertices.size() * 3);
+  out.endMap();
+}
+
+inline void parse(YamlReader& in, shape_msgs::MeshTriangle& rhs)
+{
+  YamlReader::Map map(in, 1);
+  while (map.next())
+  {
+    if (map.key("vertex_indices"))
+      parse(in, rhs.vertex_indices);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, shape_msgs::Mesh& rhs)
+{
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("triangles"))
+      parseArray(in, rhs.triangles);
+    else if (map.key("vertices"))
+      parseArray(in, rhs.vertices);
+    else
+      map.unknown();
+  }
+}
+
+} // namespace message_serialization
+
 #endif // MESSAGE_SERIALIZATION_SHAPE_MSGS_YAML
@@ -0,0 +1,581 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_SHM_RING_H
+#define MESSAGE_SERIALIZATION_SHM_RING_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <limits>
+#include <message_serialization/serialization_buffer.h>
+#include <ros/serialization.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+/*
+ * Shared-memory ring layout
+ *
+ * A ring is a POSIX shared memory object (/dev/shm/<name>) holding a header followed by a fixed number of slots:
+ *
+ *   header: uint64 magic | uint32 version | uint32 slot count | uint64 slot capacity | uint64 slot stride
+ *           | (next cache line) uint64 sequence number of the last published message
+ *   slot:   uint64 state | uint32 message size | uint32 reserved | ROS-serialized message, padded to the stride
+ *
+ * Messages are numbered from 1 and message n goes to slot (n - 1) % slot count. Each slot is a sequence lock: its state
+ * is 2n - 1 while message n is being written and 2n once it is published. A reader decodes a message straight from its
+ * slot, then checks that the state did not change meanwhile; if it did, the writer reused the slot and the message is
+ * counted as dropped. Neither side ever blocks the other, and nothing touches the file system after the ring has been
+ * created. There must be a single writer per ring; any number of readers may attach to it.
+ */
+
+namespace message_serialization
+{
+namespace shm_ring
+{
+const uint64_t MAGIC = 0x31474e4952534d4dull;  // "MMSRING1"
+const uint32_t VERSION = 1;
+const std::size_t CACHE_LINE = 64;
+
+struct RingHeader
+{
+  std::atomic<uint64_t> magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint64_t slot_capacity;
+  uint64_t slot_stride;
+  alignas(CACHE_LINE) std::atomic<uint64_t> head;
+};
+
+struct SlotHeader
+{
+  std::atomic<uint64_t> state;
+  std::atomic<uint32_t> size;
+  uint32_t reserved;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The shared-memory ring requires lock-free 64-bit atomics");
+
+const std::size_t HEADER_SIZE = (sizeof(RingHeader) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+inline std::size_t slotStride(const std::size_t capacity)
+{
+  return (sizeof(SlotHeader) + capacity + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+}  // namespace shm_ring
+
+namespace detail
+{
+/**
+ * @brief Name of a shared memory object, which must start with a slash
+ */
+inline std::string shmName(const std::string& name)
+{
+  return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
+
+/**
+ * @brief Shared mapping of a shared memory object, released when the object is destroyed
+ */
+class ShmMapping
+{
+public:
+  ShmMapping() = default;
+
+  /**
+   * @throws on failure to map the object
+   */
+  ShmMapping(const int fd, const std::size_t size, const int protection, const std::string& name) : size_(size)
+  {
+    // Populating the pages up front keeps page faults out of the publish and read paths
+    void* addr = ::mmap(nullptr, size, protection, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (addr == MAP_FAILED)
+      throw std::runtime_error("Failed to map shared memory '" + name + "': " + std::strerror(errno));
+    data_ = static_cast<uint8_t*>(addr);
+  }
+
+  ShmMapping(const ShmMapping&) = delete;
+  ShmMapping& operator=(const ShmMapping&) = delete;
+
+  ShmMapping& operator=(ShmMapping&& other) noexcept
+  {
+    if (this != &other)
+    {
+      if (data_)
+        ::munmap(data_, size_);
+      data_ = other.data_;
+      size_ = other.size_;
+      other.data_ = nullptr;
+      other.size_ = 0;
+    }
+    return *this;
+  }
+
+  ~ShmMapping()
+  {
+    if (data_)
+      ::munmap(data_, size_);
+  }
+
+  uint8_t* data() const
+  {
+    return data_;
+  }
+
+private:
+  uint8_t* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Geometry and lifetime of a shared-memory ring
+ */
+struct ShmRingOptions
+{
+  /**
+   * @brief Number of slots, i.e. of messages a reader may fall behind before it starts dropping them
+   */
+  uint32_t slot_count = 64;
+
+  /**
+   * @brief Largest serialized message a slot can hold, in bytes
+   */
+  std::size_t slot_capacity = 64 * 1024;
+
+  /**
+   * @brief Permissions of the shared memory object when it is created; readers only need read access
+   */
+  mode_t permissions = 0600;
+
+  /**
+   * @brief Removes the shared memory object when the writer is destroyed; attached readers keep their mapping
+   */
+  bool unlink_on_close = false;
+};
+
+/**
+ * @brief Single producer of a shared-memory ring of ROS-serialized messages
+ * @details Publishing never blocks and never waits for readers: a reader that falls more than a ring behind loses the
+ * oldest messages. A writer attaching to an existing ring with the same geometry continues its sequence numbers, so
+ * readers survive a restart of the writer; a ring with another geometry is replaced.
+ */
+class ShmRingWriter
+{
+public:
+  /**
+   * @brief Creates (or attaches to) the ring of the given name
+   * @param name Name of the shared memory object, e.g. `/robot_state`
+   * @param options
+   * @throws on invalid options or failure to create or map the shared memory object
+   */
+  explicit ShmRingWriter(const std::string& name, const ShmRingOptions& options = ShmRingOptions())
+    : name_(detail::shmName(name)), unlink_(options.unlink_on_close)
+  {
+    if (options.slot_count == 0 || options.slot_capacity == 0 ||
+        options.slot_capacity > std::numeric_limits<uint32_t>::max())
+      throw std::invalid_argument("Invalid geometry for shared memory ring '" + name_ + "'");
+
+    const std::size_t stride = shm_ring::slotStride(options.slot_capacity);
+    const std::size_t size = shm_ring::HEADER_SIZE + options.slot_count * stride;
+
+    int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, options.permissions);
+    if (fd < 0)
+      throw std::runtime_error("Failed to open shared memory '" + name_ + "': " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+      fail(fd, "stat");
+
+    if (st.st_size != 0 && static_cast<std::size_t>(st.st_size) != size)
+    {
+      // Resizing the object would invalidate the mappings of attached readers, so replace it instead
+      ::close(fd);
+      ::shm_unlink(name_.c_str());
+      fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, options.permissions);
+      if (fd < 0)
+        throw std::runtime_error("Failed to recreate shared memory '" + name_ + "': " + std::strerror(errno));
+      st.st_size = 0;
+    }
+    if (st.st_size == 0 && ::ftruncate(fd, static_cast<off_t>(size)) != 0)
+      fail(fd, "resize");
+
+    try
+    {
+      mapping_ = detail::ShmMapping(fd, size, PROT_READ | PROT_WRITE, name_);
+    }
+    catch (...)
+    {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+
+    header_ = reinterpret_cast<shm_ring::RingHeader*>(mapping_.data());
+    slot_count_ = options.slot_count;
+    capacity_ = options.slot_capacity;
+    stride_ = stride;
+
+    if (header_->magic.load(std::memory_order_acquire) == shm_ring::MAGIC && header_->version == shm_ring::VERSION &&
+        header_->slot_count == slot_count_ && header_->slot_capacity == capacity_)
+    {
+      sequence_ = header_->head.load(std::memory_order_relaxed);
+      return;
+    }
+
+    header_->magic.store(0, std::memory_order_relaxed);
+    header_->version = shm_ring::VERSION;
+    header_->slot_count = slot_count_;
+    header_->slot_capacity = capacity_;
+    header_->slot_stride = stride_;
+    header_->head.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < slot_count_; ++i)
+      slot(i)->state.store(0, std::memory_order_relaxed);
+    header_->magic.store(shm_ring::MAGIC, std::memory_order_release);
+  }
+
+  ShmRingWriter(const ShmRingWriter&) = delete;
+  ShmRingWriter& operator=(const ShmRingWriter&) = delete;
+
+  ~ShmRingWriter()
+  {
+    if (unlink_)
+      ::shm_unlink(name_.c_str());
+  }
+
+  /**
+   * @brief Serializes a ROS message straight into the next slot and publishes it
+   * @return sequence number of the message
+   * @throws std::runtime_error if the serialized message does not fit a slot
+   */
+  template <typename T>
+  uint64_t publish(const T& message)
+  {
+    const uint32_t size = ros::serialization::serializationLength(message);
+    uint8_t* payload = beginWrite(size);
+    ros::serialization::OStream stream(payload, size);
+    ros::serialization::serialize(stream, message);
+    return endWrite();
+  }
+
+  /**
+   * @brief Publishes an already serialized message, e.g. from @ref serializeToBuffer
+   * @return sequence number of the message
+   * @throws std::runtime_error if the message does not fit a slot
+   */
+  uint64_t publish(const uint8_t* data, const uint32_t size)
+  {
+    uint8_t* payload = beginWrite(size);
+    if (size > 0)
+      std::memcpy(payload, data, size);
+    return endWrite();
+  }
+
+  uint64_t publish(const SerializationBuffer& buffer)
+  {
+    return publish(buffer.data(), static_cast<uint32_t>(buffer.size()));
+  }
+
+  /**
+   * @brief Sequence number of the last published message, or zero if none was
+   */
+  uint64_t sequence() const
+  {
+    return sequence_;
+  }
+
+  const std::string& name() const
+  {
+    return name_;
+  }
+
+private:
+  [[noreturn]] void fail(const int fd, const std::string& action) const
+  {
+    const int err = errno;
+    ::close(fd);
+    throw std::runtime_error("Failed to " + action + " shared memory '" + name_ + "': " + std::strerror(err));
+  }
+
+  shm_ring::SlotHeader* slot(const uint64_t index) const
+  {
+    return reinterpret_cast<shm_ring::SlotHeader*>(mapping_.data() + shm_ring::HEADER_SIZE + index * stride_);
+  }
+
+  /**
+   * @brief Marks the slot of the next message as being written
+   * @return the payload of the slot
+   */
+  uint8_t* beginWrite(const uint32_t size)
+  {
+    if (size > capacity_)
+      throw std::runtime_error("Message of " + std::to_string(size) + " bytes does not fit the slots of shared memory "
+                               "ring '" + name_ + "' (" + std::to_string(capacity_) + " bytes)");
+
+    const uint64_t sequence = sequence_ + 1;
+    shm_ring::SlotHeader* header = slot((sequence - 1) % slot_count_);
+    header->state.store(2 * sequence - 1, std::memory_order_relaxed);
+    // Orders the state before the payload for readers, which check the state after reading the payload
+    std::atomic_thread_fence(std::memory_order_release);
+    header->size.store(size, std::memory_order_relaxed);
+    return reinterpret_cast<uint8_t*>(header + 1);
+  }
+
+  uint64_t endWrite()
+  {
+    const uint64_t sequence = sequence_ + 1;
+    slot((sequence - 1) % slot_count_)->state.store(2 * sequence, std::memory_order_release);
+    header_->head.store(sequence, std::memory_order_release);
+    sequence_ = sequence;
+    return sequence;
+  }
+
+  const std::string name_;
+  const bool unlink_;
+  detail::ShmMapping mapping_;
+  shm_ring::RingHeader* header_ = nullptr;
+  uint32_t slot_count_ = 0;
+  std::size_t capacity_ = 0;
+  std::size_t stride_ = 0;
+  uint64_t sequence_ = 0;
+};
+
+/**
+ * @brief Consumer of a shared-memory ring, decoding messages straight from their slots
+ * @details Each reader has its own position in the ring, and only maps it read-only. A reader that falls more than a
+ * ring behind skips to the oldest message still available; skipped messages are counted by @ref dropped. Size the ring
+ * so that this is rare: a message overwritten while it is being decoded is detected and dropped, but the partial decode
+ * of an overwritten slot may have allocated for bogus lengths in the meantime.
+ */
+class ShmRingReader
+{
+public:
+  /**
+   * @brief Attaches to the ring of the given name
+   * @param name Name of the shared memory object
+   * @param from_oldest Starts at the oldest message still in the ring rather than at the next one published
+   * @throws on failure to open or map the shared memory object, or if it does not hold an initialized ring
+   */
+  explicit ShmRingReader(const std::string& name, const bool from_oldest = false) : name_(detail::shmName(name))
+  {
+    const int fd = ::shm_open(name_.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+      throw std::runtime_error("Failed to open shared memory '" + name_ + "': " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+      const int err = errno;
+      ::close(fd);
+      throw std::runtime_error("Failed to stat shared memory '" + name_ + "': " + std::strerror(err));
+    }
+    const std::size_t size = static_cast<std::size_t>(st.st_size);
+    if (size < shm_ring::HEADER_SIZE)
+    {
+      ::close(fd);
+      throw std::runtime_error("Shared memory '" + name_ + "' does not hold a message ring");
+    }
+
+    try
+    {
+      mapping_ = detail::ShmMapping(fd, size, PROT_READ, name_);
+    }
+    catch (...)
+    {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+
+    header_ = reinterpret_cast<const shm_ring::RingHeader*>(mapping_.data());
+    if (header_->magic.load(std::memory_order_acquire) != shm_ring::MAGIC || header_->version != shm_ring::VERSION ||
+        header_->slot_count == 0 || header_->slot_stride != shm_ring::slotStride(header_->slot_capacity) ||
+        shm_ring::HEADER_SIZE + header_->slot_count * header_->slot_stride > size)
+      throw std::runtime_error("Shared memory '" + name_ + "' does not hold an initialized message ring");
+
+    slot_count_ = header_->slot_count;
+    capacity_ = header_->slot_capacity;
+    stride_ = header_->slot_stride;
+
+    const uint64_t head = header_->head.load(std::memory_order_acquire);
+    next_ = from_oldest && head >= slot_count_ ? head - slot_count_ + 1 : from_oldest ? 1 : head + 1;
+  }
+
+  ShmRingReader(const ShmRingReader&) = delete;
+  ShmRingReader& operator=(const ShmRingReader&) = delete;
+
+  /**
+   * @brief Decodes the next message, if one has been published since the last one read
+   * @param message (output) Only valid when true is returned
+   * @return true if a message was read, false if there is no new message
+   * @throws ros::serialization::StreamOverrunException if the message does not decode as the input type; the
+   * message is skipped
+   */
+  template <typename T>
+  bool read(T& message)
+  {
+    return consume([&message](const uint8_t* data, const uint32_t size) {
+      ros::serialization::IStream stream(const_cast<uint8_t*>(data), size);
+      ros::serialization::deserialize(stream, message);
+    });
+  }
+
+  /**
+   * @brief Copies the serialized bytes of the next message, if one has been published since the last one read
+   * @param buffer (output) Its contents are replaced by the message
+   * @return true if a message was read, false if there is no new message
+   */
+  bool read(SerializationBuffer& buffer)
+  {
+    return consume([&buffer](const uint8_t* data, const uint32_t size) {
+      buffer.resize(size);
+      if (size > 0)
+        std::memcpy(buffer.data(), data, size);
+    });
+  }
+
+  /**
+   * @brief Waits for the next message and decodes it
+   * @details The ring is polled without sleeping, which keeps the handoff latency in the order of a cache miss; after a
+   * short spin, the thread yields between polls
+   * @param message (output) Only valid when true is returned
+   * @param timeout
+   * @return true if a message was read, false if none was published before the timeout
+   */
+  template <typename T>
+  bool wait(T& message, const std::chrono::nanoseconds timeout)
+  {
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    for (unsigned polls = 0;; ++polls)
+    {
+      if (read(message))
+        return true;
+      if (std::chrono::steady_clock::now() >= deadline)
+        return false;
+      if (polls >= 1000)
+        std::this_thread::yield();
+    }
+  }
+
+  /**
+   * @brief Sequence number of the last message read, or zero if none was
+   */
+  uint64_t sequence() const
+  {
+    return sequence_;
+  }
+
+  /**
+   * @brief Sequence number of the last message published to the ring
+   */
+  uint64_t latest() const
+  {
+    return header_->head.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Number of messages skipped because the writer reused their slots before they were read
+   */
+  uint64_t dropped() const
+  {
+    return dropped_;
+  }
+
+  const std::string& name() const
+  {
+    return name_;
+  }
+
+private:
+  const shm_ring::SlotHeader* slot(const uint64_t index) const
+  {
+    return reinterpret_cast<const shm_ring::SlotHeader*>(mapping_.data() + shm_ring::HEADER_SIZE + index * stride_);
+  }
+
+  /**
+   * @brief Passes the payload of the next message to a decoder, and checks that the slot was not reused meanwhile
+   */
+  template <typename Decoder>
+  bool consume(Decoder decode)
+  {
+    while (true)
+    {
+      const uint64_t head = header_->head.load(std::memory_order_acquire);
+      if (next_ > head)
+        return false;
+
+      if (head - next_ >= slot_count_)
+      {
+        dropped_ += head - slot_count_ + 1 - next_;
+        next_ = head - slot_count_ + 1;
+      }
+
+      const shm_ring::SlotHeader* header = slot((next_ - 1) % slot_count_);
+      const uint64_t state = header->state.load(std::memory_order_acquire);
+      const uint32_t size = header->size.load(std::memory_order_relaxed);
+      const bool valid = state == 2 * next_ && size <= capacity_;
+
+      std::exception_ptr error;
+      if (valid)
+      {
+        try
+        {
+          decode(reinterpret_cast<const uint8_t*>(header + 1), size);
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (!valid || header->state.load(std::memory_order_relaxed) != state)
+      {
+        // The writer lapped this reader: the slot holds (part of) a newer message
+        ++dropped_;
+        ++next_;
+        continue;
+      }
+
+      sequence_ = next_++;
+      if (error)
+        std::rethrow_exception(error);
+      return true;
+    }
+  }
+
+  const std::string name_;
+  detail::ShmMapping mapping_;
+  const shm_ring::RingHeader* header_ = nullptr;
+  uint64_t slot_count_ = 0;
+  uint64_t capacity_ = 0;
+  uint64_t stride_ = 0;
+  uint64_t next_ = 1;
+  uint64_t sequence_ = 0;
+  uint64_t dropped_ = 0;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_SHM_RING_H
@@ -16,9 +16,28 @@
 #ifndef MESSAGE_SERIALIZATION_STD_MSGS_YAML
 #define MESSAGE_SERIALIZATION_STD_MSGS_YAML
 
+#include <message_serialization/yaml_reader.h>
+#include <message_serialization/yaml_writer.h>
 #include <std_msgs/Header.h>
 #include <yaml-cpp/yaml.h>
 
+namespace message_serialization
+{
+namespace detail
+{
+/**
+ * @brief Field of a time or duration node, named either like the C++ members (sec, nsec) or like the fields of rospy
+ * (secs, nsecs)
+ */
+inline YAML::Node timeField(const YAML::Node& node, const char* name, const char* rospy_name)
+{
+  const YAML::Node field = node[name];
+  return field ? field : node[rospy_name];
+}
+
+}  // namespace detail
+}  // namespace message_serialization
+
 namespace YAML
 {
 
@@ -37,8 +56,9 @@ struct convert<ros::Time>
   {
     if (node.size() != 2) return false;
 
-    rhs.sec = node["sec"].as<uint32_t>();
-    rhs.nsec = node["nsec"].as<uint32_t>();
+    using message_serialization::detail::timeField;
+    rhs.sec = message_serialization::decodeNumber<uint32_t>(timeField(node, "sec", "secs"));
+    rhs.nsec = message_serialization::decodeNumber<uint32_t>(timeField(node, "nsec", "nsecs"));
 
     return true;
   }
@@ -60,7 +80,7 @@ struct convert<std_msgs::Header>
   {
     if (node.size() != 3) return false;
 
-    rhs.seq = node["seq"].as<uint32_t>();
+    rhs.seq = message_serialization::decodeNumber<uint32_t>(node["seq"]);
     rhs.stamp = node["stamp"].as<ros::Time>();
     rhs.frame_id = node["frame_id"].as<std::string>();
 
@@ -68,8 +88,107 @@ struct convert<std_msgs::Header>
   }
 };
 
-// TODO: Duration
+template<>
+struct convert<ros::Duration>
+{
+  static Node encode(const ros::Duration& rhs)
+  {
+    Node node;
+    node["sec"] = rhs.sec;
+    node["nsec"] = rhs.nsec;
+    return node;
+  }
+
+  static bool decode(const Node& node, ros::Duration& rhs)
+  {
+    if (node.size() != 2) return false;
+
+    using message_serialization::detail::timeField;
+    rhs.sec = message_serialization::decodeNumber<int32_t>(timeField(node, "sec", "secs"));
+    rhs.nsec = message_serialization::decodeNumber<int32_t>(timeField(node, "nsec", "nsecs"));
+
+    return true;
+  }
+};
+
+}
+
+namespace message_serialization
+{
 
+inline void emit(YamlWriter& out, const ros::Time& rhs)
+{
+  // JSON output uses the field names of rospy, like rospy_message_converter
+  const bool rospy = out.options().json;
+  out.beginMap();
+  out.field(rospy ? "secs" : "sec", rhs.sec);
+  out.field(rospy ? "nsecs" : "nsec", rhs.nsec);
+  out.endMap();
 }
 
+inline void emit(YamlWriter& out, const ros::Duration& rhs)
+{
+  // JSON output uses the field names of rospy, like rospy_message_converter
+  const bool rospy = out.options().json;
+  out.beginMap();
+  out.field(rospy ? "secs" : "sec", rhs.sec);
+  out.field(rospy ? "nsecs" : "nsec", rhs.nsec);
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const std_msgs::Header& rhs)
+{
+  out.beginMap();
+  out.field("seq", rhs.seq);
+  out.field("stamp", rhs.stamp);
+  out.field("frame_id", rhs.frame_id);
+  out.endMap();
+}
+
+inline void parse(YamlReader& in, ros::Time& rhs)
+{
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("sec", "secs"))
+      parse(in, rhs.sec);
+    else if (map.key("nsec", "nsecs"))
+      parse(in, rhs.nsec);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, ros::Duration& rhs)
+{
+  YamlReader::Map map(in, 2);
+  while (map.next())
+  {
+    if (map.key("sec", "secs"))
+      parse(in, rhs.sec);
+    else if (map.key("nsec", "nsecs"))
+      parse(in, rhs.nsec);
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, std_msgs::Header& rhs)
+{
+  YamlReader::Map map(in, 3);
+  while (map.next())
+  {
+    if (map.key("seq"))
+      parse(in, rhs.seq);
+    else if (map.key("stamp"))
+      parse(in, rhs.stamp);
+    else if (map.key("frame_id"))
+      parse(in, rhs.frame_id);
+    else
+      map.unknown();
+  }
+}
+
+} // namespace message_serialization
+
 #endif // MESSAGE_SERIALIZATION_STD_MSGS_YAML
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_TRAJECTORY_LOG_H
+#define MESSAGE_SERIALIZATION_TRAJECTORY_LOG_H
+
+#include <message_serialization/binary_log.h>
+#include <trajectory_msgs/JointTrajectory.h>
+
+/*
+ * Trajectory log layout
+ *
+ * A trajectory log is a binary log (see binary_log.h) whose first record is the trajectory without its points, stamped
+ * with the trajectory header stamp, followed by one record per point, stamped with the header stamp plus the time from
+ * start of the point. Appending a point therefore writes only that point, and readers can seek to a time from start
+ * through the log index.
+ */
+
+namespace message_serialization
+{
+/**
+ * @brief Records a growing joint trajectory by appending one point at a time
+ * @details The header and joint names are written once on construction; each point costs O(1) regardless of the length
+ * of the recording. A log that was never closed (e.g. after a crash) can still be read back, up to the last point that
+ * reached the file; call @ref flush to checkpoint the points appended so far.
+ */
+class JointTrajectoryWriter
+{
+public:
+  /**
+   * @brief Creates a new trajectory log, replacing any existing file
+   * @param file
+   * @param header
+   * @param joint_names
+   * @param index_interval Number of points between index records of the underlying log
+   * @throws on failure to open or write to the file
+   */
+  JointTrajectoryWriter(const std::string& file, const std_msgs::Header& header,
+                        const std::vector<std::string>& joint_names, const std::size_t index_interval = 1024)
+    : log_(file, index_interval), stamp_(header.stamp)
+  {
+    trajectory_msgs::JointTrajectory trajectory;
+    trajectory.header = header;
+    trajectory.joint_names = joint_names;
+    log_.write(trajectory, stamp_);
+  }
+
+  /**
+   * @brief Appends a point to the trajectory
+   * @throws std::invalid_argument if the time from start of the point is earlier than that of the previous point
+   * @throws on failure to write to the file
+   */
+  void append(const trajectory_msgs::JointTrajectoryPoint& point)
+  {
+    if (point.time_from_start < last_time_from_start_)
+      throw std::invalid_argument("Trajectory points must be appended in order of time from start");
+
+    log_.write(point, stamp_ + point.time_from_start);
+    last_time_from_start_ = point.time_from_start;
+  }
+
+  /**
+   * @brief Flushes the points appended so far to the operating system
+   */
+  void flush()
+  {
+    log_.flush();
+  }
+
+  /**
+   * @brief Finalizes the log; closing an already closed writer has no effect
+   */
+  void close()
+  {
+    log_.close();
+  }
+
+  /**
+   * @brief Number of points appended so far
+   */
+  std::size_t size() const
+  {
+    return log_.size() - 1;
+  }
+
+private:
+  BinaryLogWriter log_;
+  ros::Time stamp_;
+  ros::Duration last_time_from_start_;
+};
+
+/**
+ * @brief Reads a joint trajectory recorded by @ref JointTrajectoryWriter, either as a whole or point by point
+ */
+class JointTrajectoryReader
+{
+public:
+  /**
+   * @brief Opens a trajectory log and reads its header and joint names
+   * @throws on failure to open the file or if it is not a trajectory log
+   */
+  explicit JointTrajectoryReader(const std::string& file) : log_(file)
+  {
+    if (log_.size() == 0)
+      throw std::runtime_error("File at '" + file + "' is not a trajectory log");
+
+    trajectory_ = log_.read<trajectory_msgs::JointTrajectory>(0);
+    if (!trajectory_.points.empty())
+      throw std::runtime_error("File at '" + file + "' is not a trajectory log");
+    log_.seek(std::size_t(1));
+  }
+
+  const std_msgs::Header& header() const
+  {
+    return trajectory_.header;
+  }
+
+  const std::vector<std::string>& jointNames() const
+  {
+    return trajectory_.joint_names;
+  }
+
+  /**
+   * @brief Number of points in the trajectory
+   */
+  std::size_t size() const
+  {
+    return log_.size() - 1;
+  }
+
+  /**
+   * @brief Reads the point at the input index
+   * @throws if the index is out of range or the point cannot be read
+   */
+  trajectory_msgs::JointTrajectoryPoint read(const std::size_t index)
+  {
+    return log_.read<trajectory_msgs::JointTrajectoryPoint>(index + 1);
+  }
+
+  /**
+   * @brief Moves the read cursor to the first point whose time from start is not earlier than the input duration
+   * @return index of that point, or @ref size if there is none
+   */
+  std::size_t seek(const ros::Duration& time_from_start)
+  {
+    const std::size_t position = std::max<std::size_t>(log_.lowerBound(trajectory_.header.stamp + time_from_start), 1);
+    log_.seek(position);
+    return position - 1;
+  }
+
+  /**
+   * @brief Moves the read cursor to the point at the input index
+   */
+  void seek(const std::size_t index)
+  {
+    log_.seek(index + 1);
+  }
+
+  /**
+   * @brief Reads the point at the cursor and advances the cursor
+   * @param point (output)
+   * @return false if there are no more points
+   */
+  bool next(trajectory_msgs::JointTrajectoryPoint& point)
+  {
+    return log_.next(point);
+  }
+
+  /**
+   * @brief Reconstructs the complete trajectory
+   */
+  trajectory_msgs::JointTrajectory readAll()
+  {
+    trajectory_msgs::JointTrajectory trajectory = trajectory_;
+    trajectory.points.resize(size());
+    for (std::size_t i = 0; i < trajectory.points.size(); ++i)
+      trajectory.points[i] = read(i);
+    return trajectory;
+  }
+
+private:
+  BinaryLogReader log_;
+  trajectory_msgs::JointTrajectory trajectory_;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_TRAJECTORY_LOG_H
@@ -18,6 +18,80 @@
 
 #include <trajectory_msgs/JointTrajectory.h>
 #include <message_serialization/std_msgs_yaml.h>
+#include <message_serialization/yaml_binary.h>
+
+namespace message_serialization
+{
+
+/**
+ * @brief Number of values of a trajectory point when packed into a binary array row
+ */
+inline std::size_t binaryArrayColumns(const trajectory_msgs::JointTrajectoryPoint& rhs)
+{
+  return rhs.positions.size() + rhs.velocities.size() + rhs.accelerations.size() + rhs.effort.size() + 1;
+}
+
+/**
+ * @brief Packs trajectory points into an array of rows [positions, velocities, accelerations, effort, time_from_start]
+ * @return false if the points do not all have the same number of positions, velocities, accelerations and efforts
+ */
+inline bool toBinaryArray(const std::vector<trajectory_msgs::JointTrajectoryPoint>& rhs, BinaryArray& array)
+{
+  if (rhs.empty())
+    return false;
+
+  const trajectory_msgs::JointTrajectoryPoint& first = rhs.front();
+  for (const trajectory_msgs::JointTrajectoryPoint& point : rhs)
+  {
+    if (point.positions.size() != first.positions.size() || point.velocities.size() != first.velocities.size() ||
+        point.accelerations.size() != first.accelerations.size() || point.effort.size() != first.effort.size())
+      return false;
+  }
+
+  array.reset<double>(rhs.size(), binaryArrayColumns(first));
+  array.fields = { static_cast<uint32_t>(first.positions.size()), static_cast<uint32_t>(first.velocities.size()),
+                   static_cast<uint32_t>(first.accelerations.size()), static_cast<uint32_t>(first.effort.size()) };
+  for (const trajectory_msgs::JointTrajectoryPoint& point : rhs)
+  {
+    for (const double v : point.positions)
+      array.append(v);
+    for (const double v : point.velocities)
+      array.append(v);
+    for (const double v : point.accelerations)
+      array.append(v);
+    for (const double v : point.effort)
+      array.append(v);
+    array.append(point.time_from_start.toSec());
+  }
+  return true;
+}
+
+inline void fromBinaryArray(const BinaryArray& array, std::vector<trajectory_msgs::JointTrajectoryPoint>& rhs)
+{
+  if (array.fields.size() != 4)
+    throw YamlParseError("yaml: expected a binary array with 4 fields");
+
+  const std::size_t columns = static_cast<std::size_t>(array.fields[0]) + array.fields[1] + array.fields[2] + array.fields[3] + 1;
+  array.check<double>(columns);
+
+  rhs.resize(array.rows());
+  for (std::size_t i = 0; i < rhs.size(); ++i)
+  {
+    trajectory_msgs::JointTrajectoryPoint& point = rhs[i];
+    std::vector<double>* const fields[] = { &point.positions, &point.velocities, &point.accelerations, &point.effort };
+
+    std::size_t column = 0;
+    for (std::size_t f = 0; f < 4; ++f)
+    {
+      fields[f]->resize(array.fields[f]);
+      for (double& v : *fields[f])
+        v = array.at<double>(i, column++);
+    }
+    point.time_from_start = ros::Duration(array.at<double>(i, column));
+  }
+}
+
+} // namespace message_serialization
 
 namespace YAML
 {
@@ -41,11 +115,15 @@ struct convert<trajectory_msgs::JointTrajectoryPoint>
   {
     if (node.size() != 5) return false;
 
-    rhs.positions = node["positions"].as<std::vector<double> >();
-    rhs.velocities = node["velocities"].as<std::vector<double> >();
-    rhs.accelerations = node["accelerations"].as<std::vector<double> >();
-    rhs.effort = node["effort"].as<std::vector<double> >();
-    rhs.time_from_start = ros::Duration(node["time_from_start"].as<double>());
+    rhs.positions = message_serialization::decodeNumbers<double>(node["positions"]);
+    rhs.velocities = message_serialization::decodeNumbers<double>(node["velocities"]);
+    rhs.accelerations = message_serialization::decodeNumbers<double>(node["accelerations"]);
+    rhs.effort = message_serialization::decodeNumbers<double>(node["effort"]);
+    const Node time_from_start = node["time_from_start"];
+    if (time_from_start.IsMap())
+      rhs.time_from_start = time_from_start.as<ros::Duration>();
+    else
+      rhs.time_from_start = ros::Duration(message_serialization::decodeNumber<double>(time_from_start));
 
     return true;
   }
@@ -69,7 +147,7 @@ struct convert<trajectory_msgs::JointTrajectory>
   
     rhs.header = node["header"].as<std_msgs::Header>();
     rhs.joint_names = node["joint_names"].as<std::vector<std::string> >();
-    rhs.points = node["points"].as<std::vector<trajectory_msgs::JointTrajectoryPoint> >(); 
+    rhs.points = message_serialization::decodeArray<trajectory_msgs::JointTrajectoryPoint>(node["points"]);
   
     return true;
   }
@@ -77,4 +155,80 @@ struct convert<trajectory_msgs::JointTrajectory>
 
 }
 
+namespace message_serialization
+{
+
+inline void emit(YamlWriter& out, const trajectory_msgs::JointTrajectoryPoint& rhs)
+{
+  out.beginMap();
+  out.field("positions", rhs.positions);
+  out.field("velocities", rhs.velocities);
+  out.field("accelerations", rhs.accelerations);
+  out.field("effort", rhs.effort);
+  // JSON output keeps the duration message layout of rospy
+  if (out.options().json)
+    out.field("time_from_start", rhs.time_from_start);
+  else
+    out.field("time_from_start", rhs.time_from_start.toSec());
+  out.endMap();
+}
+
+inline void emit(YamlWriter& out, const trajectory_msgs::JointTrajectory& rhs)
+{
+  out.beginMap();
+  out.field("header", rhs.header);
+  out.field("joint_names", rhs.joint_names);
+  out.key("points");
+  emitArray(out, rhs.points, rhs.points.empty() ? 0 : rhs.points.size() * binaryArrayColumns(rhs.points.front()));
+  out.endMap();
+}
+
+inline void parse(YamlReader& in, trajectory_msgs::JointTrajectoryPoint& rhs)
+{
+  YamlReader::Map map(in, 5);
+  while (map.next())
+  {
+    if (map.key("positions"))
+      parse(in, rhs.positions);
+    else if (map.key("velocities"))
+      parse(in, rhs.velocities);
+    else if (map.key("accelerations"))
+      parse(in, rhs.accelerations);
+    else if (map.key("effort"))
+      parse(in, rhs.effort);
+    else if (map.key("time_from_start"))
+    {
+      // Seconds, or the duration message layout of JSON output
+      if (in.peek() == YamlReader::Event::MAP_START)
+      {
+        parse(in, rhs.time_from_start);
+        continue;
+      }
+      double time_from_start;
+      parse(in, time_from_start);
+      rhs.time_from_start = ros::Duration(time_from_start);
+    }
+    else
+      map.unknown();
+  }
+}
+
+inline void parse(YamlReader& in, trajectory_msgs::JointTrajectory& rhs)
+{
+  YamlReader::Map map(in, 3);
+  while (map.next())
+  {
+    if (map.key("header"))
+      parse(in, rhs.header);
+    else if (map.key("joint_names"))
+      parse(in, rhs.joint_names);
+    else if (map.key("points"))
+      parseArray(in, rhs.points);
+    else
+      map.unknown();
+  }
+}
+
+} // namespace message_serialization
+
 #endif // MESSAGE_SERIALIZATION_TRAJECTORY_MSGS_YAML
@@ -0,0 +1,495 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_YAML_BINARY_H
+#define MESSAGE_SERIALIZATION_YAML_BINARY_H
+
+#include <cstdint>
+#include <cstring>
+#include <message_serialization/yaml_reader.h>
+#include <message_serialization/yaml_writer.h>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+namespace message_serialization
+{
+/**
+ * @brief Name of the element type of a binary array
+ */
+template <typename T>
+struct BinaryDType;
+
+template <>
+struct BinaryDType<double>
+{
+  static const char* name()
+  {
+    return "float64";
+  }
+};
+
+template <>
+struct BinaryDType<float>
+{
+  static const char* name()
+  {
+    return "float32";
+  }
+};
+
+template <>
+struct BinaryDType<uint32_t>
+{
+  static const char* name()
+  {
+    return "uint32";
+  }
+};
+
+template <>
+struct BinaryDType<int32_t>
+{
+  static const char* name()
+  {
+    return "int32";
+  }
+};
+
+namespace detail
+{
+template <std::size_t Size>
+struct BinaryBits;
+
+template <>
+struct BinaryBits<4>
+{
+  typedef uint32_t type;
+};
+
+template <>
+struct BinaryBits<8>
+{
+  typedef uint64_t type;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Two-dimensional numeric array stored as little-endian binary data
+ * @details In YAML, the array is written as a map of the form
+ * `{dtype: float64, shape: [rows, columns], data: !!binary ...}`, or in the columnar layout, where `data` is replaced
+ * by `columns: [[...], ...]` with one sequence of values per column. Arrays whose rows pack several variable-length
+ * fields also carry a `fields` entry with the number of columns of each field
+ */
+struct BinaryArray
+{
+  std::string dtype;
+  std::vector<uint64_t> shape;
+  std::vector<uint32_t> fields;
+  std::vector<unsigned char> data;
+
+  /**
+   * @brief Prepares the array to receive rows * columns values of type T through @ref append
+   */
+  template <typename T>
+  void reset(const std::size_t rows, const std::size_t columns)
+  {
+    dtype = BinaryDType<T>::name();
+    shape.assign({ rows, columns });
+    fields.clear();
+    data.clear();
+    data.reserve(rows * columns * sizeof(T));
+  }
+
+  /**
+   * @brief Appends a value in little-endian byte order
+   */
+  template <typename T>
+  void append(const T value)
+  {
+    typename detail::BinaryBits<sizeof(T)>::type bits;
+    std::memcpy(&bits, &value, sizeof(T));
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+      data.push_back(static_cast<unsigned char>(bits >> (8 * i)));
+  }
+
+  /**
+   * @brief Verifies that the array holds two-dimensional data of type T with the expected number of columns
+   * @throws YamlParseError if the array does not match
+   */
+  template <typename T>
+  void check(const std::size_t columns) const
+  {
+    if (dtype != BinaryDType<T>::name() || shape.size() != 2 || shape[1] != columns)
+      throw YamlParseError("yaml: expected a binary array of " + std::string(BinaryDType<T>::name()) + " with " +
+                           std::to_string(columns) + " columns");
+    // The number of rows is compared before multiplying so that a bogus shape cannot wrap around
+    const std::size_t row_size = columns * sizeof(T);
+    const bool matches = row_size == 0 ? data.empty() && shape[0] == 0 :
+                                         shape[0] <= data.size() / row_size && data.size() == shape[0] * row_size;
+    if (!matches)
+      throw YamlParseError("yaml: binary array data does not match its shape");
+  }
+
+  std::size_t rows() const
+  {
+    return shape.empty() ? 0 : static_cast<std::size_t>(shape[0]);
+  }
+
+  std::size_t columns() const
+  {
+    return shape.size() < 2 ? 0 : static_cast<std::size_t>(shape[1]);
+  }
+
+  /**
+   * @brief Writes the value at the given row and column of data already sized to the shape
+   */
+  template <typename T>
+  void set(const std::size_t row, const std::size_t column, const T value)
+  {
+    typename detail::BinaryBits<sizeof(T)>::type bits;
+    std::memcpy(&bits, &value, sizeof(T));
+    unsigned char* bytes = data.data() + (row * shape[1] + column) * sizeof(T);
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+      bytes[i] = static_cast<unsigned char>(bits >> (8 * i));
+  }
+
+  /**
+   * @brief Reads the value at the given row and column; @ref check must have succeeded for type T
+   */
+  template <typename T>
+  T at(const std::size_t row, const std::size_t column) const
+  {
+    const unsigned char* bytes = data.data() + (row * shape[1] + column) * sizeof(T);
+    typename detail::BinaryBits<sizeof(T)>::type bits = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+      bits |= static_cast<typename detail::BinaryBits<sizeof(T)>::type>(bytes[i]) << (8 * i);
+
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+  }
+};
+
+namespace detail
+{
+/**
+ * @brief Calls `f.template apply<T>()` with the element type T named by the dtype of a binary array
+ * @throws YamlParseError for unsupported element types
+ */
+template <typename F>
+inline void visitDType(const std::string& dtype, F& f)
+{
+  if (dtype == BinaryDType<double>::name())
+    f.template apply<double>();
+  else if (dtype == BinaryDType<float>::name())
+    f.template apply<float>();
+  else if (dtype == BinaryDType<uint32_t>::name())
+    f.template apply<uint32_t>();
+  else if (dtype == BinaryDType<int32_t>::name())
+    f.template apply<int32_t>();
+  else
+    throw YamlParseError("yaml: unsupported binary array dtype '" + dtype + "'");
+}
+
+/**
+ * @brief Verifies that the shape of a columnar array was read before its columns
+ */
+inline void checkColumnsShape(const BinaryArray& array)
+{
+  if (array.shape.size() != 2)
+    throw YamlParseError("yaml: expected the shape of a columnar array to precede its columns");
+}
+
+/**
+ * @brief Sizes the data of an array to its shape before its values are set column by column
+ * @details The shape is read from the document, so this must only be called once the columns have been found to
+ * match it, which bounds the size by the number of values actually present
+ */
+template <typename T>
+inline void prepareColumns(BinaryArray& array)
+{
+  array.data.assign(array.rows() * array.columns() * sizeof(T), 0);
+}
+
+struct ColumnEmitter
+{
+  YamlWriter& out;
+  const BinaryArray& array;
+
+  template <typename T>
+  void apply()
+  {
+    for (std::size_t c = 0; c < array.columns(); ++c)
+    {
+      out.beginFlowSeq();
+      for (std::size_t r = 0; r < array.rows(); ++r)
+        emit(out, array.at<T>(r, c));
+      out.endSeq();
+    }
+  }
+};
+
+struct ColumnParser
+{
+  YamlReader& in;
+  BinaryArray& array;
+
+  /**
+   * @details The values are collected in column order before the data is sized to the shape, so that memory only
+   * grows with the values actually present in the document
+   */
+  template <typename T>
+  void apply()
+  {
+    checkColumnsShape(array);
+    std::vector<T> values;
+    in.beginSeq();
+    std::size_t c = 0;
+    for (; in.nextElement(); ++c)
+    {
+      if (c == array.columns())
+        throw in.error("expected " + std::to_string(array.columns()) + " columns");
+
+      in.beginSeq();
+      std::size_t r = 0;
+      for (; in.nextElement(); ++r)
+      {
+        if (r == array.rows())
+          throw in.error("expected columns of " + std::to_string(array.rows()) + " values");
+        T value;
+        parse(in, value);
+        values.push_back(value);
+      }
+      if (r != array.rows())
+        throw in.error("expected columns of " + std::to_string(array.rows()) + " values");
+    }
+    if (c != array.columns())
+      throw in.error("expected " + std::to_string(array.columns()) + " columns");
+
+    prepareColumns<T>(array);
+    for (std::size_t i = 0; i < values.size(); ++i)
+      array.set(i % array.rows(), i / array.rows(), values[i]);
+  }
+};
+
+struct ColumnDecoder
+{
+  const YAML::Node& node;
+  BinaryArray& array;
+
+  template <typename T>
+  void apply()
+  {
+    checkColumnsShape(array);
+    if (!node.IsSequence() || node.size() != array.columns())
+      throw YamlParseError("yaml: expected " + std::to_string(array.columns()) + " columns");
+    for (std::size_t c = 0; c < array.columns(); ++c)
+    {
+      const YAML::Node column = node[c];
+      if (!column.IsSequence() || column.size() != array.rows())
+        throw YamlParseError("yaml: expected columns of " + std::to_string(array.rows()) + " values");
+    }
+
+    prepareColumns<T>(array);
+    for (std::size_t c = 0; c < array.columns(); ++c)
+    {
+      const YAML::Node column = node[c];
+      for (std::size_t r = 0; r < array.rows(); ++r)
+        array.set(r, c, decodeNumber<T>(column[r]));
+    }
+  }
+};
+
+}  // namespace detail
+
+inline void emit(YamlWriter& out, const BinaryArray& rhs)
+{
+  out.beginMap();
+  out.field("dtype", rhs.dtype);
+  out.field("shape", rhs.shape);
+  if (!rhs.fields.empty())
+    out.field("fields", rhs.fields);
+  out.key("data");
+  out.binary(rhs.data.data(), rhs.data.size());
+  out.endMap();
+}
+
+/**
+ * @brief Writes an array in the columnar layout `{dtype, shape, [fields,] columns: [[...], ...]}`, with one flow
+ * sequence of values per column
+ */
+inline void emitColumns(YamlWriter& out, const BinaryArray& rhs)
+{
+  out.beginMap();
+  out.field("dtype", rhs.dtype);
+  out.key("shape");
+  out.beginFlowSeq();
+  for (const uint64_t size : rhs.shape)
+    out.scalar(size);
+  out.endSeq();
+  if (!rhs.fields.empty())
+  {
+    out.key("fields");
+    out.beginFlowSeq();
+    for (const uint32_t size : rhs.fields)
+      out.scalar(static_cast<uint64_t>(size));
+    out.endSeq();
+  }
+  out.key("columns");
+  out.beginSeq();
+  detail::ColumnEmitter emitter = { out, rhs };
+  detail::visitDType(rhs.dtype, emitter);
+  out.endSeq();
+  out.endMap();
+}
+
+/**
+ * @brief Reads an array in either the binary or the columnar layout
+ */
+inline void parse(YamlReader& in, BinaryArray& rhs)
+{
+  rhs.dtype.clear();
+  rhs.shape.clear();
+  rhs.fields.clear();
+  YamlReader::Map map(in, in.peekCollectionSize() == 4 ? 4 : 3);
+  while (map.next())
+  {
+    if (map.key("dtype"))
+      parse(in, rhs.dtype);
+    else if (map.key("shape"))
+      parse(in, rhs.shape);
+    else if (map.key("fields"))
+      parse(in, rhs.fields);
+    else if (map.key("data"))
+      rhs.data = YAML::DecodeBase64(in.scalar().str());
+    else if (map.key("columns"))
+    {
+      detail::ColumnParser parser = { in, rhs };
+      detail::visitDType(rhs.dtype, parser);
+    }
+    else
+      map.unknown();
+  }
+}
+
+/**
+ * @brief Writes a sequence as a binary array if it holds at least as many values as the threshold of the writer's
+ * options, in the columnar layout if the options request it, and as a regular sequence otherwise
+ * @details Element types opt in by providing an overload of `bool toBinaryArray(const std::vector<T>&, BinaryArray&)`,
+ * which may return false if the sequence cannot be represented as a binary array
+ * @param out
+ * @param value
+ * @param values Number of scalar values in the sequence
+ */
+template <typename T>
+inline void emitArray(YamlWriter& out, const std::vector<T>& value, const std::size_t values)
+{
+  const bool binary = out.binaryArray(values);
+  BinaryArray array;
+  if ((binary || out.options().columnar_arrays) && toBinaryArray(value, array))
+  {
+    if (binary)
+      emit(out, array);
+    else
+      emitColumns(out, array);
+  }
+  else
+  {
+    emit(out, value);
+  }
+}
+
+/**
+ * @brief Reads a sequence written by @ref emitArray in either representation
+ * @details Element types opt in by providing an overload of `void fromBinaryArray(const BinaryArray&,
+ * std::vector<T>&)`
+ */
+template <typename T>
+inline void parseArray(YamlReader& in, std::vector<T>& value)
+{
+  if (in.peek() == YamlReader::Event::MAP_START)
+  {
+    BinaryArray array;
+    parse(in, array);
+    fromBinaryArray(array, value);
+  }
+  else
+  {
+    parse(in, value);
+  }
+}
+
+}  // namespace message_serialization
+
+namespace YAML
+{
+template <>
+struct convert<message_serialization::BinaryArray>
+{
+  static Node encode(const message_serialization::BinaryArray& rhs)
+  {
+    Node node;
+    node["dtype"] = rhs.dtype;
+    node["shape"] = rhs.shape;
+    if (!rhs.fields.empty())
+      node["fields"] = rhs.fields;
+    node["data"] = Binary(rhs.data.data(), rhs.data.size());
+    return node;
+  }
+
+  static bool decode(const Node& node, message_serialization::BinaryArray& rhs)
+  {
+    if (node.size() != 3 && node.size() != 4) return false;
+
+    rhs.dtype = node["dtype"].as<std::string>();
+    rhs.shape = message_serialization::decodeNumbers<uint64_t>(node["shape"]);
+    rhs.fields = node["fields"] ? message_serialization::decodeNumbers<uint32_t>(node["fields"]) :
+                                  std::vector<uint32_t>();
+    if (node["columns"])
+    {
+      message_serialization::detail::ColumnDecoder decoder = { node["columns"], rhs };
+      message_serialization::detail::visitDType(rhs.dtype, decoder);
+    }
+    else
+    {
+      rhs.data = DecodeBase64(node["data"].Scalar());
+    }
+    return true;
+  }
+};
+
+}
+
+namespace message_serialization
+{
+/**
+ * @brief Decodes a YAML::Node sequence written by @ref emitArray in either representation
+ */
+template <typename T>
+inline std::vector<T> decodeArray(const YAML::Node& node)
+{
+  std::vector<T> value;
+  if (node.IsMap())
+    fromBinaryArray(node.as<BinaryArray>(), value);
+  else
+    value = node.as<std::vector<T> >();
+  return value;
+}
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_YAML_BINARY_H
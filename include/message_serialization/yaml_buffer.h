@@ -0,0 +1,151 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_YAML_BUFFER_H
+#define MESSAGE_SERIALIZATION_YAML_BUFFER_H
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+namespace message_serialization
+{
+namespace detail
+{
+/**
+ * @brief Stream buffer appending everything written to it to a string
+ */
+class StringAppendBuf : public std::streambuf
+{
+public:
+  explicit StringAppendBuf(std::string& str) : str_(str)
+  {
+  }
+
+protected:
+  int_type overflow(const int_type c) override
+  {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      str_.push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char* s, const std::streamsize n) override
+  {
+    str_.append(s, static_cast<std::size_t>(n));
+    return n;
+  }
+
+private:
+  std::string& str_;
+};
+
+/**
+ * @brief Read-only stream buffer over a block of memory, which is not copied
+ */
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+  MemoryStreamBuf(const char* data, const std::size_t size)
+  {
+    // The get area is only read from, so the memory is never written through
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+};
+
+}  // namespace detail
+
+/**
+ * @brief Text buffer intended to be reused across in-memory YAML encodes
+ * @details Each encode clears the buffer but keeps its capacity, so repeatedly serializing objects of similar size into
+ * the same buffer stops reallocating once it has grown to fit them. See @ref serializeToString
+ */
+class YamlBuffer
+{
+public:
+  YamlBuffer() : buf_(str_), stream_(&buf_)
+  {
+  }
+
+  explicit YamlBuffer(const std::size_t capacity) : YamlBuffer()
+  {
+    reserve(capacity);
+  }
+
+  // The stream refers to the buffer, so it can be neither copied nor moved
+  YamlBuffer(const YamlBuffer&) = delete;
+  YamlBuffer& operator=(const YamlBuffer&) = delete;
+
+  /**
+   * @brief Text written since the last @ref clear
+   */
+  const std::string& str() const
+  {
+    return str_;
+  }
+
+  const char* data() const
+  {
+    return str_.data();
+  }
+
+  std::size_t size() const
+  {
+    return str_.size();
+  }
+
+  std::size_t capacity() const
+  {
+    return str_.capacity();
+  }
+
+  bool empty() const
+  {
+    return str_.empty();
+  }
+
+  void reserve(const std::size_t capacity)
+  {
+    str_.reserve(capacity);
+  }
+
+  /**
+   * @brief Discards the text, keeping the capacity
+   */
+  void clear()
+  {
+    str_.clear();
+    stream_.clear();
+  }
+
+  /**
+   * @brief Output stream appending to the buffer
+   */
+  std::ostream& stream()
+  {
+    return stream_;
+  }
+
+private:
+  std::string str_;
+  detail::StringAppendBuf buf_;
+  std::ostream stream_;
+};
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_YAML_BUFFER_H
@@ -0,0 +1,1601 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_YAML_READER_H
+#define MESSAGE_SERIALIZATION_YAML_READER_H
+
+#include <algorithm>
+#include <boost/array.hpp>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <message_serialization/numeric.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <yaml-cpp/eventhandler.h>
+#include <yaml-cpp/yaml.h>
+
+// yaml-cpp 0.5.3 added the collection style to the event handler callbacks, along with the header defining it
+#ifdef __has_include
+#if __has_include(<yaml-cpp/emitterstyle.h>)
+#define MESSAGE_SERIALIZATION_YAML_EVENT_STYLE
+#endif
+#endif
+
+namespace message_serialization
+{
+/**
+ * @brief Exception thrown when a YAML document does not match the structure of the type being decoded
+ */
+class YamlParseError : public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
+
+/**
+ * @brief Path to a field of a YAML document, such as `header.stamp`, `poses[3].position` or `poses[100:200]`
+ * @details A path is a sequence of map keys separated by dots, each optionally followed by sequence indices in
+ * brackets. The last component may instead be a slice `[begin:end]` (either bound may be omitted), which selects a
+ * sequence of the elements with indices in [begin, end).
+ */
+class FieldPath
+{
+public:
+  struct Component
+  {
+    enum Type
+    {
+      KEY,
+      INDEX,
+      SLICE
+    };
+
+    Type type;
+    std::string key;
+    std::size_t begin;
+    std::size_t end;
+  };
+
+  /**
+   * @brief Parses a path; an empty path selects the whole document
+   * @throws std::invalid_argument if the path is malformed
+   */
+  FieldPath(const std::string& path) : path_(path)
+  {
+    std::size_t i = 0;
+    while (i < path.size())
+    {
+      if (path[i] == '[')
+      {
+        const std::size_t close = path.find(']', i);
+        if (close == std::string::npos)
+          throw invalid("unterminated '['");
+        components_.push_back(parseBrackets(path.substr(i + 1, close - i - 1)));
+        i = close + 1;
+        if (i < path.size() && path[i] == '.')
+        {
+          if (++i == path.size())
+            throw invalid("trailing '.'");
+        }
+      }
+      else
+      {
+        const std::size_t end = path.find_first_of(".[", i);
+        const std::string key = path.substr(i, end == std::string::npos ? std::string::npos : end - i);
+        if (key.empty())
+          throw invalid("empty key");
+
+        Component component = { Component::KEY, key, 0, 0 };
+        components_.push_back(component);
+        i = end == std::string::npos ? path.size() : end;
+        if (i < path.size() && path[i] == '.')
+        {
+          if (++i == path.size())
+            throw invalid("trailing '.'");
+        }
+      }
+    }
+
+    for (std::size_t c = 0; c + 1 < components_.size(); ++c)
+      if (components_[c].type == Component::SLICE)
+        throw invalid("a slice may only be the last component");
+  }
+
+  FieldPath(const char* path) : FieldPath(std::string(path))
+  {
+  }
+
+  const std::vector<Component>& components() const
+  {
+    return components_;
+  }
+
+  const std::string& str() const
+  {
+    return path_;
+  }
+
+  /**
+   * @brief Selects the field from a YAML::Node tree
+   * @throws YamlParseError if the document does not contain the field
+   */
+  YAML::Node select(const YAML::Node& root) const
+  {
+    YAML::Node node = root;
+    for (const Component& component : components_)
+    {
+      if (component.type == Component::KEY)
+      {
+        if (!node.IsMap() || !node[component.key])
+          throw notFound();
+        node = node[component.key];
+      }
+      else if (!node.IsSequence())
+      {
+        throw notFound();
+      }
+      else if (component.type == Component::INDEX)
+      {
+        if (component.begin >= node.size())
+          throw notFound();
+        node = node[component.begin];
+      }
+      else
+      {
+        YAML::Node slice(YAML::NodeType::Sequence);
+        for (std::size_t i = component.begin; i < std::min<std::size_t>(component.end, node.size()); ++i)
+          slice.push_back(node[i]);
+        node = slice;
+      }
+    }
+    return node;
+  }
+
+  YamlParseError notFound() const
+  {
+    return YamlParseError("yaml: document does not contain field '" + path_ + "'");
+  }
+
+private:
+  std::invalid_argument invalid(const std::string& what) const
+  {
+    return std::invalid_argument("Invalid field path '" + path_ + "': " + what);
+  }
+
+  std::size_t parseIndex(const std::string& text, const std::size_t fallback) const
+  {
+    if (text.empty())
+      return fallback;
+    std::size_t value;
+    if (!parseNumber(text.data(), text.data() + text.size(), value))
+      throw invalid("'" + text + "' is not an index");
+    return value;
+  }
+
+  Component parseBrackets(const std::string& text) const
+  {
+    const std::size_t colon = text.find(':');
+    if (colon == std::string::npos)
+    {
+      if (text.empty())
+        throw invalid("empty index");
+      Component component = { Component::INDEX, std::string(), parseIndex(text, 0), 0 };
+      component.end = component.begin + 1;
+      return component;
+    }
+
+    Component component = { Component::SLICE, std::string(), parseIndex(text.substr(0, colon), 0),
+                            parseIndex(text.substr(colon + 1), std::numeric_limits<std::size_t>::max()) };
+    return component;
+  }
+
+  std::string path_;
+  std::vector<Component> components_;
+};
+
+/**
+ * @brief Decodes YAML from the parser's event stream without building a YAML::Node tree
+ * @details The document is parsed once into a compact, flat list of events (scalar text is stored contiguously), which
+ * typed decoders then consume in order through the overloads of the free function @ref parse. Compared to loading a
+ * YAML::Node tree, this avoids allocating several objects per node and copying every value out of the tree again.
+ * Types that only provide a YAML::convert specialization are still supported through a generic overload that
+ * rebuilds a YAML::Node for just their part of the document.
+ */
+class YamlReader
+{
+public:
+  enum class Event : uint8_t
+  {
+    MAP_START,
+    MAP_END,
+    SEQ_START,
+    SEQ_END,
+    SCALAR,
+    NULL_VALUE,
+    END
+  };
+
+  /**
+   * @brief Non-owning view of scalar text held by the reader; the text is null-terminated
+   */
+  struct StringRef
+  {
+    const char* data;
+    std::size_t size;
+
+    bool operator==(const char* rhs) const
+    {
+      return std::strlen(rhs) == size && std::memcmp(data, rhs, size) == 0;
+    }
+
+    bool operator!=(const char* rhs) const
+    {
+      return !(*this == rhs);
+    }
+
+    std::string str() const
+    {
+      return std::string(data, size);
+    }
+  };
+
+  /**
+   * @brief Helper for decoding a map whose keys correspond to the fields of a structure
+   * @details Consumes the start of the map on construction. @ref next advances to the next key and, once the end of
+   * the map is reached, verifies that the expected number of distinct fields was matched through @ref key. A field
+   * matched twice is rejected, so a repeated key cannot make up for a missing one
+   */
+  class Map
+  {
+  public:
+    Map(YamlReader& in, const std::size_t fields) : in_(in), fields_(fields)
+    {
+      in_.beginMap();
+    }
+
+    bool next()
+    {
+      if (in_.nextKey(key_))
+        return true;
+
+      if (matched_ != fields_)
+        throw in_.error("expected a map with " + std::to_string(fields_) + " fields");
+      return false;
+    }
+
+    /**
+     * @brief Returns true if the current key is the input name
+     */
+    bool key(const char* name)
+    {
+      if (key_ != name)
+        return false;
+      match(name);
+      return true;
+    }
+
+    /**
+     * @brief Returns true if the current key is the input name or its alias, which count as the same field
+     */
+    bool key(const char* name, const char* alias)
+    {
+      if (key_ != name && key_ != alias)
+        return false;
+      match(name);
+      return true;
+    }
+
+    /**
+     * @brief Returns true if the current key is the input name of known length
+     * @details Avoids measuring the name on every comparison; used by generated code
+     */
+    bool key(const char* name, const std::size_t size)
+    {
+      if (key_.size != size || std::memcmp(key_.data, name, size) != 0)
+        return false;
+      match(name);
+      return true;
+    }
+
+    /**
+     * @brief Rejects the current key
+     */
+    void unknown()
+    {
+      throw in_.error("unexpected key '" + key_.str() + "'");
+    }
+
+  private:
+    /**
+     * @brief Records a matched field, identified by the address of its name
+     * @details Each field is matched by a single call site with a constant name, so comparing addresses is enough to
+     * detect a repeated key. The names of typical messages fit in a fixed array, which avoids allocating per map
+     */
+    void match(const char* name)
+    {
+      const std::size_t inline_matched = matched_ < INLINE_FIELDS ? matched_ : INLINE_FIELDS;
+      for (std::size_t i = 0; i < inline_matched; ++i)
+        if (inline_names_[i] == name)
+          throw in_.error("duplicate key '" + key_.str() + "'");
+      if (std::find(more_names_.begin(), more_names_.end(), name) != more_names_.end())
+        throw in_.error("duplicate key '" + key_.str() + "'");
+
+      if (matched_ < INLINE_FIELDS)
+        inline_names_[matched_] = name;
+      else
+        more_names_.push_back(name);
+      ++matched_;
+    }
+
+    static const std::size_t INLINE_FIELDS = 16;
+
+    YamlReader& in_;
+    std::size_t fields_;
+    std::size_t matched_ = 0;
+    StringRef key_;
+    const char* inline_names_[INLINE_FIELDS];
+    std::vector<const char*> more_names_;
+  };
+
+  /**
+   * @brief Parses the first document of the input stream
+   * @throws if the stream does not contain a well-formed YAML document
+   */
+  explicit YamlReader(std::istream& in)
+  {
+    Handler handler(*this);
+    YAML::Parser parser(in);
+    if (!parser.HandleNextDocument(handler))
+      throw YamlParseError("yaml: input does not contain a document");
+  }
+
+  /**
+   * @brief Parses only the part of the first document of the input stream selected by a field path
+   * @details Events outside the selected field are discarded as they are parsed, and parsing stops as soon as the
+   * field is complete, so the rest of the document is never read. The reader then holds the field as if it were the
+   * whole document; a slice is presented as a sequence of the selected elements
+   * @throws YamlParseError if the document does not contain the field or is not well-formed up to it
+   */
+  YamlReader(std::istream& in, const FieldPath& path)
+  {
+    Handler handler(*this);
+    Selector selector(handler, path);
+    YAML::Parser parser(in);
+    try
+    {
+      parser.HandleNextDocument(selector);
+    }
+    catch (const Selector::Done&)
+    {
+      return;
+    }
+    throw path.notFound();
+  }
+
+  /**
+   * @brief Parses a JSON document with a dedicated parser rather than yaml-cpp
+   * @details The reader takes over the text and parses it in place: strings are unescaped and null-terminated within
+   * it, so the scalars are never copied. The events are the same as for the equivalent YAML, so a document is decoded
+   * by the same @ref parse overloads. The NaN, Infinity and -Infinity literals of Python's json module are accepted
+   * @param json
+   * @throws YamlParseError if the text is not a well-formed JSON document
+   */
+  static YamlReader fromJson(std::string json)
+  {
+    YamlReader reader;
+    reader.text_ = std::move(json);
+    reader.parseJson();
+    return reader;
+  }
+
+  /**
+   * @brief True if the document uses aliases, which this reader does not resolve
+   * @details Such documents should be decoded through YAML::Node instead
+   */
+  bool hasAliases() const
+  {
+    return has_aliases_;
+  }
+
+  /**
+   * @brief Number of events recorded for the document
+   */
+  std::size_t events() const
+  {
+    return events_.size();
+  }
+
+  /**
+   * @brief Number of nodes (scalars, nulls, aliases and collections) recorded for the document
+   */
+  std::size_t nodes() const
+  {
+    std::size_t count = 0;
+    for (const Record& record : events_)
+      count += record.type != Event::MAP_END && record.type != Event::SEQ_END;
+    return count;
+  }
+
+  /**
+   * @brief Type of the next event
+   */
+  Event peek() const
+  {
+    return pos_ < events_.size() ? events_[pos_].type : Event::END;
+  }
+
+  /**
+   * @brief Number of entries in the collection that starts at the next event
+   */
+  std::size_t peekCollectionSize() const
+  {
+    return pos_ < events_.size() ? events_[pos_].size : 0;
+  }
+
+  /**
+   * @brief True if the next event is a scalar with the YAML binary tag
+   */
+  bool peekBinary() const
+  {
+    return pos_ < events_.size() && (events_[pos_].flags & BINARY);
+  }
+
+  void beginMap()
+  {
+    expect(Event::MAP_START, "expected a map");
+  }
+
+  /**
+   * @brief Reads the next key of the current map
+   * @param key (output)
+   * @return false if the end of the map was reached instead
+   */
+  bool nextKey(StringRef& key)
+  {
+    if (peek() == Event::MAP_END)
+    {
+      ++pos_;
+      return false;
+    }
+
+    key = scalar();
+    return true;
+  }
+
+  void beginSeq()
+  {
+    expect(Event::SEQ_START, "expected a sequence");
+  }
+
+  /**
+   * @brief Checks whether the current sequence has another element
+   * @return false if the end of the sequence was reached (and consumed) instead
+   */
+  bool nextElement()
+  {
+    if (peek() == Event::SEQ_END)
+    {
+      ++pos_;
+      return false;
+    }
+    if (peek() == Event::END)
+      throw error("unexpected end of document");
+    return true;
+  }
+
+  /**
+   * @brief Reads a scalar
+   */
+  StringRef scalar()
+  {
+    const Record& record = expect(Event::SCALAR, "expected a scalar");
+    StringRef ref = { text_.data() + record.offset, record.size };
+    return ref;
+  }
+
+  /**
+   * @brief Returns the next scalar without consuming it
+   */
+  StringRef peekScalar() const
+  {
+    if (peek() != Event::SCALAR)
+      throw error("expected a scalar");
+    StringRef ref = { text_.data() + events_[pos_].offset, events_[pos_].size };
+    return ref;
+  }
+
+  /**
+   * @brief Reads a scalar, treating a null value as an empty string
+   */
+  StringRef scalarOrNull()
+  {
+    if (peek() == Event::NULL_VALUE)
+    {
+      ++pos_;
+      StringRef ref = { "", 0 };
+      return ref;
+    }
+    return scalar();
+  }
+
+  /**
+   * @brief Skips the next value, including all of its children
+   */
+  void skip()
+  {
+    std::size_t depth = 0;
+    do
+    {
+      switch (next("unexpected end of document").type)
+      {
+        case Event::MAP_START:
+        case Event::SEQ_START:
+          ++depth;
+          break;
+        case Event::MAP_END:
+        case Event::SEQ_END:
+          --depth;
+          break;
+        default:
+          break;
+      }
+    } while (depth > 0);
+  }
+
+  /**
+   * @brief Builds a YAML::Node from the next value, including all of its children
+   */
+  YAML::Node node()
+  {
+    YAML::Emitter out;
+    std::size_t depth = 0;
+    do
+    {
+      const Record& record = next("unexpected end of document");
+      switch (record.type)
+      {
+        case Event::MAP_START:
+          out << YAML::BeginMap;
+          ++depth;
+          break;
+        case Event::SEQ_START:
+          out << YAML::BeginSeq;
+          ++depth;
+          break;
+        case Event::MAP_END:
+          out << YAML::EndMap;
+          --depth;
+          break;
+        case Event::SEQ_END:
+          out << YAML::EndSeq;
+          --depth;
+          break;
+        case Event::SCALAR:
+          if (record.flags & BINARY)
+            out << YAML::SecondaryTag("binary");
+          if (record.flags & QUOTED)
+            out << YAML::DoubleQuoted;
+          out << std::string(text_.data() + record.offset, record.size);
+          break;
+        default:
+          out << YAML::Null;
+          break;
+      }
+    } while (depth > 0);
+
+    return YAML::Load(out.c_str());
+  }
+
+  /**
+   * @brief Creates an exception that refers to the location of the next event
+   */
+  YamlParseError error(const std::string& what) const
+  {
+    const std::size_t index = pos_ < events_.size() ? pos_ : (pos_ > 0 ? pos_ - 1 : 0);
+    const int line = events_.empty() ? 0 : events_[std::min(index, events_.size() - 1)].line;
+    return YamlParseError(std::string(format_) + ": line " + std::to_string(line + 1) + ": " + what);
+  }
+
+private:
+  enum Flags : uint8_t
+  {
+    QUOTED = 1,
+    BINARY = 2
+  };
+
+  struct Record
+  {
+    std::size_t offset;
+    uint32_t size;
+    int line;
+    Event type;
+    uint8_t flags;
+  };
+
+  class Selector;
+
+  /**
+   * @brief Records parser events into the reader's buffers
+   */
+  class Handler : public YAML::EventHandler
+  {
+    friend class Selector;
+
+  public:
+    explicit Handler(YamlReader& reader) : reader_(reader)
+    {
+    }
+
+    void OnDocumentStart(const YAML::Mark&) override
+    {
+    }
+
+    void OnDocumentEnd() override
+    {
+    }
+
+    void OnNull(const YAML::Mark& mark, YAML::anchor_t) override
+    {
+      add(Event::NULL_VALUE, mark);
+    }
+
+    void OnAlias(const YAML::Mark& mark, YAML::anchor_t) override
+    {
+      reader_.has_aliases_ = true;
+      add(Event::NULL_VALUE, mark);
+    }
+
+    void OnScalar(const YAML::Mark& mark, const std::string& tag, YAML::anchor_t,
+                  const std::string& value) override
+    {
+      Record& record = add(Event::SCALAR, mark);
+      record.offset = reader_.text_.size();
+      record.size = static_cast<uint32_t>(value.size());
+      if (tag == "!")
+        record.flags |= QUOTED;
+      else if (tag == "tag:yaml.org,2002:binary")
+        record.flags |= BINARY;
+
+      reader_.text_.append(value);
+      reader_.text_.push_back('\0');
+    }
+
+#ifdef MESSAGE_SERIALIZATION_YAML_EVENT_STYLE
+    void OnSequenceStart(const YAML::Mark& mark, const std::string&, YAML::anchor_t,
+                         YAML::EmitterStyle::value) override
+#else
+    void OnSequenceStart(const YAML::Mark& mark, const std::string&, YAML::anchor_t) override
+#endif
+    {
+      open(Event::SEQ_START, mark);
+    }
+
+    void OnSequenceEnd() override
+    {
+      close(Event::SEQ_END);
+    }
+
+#ifdef MESSAGE_SERIALIZATION_YAML_EVENT_STYLE
+    void OnMapStart(const YAML::Mark& mark, const std::string&, YAML::anchor_t, YAML::EmitterStyle::value) override
+#else
+    void OnMapStart(const YAML::Mark& mark, const std::string&, YAML::anchor_t) override
+#endif
+    {
+      open(Event::MAP_START, mark);
+    }
+
+    void OnMapEnd() override
+    {
+      close(Event::MAP_END);
+    }
+
+  private:
+    Record& add(const Event type, const YAML::Mark& mark)
+    {
+      return reader_.add(type, mark.line);
+    }
+
+    void open(const Event type, const YAML::Mark& mark)
+    {
+      reader_.open(type, mark.line);
+    }
+
+    void close(const Event type)
+    {
+      reader_.close(type);
+    }
+
+    YamlReader& reader_;
+  };
+
+  /**
+   * @brief Forwards to a @ref Handler only the events of the field selected by a path, and stops the parser by
+   * throwing @ref Done once the field is complete
+   */
+  class Selector : public YAML::EventHandler
+  {
+  public:
+    struct Done
+    {
+    };
+
+    Selector(Handler& handler, const FieldPath& path) : handler_(handler), path_(path)
+    {
+    }
+
+    void OnDocumentStart(const YAML::Mark&) override
+    {
+    }
+
+    void OnDocumentEnd() override
+    {
+    }
+
+    void OnNull(const YAML::Mark& mark, YAML::anchor_t anchor) override
+    {
+      if (begin(false, nullptr))
+        handler_.OnNull(mark, anchor);
+      endAtom();
+    }
+
+    void OnAlias(const YAML::Mark& mark, YAML::anchor_t anchor) override
+    {
+      if (begin(false, nullptr))
+        handler_.OnAlias(mark, anchor);
+      endAtom();
+    }
+
+    void OnScalar(const YAML::Mark& mark, const std::string& tag, YAML::anchor_t anchor,
+                  const std::string& value) override
+    {
+      if (begin(false, &value))
+        handler_.OnScalar(mark, tag, anchor, value);
+      endAtom();
+    }
+
+#ifdef MESSAGE_SERIALIZATION_YAML_EVENT_STYLE
+    void OnSequenceStart(const YAML::Mark& mark, const std::string& tag, YAML::anchor_t anchor,
+                         YAML::EmitterStyle::value style) override
+#else
+    void OnSequenceStart(const YAML::Mark& mark, const std::string& tag, YAML::anchor_t anchor) override
+#endif
+    {
+      mark_ = mark;
+      if (begin(true, nullptr, false))
+#ifdef MESSAGE_SERIALIZATION_YAML_EVENT_STYLE
+        handler_.OnSequenceStart(mark, tag, anchor, style);
+#else
+        handler_.OnSequenceStart(mark, tag, anchor);
+#endif
+    }
+
+    void OnSequenceEnd() override
+    {
+      if (end())
+        handler_.OnSequenceEnd();
+      endContainer();
+    }
+
+#ifdef MESSAGE_SERIALIZATION_YAML_EVENT_STYLE
+    void OnMapStart(const YAML::Mark& mark, const std::string& tag, YAML::anchor_t anchor,
+                    YAML::EmitterStyle::value style) override
+#else
+    void OnMapStart(const YAML::Mark& mark, const std::string& tag, YAML::anchor_t anchor) override
+#endif
+    {
+      mark_ = mark;
+      if (begin(true, nullptr, true))
+#ifdef MESSAGE_SERIALIZATION_YAML_EVENT_STYLE
+        handler_.OnMapStart(mark, tag, anchor, style);
+#else
+        handler_.OnMapStart(mark, tag, anchor);
+#endif
+    }
+
+    void OnMapEnd() override
+    {
+      if (end())
+        handler_.OnMapEnd();
+      endContainer();
+    }
+
+  private:
+    /**
+     * @brief Container on the path to the field, matched against one component of the path
+     */
+    struct Frame
+    {
+      bool map;
+      std::size_t component;
+      bool expecting_key;
+      bool key_matched;
+      std::size_t index;
+    };
+
+    /**
+     * @brief Handles the start of a node
+     * @param container True for maps and sequences
+     * @param key Text of a scalar, for matching map keys
+     * @param map True if a container is a map
+     * @return true if the event belongs to the field and must be forwarded
+     */
+    bool begin(const bool container, const std::string* key, const bool map = false)
+    {
+      if (depth_ > 0)
+      {
+        depth_ += container;
+        return recording_;
+      }
+
+      std::size_t component = 0;
+      if (!frames_.empty())
+      {
+        Frame& frame = frames_.back();
+        if (frame.map)
+        {
+          if (frame.expecting_key)
+          {
+            // Keys are never part of the path's value; complex keys are skipped along with their children
+            frame.expecting_key = false;
+            frame.key_matched = key && *key == path_.components()[frame.component].key;
+            depth_ = container;
+            recording_ = false;
+            return false;
+          }
+
+          frame.expecting_key = true;
+          if (!frame.key_matched)
+            return skip(container);
+        }
+        else
+        {
+          const FieldPath::Component& c = path_.components()[frame.component];
+          const std::size_t index = frame.index++;
+          if (index < c.begin || index >= c.end)
+            return skip(container);
+
+          // Elements of a slice are recorded as they are
+          if (c.type == FieldPath::Component::SLICE)
+            return record(container);
+        }
+        component = frame.component + 1;
+      }
+      else if (started_)
+      {
+        return skip(container);
+      }
+      started_ = true;
+
+      if (component == path_.components().size())
+        return record(container);
+
+      const FieldPath::Component& c = path_.components()[component];
+      if (!container || map != (c.type == FieldPath::Component::KEY))
+        throw path_.notFound();
+
+      const Frame frame = { map, component, true, false, 0 };
+      frames_.push_back(frame);
+      if (c.type == FieldPath::Component::SLICE)
+      {
+        handler_.open(Event::SEQ_START, mark_);
+        if (c.begin >= c.end)
+          finishSlice();
+      }
+      return false;
+    }
+
+    bool skip(const bool container)
+    {
+      depth_ = container;
+      recording_ = false;
+      return false;
+    }
+
+    bool record(const bool container)
+    {
+      depth_ = container;
+      recording_ = true;
+      return true;
+    }
+
+    /**
+     * @brief Handles the end of a container
+     * @return true if the event belongs to the field and must be forwarded
+     */
+    bool end()
+    {
+      if (depth_ > 0)
+        return recording_;
+
+      // The end of a container on the path, which did not contain the rest of it
+      const Frame frame = frames_.back();
+      if (!frame.map && path_.components()[frame.component].type == FieldPath::Component::SLICE)
+        finishSlice();
+      throw path_.notFound();
+    }
+
+    /**
+     * @brief Completes a scalar or null node
+     */
+    void endAtom()
+    {
+      if (depth_ == 0 && recording_)
+        completed();
+    }
+
+    /**
+     * @brief Completes the end of a container
+     */
+    void endContainer()
+    {
+      if (depth_ > 0 && --depth_ == 0 && recording_)
+        completed();
+    }
+
+    /**
+     * @brief Called once a recorded node is complete: either the whole field or an element of a slice
+     */
+    void completed()
+    {
+      recording_ = false;
+      if (frames_.empty())
+        throw Done();
+
+      const Frame& frame = frames_.back();
+      const FieldPath::Component& c = path_.components()[frame.component];
+      if (c.type != FieldPath::Component::SLICE)
+        throw Done();
+      if (frame.index >= c.end)
+        finishSlice();
+    }
+
+    void finishSlice()
+    {
+      handler_.close(Event::SEQ_END);
+      throw Done();
+    }
+
+    Handler& handler_;
+    const FieldPath& path_;
+    std::vector<Frame> frames_;
+    YAML::Mark mark_;
+    std::size_t depth_ = 0;
+    bool recording_ = false;
+    bool started_ = false;
+  };
+
+  YamlReader() = default;
+
+  /**
+   * @brief Records an event, counting it as an entry of the enclosing collection (map keys and values are counted
+   * separately)
+   */
+  Record& add(const Event type, const int line)
+  {
+    if (!open_.empty())
+      ++events_[open_.back()].size;
+
+    const Record record = { 0, 0, line, type, 0 };
+    events_.push_back(record);
+    return events_.back();
+  }
+
+  void open(const Event type, const int line)
+  {
+    add(type, line);
+    open_.push_back(events_.size() - 1);
+  }
+
+  void close(const Event type)
+  {
+    Record& start = events_[open_.back()];
+    if (start.type == Event::MAP_START)
+      start.size /= 2;
+    const Record record = { 0, 0, start.line, type, 0 };
+    open_.pop_back();
+    events_.push_back(record);
+  }
+
+  /**
+   * @brief Records the events of the JSON document held in the text buffer, unescaping and terminating its scalars in
+   * place
+   * @details Collections are tracked on the stack of open events rather than by recursion, so the depth of a document
+   * is not limited by the call stack. A number or literal is terminated by overwriting the character that follows it;
+   * when that character is structural (a comma or a closing bracket), it is held aside until the parser gets to it
+   */
+  void parseJson()
+  {
+    format_ = "json";
+    char* const begin = &text_[0];
+    char* const end = begin + text_.size();
+    char* p = begin;
+    int line = 0;
+    char held = 0;
+
+    if (std::strncmp(p, "\xEF\xBB\xBF", 3) == 0)
+      p += 3;
+
+    const auto fail = [&](const std::string& what) {
+      return YamlParseError("json: line " + std::to_string(line + 1) + ": " + what);
+    };
+
+    const auto skipSpace = [&]() {
+      for (;; ++p)
+      {
+        if (*p == '\n')
+          ++line;
+        else if (*p != ' ' && *p != '\t' && *p != '\r')
+          return;
+      }
+    };
+
+    const auto hex = [&](const char* digits) {
+      uint32_t value = 0;
+      for (int i = 0; i < 4; ++i)
+      {
+        const char c = digits[i];
+        const uint32_t digit = detail::isDigit(c) ? c - '0' :
+                               (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                               (c >= 'A' && c <= 'F') ? c - 'A' + 10 : 16;
+        if (digit == 16)
+          throw fail("invalid unicode escape");
+        value = value * 16 + digit;
+      }
+      return value;
+    };
+
+    // Unescaped text never takes more room than its escaped form, so it is written over the escaped string
+    const auto string = [&]() {
+      char* const start = ++p;
+      while (static_cast<unsigned char>(*p) >= 0x20 && *p != '"' && *p != '\\')
+        ++p;
+
+      char* out = p;
+      while (*p != '"')
+      {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        if (c < 0x20)
+          throw fail(p == end ? "unterminated string" : "control character in string");
+        if (c != '\\')
+        {
+          *out++ = *p++;
+          continue;
+        }
+
+        p += 2;
+        switch (p[-1])
+        {
+          case '"':
+          case '\\':
+          case '/':
+            *out++ = p[-1];
+            break;
+          case 'b':
+            *out++ = '\b';
+            break;
+          case 'f':
+            *out++ = '\f';
+            break;
+          case 'n':
+            *out++ = '\n';
+            break;
+          case 'r':
+            *out++ = '\r';
+            break;
+          case 't':
+            *out++ = '\t';
+            break;
+          case 'u':
+          {
+            uint32_t code = hex(p);
+            p += 4;
+            if (code >= 0xD800 && code < 0xDC00 && p[0] == '\\' && p[1] == 'u')
+            {
+              const uint32_t low = hex(p + 2);
+              if (low >= 0xDC00 && low < 0xE000)
+              {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+              }
+            }
+
+            // UTF-8
+            if (code < 0x80)
+            {
+              *out++ = static_cast<char>(code);
+            }
+            else if (code < 0x800)
+            {
+              *out++ = static_cast<char>(0xC0 | (code >> 6));
+              *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000)
+            {
+              *out++ = static_cast<char>(0xE0 | (code >> 12));
+              *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+              *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            {
+              *out++ = static_cast<char>(0xF0 | (code >> 18));
+              *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+              *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+              *out++ = static_cast<char>(0x80 | (code & 0x3F));
+            }
+            break;
+          }
+          default:
+            throw fail("invalid escape in string");
+        }
+      }
+
+      *out = '\0';
+      ++p;
+      Record& record = add(Event::SCALAR, line);
+      record.offset = static_cast<std::size_t>(start - begin);
+      record.size = static_cast<uint32_t>(out - start);
+      record.flags = QUOTED;
+    };
+
+    // Numbers and literals
+    const auto token = [&](const Event type, const char* start) {
+      const char next = *p;
+      if (next != '\0' && next != ',' && next != ']' && next != '}' && next != ' ' && next != '\n' && next != '\t' &&
+          next != '\r')
+        throw fail("invalid value");
+
+      Record& record = add(type, line);
+      record.offset = static_cast<std::size_t>(start - begin);
+      record.size = static_cast<uint32_t>(p - start);
+      if (next == '\0')
+        return;
+
+      *p++ = '\0';
+      if (next == '\n')
+        ++line;
+      else if (next == ',' || next == ']' || next == '}')
+        held = next;
+    };
+
+    const auto literal = [&](const char* word, const std::size_t size, const Event type) {
+      char* const start = p;
+      if (std::strncmp(p, word, size) != 0)
+        throw fail("invalid value");
+      p += size;
+      token(type, start);
+    };
+
+    const auto number = [&]() {
+      char* const start = p;
+      if (*p == '-')
+        ++p;
+      if (*p == 'I')
+      {
+        p = start;
+        literal("-Infinity", 9, Event::SCALAR);
+        return;
+      }
+
+      // No leading zeros
+      if (*p == '0')
+        ++p;
+      else if (!detail::isDigit(*p))
+        throw fail("invalid number");
+      else
+        while (detail::isDigit(*p))
+          ++p;
+      if (*p == '.')
+      {
+        if (!detail::isDigit(*++p))
+          throw fail("invalid number");
+        while (detail::isDigit(*p))
+          ++p;
+      }
+      if (*p == 'e' || *p == 'E')
+      {
+        if (*++p == '+' || *p == '-')
+          ++p;
+        if (!detail::isDigit(*p))
+          throw fail("invalid number");
+        while (detail::isDigit(*p))
+          ++p;
+      }
+      token(Event::SCALAR, start);
+    };
+
+    const auto key = [&]() {
+      if (*p != '"')
+        throw fail("expected a string key");
+      string();
+      skipSpace();
+      if (*p != ':')
+        throw fail("expected ':'");
+      ++p;
+    };
+
+    for (;;)
+    {
+      skipSpace();
+      switch (*p)
+      {
+        case '{':
+          open(Event::MAP_START, line);
+          ++p;
+          skipSpace();
+          if (*p != '}')
+          {
+            key();
+            continue;
+          }
+          ++p;
+          close(Event::MAP_END);
+          break;
+        case '[':
+          open(Event::SEQ_START, line);
+          ++p;
+          skipSpace();
+          if (*p != ']')
+            continue;
+          ++p;
+          close(Event::SEQ_END);
+          break;
+        case '"':
+          string();
+          break;
+        case 't':
+          literal("true", 4, Event::SCALAR);
+          break;
+        case 'f':
+          literal("false", 5, Event::SCALAR);
+          break;
+        case 'n':
+          literal("null", 4, Event::NULL_VALUE);
+          break;
+        case 'N':
+          literal("NaN", 3, Event::SCALAR);
+          break;
+        case 'I':
+          literal("Infinity", 8, Event::SCALAR);
+          break;
+        default:
+          if (*p != '-' && !detail::isDigit(*p))
+            throw fail(p == end ? "unexpected end of document" : "unexpected character");
+          number();
+          break;
+      }
+
+      // After a value, close the collections it completes until the next value is due
+      for (;;)
+      {
+        char c = held;
+        held = 0;
+        if (c == 0)
+        {
+          skipSpace();
+          c = *p;
+          if (c != '\0')
+            ++p;
+        }
+
+        if (open_.empty())
+        {
+          if (c != '\0' || p != end)
+            throw fail("unexpected content after the document");
+          return;
+        }
+
+        const bool map = events_[open_.back()].type == Event::MAP_START;
+        if (c == ',')
+        {
+          if (map)
+          {
+            skipSpace();
+            key();
+          }
+          break;
+        }
+        if (c != (map ? '}' : ']'))
+          throw fail(c == '\0' ? "unexpected end of document" : map ? "expected ',' or '}'" : "expected ',' or ']'");
+        close(map ? Event::MAP_END : Event::SEQ_END);
+      }
+    }
+  }
+
+  const Record& next(const char* what)
+  {
+    if (pos_ >= events_.size())
+      throw error(what);
+    return events_[pos_++];
+  }
+
+  const Record& expect(const Event type, const char* what)
+  {
+    if (peek() != type)
+      throw error(what);
+    return events_[pos_++];
+  }
+
+  std::vector<Record> events_;
+  std::string text_;
+  std::vector<std::size_t> open_;
+  std::size_t pos_ = 0;
+  bool has_aliases_ = false;
+  const char* format_ = "yaml";
+};
+
+namespace detail
+{
+inline bool isNaN(const YamlReader::StringRef& s)
+{
+  return s == ".nan" || s == ".NaN" || s == ".NAN" || s == "NaN";
+}
+
+inline int infinitySign(const YamlReader::StringRef& s)
+{
+  // Infinity and -Infinity are the spellings of Python's json module
+  if (s == ".inf" || s == ".Inf" || s == ".INF" || s == "+.inf" || s == "+.Inf" || s == "+.INF" || s == "Infinity")
+    return 1;
+  if (s == "-.inf" || s == "-.Inf" || s == "-.INF" || s == "-Infinity")
+    return -1;
+  return 0;
+}
+
+/**
+ * @brief Converts the text of a YAML scalar to a floating point number, including the YAML notation for non-finite
+ * values
+ * @return false if the scalar is not a number
+ */
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+parseNumericScalar(const YamlReader::StringRef& s, T& value)
+{
+  if (parseNumber(s.data, s.data + s.size, value))
+    return true;
+
+  if (isNaN(s))
+  {
+    value = std::numeric_limits<T>::quiet_NaN();
+    return true;
+  }
+  if (const int sign = infinitySign(s))
+  {
+    value = sign * std::numeric_limits<T>::infinity();
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Converts the text of a YAML scalar to an integer
+ * @return false if the scalar is not an integer or is out of range for the output type
+ */
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value, bool>::type
+parseNumericScalar(const YamlReader::StringRef& s, T& value)
+{
+  return parseNumber(s.data, s.data + s.size, value);
+}
+
+template <typename T>
+inline void parseFloat(YamlReader& in, T& value)
+{
+  const YamlReader::StringRef s = in.scalar();
+  if (!parseNumericScalar(s, value))
+    throw in.error("bad conversion of '" + s.str() + "' to a floating point number");
+}
+
+template <typename T>
+inline void parseInteger(YamlReader& in, T& value)
+{
+  const YamlReader::StringRef s = in.scalar();
+  if (!parseNumericScalar(s, value))
+    throw in.error("bad conversion of '" + s.str() + "' to an integer");
+}
+
+}  // namespace detail
+
+/**
+ * @brief Decodes a numeric YAML::Node scalar with the same parser as @ref YamlReader
+ * @details Faster than YAML::Node::as, which converts through a std::stringstream, and used by the YAML::convert
+ * specializations of this package
+ * @throws YamlParseError if the node is not a scalar or not a number of the requested type
+ */
+template <typename T>
+inline T decodeNumber(const YAML::Node& node)
+{
+  if (!node.IsScalar())
+    throw YamlParseError("yaml: expected a numeric scalar");
+
+  const std::string& text = node.Scalar();
+  const YamlReader::StringRef s = { text.data(), text.size() };
+  T value;
+  if (!detail::parseNumericScalar(s, value))
+    throw YamlParseError("yaml: bad conversion of '" + text + "' to a number");
+  return value;
+}
+
+/**
+ * @brief Decodes a YAML::Node sequence of numbers
+ * @throws YamlParseError if the node is not a sequence of numbers of the requested type
+ */
+template <typename T>
+inline std::vector<T> decodeNumbers(const YAML::Node& node)
+{
+  if (!node.IsSequence())
+    throw YamlParseError("yaml: expected a sequence of numbers");
+
+  std::vector<T> values;
+  values.reserve(node.size());
+  for (YAML::const_iterator it = node.begin(); it != node.end(); ++it)
+    values.push_back(decodeNumber<T>(*it));
+  return values;
+}
+
+/**
+ * @brief Decodes a YAML::Node sequence of numbers into a fixed-size array
+ * @throws YamlParseError if the node is not a sequence of exactly N numbers of the requested type
+ */
+template <typename T, std::size_t N>
+inline void decodeNumbers(const YAML::Node& node, boost::array<T, N>& values)
+{
+  if (!node.IsSequence() || node.size() != N)
+    throw YamlParseError("yaml: expected a sequence of " + std::to_string(N) + " numbers");
+
+  std::size_t i = 0;
+  for (YAML::const_iterator it = node.begin(); it != node.end(); ++it)
+    values[i++] = decodeNumber<T>(*it);
+}
+
+/**
+ * @brief Decodes a YAML::Node sequence of arbitrary elements, reserving space for all of them up front
+ */
+template <typename T, typename Alloc>
+inline void decodeSequence(const YAML::Node& node, std::vector<T, Alloc>& values)
+{
+  if (!node.IsSequence())
+    throw YamlParseError("yaml: expected a sequence");
+
+  values.clear();
+  values.reserve(node.size());
+  for (YAML::const_iterator it = node.begin(); it != node.end(); ++it)
+    values.push_back(it->as<T>());
+}
+
+template <typename T, std::size_t N>
+inline void decodeSequence(const YAML::Node& node, boost::array<T, N>& values)
+{
+  if (!node.IsSequence() || node.size() != N)
+    throw YamlParseError("yaml: expected a sequence of " + std::to_string(N) + " elements");
+
+  std::size_t i = 0;
+  for (YAML::const_iterator it = node.begin(); it != node.end(); ++it)
+    values[i++] = it->as<T>();
+}
+
+/**
+ * @brief Generic overload for types that only provide a YAML::convert specialization
+ */
+template <typename T>
+inline void parse(YamlReader& in, T& value)
+{
+  value = in.node().as<T>();
+}
+
+inline void parse(YamlReader& in, std::string& value)
+{
+  const YamlReader::StringRef s = in.scalarOrNull();
+  value.assign(s.data, s.size);
+}
+
+inline void parse(YamlReader& in, bool& value)
+{
+  const YamlReader::StringRef s = in.scalar();
+  if (s == "true" || s == "True" || s == "TRUE" || s == "yes" || s == "Yes" || s == "YES" || s == "on" ||
+      s == "On" || s == "ON" || s == "y" || s == "Y")
+    value = true;
+  else if (s == "false" || s == "False" || s == "FALSE" || s == "no" || s == "No" || s == "NO" || s == "off" ||
+           s == "Off" || s == "OFF" || s == "n" || s == "N")
+    value = false;
+  else
+    throw in.error("bad conversion of '" + s.str() + "' to a boolean");
+}
+
+inline void parse(YamlReader& in, double& value)
+{
+  detail::parseFloat(in, value);
+}
+
+inline void parse(YamlReader& in, float& value)
+{
+  detail::parseFloat(in, value);
+}
+
+inline void parse(YamlReader& in, int8_t& value)
+{
+  detail::parseInteger(in, value);
+}
+
+inline void parse(YamlReader& in, uint8_t& value)
+{
+  detail::parseInteger(in, value);
+}
+
+inline void parse(YamlReader& in, int16_t& value)
+{
+  detail::parseInteger(in, value);
+}
+
+inline void parse(YamlReader& in, uint16_t& value)
+{
+  detail::parseInteger(in, value);
+}
+
+inline void parse(YamlReader& in, int32_t& value)
+{
+  detail::parseInteger(in, value);
+}
+
+inline void parse(YamlReader& in, uint32_t& value)
+{
+  detail::parseInteger(in, value);
+}
+
+inline void parse(YamlReader& in, int64_t& value)
+{
+  detail::parseInteger(in, value);
+}
+
+inline void parse(YamlReader& in, uint64_t& value)
+{
+  detail::parseInteger(in, value);
+}
+
+template <typename T, typename Alloc>
+inline void parse(YamlReader& in, std::vector<T, Alloc>& value)
+{
+  value.clear();
+  value.reserve(in.peekCollectionSize());
+  in.beginSeq();
+  while (in.nextElement())
+  {
+    T element;
+    parse(in, element);
+    value.push_back(std::move(element));
+  }
+}
+
+template <typename T, std::size_t N>
+inline void parse(YamlReader& in, boost::array<T, N>& value)
+{
+  in.beginSeq();
+  std::size_t i = 0;
+  while (in.nextElement())
+  {
+    if (i == N)
+      throw in.error("expected a sequence of " + std::to_string(N) + " elements");
+    parse(in, value[i++]);
+  }
+  if (i != N)
+    throw in.error("expected a sequence of " + std::to_string(N) + " elements");
+}
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_YAML_READER_H
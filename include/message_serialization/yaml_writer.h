@@ -0,0 +1,502 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MESSAGE_SERIALIZATION_YAML_WRITER_H
+#define MESSAGE_SERIALIZATION_YAML_WRITER_H
+
+#include <boost/array.hpp>
+#include <cstdint>
+#include <cstring>
+#include <message_serialization/json_emitter.h>
+#include <message_serialization/numeric.h>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+namespace message_serialization
+{
+/**
+ * @brief Options controlling the layout of YAML output
+ */
+struct YamlOptions
+{
+  /**
+   * @brief Writes sequences of numbers in flow style (`[1, 2, 3]`) rather than one element per line
+   * @details This makes files containing long numeric vectors considerably smaller and faster to parse
+   */
+  bool flow_numeric_sequences = false;
+
+  /**
+   * @brief Minimum number of values in a large homogeneous numeric array (such as mesh vertices, pose array poses or
+   * joint trajectory points) for it to be written as a little-endian `!!binary` block; zero disables binary blocks
+   * @details Binary blocks are several times smaller than text and are decoded without parsing numbers, at the cost of
+   * readability. Decoding accepts either representation regardless of this option
+   */
+  std::size_t binary_array_threshold = 0;
+
+  /**
+   * @brief Writes large homogeneous numeric arrays that are not written as binary blocks column by column, as one flow
+   * sequence of values per column, instead of as a sequence of small maps
+   * @details Field names are then written once per array rather than once per element, which makes files and the
+   * number of nodes to parse an order of magnitude smaller. Decoding accepts either representation regardless of this
+   * option
+   */
+  bool columnar_arrays = false;
+
+  /**
+   * @brief Writes JSON (which is also valid YAML) with the field layout of the JSON written by rospy_message_converter
+   * @details Collections are written in flow style and strings in double quotes. ROS times and durations use the
+   * `secs`/`nsecs` fields of rospy, and non-finite numbers are written as NaN, Infinity and -Infinity like Python's
+   * json module does. Binary blocks and columnar arrays are disabled. Decoding accepts both layouts regardless of this
+   * option
+   */
+  bool json = false;
+};
+
+/**
+ * @brief Streams YAML directly to a YAML::Emitter without building an intermediate YAML::Node tree
+ * @details Types are written through overloads of the free function @ref emit. Types that only provide a
+ * YAML::convert specialization are still supported through a generic overload that encodes them to a YAML::Node first.
+ * The same overloads write JSON when the writer is constructed on a @ref JsonEmitter instead.
+ */
+class YamlWriter
+{
+public:
+  explicit YamlWriter(YAML::Emitter& out, const YamlOptions& options = YamlOptions()) : out_(&out), options_(options)
+  {
+    if (options_.json)
+    {
+      restrictToJson();
+      out_->SetMapFormat(YAML::Flow);
+      out_->SetSeqFormat(YAML::Flow);
+      out_->SetStringFormat(YAML::DoubleQuoted);
+    }
+  }
+
+  /**
+   * @brief Writes JSON directly, bypassing yaml-cpp; @ref YamlOptions::json is implied
+   */
+  explicit YamlWriter(JsonEmitter& out, const YamlOptions& options = YamlOptions()) : json_(&out), options_(options)
+  {
+    options_.json = true;
+    restrictToJson();
+  }
+
+  const YamlOptions& options() const
+  {
+    return options_;
+  }
+
+  void beginMap()
+  {
+    countNode();
+    if (json_)
+      json_->beginMap();
+    else
+      *out_ << YAML::BeginMap;
+  }
+
+  void endMap()
+  {
+    if (json_)
+      json_->endMap();
+    else
+      *out_ << YAML::EndMap;
+  }
+
+  void beginSeq()
+  {
+    countNode();
+    if (json_)
+      json_->beginSeq();
+    else
+      *out_ << YAML::BeginSeq;
+  }
+
+  /**
+   * @brief Begins a sequence of numbers, which is written in flow style if enabled by the options
+   */
+  void beginNumericSeq()
+  {
+    countNode();
+    if (json_)
+      json_->beginSeq();
+    else if (options_.flow_numeric_sequences)
+      *out_ << YAML::Flow << YAML::BeginSeq;
+    else
+      *out_ << YAML::BeginSeq;
+  }
+
+  /**
+   * @brief Begins a sequence that is always written in flow style
+   */
+  void beginFlowSeq()
+  {
+    countNode();
+    if (json_)
+      json_->beginSeq();
+    else
+      *out_ << YAML::Flow << YAML::BeginSeq;
+  }
+
+  void endSeq()
+  {
+    if (json_)
+      json_->endSeq();
+    else
+      *out_ << YAML::EndSeq;
+  }
+
+  /**
+   * @brief Returns true if an array of the given number of values should be written as a binary block
+   */
+  bool binaryArray(const std::size_t values) const
+  {
+    return options_.binary_array_threshold > 0 && values >= options_.binary_array_threshold;
+  }
+
+  /**
+   * @brief Writes the key of the next map entry; the value must be written next
+   */
+  void key(const char* key)
+  {
+    countNode();
+    if (json_)
+      json_->key(key, std::strlen(key));
+    else
+      *out_ << YAML::Key << key << YAML::Value;
+  }
+
+  /**
+   * @brief Writes a map entry
+   */
+  template <typename T>
+  void field(const char* key, const T& value);
+
+  void scalar(const std::string& value)
+  {
+    countNode();
+    if (json_)
+      json_->string(value.data(), value.size());
+    else
+      *out_ << value;
+  }
+
+  void scalar(const char* value)
+  {
+    countNode();
+    if (json_)
+      json_->string(value, std::strlen(value));
+    else
+      *out_ << value;
+  }
+
+  void scalar(const bool value)
+  {
+    countNode();
+    if (json_)
+      json_->boolean(value);
+    else
+      *out_ << value;
+  }
+
+  /**
+   * @brief Writes a floating point value as the shortest text that parses back to exactly the same value
+   * @details Non-finite values use the same notation as YAML::convert<double>, or that of Python's json module for
+   * JSON output
+   */
+  void scalar(const double value)
+  {
+    countNode();
+    char buffer[NUMBER_BUFFER_SIZE];
+    number(buffer, formatNumber(buffer, value));
+  }
+
+  void scalar(const float value)
+  {
+    countNode();
+    char buffer[NUMBER_BUFFER_SIZE];
+    number(buffer, formatNumber(buffer, value));
+  }
+
+  /**
+   * @brief Writes an integer value
+   * @details Single-byte integers are written as numbers rather than characters
+   */
+  void scalar(const int64_t value)
+  {
+    countNode();
+    if (json_)
+      json_->integer(value);
+    else
+      *out_ << static_cast<long long>(value);
+  }
+
+  void scalar(const uint64_t value)
+  {
+    countNode();
+    if (json_)
+      json_->integer(value);
+    else
+      *out_ << static_cast<unsigned long long>(value);
+  }
+
+  /**
+   * @brief Writes data as a base64-encoded scalar with the YAML binary tag
+   * @details JSON has no tags, so JSON output is a plain base64 string, like rospy writes uint8[] fields
+   */
+  void binary(const unsigned char* data, const std::size_t size)
+  {
+    countNode();
+    if (json_)
+    {
+      const std::string encoded = YAML::EncodeBase64(data, size);
+      json_->string(encoded.data(), encoded.size());
+    }
+    else
+    {
+      *out_ << YAML::Binary(data, size);
+    }
+  }
+
+  /**
+   * @brief Writes a YAML node
+   */
+  void node(const YAML::Node& node)
+  {
+    countNode();
+    if (json_)
+      json_->node(node);
+    else
+      *out_ << node;
+  }
+
+  /**
+   * @throws std::logic_error if the writer writes JSON directly
+   */
+  YAML::Emitter& emitter()
+  {
+    if (!out_)
+      throw std::logic_error("The writer has no YAML::Emitter: it writes JSON directly");
+    return *out_;
+  }
+
+  /**
+   * @brief Number of nodes (keys, scalars and collections) written so far; only counted when built with metrics (see
+   * metrics.h), and zero otherwise
+   */
+  std::size_t nodes() const
+  {
+    return nodes_;
+  }
+
+private:
+  /**
+   * @brief Writes the text of a floating point number formatted by @ref formatNumber
+   * @param buffer Text of the number, with room for NUMBER_BUFFER_SIZE characters
+   * @param size Length of the text
+   */
+  void number(char* buffer, std::size_t size)
+  {
+    const char* text = buffer;
+    if (options_.json)
+    {
+      // Numbers are spelled as by Python's json module: floats always have a decimal point or an exponent, and
+      // non-finite values are NaN, Infinity and -Infinity
+      if (buffer[0] == '.' || (buffer[0] == '-' && buffer[1] == '.'))
+      {
+        text = buffer[1] == 'n' ? "NaN" : buffer[0] == '-' ? "-Infinity" : "Infinity";
+        size = std::strlen(text);
+      }
+      else if (std::strpbrk(buffer, ".e") == nullptr && size + 2 < NUMBER_BUFFER_SIZE)
+      {
+        std::memcpy(buffer + size, ".0", 3);
+        size += 2;
+      }
+
+      if (json_)
+      {
+        json_->raw(text, size);
+        return;
+      }
+      // Numbers must not be quoted like strings
+      *out_ << YAML::Auto;
+    }
+    *out_ << text;
+  }
+
+  /**
+   * @brief Disables the layout options that have no JSON equivalent
+   */
+  void restrictToJson()
+  {
+    options_.flow_numeric_sequences = true;
+    options_.binary_array_threshold = 0;
+    options_.columnar_arrays = false;
+  }
+
+  void countNode()
+  {
+#ifdef MESSAGE_SERIALIZATION_WITH_METRICS
+    ++nodes_;
+#endif
+  }
+
+  YAML::Emitter* out_ = nullptr;
+  JsonEmitter* json_ = nullptr;
+  YamlOptions options_;
+  std::size_t nodes_ = 0;
+};
+
+/**
+ * @brief Generic overload for types that only provide a YAML::convert specialization
+ */
+template <typename T>
+inline void emit(YamlWriter& out, const T& value)
+{
+  out.node(YAML::Node(value));
+}
+
+inline void emit(YamlWriter& out, const std::string& value)
+{
+  out.scalar(value);
+}
+
+inline void emit(YamlWriter& out, const bool value)
+{
+  out.scalar(value);
+}
+
+inline void emit(YamlWriter& out, const double value)
+{
+  out.scalar(value);
+}
+
+inline void emit(YamlWriter& out, const float value)
+{
+  out.scalar(value);
+}
+
+inline void emit(YamlWriter& out, const int8_t value)
+{
+  out.scalar(static_cast<int64_t>(value));
+}
+
+inline void emit(YamlWriter& out, const uint8_t value)
+{
+  out.scalar(static_cast<uint64_t>(value));
+}
+
+inline void emit(YamlWriter& out, const int16_t value)
+{
+  out.scalar(static_cast<int64_t>(value));
+}
+
+inline void emit(YamlWriter& out, const uint16_t value)
+{
+  out.scalar(static_cast<uint64_t>(value));
+}
+
+inline void emit(YamlWriter& out, const int32_t value)
+{
+  out.scalar(static_cast<int64_t>(value));
+}
+
+inline void emit(YamlWriter& out, const uint32_t value)
+{
+  out.scalar(static_cast<uint64_t>(value));
+}
+
+inline void emit(YamlWriter& out, const int64_t value)
+{
+  out.scalar(value);
+}
+
+inline void emit(YamlWriter& out, const uint64_t value)
+{
+  out.scalar(value);
+}
+
+/**
+ * @brief Writes the elements of a range as a sequence
+ */
+template <typename T, typename Iterator>
+inline void emitSequence(YamlWriter& out, Iterator begin, const Iterator end)
+{
+  if (std::is_arithmetic<T>::value)
+    out.beginNumericSeq();
+  else
+    out.beginSeq();
+
+  for (; begin != end; ++begin)
+    emit(out, static_cast<const T&>(*begin));
+  out.endSeq();
+}
+
+template <typename T, typename Alloc>
+inline void emit(YamlWriter& out, const std::vector<T, Alloc>& value)
+{
+  emitSequence<T>(out, value.begin(), value.end());
+}
+
+template <typename T, std::size_t N>
+inline void emit(YamlWriter& out, const boost::array<T, N>& value)
+{
+  emitSequence<T>(out, value.begin(), value.end());
+}
+
+/**
+ * @brief Encodes a value as a YAML::Node, writing single-byte integers as numbers rather than characters
+ */
+template <typename T>
+inline YAML::Node encodeElement(const T& value)
+{
+  return YAML::Node(value);
+}
+
+inline YAML::Node encodeElement(const int8_t value)
+{
+  return YAML::Node(static_cast<int32_t>(value));
+}
+
+inline YAML::Node encodeElement(const uint8_t value)
+{
+  return YAML::Node(static_cast<uint32_t>(value));
+}
+
+/**
+ * @brief Encodes a container as a YAML::Node sequence
+ */
+template <typename Container>
+inline YAML::Node encodeSequence(const Container& values)
+{
+  YAML::Node node(YAML::NodeType::Sequence);
+  for (const auto& value : values)
+    node.push_back(encodeElement(value));
+  return node;
+}
+
+template <typename T>
+void YamlWriter::field(const char* key, const T& value)
+{
+  this->key(key);
+  emit(*this, value);
+}
+
+}  // namespace message_serialization
+
+#endif  // MESSAGE_SERIALIZATION_YAML_WRITER_H
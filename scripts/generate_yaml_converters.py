@@ -0,0 +1,388 @@
+#!/usr/bin/env python
+# This Python file uses the following encoding: utf-8
+
+"""
+Copyright 2020 Southwest Research Institute
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+see the License for the specific language governing permissions and
+limitations under the License.
+
+Generates YAML converters (YAML::convert specializations and message_serialization emit/parse overloads) for every
+message of one or more ROS message packages from their .msg definitions.
+
+One header named <package>_yaml.h is written per package, including packages whose messages are used by the requested
+ones. Messages that already have hand-written converters in this package are not generated again; the generated header
+includes the hand-written one instead.
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+import re
+import sys
+
+# ROS primitive types and the C++ types of the generated message structures
+PRIMITIVES = {
+  'bool': 'uint8_t',
+  'byte': 'int8_t',
+  'char': 'uint8_t',
+  'int8': 'int8_t',
+  'uint8': 'uint8_t',
+  'int16': 'int16_t',
+  'uint16': 'uint16_t',
+  'int32': 'int32_t',
+  'uint32': 'uint32_t',
+  'int64': 'int64_t',
+  'uint64': 'uint64_t',
+  'float32': 'float',
+  'float64': 'double',
+  'string': 'std::string',
+  'time': 'ros::Time',
+  'duration': 'ros::Duration',
+}
+
+NON_NUMERIC = set(['string', 'time', 'duration'])
+
+# Messages with hand-written converters, and the headers that provide them
+HANDWRITTEN = {
+  'std_msgs/Header': 'message_serialization/std_msgs_yaml.h',
+  'geometry_msgs/Vector3': 'message_serialization/geometry_msgs_yaml.h',
+  'geometry_msgs/Point': 'message_serialization/geometry_msgs_yaml.h',
+  'geometry_msgs/Quaternion': 'message_serialization/geometry_msgs_yaml.h',
+  'geometry_msgs/Pose': 'message_serialization/geometry_msgs_yaml.h',
+  'geometry_msgs/PoseStamped': 'message_serialization/geometry_msgs_yaml.h',
+  'geometry_msgs/PoseArray': 'message_serialization/geometry_msgs_yaml.h',
+  'geometry_msgs/Transform': 'message_serialization/geometry_msgs_yaml.h',
+  'geometry_msgs/TransformStamped': 'message_serialization/geometry_msgs_yaml.h',
+  'sensor_msgs/RegionOfInterest': 'message_serialization/sensor_msgs_yaml.h',
+  'sensor_msgs/CameraInfo': 'message_serialization/sensor_msgs_yaml.h',
+  'sensor_msgs/JointState': 'message_serialization/sensor_msgs_yaml.h',
+  'shape_msgs/MeshTriangle': 'message_serialization/shape_msgs_yaml.h',
+  'shape_msgs/Mesh': 'message_serialization/shape_msgs_yaml.h',
+  'trajectory_msgs/JointTrajectoryPoint': 'message_serialization/trajectory_msgs_yaml.h',
+  'trajectory_msgs/JointTrajectory': 'message_serialization/trajectory_msgs_yaml.h',
+}
+
+FIELD_PATTERN = re.compile(r'^\s*([\w/]+)\s*(\[(\d*)\])?\s+(\w+)\s*(=.*)?$')
+
+
+class Field:
+  def __init__(self, name, base, array):
+    self.name = name
+    # Primitive type name or package/Message
+    self.base = base
+    # None for scalars, 0 for variable-length arrays, N for fixed-size arrays
+    self.array = array
+
+  def isPrimitive(self):
+    return self.base in PRIMITIVES
+
+  def isNumeric(self):
+    return self.isPrimitive() and self.base not in NON_NUMERIC
+
+  def cppBase(self):
+    if self.isPrimitive():
+      return PRIMITIVES[self.base]
+    return self.base.replace('/', '::')
+
+
+class Message:
+  def __init__(self, package, name, fields):
+    self.package = package
+    self.name = name
+    self.fields = fields
+
+  def fullName(self):
+    return self.package + '/' + self.name
+
+  def cppName(self):
+    return self.package + '::' + self.name
+
+  def dependencies(self):
+    return set(f.base for f in self.fields if not f.isPrimitive())
+
+
+def parseMessage(package, name, path):
+  """Parses a .msg file, ignoring comments and constants"""
+  fields = []
+  with open(path, 'r') as f:
+    for line in f:
+      match = FIELD_PATTERN.match(line.split('#', 1)[0])
+      if match is None or match.group(5) is not None:
+        continue
+
+      base = match.group(1)
+      if base == 'Header':
+        base = 'std_msgs/Header'
+      elif base not in PRIMITIVES and '/' not in base:
+        base = package + '/' + base
+
+      array = None
+      if match.group(2) is not None:
+        array = int(match.group(3)) if match.group(3) else 0
+
+      fields.append(Field(match.group(4), base, array))
+  return Message(package, name, fields)
+
+
+class Generator:
+  def __init__(self, search_paths, output_dir, include_prefix, dry_run=False):
+    self.search_paths = search_paths
+    self.output_dir = output_dir
+    self.include_prefix = include_prefix
+    self.dry_run = dry_run
+    self.generated = set()
+    self.sources = []
+    self.outputs = []
+
+  def messageDirectories(self, package):
+    if package in self.search_paths:
+      return self.search_paths[package]
+
+    # Fall back to the ROS package path for packages that were not given explicitly
+    try:
+      import rospkg
+      return [os.path.join(rospkg.RosPack().get_path(package), 'msg')]
+    except Exception as ex:
+      raise RuntimeError("Cannot find the messages of package '{}': {}".format(package, ex))
+
+  def loadPackage(self, package):
+    messages = {}
+    for directory in self.messageDirectories(package):
+      if not os.path.isdir(directory):
+        continue
+      for filename in sorted(os.listdir(directory)):
+        if filename.endswith('.msg'):
+          name = filename[:-len('.msg')]
+          path = os.path.join(directory, filename)
+          messages[name] = parseMessage(package, name, path)
+          self.sources.append(path)
+
+    if not messages:
+      raise RuntimeError("Package '{}' does not contain any messages".format(package))
+    return messages
+
+  def generate(self, package):
+    """Generates the header of a package and of the packages it depends on"""
+    if package in self.generated:
+      return
+    self.generated.add(package)
+
+    messages = self.loadPackage(package)
+    generated = [m for m in messages.values() if m.fullName() not in HANDWRITTEN]
+
+    # Headers for the types used by the generated messages
+    includes = set(['message_serialization/std_msgs_yaml.h'])
+    for message in messages.values():
+      if message.fullName() in HANDWRITTEN:
+        includes.add(HANDWRITTEN[message.fullName()])
+    for message in generated:
+      includes.add('{}/{}.h'.format(message.package, message.name))
+      for dependency in message.dependencies():
+        dep_package = dependency.split('/')[0]
+        if dependency in HANDWRITTEN:
+          includes.add(HANDWRITTEN[dependency])
+        elif dep_package != package:
+          self.generate(dep_package)
+          includes.add('{}/{}_yaml.h'.format(self.include_prefix, dep_package))
+          includes.add('{}.h'.format(dependency))
+
+    output = os.path.join(self.output_dir, package + '_yaml.h')
+    self.outputs.append(output)
+    if not self.dry_run:
+      writeIfChanged(output, renderHeader(package, sortByDependency(generated), sorted(includes)))
+
+
+def sortByDependency(messages):
+  """Orders messages so that each one comes after the messages of the same package that it contains"""
+  by_name = dict((m.fullName(), m) for m in messages)
+  ordered = []
+  visited = set()
+
+  def visit(message):
+    if message.fullName() in visited:
+      return
+    visited.add(message.fullName())
+    for dependency in sorted(message.dependencies()):
+      if dependency in by_name:
+        visit(by_name[dependency])
+    ordered.append(message)
+
+  for message in sorted(messages, key=lambda m: m.name):
+    visit(message)
+  return ordered
+
+
+def renderEncode(field):
+  if field.array is not None:
+    return '    node["{0}"] = message_serialization::encodeSequence(rhs.{0});'.format(field.name)
+  if field.base in ('int8', 'byte'):
+    return '    node["{0}"] = static_cast<int32_t>(rhs.{0});'.format(field.name)
+  if field.base in ('uint8', 'char', 'bool'):
+    return '    node["{0}"] = static_cast<uint32_t>(rhs.{0});'.format(field.name)
+  return '    node["{0}"] = rhs.{0};'.format(field.name)
+
+
+def renderDecode(field):
+  node = 'node["{}"]'.format(field.name)
+  if field.array is None:
+    if field.isNumeric():
+      return '    rhs.{0} = message_serialization::decodeNumber<{1}>({2});'.format(field.name, field.cppBase(), node)
+    return '    rhs.{0} = {1}.as<{2}>();'.format(field.name, node, field.cppBase())
+
+  if field.isNumeric():
+    if field.array == 0:
+      return '    rhs.{0} = message_serialization::decodeNumbers<{1}>({2});'.format(field.name, field.cppBase(), node)
+    return '    message_serialization::decodeNumbers({0}, rhs.{1});'.format(node, field.name)
+  return '    message_serialization::decodeSequence({0}, rhs.{1});'.format(node, field.name)
+
+
+def renderConvert(message):
+  lines = []
+  lines.append('template<>')
+  lines.append('struct convert<{}>'.format(message.cppName()))
+  lines.append('{')
+  lines.append('  static Node encode(const {}& rhs)'.format(message.cppName()))
+  lines.append('  {')
+  lines.append('    Node node(NodeType::Map);')
+  lines.extend(renderEncode(f) for f in message.fields)
+  lines.append('    return node;')
+  lines.append('  }')
+  lines.append('')
+  lines.append('  static bool decode(const Node& node, {}& rhs)'.format(message.cppName()))
+  lines.append('  {')
+  lines.append('    if (!node.IsMap() || node.size() != {}) return false;'.format(len(message.fields)))
+  if message.fields:
+    lines.append('')
+    lines.extend(renderDecode(f) for f in message.fields)
+    lines.append('')
+  lines.append('    return true;')
+  lines.append('  }')
+  lines.append('};')
+  return lines
+
+
+def renderEmit(message):
+  lines = []
+  lines.append('inline void emit(YamlWriter& out, const {}& rhs)'.format(message.cppName()))
+  lines.append('{')
+  lines.append('  out.beginMap();')
+  lines.extend('  out.field("{0}", rhs.{0});'.format(f.name) for f in message.fields)
+  lines.append('  out.endMap();')
+  lines.append('}')
+  return lines
+
+
+def renderParse(message):
+  name = 'rhs' if message.fields else '/*rhs*/'
+  lines = []
+  lines.append('inline void parse(YamlReader& in, {}& {})'.format(message.cppName(), name))
+  lines.append('{')
+  lines.append('  YamlReader::Map map(in, {});'.format(len(message.fields)))
+  lines.append('  while (map.next())')
+  lines.append('  {')
+  for i, field in enumerate(message.fields):
+    keyword = 'if' if i == 0 else 'else if'
+    lines.append('    {} (map.key("{}", {}))'.format(keyword, field.name, len(field.name)))
+    lines.append('      parse(in, rhs.{});'.format(field.name))
+  if message.fields:
+    lines.append('    else')
+    lines.append('      map.unknown();')
+  else:
+    lines.append('    map.unknown();')
+  lines.append('  }')
+  lines.append('}')
+  return lines
+
+
+def renderHeader(package, messages, includes):
+  guard = 'MESSAGE_SERIALIZATION_GENERATED_{}_YAML'.format(package.upper())
+  lines = []
+  lines.append('// Generated by message_serialization/generate_yaml_converters.py from the definitions of {}.'.format(
+      package))
+  lines.append('// Do not edit.')
+  lines.append('#ifndef ' + guard)
+  lines.append('#define ' + guard)
+  lines.append('')
+  lines.extend('#include <{}>'.format(i) for i in includes)
+  lines.append('')
+  lines.append('namespace YAML')
+  lines.append('{')
+  for message in messages:
+    lines.append('')
+    lines.extend(renderConvert(message))
+  lines.append('')
+  lines.append('} // namespace YAML')
+  lines.append('')
+  lines.append('namespace message_serialization')
+  lines.append('{')
+  for message in messages:
+    lines.append('')
+    lines.extend(renderEmit(message))
+    lines.append('')
+    lines.extend(renderParse(message))
+  lines.append('')
+  lines.append('} // namespace message_serialization')
+  lines.append('')
+  lines.append('#endif // ' + guard)
+  return '\n'.join(lines) + '\n'
+
+
+def writeIfChanged(path, content):
+  """Writes a file only if its content changes, so that dependent targets are not rebuilt needlessly"""
+  if os.path.exists(path):
+    with open(path, 'r') as f:
+      if f.read() == content:
+        return
+
+  directory = os.path.dirname(path)
+  if directory and not os.path.isdir(directory):
+    os.makedirs(directory)
+  with open(path, 'w') as f:
+    f.write(content)
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(description='Generates YAML converters for ROS message packages')
+  parser.add_argument('packages', nargs='+', help='Message packages for which to generate converters')
+  parser.add_argument('-I', dest='include', action='append', default=[], metavar='PACKAGE:DIR',
+                      help='Directory containing the .msg files of a package; the ROS package path is searched '
+                           'for packages that are not given')
+  parser.add_argument('-o', dest='output_dir', required=True, help='Output directory')
+  parser.add_argument('--include-prefix', dest='include_prefix',
+                      help='Directory under which the generated headers include each other; the name of the output '
+                           'directory by default')
+  parser.add_argument('--list', action='store_true',
+                      help='Print the headers that would be generated and the message definitions they are generated '
+                           'from, as "output <path>" and "depends <path>" lines, without writing anything')
+  args = parser.parse_args()
+
+  search_paths = {}
+  for include in args.include:
+    package, _, directory = include.partition(':')
+    search_paths.setdefault(package, []).append(directory)
+
+  output_dir = os.path.abspath(args.output_dir)
+  generator = Generator(search_paths, output_dir, args.include_prefix or os.path.basename(output_dir), args.list)
+  try:
+    for package in args.packages:
+      generator.generate(package)
+  except (RuntimeError, IOError) as ex:
+    print('generate_yaml_converters.py: ' + str(ex), file=sys.stderr)
+    sys.exit(1)
+
+  if args.list:
+    for output in generator.outputs:
+      print('output ' + output)
+    for source in generator.sources:
+      print('depends ' + source)
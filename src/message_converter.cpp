@@ -0,0 +1,333 @@
+/*
+ * Copyright 2018 Southwest Research Institute
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <dirent.h>
+#include <glob.h>
+#include <iostream>
+#include <map>
+#include <message_serialization/batch.h>
+#include <message_serialization/message_registry.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+/*
+ * Converts ROS message files between the binary, YAML and JSON formats, in parallel.
+ *
+ * JSON output has the layout of scripts/message_converter.py (rospy_message_converter), and JSON written by that script
+ * can be read back. The script's command line is also accepted:
+ *
+ *   message_converter -b2j geometry_msgs.msg PoseStamped pose.msg pose.json
+ */
+
+namespace
+{
+using message_serialization::MessageFormat;
+
+const char USAGE[] =
+    "Usage: message_converter [options] <type> <input>...\n"
+    "       message_converter -b2j|-j2b <msg_module> <msg_class> <bin_file> <json_file>\n"
+    "\n"
+    "Converts ROS message files between the binary, YAML and JSON formats.\n"
+    "\n"
+    "  <type>             Message type, e.g. geometry_msgs/PoseStamped (or geometry_msgs.msg.PoseStamped)\n"
+    "  <input>            Files, directories (whose files are all converted) or glob patterns\n"
+    "\n"
+    "Options:\n"
+    "  -t, --to FORMAT    Output format: binary, yaml or json (required)\n"
+    "  -f, --from FORMAT  Input format; deduced from the extension of each file by default (.yaml, .yml and .json\n"
+    "                     files are YAML and JSON, any other file is binary)\n"
+    "  -o, --output DIR   Output directory; by default, each output is written next to its input. Inputs that would\n"
+    "                     be converted to the same output are rejected\n"
+    "  -j, --jobs N       Number of parallel workers; the number of hardware threads by default\n"
+    "  -l, --list         Lists the supported message types\n"
+    "  -h, --help         Shows this message\n";
+
+struct Job
+{
+  std::string input;
+  MessageFormat input_format;
+  std::string output;
+};
+
+bool isDirectory(const std::string& path)
+{
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool isFile(const std::string& path)
+{
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/**
+ * @brief Regular files of a directory, in alphabetical order
+ */
+std::vector<std::string> listDirectory(const std::string& dir)
+{
+  std::vector<std::string> files;
+  DIR* handle = ::opendir(dir.c_str());
+  if (!handle)
+    throw std::runtime_error("Failed to open directory '" + dir + "'");
+  while (const dirent* entry = ::readdir(handle))
+  {
+    const std::string path = dir + "/" + entry->d_name;
+    if (entry->d_name[0] != '.' && isFile(path))
+      files.push_back(path);
+  }
+  ::closedir(handle);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+/**
+ * @brief Expands the inputs of the command line into files
+ * @details Patterns are expanded here for shells that pass them through unexpanded, or when quoted to avoid the limit
+ * on the length of the command line
+ */
+std::vector<std::string> expandInputs(const std::vector<std::string>& inputs)
+{
+  std::vector<std::string> files;
+  for (const std::string& input : inputs)
+  {
+    if (isDirectory(input))
+    {
+      const std::vector<std::string> listed = listDirectory(input);
+      files.insert(files.end(), listed.begin(), listed.end());
+    }
+    else if (input.find_first_of("*?[") != std::string::npos && !isFile(input))
+    {
+      glob_t matches;
+      if (::glob(input.c_str(), 0, nullptr, &matches) == 0)
+      {
+        for (std::size_t i = 0; i < matches.gl_pathc; ++i)
+          if (isFile(matches.gl_pathv[i]))
+            files.push_back(matches.gl_pathv[i]);
+      }
+      ::globfree(&matches);
+    }
+    else
+    {
+      files.push_back(input);
+    }
+  }
+  return files;
+}
+
+/**
+ * @brief Path of the output of a file: its name with the extension of the output format, in the output directory or
+ * next to the input
+ */
+std::string outputPath(const std::string& input, const MessageFormat format, const std::string& output_dir)
+{
+  const std::size_t slash = input.rfind('/');
+  std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+  const std::size_t dot = name.rfind('.');
+  if (dot != std::string::npos && dot > 0)
+    name.erase(dot);
+  name += std::string(".") + message_serialization::messageFormatExtension(format);
+
+  if (!output_dir.empty())
+    return output_dir + "/" + name;
+  return slash == std::string::npos ? name : input.substr(0, slash + 1) + name;
+}
+
+/**
+ * @brief Verifies that no two inputs are converted to the same output
+ * @details Outputs depend only on the name of each input, so inputs with the same name in different directories, or
+ * with different extensions, would otherwise overwrite each other's output while being converted concurrently
+ * @throws std::invalid_argument naming the first pair of conflicting inputs
+ */
+void checkDistinctOutputs(const std::vector<Job>& jobs)
+{
+  std::map<std::string, const std::string*> inputs;
+  for (const Job& job : jobs)
+  {
+    const auto inserted = inputs.insert(std::make_pair(job.output, &job.input));
+    if (!inserted.second)
+      throw std::invalid_argument("Inputs '" + *inserted.first->second + "' and '" + job.input +
+                                  "' would both be converted to '" + job.output + "'");
+  }
+}
+
+/**
+ * @brief Converts the files in parallel, reading ahead of the workers
+ * @return number of failed conversions
+ */
+std::size_t convertAll(const std::string& type, const std::vector<Job>& jobs, const MessageFormat output_format,
+                       const message_serialization::BatchOptions& batch)
+{
+  const message_serialization::MessageRegistry::Converter& convert =
+      message_serialization::MessageRegistry::builtin().converter(type);
+  const message_serialization::ConversionOptions options;
+
+  std::vector<std::string> errors(jobs.size());
+  const std::size_t window = std::min(batch.prefetch, jobs.size());
+  for (std::size_t i = 0; i < window; ++i)
+    message_serialization::detail::prefetchFile(jobs[i].input);
+
+  message_serialization::detail::parallelFor(jobs.size(), batch, [&](const std::size_t i) {
+    if (i + batch.prefetch < jobs.size())
+      message_serialization::detail::prefetchFile(jobs[i + batch.prefetch].input);
+
+    const Job& job = jobs[i];
+    try
+    {
+      if (job.output == job.input)
+        throw std::runtime_error("the output would overwrite the input");
+      convert(job.input, job.input_format, job.output, output_format, options);
+    }
+    catch (const std::exception& ex)
+    {
+      errors[i] = ex.what();
+    }
+  });
+
+  std::size_t failures = 0;
+  for (std::size_t i = 0; i < jobs.size(); ++i)
+  {
+    if (errors[i].empty())
+      continue;
+    std::cerr << "Failure: " << jobs[i].input << ": " << errors[i] << std::endl;
+    ++failures;
+  }
+  return failures;
+}
+
+/**
+ * @brief Runs the command line of scripts/message_converter.py
+ */
+int runLegacy(const std::string& direction, const std::vector<std::string>& args)
+{
+  if (args.size() != 4)
+  {
+    std::cerr << USAGE;
+    return 2;
+  }
+
+  std::string module = args[0];
+  if (module.size() > 4 && module.compare(module.size() - 4, 4, ".msg") == 0)
+    module.erase(module.size() - 4);
+  const std::string type = module + "/" + args[1];
+
+  const bool to_json = direction == "-b2j" || direction == "--binary-to-json";
+  Job job;
+  job.input = to_json ? args[2] : args[3];
+  job.input_format = to_json ? MessageFormat::BINARY : MessageFormat::JSON;
+  job.output = to_json ? args[3] : args[2];
+
+  message_serialization::BatchOptions batch;
+  batch.threads = 1;
+  return convertAll(type, { job }, to_json ? MessageFormat::JSON : MessageFormat::BINARY, batch) == 0 ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  std::vector<std::string> positional;
+  std::string to, from, output_dir, legacy;
+  message_serialization::BatchOptions batch;
+
+  try
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      const auto value = [&]() -> std::string {
+        if (i + 1 >= argc)
+          throw std::invalid_argument("Missing value for option " + arg);
+        return argv[++i];
+      };
+
+      if (arg == "-h" || arg == "--help")
+      {
+        std::cout << USAGE;
+        return 0;
+      }
+      else if (arg == "-l" || arg == "--list")
+      {
+        for (const std::string& type : message_serialization::MessageRegistry::builtin().types())
+          std::cout << type << "\n";
+        return 0;
+      }
+      else if (arg == "-t" || arg == "--to")
+        to = value();
+      else if (arg == "-f" || arg == "--from")
+        from = value();
+      else if (arg == "-o" || arg == "--output")
+        output_dir = value();
+      else if (arg == "-j" || arg == "--jobs")
+        batch.threads = std::stoul(value());
+      else if (arg == "-b2j" || arg == "--binary-to-json" || arg == "-j2b" || arg == "--json-to-binary")
+      {
+        if (!legacy.empty() && legacy != arg)
+          throw std::invalid_argument("Choose a single direction of conversion!");
+        legacy = arg;
+      }
+      else if (arg.size() > 1 && arg[0] == '-')
+        throw std::invalid_argument("Unknown option " + arg);
+      else
+        positional.push_back(arg);
+    }
+
+    if (!legacy.empty())
+      return runLegacy(legacy, positional);
+
+    if (to.empty() || positional.size() < 2)
+    {
+      std::cerr << USAGE;
+      return 2;
+    }
+
+    const std::string type = positional.front();
+    if (!message_serialization::MessageRegistry::builtin().contains(type))
+      throw std::invalid_argument("Unsupported message type '" + type + "'; see --list");
+    const MessageFormat output_format = message_serialization::messageFormat(to);
+    if (!output_dir.empty() && !isDirectory(output_dir))
+      throw std::invalid_argument("Output directory '" + output_dir + "' does not exist");
+
+    const std::vector<std::string> files =
+        expandInputs(std::vector<std::string>(positional.begin() + 1, positional.end()));
+    if (files.empty())
+      throw std::invalid_argument("No input files");
+
+    std::vector<Job> jobs(files.size());
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+      jobs[i].input = files[i];
+      jobs[i].input_format =
+          from.empty() ? message_serialization::messageFormatOf(files[i]) : message_serialization::messageFormat(from);
+      jobs[i].output = outputPath(files[i], output_format, output_dir);
+    }
+    checkDistinctOutputs(jobs);
+
+    const std::size_t failures = convertAll(type, jobs, output_format, batch);
+    if (failures > 0)
+    {
+      std::cerr << "Converted " << jobs.size() - failures << " of " << jobs.size() << " files" << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+  catch (const std::exception& ex)
+  {
+    std::cerr << "Failure: " << ex.what() << std::endl;
+    return 2;
+  }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "utilities.h"
+#include <Eigen/StdVector>
+#include <message_serialization/eigen_binary.h>
+#include <message_serialization/eigen_yaml.h>
+
+typedef Eigen::Matrix<float, 2, 3, Eigen::RowMajor> Matrix23fRowMajor;
+typedef Eigen::Matrix<int32_t, Eigen::Dynamic, 3> MatrixX3i;
+typedef std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>> Isometry3dVector;
+
+template <>
+Eigen::Vector3d create()
+{
+  return Eigen::Vector3d::Random();
+}
+
+template <>
+bool equals(const Eigen::Vector3d& lhs, const Eigen::Vector3d& rhs)
+{
+  return lhs.isApprox(rhs);
+}
+
+template <>
+Eigen::Isometry3d create()
+{
+  return Eigen::Translation3d(Eigen::Vector3d::Random()) * Eigen::Quaterniond::UnitRandom();
+}
+
+template <>
+bool equals(const Eigen::Isometry3d& lhs, const Eigen::Isometry3d& rhs)
+{
+  return lhs.isApprox(rhs);
+}
+
+template <>
+Eigen::Affine3d create()
+{
+  Eigen::Affine3d t;
+  t = Eigen::Translation3d(Eigen::Vector3d::Random()) * Eigen::Quaterniond::UnitRandom();
+  return t;
+}
+
+template <>
+bool equals(const Eigen::Affine3d& lhs, const Eigen::Affine3d& rhs)
+{
+  return lhs.isApprox(rhs);
+}
+
+template <>
+Eigen::Matrix4d create()
+{
+  return Eigen::Matrix4d::Random();
+}
+
+template <>
+bool equals(const Eigen::Matrix4d& lhs, const Eigen::Matrix4d& rhs)
+{
+  return lhs == rhs;
+}
+
+template <>
+Eigen::MatrixXd create()
+{
+  return Eigen::MatrixXd::Random(7, 5);
+}
+
+template <>
+bool equals(const Eigen::MatrixXd& lhs, const Eigen::MatrixXd& rhs)
+{
+  return lhs.rows() == rhs.rows() && lhs.cols() == rhs.cols() && lhs == rhs;
+}
+
+template <>
+Matrix23fRowMajor create()
+{
+  return Matrix23fRowMajor::Random();
+}
+
+template <>
+bool equals(const Matrix23fRowMajor& lhs, const Matrix23fRowMajor& rhs)
+{
+  return lhs == rhs;
+}
+
+template <>
+MatrixX3i create()
+{
+  return MatrixX3i::Random(4, 3);
+}
+
+template <>
+bool equals(const MatrixX3i& lhs, const MatrixX3i& rhs)
+{
+  return lhs.rows() == rhs.rows() && lhs == rhs;
+}
+
+template <>
+Isometry3dVector create()
+{
+  Isometry3dVector v;
+  for (std::size_t i = 0; i < 10; ++i)
+    v.push_back(create<Eigen::Isometry3d>());
+  return v;
+}
+
+template <>
+bool equals(const Isometry3dVector& lhs, const Isometry3dVector& rhs)
+{
+  bool eq = lhs.size() == rhs.size();
+  for (std::size_t i = 0; eq && i < lhs.size(); ++i)
+    eq &= equals(lhs[i], rhs[i]);
+  return eq;
+}
@@ -1,11 +1,30 @@
+#include <dirent.h>
+#include <fcntl.h>
 #include <gtest/gtest.h>
+#include <message_serialization/async_writer.h>
+#include <message_serialization/batch.h>
+#include <message_serialization/binary_log.h>
+#include <message_serialization/binary_peek.h>
 #include <message_serialization/binary_serialization.h>
+#include <message_serialization/deserialize_cache.h>
+#include <message_serialization/json_serialization.h>
+#include <message_serialization/message_registry.h>
 #include <message_serialization/serialize.h>
+#include <message_serialization/shm_ring.h>
+#include <message_serialization/trajectory_log.h>
+#include <message_serialization/message_serialization_generated/geometry_msgs_yaml.h>
+#include <sys/stat.h>
+#include <thread>
 #include "std_msgs_test.h"
 #include "geometry_msgs_test.h"
 #include "trajectory_msgs_test.h"
 #include "shape_msgs_test.h"
 #include "sensor_msgs_test.h"
+#include "eigen_test.h"
+
+#ifdef MESSAGE_SERIALIZATION_WITH_METRICS
+MESSAGE_SERIALIZATION_DEFINE_ALLOCATION_COUNTER
+#endif
 
 const std::string YAML_EXT = "yaml";
 const std::string BINARY_EXT = "msg";
@@ -45,6 +64,126 @@ public:
       EXPECT_TRUE(equals(value, new_value));
     }
 
+    // Flow-style numeric sequences
+    {
+      const std::string filename = createFilename(YAML_EXT);
+      T value = create<T>();
+      message_serialization::YamlOptions options;
+      options.flow_numeric_sequences = true;
+      EXPECT_TRUE(message_serialization::serialize(filename, value, options));
+      T new_value;
+      EXPECT_TRUE(message_serialization::deserialize(filename, new_value));
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // Binary blocks for numeric arrays, decoded from events and through YAML::Node
+    {
+      const std::string filename = createFilename(YAML_EXT);
+      T value = create<T>();
+      message_serialization::YamlOptions options;
+      options.binary_array_threshold = 1;
+      EXPECT_TRUE(message_serialization::serialize(filename, value, options));
+      T new_value;
+      EXPECT_TRUE(message_serialization::deserialize(filename, new_value));
+      EXPECT_TRUE(equals(value, new_value));
+      EXPECT_NO_THROW(new_value = YAML::LoadFile(filename).as<T>());
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // Columnar arrays, decoded from events and through YAML::Node
+    {
+      const std::string filename = createFilename(YAML_EXT);
+      T value = create<T>();
+      message_serialization::YamlOptions options;
+      options.columnar_arrays = true;
+      EXPECT_TRUE(message_serialization::serialize(filename, value, options));
+      T new_value;
+      EXPECT_TRUE(message_serialization::deserialize(filename, new_value));
+      EXPECT_TRUE(equals(value, new_value));
+      EXPECT_NO_THROW(new_value = YAML::LoadFile(filename).as<T>());
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // JSON-compatible output, decoded from events and through YAML::Node
+    {
+      const std::string filename = createFilename("json");
+      T value = create<T>();
+      message_serialization::YamlOptions options;
+      options.json = true;
+      EXPECT_TRUE(message_serialization::serialize(filename, value, options));
+      T new_value;
+      EXPECT_TRUE(message_serialization::deserialize(filename, new_value));
+      EXPECT_TRUE(equals(value, new_value));
+      EXPECT_NO_THROW(new_value = YAML::LoadFile(filename).as<T>());
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // Native JSON, which the YAML decoders read too
+    {
+      const std::string filename = createFilename("json");
+      T value = create<T>();
+      EXPECT_TRUE(message_serialization::serializeToJson(filename, value));
+      T new_value;
+      EXPECT_TRUE(message_serialization::deserializeFromJson(filename, new_value));
+      EXPECT_TRUE(equals(value, new_value));
+      EXPECT_TRUE(message_serialization::deserialize(filename, new_value));
+      EXPECT_TRUE(equals(value, new_value));
+
+      std::string json;
+      EXPECT_TRUE(message_serialization::serializeToJsonString(json, value));
+      EXPECT_NO_THROW(new_value = message_serialization::deserializeFromJsonString<T>(json));
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // YAML::Node-based encoding
+    {
+      T value = create<T>();
+      const std::string yaml = YAML::Dump(YAML::Node(value));
+      T new_value;
+      EXPECT_NO_THROW(new_value = YAML::Load(yaml).as<T>());
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // Streamed encoding
+    {
+      T value = create<T>();
+      YAML::Emitter out;
+      message_serialization::YamlWriter writer(out);
+      message_serialization::emit(writer, value);
+      ASSERT_TRUE(out.good());
+      T new_value;
+      EXPECT_NO_THROW(new_value = YAML::Load(out.c_str()).as<T>());
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // In-memory encoding and decoding
+    {
+      T value = create<T>();
+      const std::string yaml = message_serialization::serializeToString(value);
+      T new_value;
+      EXPECT_NO_THROW(new_value = message_serialization::deserializeFromString<T>(yaml));
+      EXPECT_TRUE(equals(value, new_value));
+
+      message_serialization::YamlBuffer buffer;
+      EXPECT_EQ(message_serialization::serializeToString(value, buffer), yaml);
+      std::ostringstream stream;
+      EXPECT_TRUE(message_serialization::serializeToStream(stream, value));
+      EXPECT_EQ(stream.str(), yaml);
+      EXPECT_TRUE(message_serialization::deserializeFromBuffer(buffer.data(), buffer.size(), new_value));
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // Event-based decoding
+    {
+      T value = create<T>();
+      std::istringstream stream(YAML::Dump(YAML::Node(value)));
+      message_serialization::YamlReader reader(stream);
+      T new_value;
+      EXPECT_NO_THROW(message_serialization::parse(reader, new_value));
+      EXPECT_EQ(reader.peek(), message_serialization::YamlReader::Event::END);
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
     // Binary
     // Throwing version
     {
@@ -65,6 +204,59 @@ public:
       EXPECT_TRUE(message_serialization::deserializeFromBinary(filename, new_value));
       EXPECT_TRUE(equals(value, new_value));
     }
+
+    // Memory-mapped binary
+    {
+      const std::string filename = createFilename(BINARY_EXT);
+      T value = create<T>();
+      EXPECT_TRUE(message_serialization::serializeToBinary(filename, value));
+
+      message_serialization::BinaryReadOptions options;
+      options.mmap_threshold = 0;
+      T new_value;
+      EXPECT_TRUE(message_serialization::deserializeFromBinary(filename, new_value, options));
+      EXPECT_TRUE(equals(value, new_value));
+      EXPECT_NO_THROW(new_value = message_serialization::deserializeFromMappedBinary<T>(filename));
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // Compressed binary, read from a stream and from a memory mapping
+    for (const auto compression : { message_serialization::Compression::LZ4, message_serialization::Compression::ZSTD })
+    {
+      if (!message_serialization::isCompressionAvailable(compression))
+        continue;
+
+      const std::string filename = createFilename(BINARY_EXT);
+      T value = create<T>();
+      message_serialization::BinaryWriteOptions write_options;
+      write_options.compression = compression;
+      EXPECT_NO_THROW(message_serialization::serializeToBinary(value, filename, write_options));
+
+      T new_value;
+      EXPECT_NO_THROW(new_value = message_serialization::deserializeFromBinary<T>(filename));
+      EXPECT_TRUE(equals(value, new_value));
+      EXPECT_NO_THROW(new_value = message_serialization::deserializeFromMappedBinary<T>(filename));
+      EXPECT_TRUE(equals(value, new_value));
+    }
+
+    // Reusable buffer
+    {
+      message_serialization::SerializationBuffer buffer;
+      T value = create<T>();
+      const uint32_t size = message_serialization::serializeToBuffer(buffer, value);
+      EXPECT_EQ(size, buffer.size());
+
+      // Re-serializing a message of the same size should reuse the existing storage
+      const uint8_t* data = buffer.data();
+      const std::size_t capacity = buffer.capacity();
+      EXPECT_EQ(size, message_serialization::serializeToBuffer(buffer, value));
+      EXPECT_EQ(data, buffer.data());
+      EXPECT_EQ(capacity, buffer.capacity());
+
+      T new_value;
+      EXPECT_TRUE(message_serialization::deserializeFromBuffer(buffer.data(), size, new_value));
+      EXPECT_TRUE(equals(value, new_value));
+    }
   }
 };
 
@@ -84,7 +276,15 @@ using Implementations = testing::Types<ros::Time,
                                        shape_msgs::Mesh,
                                        sensor_msgs::JointState,
                                        sensor_msgs::RegionOfInterest,
-                                       sensor_msgs::CameraInfo>;
+                                       sensor_msgs::CameraInfo,
+                                       Eigen::Vector3d,
+                                       Eigen::Isometry3d,
+                                       Eigen::Affine3d,
+                                       Eigen::Matrix4d,
+                                       Eigen::MatrixXd,
+                                       Matrix23fRowMajor,
+                                       MatrixX3i,
+                                       Isometry3dVector>;
 
 TYPED_TEST_CASE(SerializationTestFixture, Implementations);
 
@@ -93,6 +293,1215 @@ TYPED_TEST(SerializationTestFixture, SerializationTest)
   this->runTest();
 }
 
+TEST(SerializationBufferPool, ReusesBuffers)
+{
+  message_serialization::SerializationBufferPool pool(1);
+  const uint8_t* data;
+  {
+    message_serialization::SerializationBufferPool::Lease buffer = pool.acquire();
+    buffer->resize(1024);
+    data = buffer->data();
+  }
+  EXPECT_EQ(pool.idle(), 1u);
+
+  {
+    message_serialization::SerializationBufferPool::Lease buffer = pool.acquire();
+    EXPECT_EQ(pool.idle(), 0u);
+    EXPECT_TRUE(buffer->empty());
+    EXPECT_GE(buffer->capacity(), 1024u);
+    EXPECT_EQ(buffer->data(), data);
+
+    // Buffers returned beyond the retention limit are freed rather than kept
+    message_serialization::SerializationBufferPool::Lease other = pool.acquire();
+    other->resize(16);
+  }
+  EXPECT_EQ(pool.idle(), 1u);
+
+  // So are buffers that grew beyond the capacity limit
+  message_serialization::SerializationBufferPool small_pool(8, 4096);
+  {
+    message_serialization::SerializationBufferPool::Lease buffer = small_pool.acquire();
+    buffer->resize(4096);
+    message_serialization::SerializationBufferPool::Lease large = small_pool.acquire();
+    large->resize(8192);
+  }
+  EXPECT_EQ(small_pool.idle(), 1u);
+}
+
+TEST(Compression, LargeMessages)
+{
+  // Large enough to span several compression chunks, and regular enough to compress well
+  sensor_msgs::JointState js;
+  for (std::size_t i = 0; i < 50000; ++i)
+  {
+    js.name.push_back("joint_" + std::to_string(i % 10));
+    js.position.push_back(static_cast<double>(i % 100));
+  }
+  const std::size_t raw_size = ros::serialization::serializationLength(js);
+
+  for (const auto compression : { message_serialization::Compression::LZ4, message_serialization::Compression::ZSTD })
+  {
+    message_serialization::BinaryWriteOptions options;
+    options.compression = compression;
+    const std::string filename = createFilename(BINARY_EXT);
+    if (!message_serialization::isCompressionAvailable(compression))
+    {
+      EXPECT_FALSE(message_serialization::serializeToBinary(filename, js, options));
+      continue;
+    }
+
+    ASSERT_TRUE(message_serialization::serializeToBinary(filename, js, options));
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    const std::size_t compressed_size = static_cast<std::size_t>(ifs.tellg());
+    EXPECT_LT(compressed_size * 4, raw_size);
+
+    sensor_msgs::JointState new_js;
+    EXPECT_TRUE(message_serialization::deserializeFromBinary(filename, new_js));
+    EXPECT_TRUE(equals(js, new_js));
+
+    // Truncated files are rejected rather than decoded into garbage
+    ifs.seekg(0);
+    std::vector<char> contents(compressed_size / 2);
+    ifs.read(contents.data(), contents.size());
+    const std::string truncated = createFilename(BINARY_EXT);
+    std::ofstream(truncated, std::ios::binary).write(contents.data(), contents.size());
+
+    EXPECT_FALSE(message_serialization::deserializeFromBinary(truncated, new_js));
+    message_serialization::BinaryReadOptions read_options;
+    read_options.mmap_threshold = 0;
+    EXPECT_FALSE(message_serialization::deserializeFromBinary(truncated, new_js, read_options));
+
+    // Files stating a decompressed size above the limit are rejected before anything is allocated
+    read_options.max_decompressed_size = raw_size - 1;
+    EXPECT_FALSE(message_serialization::deserializeFromBinary(filename, new_js, read_options));
+    read_options.mmap_threshold = std::numeric_limits<std::size_t>::max();
+    EXPECT_FALSE(message_serialization::deserializeFromBinary(filename, new_js, read_options));
+    EXPECT_THROW(message_serialization::BinaryPeek(filename, 16, read_options), std::runtime_error);
+    read_options.max_decompressed_size = raw_size;
+    EXPECT_TRUE(message_serialization::deserializeFromBinary(filename, new_js, read_options));
+    EXPECT_NO_THROW(message_serialization::BinaryPeek(filename, 16, read_options));
+  }
+}
+
+TEST(BinaryPeek, ReadsLeadingFields)
+{
+  geometry_msgs::PoseArray poses = create<geometry_msgs::PoseArray>();
+  poses.header.frame_id = std::string(300, 'f');
+  poses.poses.resize(10000, create<geometry_msgs::Pose>());
+
+  std::vector<message_serialization::BinaryWriteOptions> variants(3);
+  variants[1].compression = message_serialization::Compression::LZ4;
+  variants[2].compression = message_serialization::Compression::ZSTD;
+  for (const auto& options : variants)
+  {
+    if (!message_serialization::isCompressionAvailable(options.compression))
+      continue;
+
+    const std::string filename = createFilename(BINARY_EXT);
+    ASSERT_TRUE(message_serialization::serializeToBinary(filename, poses, options));
+
+    // The frame is longer than the initial prefix, which has to grow to fit it
+    EXPECT_TRUE(equals(poses.header, message_serialization::peekHeader(filename)));
+
+    message_serialization::BinaryPeek peek(filename, 16);
+    EXPECT_TRUE(equals(poses.header, peek.read<std_msgs::Header>()));
+    EXPECT_EQ(peek.read<uint32_t>(), poses.poses.size());
+    EXPECT_LT(peek.prefixSize(), 1024u);
+  }
+
+  // A file too short for the requested fields
+  const std::string filename = createFilename(BINARY_EXT);
+  ASSERT_TRUE(message_serialization::serializeToBinary(filename, create<geometry_msgs::Point>()));
+  std_msgs::Header header;
+  EXPECT_FALSE(message_serialization::peekHeader(filename, header));
+}
+
+TEST(YamlBuffer, ReusesCapacity)
+{
+  geometry_msgs::PoseArray poses;
+  poses.poses.resize(100, create<geometry_msgs::Pose>());
+  message_serialization::YamlBuffer buffer;
+  const std::string& yaml = message_serialization::serializeToString(poses, buffer);
+  const std::size_t capacity = buffer.capacity();
+  const char* data = buffer.data();
+
+  // Encoding a smaller message in the same buffer does not reallocate it
+  poses.poses.resize(50);
+  EXPECT_EQ(&message_serialization::serializeToString(poses, buffer), &yaml);
+  EXPECT_EQ(buffer.capacity(), capacity);
+  EXPECT_EQ(buffer.data(), data);
+  EXPECT_TRUE(equals(poses, message_serialization::deserializeFromString<geometry_msgs::PoseArray>(yaml)));
+
+  // The text need not be null-terminated, and aliases are supported
+  const std::string text = "{x: &v 1.5, y: *v, z: 2}garbage";
+  const auto point = message_serialization::deserializeFromBuffer<geometry_msgs::Point>(text.data(), text.size() - 7);
+  EXPECT_EQ(point.y, 1.5);
+
+  geometry_msgs::Point new_point;
+  EXPECT_FALSE(message_serialization::deserializeFromString("{x: [", new_point));
+}
+
+TEST(MessageRegistry, ConvertsFiles)
+{
+  using message_serialization::MessageFormat;
+  const message_serialization::MessageRegistry& registry = message_serialization::MessageRegistry::builtin();
+  EXPECT_TRUE(registry.contains("trajectory_msgs/JointTrajectory"));
+  EXPECT_TRUE(registry.contains("trajectory_msgs.msg.JointTrajectory"));
+  EXPECT_TRUE(registry.contains("trajectory_msgs::JointTrajectory"));
+  EXPECT_FALSE(registry.contains("trajectory_msgs/Missing"));
+  EXPECT_EQ(message_serialization::messageFormatOf("/a.b/file.yml"), MessageFormat::YAML);
+  EXPECT_EQ(message_serialization::messageFormatOf("/a.json/file"), MessageFormat::BINARY);
+
+  const trajectory_msgs::JointTrajectory trajectory = create<trajectory_msgs::JointTrajectory>();
+  const std::string binary_file = createFilename(BINARY_EXT);
+  const std::string json_file = createFilename("json");
+  const std::string yaml_file = createFilename(YAML_EXT);
+  ASSERT_TRUE(message_serialization::serializeToBinary(binary_file, trajectory));
+  registry.convert("trajectory_msgs/JointTrajectory", binary_file, MessageFormat::BINARY, json_file,
+                   MessageFormat::JSON);
+  registry.convert("trajectory_msgs/JointTrajectory", json_file, MessageFormat::JSON, yaml_file, MessageFormat::YAML);
+  EXPECT_TRUE(equals(trajectory, message_serialization::deserialize<trajectory_msgs::JointTrajectory>(yaml_file)));
+  EXPECT_THROW(registry.convert("trajectory_msgs/Missing", binary_file, MessageFormat::BINARY, json_file,
+                                MessageFormat::JSON),
+               std::invalid_argument);
+
+  // The layout of rospy_message_converter
+  std::ifstream ifs(json_file);
+  const std::string json((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  EXPECT_EQ(json.front(), '{');
+  EXPECT_NE(json.find("\"stamp\":{\"secs\":"), std::string::npos);
+  EXPECT_NE(json.find("\"time_from_start\":{\"secs\":"), std::string::npos);
+
+  const std::string rospy = "{\"header\": {\"seq\": 1, \"stamp\": {\"secs\": 2, \"nsecs\": 3}, \"frame_id\": \"\"}, "
+                            "\"joint_names\": [\"a\"], \"points\": [{\"positions\": [NaN], \"velocities\": [1.0], "
+                            "\"accelerations\": [], \"effort\": [-Infinity], "
+                            "\"time_from_start\": {\"secs\": 1, \"nsecs\": 500000000}}]}";
+  const auto decoded = message_serialization::deserializeFromString<trajectory_msgs::JointTrajectory>(rospy);
+  EXPECT_EQ(decoded.header.stamp, ros::Time(2, 3));
+  ASSERT_EQ(decoded.points.size(), 1u);
+  EXPECT_TRUE(std::isnan(decoded.points[0].positions[0]));
+  EXPECT_EQ(decoded.points[0].effort[0], -std::numeric_limits<double>::infinity());
+  EXPECT_EQ(decoded.points[0].time_from_start, ros::Duration(1.5));
+  EXPECT_EQ(YAML::Load(rospy).as<trajectory_msgs::JointTrajectory>().points[0].time_from_start, ros::Duration(1.5));
+}
+
+TEST(DeserializeCache, ReusesUnchangedFiles)
+{
+  message_serialization::DeserializeCache cache;
+  const std::string yaml_file = createFilename(YAML_EXT);
+  const std::string binary_file = createFilename(BINARY_EXT);
+  const geometry_msgs::PoseStamped pose = create<geometry_msgs::PoseStamped>();
+  ASSERT_TRUE(message_serialization::serialize(yaml_file, pose));
+  ASSERT_TRUE(message_serialization::serializeToBinary(binary_file, pose));
+
+  const auto first = cache.deserialize<geometry_msgs::PoseStamped>(yaml_file);
+  const auto second = cache.deserialize<geometry_msgs::PoseStamped>(yaml_file);
+  EXPECT_EQ(first, second);
+  EXPECT_TRUE(equals(pose, *first));
+  EXPECT_TRUE(equals(pose, *cache.deserializeFromBinary<geometry_msgs::PoseStamped>(binary_file)));
+  EXPECT_EQ(cache.stats().hits, 1u);
+  EXPECT_EQ(cache.stats().misses, 2u);
+  EXPECT_EQ(cache.stats().entries, 2u);
+
+  // A changed file is decoded again
+  geometry_msgs::PoseStamped changed = pose;
+  changed.header.frame_id = "changed_frame";
+  ASSERT_TRUE(message_serialization::serialize(yaml_file, changed));
+  const auto third = cache.deserialize<geometry_msgs::PoseStamped>(yaml_file);
+  EXPECT_NE(first, third);
+  EXPECT_TRUE(equals(changed, *third));
+  EXPECT_EQ(cache.stats().entries, 2u);
+
+  // A rewrite that keeps the size and modification time is only detected by hashing the contents
+  struct stat st;
+  ASSERT_EQ(::stat(yaml_file.c_str(), &st), 0);
+  changed.header.frame_id = "renamed_frame";
+  ASSERT_TRUE(message_serialization::serialize(yaml_file, changed));
+  const struct timespec times[2] = { st.st_atim, st.st_mtim };
+  ASSERT_EQ(::utimensat(AT_FDCWD, yaml_file.c_str(), times, 0), 0);
+  EXPECT_EQ(cache.deserialize<geometry_msgs::PoseStamped>(yaml_file), third);
+
+  message_serialization::DeserializeCacheOptions options;
+  options.verify_content = true;
+  cache.setOptions(options);
+  const auto fourth = cache.deserialize<geometry_msgs::PoseStamped>(yaml_file);
+  EXPECT_TRUE(equals(changed, *fourth));
+  EXPECT_EQ(cache.deserialize<geometry_msgs::PoseStamped>(yaml_file), fourth);
+
+  // Limits
+  options.max_entries = 1;
+  cache.setOptions(options);
+  EXPECT_EQ(cache.stats().entries, 1u);
+  EXPECT_EQ(cache.stats().evictions, 1u);
+  options.max_bytes = 1;
+  cache.setOptions(options);
+  EXPECT_EQ(cache.stats().entries, 0u);
+  cache.deserialize<geometry_msgs::PoseStamped>(yaml_file);
+  EXPECT_EQ(cache.stats().entries, 0u);
+
+  std::shared_ptr<const geometry_msgs::PoseStamped> missing;
+  EXPECT_FALSE(message_serialization::deserializeCached("/tmp/does_not_exist.yaml", missing));
+}
+
+#ifdef MESSAGE_SERIALIZATION_WITH_METRICS
+TEST(Metrics, RecordsCalls)
+{
+  using message_serialization::MetricsOperation;
+  message_serialization::Metrics& metrics = message_serialization::Metrics::instance();
+  metrics.reset();
+  metrics.startTrace();
+
+  const std::string yaml_file = createFilename(YAML_EXT);
+  const std::string binary_file = createFilename(BINARY_EXT);
+  const geometry_msgs::PoseStamped pose = create<geometry_msgs::PoseStamped>();
+  ASSERT_TRUE(message_serialization::serialize(yaml_file, pose));
+  ASSERT_TRUE(message_serialization::serializeToBinary(binary_file, pose));
+  geometry_msgs::PoseStamped new_pose;
+  ASSERT_TRUE(message_serialization::deserialize(yaml_file, new_pose));
+  ASSERT_TRUE(message_serialization::deserializeFromBinary(binary_file, new_pose));
+  message_serialization::BinaryReadOptions read_options;
+  read_options.mmap_threshold = 0;
+  ASSERT_TRUE(message_serialization::deserializeFromBinary(binary_file, new_pose, read_options));
+  EXPECT_FALSE(message_serialization::deserialize("/tmp/does_not_exist.yaml", new_pose));
+  metrics.stopTrace();
+
+  const std::string& type = message_serialization::detail::typeName<geometry_msgs::PoseStamped>();
+  const message_serialization::MetricsSnapshot snapshot = metrics.snapshot();
+  const message_serialization::TypeMetrics* serialize = snapshot.find(type, MetricsOperation::SERIALIZE);
+  const message_serialization::TypeMetrics* deserialize = snapshot.find(type, MetricsOperation::DESERIALIZE);
+  const message_serialization::TypeMetrics* binary = snapshot.find(type, MetricsOperation::DESERIALIZE_BINARY);
+  ASSERT_NE(serialize, nullptr);
+  ASSERT_NE(deserialize, nullptr);
+  ASSERT_NE(binary, nullptr);
+  ASSERT_NE(snapshot.find(type, MetricsOperation::SERIALIZE_BINARY), nullptr);
+
+  EXPECT_EQ(serialize->calls, 1u);
+  EXPECT_EQ(serialize->errors, 0u);
+  EXPECT_GT(serialize->bytes, 0u);
+  EXPECT_GT(serialize->allocations, 0u);
+  EXPECT_EQ(serialize->encode.count, 1u);
+  EXPECT_GE(serialize->total.max_ns, serialize->encode.max_ns);
+
+  // Both files describe the same message
+  EXPECT_EQ(deserialize->calls, 2u);
+  EXPECT_EQ(deserialize->errors, 1u);
+  EXPECT_EQ(deserialize->bytes, serialize->bytes);
+  EXPECT_EQ(deserialize->yaml_nodes, serialize->yaml_nodes);
+  EXPECT_EQ(deserialize->peak_yaml_nodes, serialize->yaml_nodes);
+
+  // The memory-mapped and buffered reads are each recorded once
+  EXPECT_EQ(binary->calls, 2u);
+  EXPECT_EQ(binary->decode.count, 2u);
+  EXPECT_EQ(binary->yaml_nodes, 0u);
+
+  const std::string trace_file = createFilename("json");
+  metrics.writeTrace(trace_file);
+  std::ifstream ifs(trace_file);
+  const std::string trace((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  EXPECT_NE(trace.find("\"traceEvents\""), std::string::npos);
+  EXPECT_NE(trace.find("\"cat\":\"deserializeFromBinary\""), std::string::npos);
+  EXPECT_EQ(metrics.droppedTraceEvents(), 0u);
+}
+#endif
+
+TEST(ShmRing, PublishesAndReads)
+{
+  const std::string name = "/message_serialization_test_" + std::to_string(::getpid());
+  message_serialization::ShmRingOptions options;
+  options.slot_count = 4;
+  options.slot_capacity = 1024;
+  options.unlink_on_close = true;
+  message_serialization::ShmRingWriter writer(name, options);
+  message_serialization::ShmRingReader reader(name);
+
+  geometry_msgs::PoseStamped pose = create<geometry_msgs::PoseStamped>();
+  geometry_msgs::PoseStamped new_pose;
+  EXPECT_FALSE(reader.read(new_pose));
+  EXPECT_EQ(writer.publish(pose), 1u);
+  ASSERT_TRUE(reader.read(new_pose));
+  EXPECT_TRUE(equals(pose, new_pose));
+  EXPECT_FALSE(reader.read(new_pose));
+
+  // A reader more than a ring behind skips to the oldest message still available
+  for (uint32_t i = 0; i < 10; ++i)
+  {
+    pose.header.seq = i;
+    writer.publish(pose);
+  }
+  for (uint32_t i = 6; i < 10; ++i)
+  {
+    ASSERT_TRUE(reader.read(new_pose));
+    EXPECT_EQ(new_pose.header.seq, i);
+  }
+  EXPECT_FALSE(reader.read(new_pose));
+  EXPECT_EQ(reader.dropped(), 6u);
+  EXPECT_EQ(reader.sequence(), 11u);
+
+  // Pre-serialized messages, and messages too large for a slot
+  message_serialization::SerializationBuffer buffer;
+  message_serialization::serializeToBuffer(buffer, create<sensor_msgs::JointState>());
+  writer.publish(buffer);
+  message_serialization::SerializationBuffer new_buffer;
+  ASSERT_TRUE(reader.read(new_buffer));
+  ASSERT_EQ(new_buffer.size(), buffer.size());
+  EXPECT_EQ(std::memcmp(new_buffer.data(), buffer.data(), buffer.size()), 0);
+  buffer.resize(2048);
+  EXPECT_THROW(writer.publish(buffer), std::runtime_error);
+
+  // A restarted writer of the same geometry continues the sequence, so attached readers keep working
+  message_serialization::ShmRingOptions reopen = options;
+  reopen.unlink_on_close = false;
+  message_serialization::ShmRingWriter restarted(name, reopen);
+  EXPECT_EQ(restarted.publish(pose), 13u);
+  ASSERT_TRUE(reader.read(new_pose));
+  EXPECT_EQ(reader.sequence(), 13u);
+
+  // Concurrent writer: every message read must be the one published with its sequence number
+  std::thread producer([&restarted, &pose]() {
+    geometry_msgs::PoseStamped msg = pose;
+    for (uint32_t i = 0; i < 20000; ++i)
+    {
+      msg.header.seq = static_cast<uint32_t>(restarted.sequence() + 1);
+      msg.pose.position.x = msg.header.seq;
+      restarted.publish(msg);
+    }
+  });
+  uint64_t received = 0;
+  while (reader.sequence() < 13u + 20000u && reader.wait(new_pose, std::chrono::seconds(1)))
+  {
+    ++received;
+    EXPECT_EQ(new_pose.header.seq, reader.sequence());
+    EXPECT_EQ(new_pose.pose.position.x, static_cast<double>(reader.sequence()));
+  }
+  producer.join();
+  EXPECT_EQ(reader.sequence(), 13u + 20000u);
+  EXPECT_EQ(received + reader.dropped(), 20000u + 6u);
+
+  EXPECT_THROW(message_serialization::ShmRingReader("/message_serialization_missing"), std::runtime_error);
+}
+
+TEST(OutputFile, WriteModes)
+{
+  char dir_template[] = "/tmp/output_file_XXXXXX";
+  ASSERT_NE(::mkdtemp(dir_template), nullptr);
+  const std::string dir = dir_template;
+  const auto entries = [&dir]() {
+    std::size_t count = 0;
+    DIR* handle = ::opendir(dir.c_str());
+    while (const dirent* entry = ::readdir(handle))
+      count += entry->d_name[0] != '.';
+    ::closedir(handle);
+    return count;
+  };
+
+  const std::string yaml_file = dir + "/pose.yaml";
+  const std::string binary_file = dir + "/pose.msg";
+  message_serialization::SyncBatch batch;
+
+  std::vector<message_serialization::FileWriteOptions> modes(6);
+  modes[1].single_write = true;
+  modes[2].atomic = true;
+  modes[3].atomic = true;
+  modes[3].sync = message_serialization::SyncPolicy::DATA;
+  modes[4].single_write = true;
+  modes[4].sync = message_serialization::SyncPolicy::DEFERRED;
+  modes[4].batch = &batch;
+  modes[5].atomic = true;
+  modes[5].sync = message_serialization::SyncPolicy::DEFERRED;
+  modes[5].batch = &batch;
+
+  for (const auto& mode : modes)
+  {
+    const geometry_msgs::PoseStamped pose = create<geometry_msgs::PoseStamped>();
+    ASSERT_TRUE(message_serialization::serialize(yaml_file, pose, message_serialization::YamlOptions(), mode));
+    ASSERT_TRUE(message_serialization::serializeToBinary(binary_file, pose, message_serialization::BinaryWriteOptions(),
+                                                         mode));
+    EXPECT_TRUE(equals(pose, message_serialization::deserialize<geometry_msgs::PoseStamped>(yaml_file)));
+    EXPECT_TRUE(equals(pose, message_serialization::deserializeFromBinary<geometry_msgs::PoseStamped>(binary_file)));
+
+    // Temporary files of atomic writes never remain next to the destination
+    EXPECT_EQ(entries(), 2u);
+  }
+
+  EXPECT_EQ(batch.pending(), 4u);
+  EXPECT_NO_THROW(batch.sync());
+  EXPECT_EQ(batch.pending(), 0u);
+
+  // Deferred sync needs a batch to record the file in
+  message_serialization::FileWriteOptions deferred;
+  deferred.sync = message_serialization::SyncPolicy::DEFERRED;
+  EXPECT_THROW(message_serialization::OutputFile(yaml_file, deferred), std::invalid_argument);
+
+  // An atomic file that is never committed leaves the destination untouched
+  const std::string previous = message_serialization::deserialize<geometry_msgs::PoseStamped>(yaml_file).header.frame_id;
+  {
+    message_serialization::OutputFile output(yaml_file, modes[2]);
+    output.stream() << "partial";
+  }
+  EXPECT_EQ(message_serialization::deserialize<geometry_msgs::PoseStamped>(yaml_file).header.frame_id, previous);
+  EXPECT_EQ(entries(), 2u);
+
+  ::unlink(yaml_file.c_str());
+  ::unlink(binary_file.c_str());
+  ::rmdir(dir.c_str());
+}
+
+TEST(BinaryLog, WriteAndRead)
+{
+  const std::string filename = createFilename("log");
+  const std::size_t n = 250;
+  std::vector<geometry_msgs::PoseStamped> messages(n);
+  {
+    message_serialization::BinaryLogWriter writer(filename, 16);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      messages[i] = create<geometry_msgs::PoseStamped>();
+      messages[i].header.seq = i;
+      messages[i].header.stamp = ros::Time(10.0 + 0.5 * i);
+      writer.write(messages[i]);
+    }
+    EXPECT_EQ(writer.size(), n);
+  }
+
+  message_serialization::BinaryLogReader reader(filename);
+  ASSERT_EQ(reader.size(), n);
+
+  // Random access
+  EXPECT_TRUE(equals(messages[123], reader.read<geometry_msgs::PoseStamped>(123)));
+
+  // Seek by time
+  EXPECT_EQ(reader.lowerBound(ros::Time(0.0)), 0u);
+  EXPECT_EQ(reader.lowerBound(ros::Time(10.0 + 0.5 * 100)), 100u);
+  EXPECT_EQ(reader.lowerBound(ros::Time(10.0 + 0.5 * 100 + 0.1)), 101u);
+  EXPECT_EQ(reader.lowerBound(ros::Time(1000.0)), n);
+
+  // Sequential iteration from a time
+  EXPECT_EQ(reader.seek(ros::Time(10.0 + 0.5 * 200)), 200u);
+  geometry_msgs::PoseStamped msg;
+  std::size_t i = 200;
+  while (reader.next(msg))
+  {
+    EXPECT_TRUE(equals(messages[i], msg));
+    ++i;
+  }
+  EXPECT_EQ(i, n);
+}
+
+TEST(BinaryLog, RecoverUnclosedLog)
+{
+  const std::string filename = createFilename("log");
+  const std::string copy = createFilename("log");
+  const std::size_t n = 40;
+  {
+    message_serialization::BinaryLogWriter writer(filename, 16);
+    for (std::size_t i = 0; i < n; ++i)
+      writer.write(create<geometry_msgs::Point>(), ros::Time(1.0 + i));
+    writer.flush();
+
+    // Snapshot the file before the writer adds its final index and trailer, then append a truncated record
+    std::ifstream src(filename, std::ios::binary);
+    std::ofstream dst(copy, std::ios::binary);
+    dst << src.rdbuf();
+    dst.write("\x01\x00", 2);
+  }
+
+  message_serialization::BinaryLogReader reader(copy);
+  EXPECT_EQ(reader.size(), n);
+  EXPECT_EQ(reader.stamp(n - 1), ros::Time(1.0 + n - 1));
+  EXPECT_NO_THROW(reader.read<geometry_msgs::Point>(n - 1));
+}
+
+TEST(BinaryLog, RejectsCorruptRecords)
+{
+  const std::string filename = createFilename("log");
+  const std::size_t n = 40;
+  {
+    message_serialization::BinaryLogWriter writer(filename, 16);
+    for (std::size_t i = 0; i < n; ++i)
+      writer.write(create<geometry_msgs::Point>(), ros::Time(1.0 + i));
+  }
+
+  std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+  const uint64_t file_size = static_cast<uint64_t>(ifs.tellg());
+  ifs.seekg(static_cast<std::streamoff>(file_size - message_serialization::binary_log::TRAILER_SIZE));
+  uint64_t last_index = 0;
+  ifs.read(reinterpret_cast<char*>(&last_index), sizeof(last_index));
+  ifs.close();
+
+  const auto patch = [](const std::string& file, const uint64_t offset, const void* data, const std::size_t size) {
+    std::fstream fs(file, std::ios::in | std::ios::out | std::ios::binary);
+    fs.seekp(static_cast<std::streamoff>(offset));
+    fs.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+  };
+  const auto copyOf = [&filename]() {
+    const std::string copy = createFilename("log");
+    std::ifstream src(filename, std::ios::binary);
+    std::ofstream(copy, std::ios::binary) << src.rdbuf();
+    return copy;
+  };
+
+  // Index chains that point to the same or a later record fall back to scanning the records instead of looping
+  for (const uint64_t previous : { last_index, last_index + 1 })
+  {
+    const std::string copy = copyOf();
+    patch(copy, last_index + message_serialization::binary_log::RECORD_HEADER_SIZE, &previous, sizeof(previous));
+    message_serialization::BinaryLogReader reader(copy);
+    EXPECT_EQ(reader.size(), n);
+  }
+
+  // A record whose length exceeds the file, or that is not a message, cannot be read
+  const uint64_t first = sizeof(message_serialization::binary_log::FILE_MAGIC);
+  {
+    const std::string copy = copyOf();
+    const uint32_t size = 0xFFFFFFF0u;
+    patch(copy, first + 4, &size, sizeof(size));
+    message_serialization::BinaryLogReader reader(copy);
+    ASSERT_EQ(reader.size(), n);
+    EXPECT_THROW(reader.read<geometry_msgs::Point>(0), std::runtime_error);
+    EXPECT_NO_THROW(reader.read<geometry_msgs::Point>(1));
+  }
+  {
+    const std::string copy = copyOf();
+    patch(copy, first, &message_serialization::binary_log::INDEX_RECORD, sizeof(uint32_t));
+    message_serialization::BinaryLogReader reader(copy);
+    ASSERT_EQ(reader.size(), n);
+    EXPECT_THROW(reader.read<geometry_msgs::Point>(0), std::runtime_error);
+  }
+}
+
+TEST(TrajectoryLog, AppendAndRead)
+{
+  const std::string filename = createFilename("log");
+  trajectory_msgs::JointTrajectory trajectory = create<trajectory_msgs::JointTrajectory>();
+  trajectory.points.resize(100);
+  for (std::size_t i = 0; i < trajectory.points.size(); ++i)
+  {
+    trajectory.points[i] = create<trajectory_msgs::JointTrajectoryPoint>();
+    trajectory.points[i].time_from_start = ros::Duration(0.1 * i);
+  }
+
+  message_serialization::JointTrajectoryWriter writer(filename, trajectory.header, trajectory.joint_names, 16);
+  for (std::size_t i = 0; i < 60; ++i)
+    writer.append(trajectory.points[i]);
+  EXPECT_THROW(writer.append(trajectory.points[0]), std::invalid_argument);
+
+  // A checkpoint of an unfinished recording is readable
+  writer.flush();
+  {
+    message_serialization::JointTrajectoryReader reader(filename);
+    EXPECT_EQ(reader.size(), 60u);
+    EXPECT_TRUE(equals(trajectory.header, reader.header()));
+    EXPECT_EQ(trajectory.joint_names, reader.jointNames());
+    EXPECT_TRUE(equals(trajectory.points[59], reader.read(59)));
+  }
+
+  for (std::size_t i = 60; i < trajectory.points.size(); ++i)
+    writer.append(trajectory.points[i]);
+  EXPECT_EQ(writer.size(), trajectory.points.size());
+  writer.close();
+
+  message_serialization::JointTrajectoryReader reader(filename);
+  EXPECT_TRUE(equals(trajectory, reader.readAll()));
+
+  // Streaming from a time from start
+  EXPECT_EQ(reader.seek(ros::Duration(5.05)), 51u);
+  trajectory_msgs::JointTrajectoryPoint point;
+  std::size_t i = 51;
+  while (reader.next(point))
+    EXPECT_TRUE(equals(trajectory.points[i++], point));
+  EXPECT_EQ(i, trajectory.points.size());
+}
+
+TEST(AsyncWriter, WritesInBackground)
+{
+  std::vector<sensor_msgs::JointState> messages;
+  std::vector<std::string> yaml_files, binary_files;
+  {
+    message_serialization::AsyncWriter writer;
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 20; ++i)
+    {
+      messages.push_back(create<sensor_msgs::JointState>());
+      yaml_files.push_back(createFilename(YAML_EXT));
+      binary_files.push_back(createFilename(BINARY_EXT));
+      futures.push_back(writer.serialize(messages.back(), yaml_files.back()));
+      futures.push_back(writer.serializeToBinary(std::make_shared<const sensor_msgs::JointState>(messages.back()),
+                                                 binary_files.back()));
+    }
+    writer.flush();
+
+    for (std::future<void>& future : futures)
+    {
+      ASSERT_EQ(future.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+      EXPECT_NO_THROW(future.get());
+    }
+
+    // Failures are reported through the future and the callback
+    bool callback_success = true;
+    std::future<void> failure = writer.serialize(create<sensor_msgs::JointState>(), "/tmp/does/not/exist.yaml",
+                                                 message_serialization::YamlOptions(),
+                                                 [&](bool success, const std::string&) { callback_success = success; });
+    EXPECT_THROW(failure.get(), std::exception);
+    writer.flush();
+    EXPECT_FALSE(callback_success);
+
+    // Messages held by non-const and Boost shared pointers, as ROS callbacks receive them, are queued without a copy
+    const auto shared = std::make_shared<geometry_msgs::PoseStamped>(create<geometry_msgs::PoseStamped>());
+    const boost::shared_ptr<const geometry_msgs::PoseStamped> boost_shared(
+        new geometry_msgs::PoseStamped(create<geometry_msgs::PoseStamped>()));
+    const std::string shared_yaml = createFilename(YAML_EXT), shared_binary = createFilename(BINARY_EXT);
+    const std::string boost_yaml = createFilename(YAML_EXT), boost_binary = createFilename(BINARY_EXT);
+    std::vector<std::future<void>> pointer_futures;
+    pointer_futures.push_back(writer.serialize(shared, shared_yaml));
+    pointer_futures.push_back(writer.serializeToBinary(shared, shared_binary));
+    pointer_futures.push_back(writer.serialize(boost_shared, boost_yaml));
+    pointer_futures.push_back(writer.serializeToBinary(boost_shared, boost_binary));
+    for (std::future<void>& future : pointer_futures)
+      EXPECT_NO_THROW(future.get());
+    EXPECT_TRUE(equals(*shared, message_serialization::deserialize<geometry_msgs::PoseStamped>(shared_yaml)));
+    EXPECT_TRUE(
+        equals(*shared, message_serialization::deserializeFromBinary<geometry_msgs::PoseStamped>(shared_binary)));
+    EXPECT_TRUE(equals(*boost_shared, message_serialization::deserialize<geometry_msgs::PoseStamped>(boost_yaml)));
+    EXPECT_TRUE(
+        equals(*boost_shared, message_serialization::deserializeFromBinary<geometry_msgs::PoseStamped>(boost_binary)));
+
+    // Exceptions thrown by a callback do not stop the writer thread
+    std::future<void> thrower = writer.serialize(create<sensor_msgs::JointState>(), createFilename(YAML_EXT),
+                                                 message_serialization::YamlOptions(),
+                                                 [](bool, const std::string&) { throw 42; });
+    writer.flush();
+    EXPECT_NO_THROW(thrower.get());
+  }
+
+  for (std::size_t i = 0; i < messages.size(); ++i)
+  {
+    EXPECT_TRUE(equals(messages[i], message_serialization::deserialize<sensor_msgs::JointState>(yaml_files[i])));
+    EXPECT_TRUE(
+        equals(messages[i], message_serialization::deserializeFromBinary<sensor_msgs::JointState>(binary_files[i])));
+  }
+}
+
+TEST(AsyncWriter, DropsWhenFull)
+{
+  message_serialization::AsyncWriterOptions options;
+  options.max_queue_size = 0;
+  EXPECT_THROW(message_serialization::AsyncWriter{ options }, std::invalid_argument);
+
+  options.max_queue_size = 1;
+  options.overflow_policy = message_serialization::OverflowPolicy::DROP;
+  message_serialization::AsyncWriter writer(options);
+
+  // Stall the writer thread in the callback of the first request
+  std::promise<void> started, release;
+  std::shared_future<void> released = release.get_future().share();
+  std::future<void> first =
+      writer.serialize(create<geometry_msgs::Pose>(), createFilename(YAML_EXT), message_serialization::YamlOptions(),
+                       [&started, released](bool, const std::string&) {
+                         started.set_value();
+                         released.wait();
+                       });
+  started.get_future().wait();
+
+  std::future<void> queued = writer.serialize(create<geometry_msgs::Pose>(), createFilename(YAML_EXT));
+  std::future<void> dropped = writer.serialize(create<geometry_msgs::Pose>(), createFilename(YAML_EXT));
+  EXPECT_EQ(writer.dropped(), 1u);
+  EXPECT_THROW(dropped.get(), std::runtime_error);
+
+  release.set_value();
+  writer.flush();
+  EXPECT_NO_THROW(first.get());
+  EXPECT_NO_THROW(queued.get());
+  EXPECT_EQ(writer.pending(), 0u);
+}
+
+TEST(Batch, SaveAndLoad)
+{
+  std::vector<std::pair<std::string, geometry_msgs::PoseStamped>> yaml_items;
+  std::vector<std::pair<std::string, geometry_msgs::PoseStamped>> binary_items;
+  for (int i = 0; i < 50; ++i)
+  {
+    geometry_msgs::PoseStamped pose = create<geometry_msgs::PoseStamped>();
+    pose.header.seq = static_cast<uint32_t>(i);
+    yaml_items.emplace_back(createFilename(YAML_EXT), pose);
+    binary_items.emplace_back(createFilename(BINARY_EXT), pose);
+  }
+
+  message_serialization::BatchOptions options;
+  options.threads = 4;
+  options.prefetch = 4;
+
+  for (const message_serialization::BatchStatus& status : message_serialization::serializeAll(yaml_items, options))
+    EXPECT_TRUE(status.success) << status.error;
+  for (const message_serialization::BatchStatus& status :
+       message_serialization::serializeAllToBinary(binary_items, options))
+    EXPECT_TRUE(status.success) << status.error;
+
+  // Failures are reported per file
+  std::vector<std::string> yaml_files, binary_files;
+  for (std::size_t i = 0; i < yaml_items.size(); ++i)
+  {
+    yaml_files.push_back(yaml_items[i].first);
+    binary_files.push_back(binary_items[i].first);
+  }
+  yaml_files.push_back("/tmp/does_not_exist.yaml");
+  binary_files.push_back("/tmp/does_not_exist.msg");
+
+  const auto yaml_results = message_serialization::deserializeAll<geometry_msgs::PoseStamped>(yaml_files, options);
+  const auto binary_results =
+      message_serialization::deserializeAllFromBinary<geometry_msgs::PoseStamped>(binary_files, options);
+  ASSERT_EQ(yaml_results.size(), yaml_files.size());
+  ASSERT_EQ(binary_results.size(), binary_files.size());
+
+  for (std::size_t i = 0; i < yaml_items.size(); ++i)
+  {
+    EXPECT_TRUE(yaml_results[i].success) << yaml_results[i].error;
+    EXPECT_TRUE(equals(yaml_results[i].value, yaml_items[i].second));
+    EXPECT_TRUE(binary_results[i].success) << binary_results[i].error;
+    EXPECT_TRUE(equals(binary_results[i].value, binary_items[i].second));
+  }
+  EXPECT_FALSE(yaml_results.back().success);
+  EXPECT_FALSE(yaml_results.back().error.empty());
+  EXPECT_FALSE(binary_results.back().success);
+  EXPECT_FALSE(binary_results.back().error.empty());
+
+  // Requests for more threads than the system should start are capped, and every index is still visited once
+  message_serialization::BatchOptions many;
+  many.threads = 100000;
+  std::vector<std::atomic<int>> visits(many.threads);
+  for (std::atomic<int>& v : visits)
+    v = 0;
+  message_serialization::detail::parallelFor(visits.size(), many, [&](const std::size_t i) { ++visits[i]; });
+  EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int>& v) { return v == 1; }));
+}
+
+/**
+ * @brief Checks that a message survives a YAML round trip through both decoding paths
+ */
+template <typename T>
+void checkYamlRoundTrip(const T& value)
+{
+  const std::string filename = createFilename(YAML_EXT);
+  ASSERT_TRUE(message_serialization::serialize(filename, value));
+
+  T new_value;
+  ASSERT_TRUE(message_serialization::deserialize(filename, new_value));
+  EXPECT_TRUE(value == new_value);
+
+  EXPECT_NO_THROW(new_value = YAML::Load(YAML::Dump(YAML::Node(value))).as<T>());
+  EXPECT_TRUE(value == new_value);
+}
+
+TEST(GeneratedConverters, RoundTrip)
+{
+  geometry_msgs::Twist twist;
+  twist.linear = create<geometry_msgs::Vector3>();
+  twist.angular = create<geometry_msgs::Vector3>();
+  checkYamlRoundTrip(twist);
+
+  geometry_msgs::WrenchStamped wrench;
+  wrench.header = create<std_msgs::Header>();
+  wrench.wrench.force = create<geometry_msgs::Vector3>();
+  wrench.wrench.torque = create<geometry_msgs::Vector3>();
+  checkYamlRoundTrip(wrench);
+
+  geometry_msgs::PoseWithCovariance pose;
+  pose.pose = create<geometry_msgs::Pose>();
+  randomize(pose.covariance.data(), pose.covariance.size());
+  checkYamlRoundTrip(pose);
+
+  geometry_msgs::Polygon polygon;
+  polygon.points.resize(5);
+  for (std::size_t i = 0; i < polygon.points.size(); ++i)
+  {
+    polygon.points[i].x = 0.5f * static_cast<float>(i);
+    polygon.points[i].y = -0.25f * static_cast<float>(i);
+  }
+  checkYamlRoundTrip(polygon);
+}
+
+TEST(Numeric, ShortestRoundTrip)
+{
+  char buffer[message_serialization::NUMBER_BUFFER_SIZE];
+
+  message_serialization::formatNumber(buffer, 0.1);
+  EXPECT_STREQ(buffer, "0.1");
+  message_serialization::formatNumber(buffer, 1.0);
+  EXPECT_STREQ(buffer, "1");
+  message_serialization::formatNumber(buffer, -2.5e-300);
+  EXPECT_STREQ(buffer, "-2.5e-300");
+  message_serialization::formatNumber(buffer, 0.1f);
+  EXPECT_STREQ(buffer, "0.1");
+  message_serialization::formatNumber(buffer, std::numeric_limits<double>::quiet_NaN());
+  EXPECT_STREQ(buffer, ".nan");
+  message_serialization::formatNumber(buffer, -std::numeric_limits<double>::infinity());
+  EXPECT_STREQ(buffer, "-.inf");
+
+  // The layout of printf's %g
+  message_serialization::formatNumber(buffer, -0.0);
+  EXPECT_STREQ(buffer, "-0");
+  message_serialization::formatNumber(buffer, 1e-5);
+  EXPECT_STREQ(buffer, "1e-05");
+  message_serialization::formatNumber(buffer, 0.00012);
+  EXPECT_STREQ(buffer, "0.00012");
+  message_serialization::formatNumber(buffer, 123456789012345.0);
+  EXPECT_STREQ(buffer, "123456789012345");
+  message_serialization::formatNumber(buffer, 1e15);
+  EXPECT_STREQ(buffer, "1e+15");
+  message_serialization::formatNumber(buffer, 5e-324);
+  EXPECT_STREQ(buffer, "5e-324");
+  message_serialization::formatNumber(buffer, 1.7976931348623157e308);
+  EXPECT_STREQ(buffer, "1.7976931348623157e+308");
+  message_serialization::formatNumber(buffer, 1234567.0f);
+  EXPECT_STREQ(buffer, "1234567");
+
+  // Values must be recovered bit for bit
+  std::mt19937_64 gen(0);
+  for (int i = 0; i < 10000; ++i)
+  {
+    const uint64_t bits = gen();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    if (!std::isfinite(value))
+      continue;
+
+    message_serialization::formatNumber(buffer, value);
+    const double parsed = std::strtod(buffer, nullptr);
+    EXPECT_EQ(std::memcmp(&parsed, &value, sizeof(value)), 0) << buffer;
+  }
+}
+
+TEST(Numeric, Parse)
+{
+  const auto parse = [](const std::string& text, double& value) {
+    return message_serialization::parseNumber(text.data(), text.data() + text.size(), value);
+  };
+
+  double value;
+  EXPECT_TRUE(parse("0.1", value));
+  EXPECT_EQ(value, 0.1);
+  EXPECT_TRUE(parse("-12345678.25e-3", value));
+  EXPECT_EQ(value, -12345678.25e-3);
+  EXPECT_TRUE(parse("+.5", value));
+  EXPECT_EQ(value, 0.5);
+  EXPECT_TRUE(parse("1e300", value));
+  EXPECT_EQ(value, 1e300);
+  EXPECT_TRUE(parse("123456789012345678901234567890", value));
+  EXPECT_EQ(value, 123456789012345678901234567890.0);
+  EXPECT_FALSE(parse("", value));
+  EXPECT_FALSE(parse("-", value));
+  EXPECT_FALSE(parse(".", value));
+  EXPECT_FALSE(parse("1e", value));
+  EXPECT_FALSE(parse("1.5x", value));
+  EXPECT_FALSE(parse("1,5", value));
+
+  const auto parse_int = [](const std::string& text, int8_t& value) {
+    return message_serialization::parseNumber(text.data(), text.data() + text.size(), value);
+  };
+  int8_t i8;
+  EXPECT_TRUE(parse_int("-128", i8));
+  EXPECT_EQ(i8, -128);
+  EXPECT_TRUE(parse_int("0x7f", i8));
+  EXPECT_EQ(i8, 127);
+  EXPECT_FALSE(parse_int("128", i8));
+  EXPECT_FALSE(parse_int("1.0", i8));
+
+  uint64_t u64;
+  const std::string max = "18446744073709551615";
+  EXPECT_TRUE(message_serialization::parseNumber(max.data(), max.data() + max.size(), u64));
+  EXPECT_EQ(u64, std::numeric_limits<uint64_t>::max());
+  const std::string negative = "-1";
+  EXPECT_FALSE(message_serialization::parseNumber(negative.data(), negative.data() + negative.size(), u64));
+
+  // Values must be identical to those of the C library, on and off the fast path
+  std::mt19937_64 gen(0);
+  std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+  char buffer[message_serialization::NUMBER_BUFFER_SIZE];
+  for (int i = 0; i < 10000; ++i)
+  {
+    const double expected = i % 2 ? dist(gen) : std::round(dist(gen) * 1000.0) / 1000.0;
+    const std::size_t n = message_serialization::formatNumber(buffer, expected);
+    ASSERT_TRUE(message_serialization::parseNumber(buffer, buffer + n, value)) << buffer;
+    EXPECT_EQ(value, expected) << buffer;
+
+    const float expected_f = static_cast<float>(expected);
+    const std::size_t n_f = message_serialization::formatNumber(buffer, expected_f);
+    float value_f;
+    ASSERT_TRUE(message_serialization::parseNumber(buffer, buffer + n_f, value_f)) << buffer;
+    EXPECT_EQ(value_f, expected_f) << buffer;
+  }
+}
+
+TEST(Eigen, WritesPosesLikeTf)
+{
+  // Rotations beyond 180 degrees convert to quaternions with w < 0, which are written with the opposite sign
+  const Eigen::Isometry3d isometry(Eigen::AngleAxisd(200.0 * M_PI / 180.0, Eigen::Vector3d::UnitX()));
+  ASSERT_LT(Eigen::Quaterniond(isometry.linear()).w(), 0.0);
+  Eigen::Affine3d affine;
+  affine.matrix() = isometry.matrix();
+
+  const std::string isometry_yaml = message_serialization::serializeToString(isometry);
+  const std::string affine_yaml = message_serialization::serializeToString(affine);
+  EXPECT_GT(message_serialization::deserializeFromString<geometry_msgs::Pose>(isometry_yaml).orientation.w, 0.0);
+  EXPECT_GT(message_serialization::deserializeFromString<geometry_msgs::Pose>(affine_yaml).orientation.w, 0.0);
+  EXPECT_GT(YAML::Node(isometry).as<geometry_msgs::Pose>().orientation.w, 0.0);
+  EXPECT_GT(YAML::Node(affine).as<geometry_msgs::Pose>().orientation.w, 0.0);
+
+  std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>> isometries(2, isometry);
+  message_serialization::BinaryArray array;
+  message_serialization::detail::toBinaryArray(isometries, array);
+  EXPECT_GT(array.at<double>(1, 6), 0.0);
+
+  // Matrix shapes whose size overflows are rejected
+  EXPECT_THROW(message_serialization::deserializeFromString<Eigen::MatrixXd>(
+                   "{shape: [2305843009213693953, 8], data: [1, 2, 3, 4, 5, 6, 7, 8]}"),
+               message_serialization::YamlParseError);
+  EXPECT_THROW(message_serialization::deserializeFromString<Eigen::MatrixXd>("{shape: [3, 0], data: [1]}"),
+               message_serialization::YamlParseError);
+}
+
+TEST(YamlReader, RejectsMismatchedStructure)
+{
+  geometry_msgs::Point point;
+
+  // Missing field
+  {
+    std::istringstream stream("{x: 1, y: 2}");
+    message_serialization::YamlReader reader(stream);
+    EXPECT_THROW(message_serialization::parse(reader, point), message_serialization::YamlParseError);
+  }
+
+  // Unknown field
+  {
+    std::istringstream stream("{x: 1, y: 2, w: 3}");
+    message_serialization::YamlReader reader(stream);
+    EXPECT_THROW(message_serialization::parse(reader, point), message_serialization::YamlParseError);
+  }
+
+  // Bad scalar
+  {
+    std::istringstream stream("{x: 1, y: 2, z: abc}");
+    message_serialization::YamlReader reader(stream);
+    EXPECT_THROW(message_serialization::parse(reader, point), message_serialization::YamlParseError);
+  }
+
+  // A repeated key does not make up for a missing one, also when spelled as an alias
+  EXPECT_THROW(message_serialization::deserializeFromString<geometry_msgs::Point>("{x: 1, x: 2, z: 3}"),
+               message_serialization::YamlParseError);
+  EXPECT_THROW(message_serialization::deserializeFromString<geometry_msgs::Point>("{x: 1, y: 2, z: 3, x: 4}"),
+               message_serialization::YamlParseError);
+  EXPECT_THROW(message_serialization::deserializeFromString<ros::Time>("{sec: 1, secs: 2}"),
+               message_serialization::YamlParseError);
+
+  // The shape of a binary array must match its data, also when its size overflows
+  {
+    geometry_msgs::PoseArray poses;
+    poses.poses.resize(1);
+    message_serialization::YamlOptions options;
+    options.binary_array_threshold = 1;
+    options.flow_numeric_sequences = true;
+    std::string yaml = message_serialization::serializeToString(poses, options);
+    const std::string shape = "[1, 7]";
+    const std::size_t pos = yaml.find(shape);
+    ASSERT_NE(pos, std::string::npos) << yaml;
+    for (const char* bogus : { "[2305843009213693953, 7]", "[2, 7]", "[0, 7]" })
+    {
+      std::string bad = yaml;
+      bad.replace(pos, shape.size(), bogus);
+      EXPECT_THROW(message_serialization::deserializeFromString<geometry_msgs::PoseArray>(bad),
+                   message_serialization::YamlParseError)
+          << bogus;
+      EXPECT_ANY_THROW(YAML::Load(bad).as<geometry_msgs::PoseArray>()) << bogus;
+    }
+  }
+
+  // Columns are checked against the shape before the array is sized to it
+  {
+    geometry_msgs::PoseArray poses;
+    poses.poses.resize(1);
+    message_serialization::YamlOptions options;
+    options.columnar_arrays = true;
+    std::string yaml = message_serialization::serializeToString(poses, options);
+    const std::string shape = "[1, 7]";
+    const std::size_t pos = yaml.find(shape);
+    ASSERT_NE(pos, std::string::npos) << yaml;
+    for (const char* bogus : { "[2305843009213693953, 7]", "[1000000000, 7]", "[1, 1000000000]", "[0, 7]" })
+    {
+      std::string bad = yaml;
+      bad.replace(pos, shape.size(), bogus);
+      EXPECT_THROW(message_serialization::deserializeFromString<geometry_msgs::PoseArray>(bad),
+                   message_serialization::YamlParseError)
+          << bogus;
+      EXPECT_ANY_THROW(YAML::Load(bad).as<geometry_msgs::PoseArray>()) << bogus;
+    }
+  }
+}
+
+TEST(YamlReader, FallsBackToConvert)
+{
+  // Types without a parse overload are decoded through YAML::convert
+  std::istringstream stream("{a: [1, 2], b: [3]}");
+  message_serialization::YamlReader reader(stream);
+  std::map<std::string, std::vector<int>> value;
+  message_serialization::parse(reader, value);
+  ASSERT_EQ(value.size(), 2u);
+  EXPECT_EQ(value["a"], std::vector<int>({ 1, 2 }));
+  EXPECT_EQ(value["b"], std::vector<int>({ 3 }));
+}
+
+TEST(Json, WritesRospyLayout)
+{
+  std_msgs::Header header;
+  header.seq = 1;
+  header.stamp = ros::Time(2, 3);
+  header.frame_id = "a\"b\\c\n\x01";
+  geometry_msgs::Point point;
+  point.x = 1.0;
+  point.y = -2.5e-300;
+  point.z = std::numeric_limits<double>::quiet_NaN();
+  EXPECT_EQ(message_serialization::serializeToJsonString(header),
+            "{\"seq\":1,\"stamp\":{\"secs\":2,\"nsecs\":3},\"frame_id\":\"a\\\"b\\\\c\\n\\u0001\"}");
+  EXPECT_EQ(message_serialization::serializeToJsonString(point), "{\"x\":1.0,\"y\":-2.5e-300,\"z\":NaN}");
+  EXPECT_EQ(message_serialization::serializeToJsonString(std::vector<int8_t>({ -128, 0, 127 })), "[-128,0,127]");
+  EXPECT_EQ(message_serialization::serializeToJsonString(std::numeric_limits<int64_t>::min()), "-9223372036854775808");
+
+  // YAML numbers outside the JSON number grammar are written as strings
+  std::string json;
+  message_serialization::JsonEmitter emitter(json);
+  emitter.node(YAML::Load("[0, -0, 12, -1.5e+3, 2E-7, 0123, -.5, 1., 1_000, +5, 1e400, 0x1F]"));
+  EXPECT_EQ(json, "[0,-0,12,-1.5e+3,2E-7,\"0123\",\"-.5\",\"1.\",\"1_000\",\"+5\",\"1e400\",\"0x1F\"]");
+}
+
+TEST(Json, RoundTripsExactly)
+{
+  std::vector<double> doubles = { 0.0, -0.0, 0.1, 1e300, -std::numeric_limits<double>::infinity(),
+                                  std::numeric_limits<double>::infinity(), std::numeric_limits<double>::min(),
+                                  std::numeric_limits<double>::denorm_min() };
+  std::vector<float> floats = { 0.1f, -3.4e38f, std::numeric_limits<float>::denorm_min() };
+  std::mt19937_64 gen(0);
+  while (doubles.size() < 10000)
+  {
+    const uint64_t bits = gen();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    if (std::isfinite(value))
+      doubles.push_back(value);
+
+    const uint32_t float_bits = static_cast<uint32_t>(bits >> 32);
+    float float_value;
+    std::memcpy(&float_value, &float_bits, sizeof(float_value));
+    if (std::isfinite(float_value))
+      floats.push_back(float_value);
+  }
+
+  // Values must be recovered bit for bit
+  const auto parsed_doubles =
+      message_serialization::deserializeFromJsonString<std::vector<double>>(
+          message_serialization::serializeToJsonString(doubles));
+  ASSERT_EQ(parsed_doubles.size(), doubles.size());
+  EXPECT_EQ(std::memcmp(parsed_doubles.data(), doubles.data(), doubles.size() * sizeof(double)), 0);
+
+  const auto parsed_floats = message_serialization::deserializeFromJsonString<std::vector<float>>(
+      message_serialization::serializeToJsonString(floats));
+  ASSERT_EQ(parsed_floats.size(), floats.size());
+  EXPECT_EQ(std::memcmp(parsed_floats.data(), floats.data(), floats.size() * sizeof(float)), 0);
+}
+
+TEST(Json, ParsesInPlace)
+{
+  // Escapes, including a surrogate pair, are decoded to UTF-8
+  const std::string text = message_serialization::deserializeFromJsonString<std::string>(
+      " \"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\ud83d\\ude00\" ");
+  EXPECT_EQ(text, "\"\\/\b\f\n\r\t\xC3\xA9\xF0\x9F\x98\x80");
+
+  // Python's json module writes non-finite values as literals, and indents with newlines
+  const auto values = message_serialization::deserializeFromJsonString<std::vector<double>>(
+      "[\n  NaN,\n  Infinity,\n  -Infinity,\n  -0.5E+2\n]");
+  ASSERT_EQ(values.size(), 4u);
+  EXPECT_TRUE(std::isnan(values[0]));
+  EXPECT_EQ(values[1], std::numeric_limits<double>::infinity());
+  EXPECT_EQ(values[2], -std::numeric_limits<double>::infinity());
+  EXPECT_EQ(values[3], -50.0);
+
+  // Nulls read as empty strings, and nesting is not limited by the call stack
+  EXPECT_EQ(message_serialization::deserializeFromJsonString<std::string>("null"), "");
+  const std::string nested = std::string(100000, '[') + std::string(100000, ']');
+  EXPECT_EQ(message_serialization::YamlReader::fromJson(nested).events(), 200000u);
+
+  // Types without a parse overload are decoded through YAML::convert
+  const auto map = message_serialization::deserializeFromJsonString<std::map<std::string, std::string>>(
+      "{\"a\": \"1\", \"b\": \"x\\ty\"}");
+  ASSERT_EQ(map.size(), 2u);
+  EXPECT_EQ(map.at("a"), "1");
+  EXPECT_EQ(map.at("b"), "x\ty");
+}
+
+TEST(Json, RejectsMalformedDocuments)
+{
+  const std::vector<std::string> documents = {
+    "", "{", "[1 2]", "[1,]", "{\"x\":1,}", "{\"x\" 1}", "{x: 1}", "01", "1.", "-", "1e", "tru", "[1]x", "\"abc",
+    "\"\\q\"", "\"\\u12g4\"", "\"a\nb\"", "[1]]", "{\"a\":1]", std::string("[1]\0", 4)
+  };
+  for (const std::string& document : documents)
+    EXPECT_THROW(message_serialization::YamlReader::fromJson(document), message_serialization::YamlParseError)
+        << document;
+
+  // Errors refer to the line of the document
+  try
+  {
+    message_serialization::deserializeFromJsonString<geometry_msgs::Point>("{\n\"x\": 1,\n\"y\": @}");
+    FAIL();
+  }
+  catch (const message_serialization::YamlParseError& ex)
+  {
+    EXPECT_EQ(std::string(ex.what()).find("json: line 3"), 0u) << ex.what();
+  }
+
+  // A well-formed document of the wrong structure
+  EXPECT_THROW(message_serialization::deserializeFromJsonString<geometry_msgs::Point>("{\"x\": 1, \"y\": 2}"),
+               message_serialization::YamlParseError);
+  geometry_msgs::Point point;
+  EXPECT_FALSE(message_serialization::deserializeFromJsonString("[1, 2, 3]", point));
+}
+
+TEST(YamlReader, SelectsField)
+{
+  geometry_msgs::PoseArray poses = create<geometry_msgs::PoseArray>();
+  poses.poses.resize(10);
+  for (std::size_t i = 0; i < poses.poses.size(); ++i)
+    poses.poses[i].position.x = static_cast<double>(i);
+
+  const std::string filename = createFilename(YAML_EXT);
+  ASSERT_TRUE(message_serialization::serialize(filename, poses));
+
+  const ros::Time stamp = message_serialization::deserializeField<ros::Time>(filename, "header.stamp");
+  EXPECT_EQ(stamp, poses.header.stamp);
+
+  const auto slice = message_serialization::deserializeField<std::vector<geometry_msgs::Pose>>(filename, "poses[2:5]");
+  ASSERT_EQ(slice.size(), 3u);
+  EXPECT_TRUE(equals(slice[0], poses.poses[2]));
+  EXPECT_TRUE(equals(slice[2], poses.poses[4]));
+  EXPECT_EQ(message_serialization::deserializeField<std::vector<geometry_msgs::Pose>>(filename, "poses[8:]").size(),
+            2u);
+  EXPECT_EQ(message_serialization::deserializeField<double>(filename, "poses[7].position.x"), 7.0);
+
+  // Parsing stops at the end of the field, before the malformed rest of the document
+  {
+    std::istringstream stream("a: {b: [1, 2, 3]}\nc: [4, 5]\nd: [: }\n");
+    message_serialization::YamlReader reader(stream, "c[1]");
+    int value;
+    message_serialization::parse(reader, value);
+    EXPECT_EQ(value, 5);
+  }
+
+  // Missing fields and invalid paths
+  geometry_msgs::Pose pose;
+  EXPECT_FALSE(message_serialization::deserializeField(filename, "poses[10]", pose));
+  EXPECT_FALSE(message_serialization::deserializeField(filename, "header.seq.x", pose));
+  EXPECT_FALSE(message_serialization::deserializeField(filename, "missing", pose));
+  EXPECT_THROW(message_serialization::FieldPath("poses[1:2].position"), std::invalid_argument);
+  EXPECT_THROW(message_serialization::FieldPath("poses[x]"), std::invalid_argument);
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);